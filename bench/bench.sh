@@ -0,0 +1,243 @@
+#!/usr/bin/env bash
+#
+# Throughput benchmark: runs sender and receiver on localhost through the impairment relay over a matrix
+# of file sizes and network profiles, then runs concurrent transfers per profile to measure fairness.
+# Needs neither root nor netem. Run it with `make bench`.
+#
+# Environment:
+#   BENCH_SIZES           File sizes, with K, M or G suffixes (default "1K 1M 100M 1G 10G")
+#   BENCH_PROFILES        Profiles to run, from the list below (default: all of them)
+#   BENCH_FAIR_FLOWS      Concurrent transfers in the fairness runs, 0 to skip them (default 4)
+#   BENCH_FAIR_SIZE       File size of each fairness transfer (default 50M)
+#   BENCH_TIMEOUT         Seconds a single run may take (default 900)
+#   BENCH_SEED            Relay random seed, so impairments repeat exactly (default 1)
+#   BENCH_DIR             Working directory, where inputs are kept for later runs (default: a new
+#                         directory under $TMPDIR, without the inputs once done)
+#   BENCH_PORT            First UDP port to use (default 41000)
+#   BENCH_SENDER_FLAGS    Extra sender options, such as "-c bbr -j 4"
+#   BENCH_RECEIVER_FLAGS  Extra receiver options
+#
+# Results are printed as a table and written to $BENCH_DIR/results.csv and $BENCH_DIR/fairness.csv. The
+# exit status is non-zero if any output differs from its input.
+
+set -u
+
+cd "$(dirname "$0")/.." || exit 1
+
+# name|relay options: -d one-way delay (us), -j jitter (us), -l loss, -a ACK loss, -o reorder, -R reorder
+# hold-back (us), -u duplication, -b bottleneck (bytes/s), -q bottleneck queue (bytes)
+PROFILES="
+clean|
+lan|-d 250
+wan|-d 20000 -j 1000 -b 12500000 -q 500000
+lossy|-d 10000 -l 0.01
+reorder|-d 5000 -o 0.05 -R 2000 -u 0.01
+congested|-d 10000 -b 6250000 -q 64000 -a 0.01
+"
+
+SIZES=${BENCH_SIZES:-"1K 1M 100M 1G 10G"}
+SELECTED=${BENCH_PROFILES:-$(echo "$PROFILES" | cut -d'|' -f1 | xargs)}
+FAIR_FLOWS=${BENCH_FAIR_FLOWS:-4}
+FAIR_SIZE=${BENCH_FAIR_SIZE:-50M}
+RUN_TIMEOUT=${BENCH_TIMEOUT:-900}
+SEED=${BENCH_SEED:-1}
+PORT=${BENCH_PORT:-41000}
+SENDER_FLAGS=${BENCH_SENDER_FLAGS:-}
+RECEIVER_FLAGS=${BENCH_RECEIVER_FLAGS:-}
+DIR=${BENCH_DIR:-$(mktemp -d "${TMPDIR:-/tmp}/rdt-bench.XXXXXX")}
+KEEP_INPUTS=${BENCH_DIR:+1}
+FAILED=0
+
+mkdir -p "$DIR" || exit 1
+
+# bytes SIZE: converts a size with an optional K, M or G suffix to bytes
+bytes() {
+    case "$1" in
+        *K) echo $(( ${1%K} * 1024 )) ;;
+        *M) echo $(( ${1%M} * 1024 * 1024 )) ;;
+        *G) echo $(( ${1%G} * 1024 * 1024 * 1024 )) ;;
+        *)  echo "$1" ;;
+    esac
+}
+
+# relayOptions PROFILE: prints the relay options of a profile
+relayOptions() {
+    echo "$PROFILES" | awk -F'|' -v name="$1" '$1 == name { print $2; found = 1 } END { exit !found }'
+}
+
+# input SIZE: creates the random input file of a size once and prints its path
+input() {
+    local file="$DIR/input-$1"
+
+    if [ ! -f "$file" ]; then
+        head -c "$(bytes "$1")" /dev/urandom > "$file.tmp" && mv "$file.tmp" "$file"
+    fi
+    echo "$file"
+}
+
+# fits BYTES: whether the working directory has room for this many more bytes
+fits() {
+    local available=$(df -Pk "$DIR" | awk 'NR == 2 { print $4 }')
+
+    [ $(( available * 1024 )) -gt $(( $1 + 64 * 1024 * 1024 )) ]
+}
+
+# total FILE NAME: prints the last value of a counter in a stats dump, which is the total
+total() {
+    grep -o "\"$2\": [0-9]*" "$1" 2>/dev/null | tail -n 1 | awk '{ print $2 }'
+}
+
+# stopRelay PID: stops the relay and waits for its summary
+stopRelay() {
+    kill -TERM "$1" 2>/dev/null
+    wait "$1" 2>/dev/null
+}
+
+# runTransfer PROFILE SIZE: one transfer through the relay
+runTransfer() {
+    local profile=$1 size=$2 length file run options receiverPort relayPort receiverPid relayPid start end rc verified
+    local needed seconds goodput sent retransmits ratio
+
+    length=$(bytes "$size")
+    needed=$length
+    [ -f "$DIR/input-$size" ] || needed=$(( 2 * length ))
+    if ! fits "$needed"; then
+        printf "%-10s %6s %10s %12s %10s %s\n" "$profile" "$size" "-" "-" "-" "skipped (disk space)"
+        return
+    fi
+    file=$(input "$size")
+    options=$(relayOptions "$profile")
+    run="$DIR/$profile-$size"
+    mkdir -p "$run"
+    receiverPort=$PORT
+    relayPort=$(( PORT + 1 ))
+    PORT=$(( PORT + 2 ))
+
+    timeout "$RUN_TIMEOUT" ./receiver -S "$run/receiver.json" $RECEIVER_FLAGS "$receiverPort" "$run/output" \
+        > "$run/receiver.log" 2>&1 &
+    receiverPid=$!
+    ./relay $options -s "$SEED" "$relayPort" 127.0.0.1 "$receiverPort" 2> "$run/relay.log" &
+    relayPid=$!
+    sleep 0.2
+
+    start=$(date +%s.%N)
+    timeout "$RUN_TIMEOUT" ./sender -S "$run/sender.json" $SENDER_FLAGS 127.0.0.1 "$relayPort" "$file" "$length" \
+        > "$run/sender.log" 2>&1
+    rc=$?
+    end=$(date +%s.%N)
+    wait "$receiverPid"
+    stopRelay "$relayPid"
+
+    if [ $rc -eq 0 ] && cmp -s "$file" "$run/output"; then
+        verified=ok
+    elif [ $rc -eq 124 ]; then
+        verified=TIMEOUT
+        FAILED=1
+    else
+        verified=MISMATCH
+        FAILED=1
+    fi
+    rm -f "$run/output"
+
+    sent=$(total "$run/sender.json" packets_sent)
+    retransmits=$(total "$run/sender.json" retransmits)
+    seconds=$(awk -v s="$start" -v e="$end" 'BEGIN { printf "%.3f", e - s }')
+    goodput=$(awk -v b="$length" -v t="$seconds" 'BEGIN { printf "%.2f", (t > 0 ? b / t / 1e6 : 0) }')
+    ratio=$(awk -v r="${retransmits:-0}" -v s="${sent:-0}" 'BEGIN { printf "%.4f", (s > 0 ? r / s : 0) }')
+
+    printf "%-10s %6s %10s %12s %10s %s\n" "$profile" "$size" "$seconds" "$goodput" "$ratio" "$verified"
+    echo "$profile,$length,$seconds,$goodput,${sent:-0},${retransmits:-0},$ratio,$verified" >> "$DIR/results.csv"
+}
+
+# runFairness PROFILE: FAIR_FLOWS transfers at once through one relay to a receiver daemon
+runFairness() {
+    local profile=$1 length file run options receiverPort relayPort receiverPid relayPid pids i verified
+    local goodputs jain
+
+    length=$(bytes "$FAIR_SIZE")
+    if ! fits $(( length * (FAIR_FLOWS + 1) )); then
+        printf "%-10s %6s %8s %22s %s\n" "$profile" "$FAIR_FLOWS" "-" "-" "skipped (disk space)"
+        return
+    fi
+    file=$(input "$FAIR_SIZE")
+    options=$(relayOptions "$profile")
+    run="$DIR/fairness-$profile"
+    rm -rf "$run"
+    mkdir -p "$run/output"
+    receiverPort=$PORT
+    relayPort=$(( PORT + 1 ))
+    PORT=$(( PORT + 2 ))
+
+    ./receiver -D $RECEIVER_FLAGS "$receiverPort" "$run/output" > "$run/receiver.log" 2>&1 &
+    receiverPid=$!
+    ./relay $options -s "$SEED" "$relayPort" 127.0.0.1 "$receiverPort" 2> "$run/relay.log" &
+    relayPid=$!
+    sleep 0.2
+
+    pids=""
+    for i in $(seq 1 "$FAIR_FLOWS"); do
+        (
+            start=$(date +%s.%N)
+            timeout "$RUN_TIMEOUT" ./sender $SENDER_FLAGS 127.0.0.1 "$relayPort" "$file" "$length" \
+                > "$run/sender-$i.log" 2>&1
+            rc=$?
+            end=$(date +%s.%N)
+            echo "$rc $start $end" > "$run/time-$i"
+        ) &
+        pids="$pids $!"
+    done
+    wait $pids
+
+    # The daemon reports each file once its last write is done
+    for i in $(seq 1 50); do
+        [ "$(grep -c '^Received' "$run/receiver.log")" -ge "$FAIR_FLOWS" ] && break
+        sleep 0.1
+    done
+    kill "$receiverPid" 2>/dev/null
+    wait "$receiverPid" 2>/dev/null
+    stopRelay "$relayPid"
+
+    verified=ok
+    for output in "$run"/output/*; do
+        cmp -s "$file" "$output" || verified=MISMATCH
+    done
+    [ "$(ls "$run/output" | wc -l)" -eq "$FAIR_FLOWS" ] || verified=MISMATCH
+    cat "$run"/time-* | awk '$1 != 0 { exit 1 }' || verified=FAILED
+    [ "$verified" = ok ] || FAILED=1
+    rm -rf "$run/output"
+
+    # Jain's index of the goodputs: 1 when every transfer got the same share, 1/n when one got everything
+    goodputs=$(cat "$run"/time-* | awk -v b="$length" '{ printf "%.2f ", b / ($3 - $2) / 1e6 }')
+    jain=$(echo "$goodputs" | awk '{ for (i = 1; i <= NF; i++) { s += $i; q += $i * $i } printf "%.3f", (q > 0 ? s * s / (NF * q) : 0) }')
+
+    printf "%-10s %6s %8s %22s %s\n" "$profile" "$FAIR_FLOWS" "$jain" "$(echo $goodputs | tr ' ' '/')" "$verified"
+    echo "$profile,$FAIR_FLOWS,$length,$jain,$(echo $goodputs | tr ' ' ';'),$verified" >> "$DIR/fairness.csv"
+}
+
+for profile in $SELECTED; do
+    if ! relayOptions "$profile" > /dev/null; then
+        echo "Error: Unknown profile $profile" >&2
+        exit 1
+    fi
+done
+
+echo "Working directory: $DIR"
+echo "profile,bytes,seconds,goodput_mb_per_sec,packets_sent,retransmits,retransmit_ratio,verified" > "$DIR/results.csv"
+printf "%-10s %6s %10s %12s %10s %s\n" profile size seconds "goodput MB/s" "retx ratio" verified
+for profile in $SELECTED; do
+    for size in $SIZES; do
+        runTransfer "$profile" "$size"
+    done
+done
+
+if [ "$FAIR_FLOWS" -gt 0 ]; then
+    echo
+    echo "profile,flows,bytes,jain_index,goodputs_mb_per_sec,verified" > "$DIR/fairness.csv"
+    printf "%-10s %6s %8s %22s %s\n" profile flows jain "goodputs MB/s" verified
+    for profile in $SELECTED; do
+        runFairness "$profile"
+    done
+fi
+
+[ -n "$KEEP_INPUTS" ] || rm -f "$DIR"/input-*
+exit $FAILED
@@ -0,0 +1,74 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sched.h>
+
+#include "./include/affinity.h"
+
+/**
+ * @brief cpuListParse is a function that reads a list of CPUs: comma-separated numbers and ranges.
+ * 
+ * @param list      Filled with the CPUs in the order given.
+ * @param spec      The list, such as "0-3,8".
+ * @return          0 on success, -1 if the list is malformed or too long.
+ */
+int cpuListParse(struct CpuList *list, const char *spec) {
+    const char *p = spec;
+
+    list->count = 0;
+    while (*p != '\0') {
+        char *end;
+        unsigned long first = strtoul(p, &end, 10);
+        unsigned long last = first;
+
+        if (end == p) {
+            return -1;
+        }
+        p = end;
+        if (*p == '-') {
+            last = strtoul(p + 1, &end, 10);
+            if (end == p + 1 || last < first) {
+                return -1;
+            }
+            p = end;
+        }
+        if (last >= CPU_SETSIZE || list->count + (last - first + 1) > AFFINITY_MAX_CPUS) {
+            return -1;
+        }
+        for (unsigned long cpu = first; cpu <= last; cpu++) {
+            list->cpus[list->count++] = cpu;
+        }
+        if (*p == ',') {
+            p++;
+        } else if (*p != '\0') {
+            return -1;
+        }
+    }
+    return list->count > 0 ? 0 : -1;
+}
+
+/**
+ * @brief threadPin is a function that pins a thread to the CPU of the list its index falls on, wrapping
+ *        around. A thread that cannot be pinned keeps running wherever the scheduler puts it.
+ * 
+ * @param thread    The thread.
+ * @param list      The CPUs, empty to leave threads unpinned.
+ * @param index     The thread's turn in the list.
+ */
+void threadPin(pthread_t thread, const struct CpuList *list, unsigned int index) {
+    cpu_set_t set;
+    unsigned int cpu;
+    int result;
+
+    if (list->count == 0) {
+        return;
+    }
+    cpu = list->cpus[index % list->count];
+    CPU_ZERO(&set);
+    CPU_SET(cpu, &set);
+    result = pthread_setaffinity_np(thread, sizeof(set), &set);
+    if (result != 0) {
+        fprintf(stderr, "Warning: Failed to pin a thread to CPU %u: %s\n", cpu, strerror(result));
+    }
+}
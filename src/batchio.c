@@ -0,0 +1,472 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <stdint.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <netinet/udp.h>
+
+#include "./include/batchio.h"
+
+// Older C libraries lack the offload options; the kernel rejects them if it does too
+#ifndef UDP_SEGMENT
+#define UDP_SEGMENT 103
+#endif
+#ifndef UDP_GRO
+#define UDP_GRO 104
+#endif
+
+#define BATCH_CONTROL_SIZE CMSG_SPACE(sizeof(int))
+#define BATCH_GRO_BUFFER_SIZE 65536
+
+/**
+ * @brief batchInit is a function that allocates capacity datagram buffers of bufSize bytes each.
+ * 
+ * @param batch     The batch to initialize.
+ * @param capacity  The number of datagrams per system call.
+ * @param bufSize   The size of each datagram buffer.
+ */
+void batchInit(struct BatchIO *batch, unsigned int capacity, size_t bufSize) {
+    if (capacity == 0) {
+        capacity = 1;
+    } else if (capacity > BATCH_MAX_SIZE) {
+        capacity = BATCH_MAX_SIZE;
+    }
+
+    batch->msgs = calloc(capacity, sizeof(struct mmsghdr));
+    batch->iovs = calloc(2 * capacity, sizeof(struct iovec));
+    batch->addrs = calloc(capacity, sizeof(struct sockaddr_in));
+    batch->buffers = calloc(capacity, bufSize);
+    batch->controls = calloc(capacity, BATCH_CONTROL_SIZE);
+    batch->groups = NULL;
+    batch->slots = NULL;
+    batch->pool = NULL;
+    batch->datagrams = calloc(capacity, sizeof(struct iovec));
+    batch->sources = calloc(capacity, sizeof(unsigned int));
+    if (batch->msgs == NULL || batch->iovs == NULL || batch->addrs == NULL || batch->buffers == NULL ||
+        batch->controls == NULL || batch->datagrams == NULL || batch->sources == NULL) {
+        perror("Error: Failed to allocate I/O batch");
+        exit(EXIT_FAILURE);
+    }
+    batch->bufSize = bufSize;
+    batch->capacity = capacity;
+    batch->count = 0;
+    batch->gso = 0;
+    batch->gro = 0;
+}
+
+/**
+ * @brief batchDestroy is a function that frees a batch.
+ * 
+ * @param batch     The batch to free.
+ */
+void batchDestroy(struct BatchIO *batch) {
+    if (batch->slots != NULL) {
+        for (unsigned int i = 0; i < batch->capacity; i++) {
+            bufferPut(batch->pool, batch->slots[i]);
+        }
+        free(batch->slots);
+    }
+    free(batch->msgs);
+    free(batch->iovs);
+    free(batch->addrs);
+    free(batch->buffers);
+    free(batch->controls);
+    free(batch->groups);
+    free(batch->datagrams);
+    free(batch->sources);
+    memset(batch, 0, sizeof(*batch));
+}
+
+/**
+ * @brief batchEnableGso is a function that makes batchFlush hand runs of equal-size datagrams to the
+ *        kernel as one UDP_SEGMENT super-buffer, which it splits at the datagram size.
+ * 
+ * @param sockfd    The file descriptor of the socket the batch is sent on.
+ * @param batch     The batch.
+ * @return          0 on success, -1 if the kernel does not support UDP_SEGMENT.
+ */
+int batchEnableGso(int sockfd, struct BatchIO *batch) {
+    int size = 0;
+
+    // A socket-wide size of 0 checks for support without segmenting anything else sent on the socket
+    if (setsockopt(sockfd, SOL_UDP, UDP_SEGMENT, &size, sizeof(size)) < 0) {
+        return -1;
+    }
+    if (batch->groups == NULL) {
+        batch->groups = calloc(batch->capacity, sizeof(struct mmsghdr));
+        if (batch->groups == NULL) {
+            perror("Error: Failed to allocate I/O batch");
+            exit(EXIT_FAILURE);
+        }
+    }
+    batch->gso = 1;
+    return 0;
+}
+
+/**
+ * @brief batchEnableGro is a function that lets the kernel coalesce datagrams of one flow into a single
+ *        UDP_GRO buffer, which batchReceive splits again. It must be called before the batch is used,
+ *        since it replaces the buffers with ones that hold a whole coalesced buffer. A batch shared by
+ *        several sockets keeps its buffers when it is enabled for the next one.
+ * 
+ * @param sockfd    The file descriptor of the socket the batch receives on.
+ * @param batch     The batch.
+ * @return          0 on success, -1 if the kernel does not support UDP_GRO.
+ */
+int batchEnableGro(int sockfd, struct BatchIO *batch) {
+    int on = 1;
+
+    if (setsockopt(sockfd, SOL_UDP, UDP_GRO, &on, sizeof(on)) < 0) {
+        return -1;
+    }
+    if (batch->gro) {
+        return 0;
+    }
+    if (batch->slots != NULL) {
+        for (unsigned int i = 0; i < batch->capacity; i++) {
+            bufferPut(batch->pool, batch->slots[i]);
+        }
+        free(batch->slots);
+        batch->slots = NULL;
+        batch->pool = NULL;
+    }
+    free(batch->buffers);
+    free(batch->datagrams);
+    free(batch->sources);
+    batch->buffers = calloc(batch->capacity, BATCH_GRO_BUFFER_SIZE);
+    batch->datagrams = calloc((size_t) batch->capacity * BATCH_GSO_MAX_SEGMENTS, sizeof(struct iovec));
+    batch->sources = calloc((size_t) batch->capacity * BATCH_GSO_MAX_SEGMENTS, sizeof(unsigned int));
+    if (batch->buffers == NULL || batch->datagrams == NULL || batch->sources == NULL) {
+        perror("Error: Failed to allocate I/O batch");
+        exit(EXIT_FAILURE);
+    }
+    batch->bufSize = BATCH_GRO_BUFFER_SIZE;
+    batch->gro = 1;
+    return 0;
+}
+
+/**
+ * @brief batchUsePool is a function that gives every message of a batch a buffer of its own from a pool,
+ *        so a received datagram can be kept by detaching its buffer instead of copying it out. The pool's
+ *        buffers must hold bufSize bytes. A batch that splits UDP_GRO buffers keeps its own.
+ * 
+ * @param batch     The batch, before it is first used.
+ * @param pool      The pool.
+ */
+void batchUsePool(struct BatchIO *batch, struct BufferPool *pool) {
+    if (batch->gro || batch->slots != NULL) {
+        return;
+    }
+    batch->slots = calloc(batch->capacity, sizeof(char *));
+    if (batch->slots == NULL) {
+        perror("Error: Failed to allocate I/O batch");
+        exit(EXIT_FAILURE);
+    }
+    for (unsigned int i = 0; i < batch->capacity; i++) {
+        batch->slots[i] = bufferGet(pool);
+    }
+    batch->pool = pool;
+    free(batch->buffers);
+    batch->buffers = NULL;
+}
+
+/**
+ * @brief batchDetach is a function that hands the buffer a received datagram starts at to the caller, who
+ *        returns it to the batch's pool when done with it, and gives the batch a fresh one in its place.
+ * 
+ * @param batch     The batch.
+ * @param index     The index of a datagram received by the last batchReceive.
+ * @return          0 on success, -1 if the batch's buffers are not from a pool, and must be copied out of.
+ */
+int batchDetach(struct BatchIO *batch, unsigned int index) {
+    if (batch->slots == NULL) {
+        return -1;
+    }
+    batch->slots[batch->sources[index]] = bufferGet(batch->pool);
+    return 0;
+}
+
+/**
+ * @brief batchBuffer is a function that returns the buffer of a datagram in the batch.
+ * 
+ * @param batch     The batch.
+ * @param index     The index of the datagram.
+ */
+void *batchBuffer(struct BatchIO *batch, unsigned int index) {
+    if (batch->slots != NULL) {
+        return batch->slots[index];
+    }
+    return batch->buffers + (size_t) index * batch->bufSize;
+}
+
+/**
+ * @brief batchData is a function that returns the contents of a received datagram.
+ * 
+ * @param batch     The batch.
+ * @param index     The index of the datagram.
+ */
+void *batchData(struct BatchIO *batch, unsigned int index) {
+    return batch->datagrams[index].iov_base;
+}
+
+/**
+ * @brief batchLength is a function that returns the length of a received datagram.
+ * 
+ * @param batch     The batch.
+ * @param index     The index of the datagram.
+ */
+size_t batchLength(struct BatchIO *batch, unsigned int index) {
+    return batch->datagrams[index].iov_len;
+}
+
+/**
+ * @brief batchAddress is a function that returns the source address of a received datagram.
+ * 
+ * @param batch     The batch.
+ * @param index     The index of the datagram.
+ */
+struct sockaddr_in *batchAddress(struct BatchIO *batch, unsigned int index) {
+    return &batch->addrs[batch->sources[index]];
+}
+
+/**
+ * @brief batchNext is a function that returns the buffer for the next datagram to queue.
+ * 
+ * @param batch     The batch, which must not be full.
+ */
+void *batchNext(struct BatchIO *batch) {
+    return batchBuffer(batch, batch->count);
+}
+
+/**
+ * @brief batchQueue is a function that queues the datagram written to batchNext for sending.
+ * 
+ * @param batch     The batch, which must not be full.
+ * @param length    The length of the datagram.
+ * @param addr      The destination address.
+ * @param addrLen   The size of the destination address.
+ */
+void batchQueue(struct BatchIO *batch, size_t length, const struct sockaddr_in *addr, socklen_t addrLen) {
+    unsigned int index = batch->count++;
+
+    batch->iovs[2 * index].iov_base = batchBuffer(batch, index);
+    batch->iovs[2 * index].iov_len = length;
+    batch->iovs[2 * index + 1].iov_base = NULL;
+    batch->iovs[2 * index + 1].iov_len = 0;
+    batch->addrs[index] = *addr;
+    memset(&batch->msgs[index].msg_hdr, 0, sizeof(struct msghdr));
+    batch->msgs[index].msg_hdr.msg_iov = &batch->iovs[2 * index];
+    batch->msgs[index].msg_hdr.msg_iovlen = 1;
+    batch->msgs[index].msg_hdr.msg_name = &batch->addrs[index];
+    batch->msgs[index].msg_hdr.msg_namelen = addrLen;
+}
+
+/**
+ * @brief batchAttach is a function that appends a payload held outside the batch to a queued datagram,
+ *        so it is sent without being copied into the datagram buffer.
+ * 
+ * @param batch     The batch.
+ * @param index     The index of a queued datagram.
+ * @param data      The payload. It must stay valid until the batch is flushed.
+ * @param length    The length of the payload.
+ */
+void batchAttach(struct BatchIO *batch, unsigned int index, const void *data, size_t length) {
+    batch->iovs[2 * index + 1].iov_base = (void *) data;
+    batch->iovs[2 * index + 1].iov_len = length;
+    batch->msgs[index].msg_hdr.msg_iovlen = 2;
+}
+
+/**
+ * @brief batchFull is a function that checks whether another datagram can be queued.
+ * 
+ * @param batch     The batch.
+ */
+int batchFull(struct BatchIO *batch) {
+    return batch->count >= batch->capacity;
+}
+
+/**
+ * @brief sendMessages is a function that sends messages using as few sendmmsg calls as the kernel allows.
+ * 
+ * @param sockfd    The file descriptor of the socket.
+ * @param msgs      The messages.
+ * @param count     The number of messages.
+ * @param sent      Set to the number of messages sent, also on error.
+ * @return          0 on success, -1 on error.
+ */
+static int sendMessages(int sockfd, struct mmsghdr *msgs, unsigned int count, unsigned int *sent) {
+    *sent = 0;
+    while (*sent < count) {
+        int result = sendmmsg(sockfd, msgs + *sent, count - *sent, 0);
+        if (result < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return -1;
+        }
+        *sent += result;
+    }
+    return 0;
+}
+
+/**
+ * @brief datagramSize is a function that returns the length of a queued datagram with its attached payload.
+ * 
+ * @param batch     The batch.
+ * @param index     The index of a queued datagram.
+ */
+static size_t datagramSize(struct BatchIO *batch, unsigned int index) {
+    return batch->iovs[2 * index].iov_len + batch->iovs[2 * index + 1].iov_len;
+}
+
+/**
+ * @brief flushSegmented is a function that sends the queued datagrams as UDP_SEGMENT super-buffers. Each
+ *        run of datagrams to one address whose length matches the first, except for a shorter last one,
+ *        becomes one message whose iovecs lay the datagrams out back to back. If the device cannot
+ *        segment, offload is turned off and the rest is sent one datagram per message.
+ * 
+ * @param sockfd    The file descriptor of the socket.
+ * @param batch     The batch to send.
+ * @return          0 on success, -1 on error.
+ */
+static int flushSegmented(int sockfd, struct BatchIO *batch) {
+    unsigned int groupCount = 0;
+    unsigned int sent;
+
+    for (unsigned int first = 0; first < batch->count; ) {
+        struct msghdr *hdr = &batch->groups[groupCount].msg_hdr;
+        size_t size = datagramSize(batch, first);
+        size_t total = size;
+        unsigned int n = 1;
+
+        while (first + n < batch->count && n < BATCH_GSO_MAX_SEGMENTS &&
+               datagramSize(batch, first + n - 1) == size && datagramSize(batch, first + n) <= size &&
+               total + datagramSize(batch, first + n) <= BATCH_GSO_MAX_BYTES &&
+               memcmp(&batch->addrs[first], &batch->addrs[first + n], sizeof(struct sockaddr_in)) == 0) {
+            total += datagramSize(batch, first + n);
+            n++;
+        }
+
+        *hdr = batch->msgs[first].msg_hdr;
+        hdr->msg_iov = &batch->iovs[2 * first];
+        hdr->msg_iovlen = 2 * n;
+        if (n > 1) {
+            uint16_t segmentSize = size;
+            struct cmsghdr *cmsg;
+
+            hdr->msg_control = batch->controls + (size_t) groupCount * BATCH_CONTROL_SIZE;
+            hdr->msg_controllen = CMSG_SPACE(sizeof(segmentSize));
+            cmsg = CMSG_FIRSTHDR(hdr);
+            cmsg->cmsg_level = SOL_UDP;
+            cmsg->cmsg_type = UDP_SEGMENT;
+            cmsg->cmsg_len = CMSG_LEN(sizeof(segmentSize));
+            memcpy(CMSG_DATA(cmsg), &segmentSize, sizeof(segmentSize));
+        }
+        batch->sources[groupCount++] = first;
+        first += n;
+    }
+
+    if (sendMessages(sockfd, batch->groups, groupCount, &sent) == 0) {
+        return 0;
+    }
+    if (errno != EIO) {
+        return -1;
+    }
+    batch->gso = 0;
+    return sendMessages(sockfd, batch->msgs + batch->sources[sent], batch->count - batch->sources[sent], &sent);
+}
+
+/**
+ * @brief batchFlush is a function that sends every queued datagram, using as few sendmmsg calls as the
+ *        kernel allows.
+ * 
+ * @param sockfd    The file descriptor of the socket.
+ * @param batch     The batch to send. It is empty afterwards.
+ * @return          0 on success, -1 on error.
+ */
+int batchFlush(int sockfd, struct BatchIO *batch) {
+    unsigned int sent;
+    int result;
+
+    if (batch->gso) {
+        result = flushSegmented(sockfd, batch);
+    } else {
+        result = sendMessages(sockfd, batch->msgs, batch->count, &sent);
+    }
+    batch->count = 0;
+    return result;
+}
+
+/**
+ * @brief groSize is a function that returns the size of the datagrams the kernel coalesced into a
+ *        received buffer.
+ * 
+ * @param hdr       The message the buffer was received in.
+ * @param length    The length of the buffer, which is returned if it holds a single datagram.
+ */
+static size_t groSize(struct msghdr *hdr, size_t length) {
+    for (struct cmsghdr *cmsg = CMSG_FIRSTHDR(hdr); cmsg != NULL; cmsg = CMSG_NXTHDR(hdr, cmsg)) {
+        if (cmsg->cmsg_level == SOL_UDP && cmsg->cmsg_type == UDP_GRO) {
+            int size;
+
+            memcpy(&size, CMSG_DATA(cmsg), sizeof(size));
+            return size > 0 ? (size_t) size : length;
+        }
+    }
+    return length;
+}
+
+/**
+ * @brief batchReceive is a function that reads as many queued datagrams as fit in the batch with one
+ *        recvmmsg call. Buffers the kernel coalesced with UDP_GRO are split back into datagrams.
+ * 
+ * @param sockfd    The file descriptor of the socket.
+ * @param batch     The batch to fill.
+ * @param flags     recvmmsg flags, e.g. MSG_DONTWAIT to only drain what is already queued.
+ * @return          The number of datagrams received, 0 if none were queued, or -1 on error.
+ */
+int batchReceive(int sockfd, struct BatchIO *batch, int flags) {
+    int result;
+
+    for (unsigned int i = 0; i < batch->capacity; i++) {
+        batch->iovs[2 * i].iov_base = batchBuffer(batch, i);
+        batch->iovs[2 * i].iov_len = batch->bufSize;
+        memset(&batch->msgs[i].msg_hdr, 0, sizeof(struct msghdr));
+        batch->msgs[i].msg_hdr.msg_iov = &batch->iovs[2 * i];
+        batch->msgs[i].msg_hdr.msg_iovlen = 1;
+        batch->msgs[i].msg_hdr.msg_name = &batch->addrs[i];
+        batch->msgs[i].msg_hdr.msg_namelen = sizeof(struct sockaddr_in);
+        if (batch->gro) {
+            batch->msgs[i].msg_hdr.msg_control = batch->controls + (size_t) i * BATCH_CONTROL_SIZE;
+            batch->msgs[i].msg_hdr.msg_controllen = BATCH_CONTROL_SIZE;
+        }
+    }
+
+    do {
+        result = recvmmsg(sockfd, batch->msgs, batch->capacity, flags, NULL);
+    } while (result < 0 && errno == EINTR);
+
+    if (result < 0) {
+        batch->count = 0;
+        return (errno == EAGAIN || errno == EWOULDBLOCK) ? 0 : -1;
+    }
+
+    batch->count = 0;
+    for (int i = 0; i < result; i++) {
+        char *buffer = batchBuffer(batch, i);
+        size_t length = batch->msgs[i].msg_len;
+        size_t size = batch->gro ? groSize(&batch->msgs[i].msg_hdr, length) : length;
+        size_t offset = 0;
+
+        do {
+            batch->datagrams[batch->count].iov_base = buffer + offset;
+            batch->datagrams[batch->count].iov_len = length - offset < size ? length - offset : size;
+            batch->sources[batch->count++] = i;
+            offset += size;
+        } while (offset < length);
+    }
+    return batch->count;
+}
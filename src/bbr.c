@@ -0,0 +1,248 @@
+#include <stddef.h>
+#include <stdint.h>
+
+#include "./include/congestion.h"
+#include "./include/timeutil.h"
+
+#define BBR_STARTUP 0
+#define BBR_DRAIN 1
+#define BBR_PROBE_BW 2
+#define BBR_PROBE_RTT 3
+
+#define BBR_HIGH_GAIN 2.885                         // 2/ln(2), doubles the sending rate every round
+#define BBR_CWND_GAIN 2.0
+#define BBR_BW_ROUNDS 10                            // Rounds covered by the bottleneck bandwidth filter
+#define BBR_FULL_BW_ROUNDS 3                        // Rounds without 25% growth before the pipe is full
+#define BBR_MIN_RTT_WINDOW (10 * NSEC_PER_SEC)      // How long a min RTT sample stays valid
+#define BBR_PROBE_RTT_TIME (200 * NSEC_PER_MSEC)    // How long PROBE_RTT drains the queue
+#define BBR_MIN_CWND 4                              // Smallest window, in segments
+
+static const double bbrGainCycle[8] = { 1.25, 0.75, 1.0, 1.0, 1.0, 1.0, 1.0, 1.0 };
+
+/**
+ * @brief bbrBdp is a function that returns the estimated bandwidth-delay product in bytes.
+ * 
+ * @param cc    The congestion control state.
+ */
+static uint64_t bbrBdp(struct CongestionControl *cc) {
+    struct BbrState *bbr = &cc->state.bbr;
+
+    if (bbr->btlBw == 0 || bbr->minRtt == 0) {
+        return CC_INITIAL_WINDOW * cc->mss;
+    }
+    return bbr->btlBw * bbr->minRtt / NSEC_PER_SEC;
+}
+
+/**
+ * @brief bbrEnterProbeBw is a function that starts cycling the pacing gain around the bandwidth estimate.
+ * 
+ * @param cc    The congestion control state.
+ * @param now   The current monotonic time (ns).
+ */
+static void bbrEnterProbeBw(struct CongestionControl *cc, uint64_t now) {
+    struct BbrState *bbr = &cc->state.bbr;
+
+    bbr->mode = BBR_PROBE_BW;
+    bbr->cwndGain = BBR_CWND_GAIN;
+    // Start anywhere but the draining phase so flows that start together do not probe in lockstep
+    bbr->cycleIndex = 2 + (int) (now % 6);
+    bbr->cycleStamp = now;
+    bbr->pacingGain = bbrGainCycle[bbr->cycleIndex];
+}
+
+/**
+ * @brief bbrInit is a function that starts BBR in STARTUP.
+ * 
+ * @param cc    The congestion control state.
+ */
+static void bbrInit(struct CongestionControl *cc) {
+    struct BbrState *bbr = &cc->state.bbr;
+
+    bbr->mode = BBR_STARTUP;
+    bbr->pacingGain = BBR_HIGH_GAIN;
+    bbr->cwndGain = BBR_HIGH_GAIN;
+    bbr->minRttStamp = monotonicNs();
+}
+
+/**
+ * @brief bbrUpdateBandwidth is a function that feeds a delivery rate sample into the windowed max filter
+ *        and counts round trips.
+ * 
+ * @param cc        The congestion control state.
+ * @param sample    The ACK sample.
+ * @return          1 if this ACK started a new round trip.
+ */
+static int bbrUpdateBandwidth(struct CongestionControl *cc, const struct AckSample *sample) {
+    struct BbrState *bbr = &cc->state.bbr;
+    int roundStart = 0;
+
+    if (sample->priorDelivered >= bbr->nextRoundDelivered) {
+        bbr->nextRoundDelivered = cc->delivered;
+        bbr->roundCount++;
+        bbr->bwSamples[bbr->roundCount % BBR_BW_ROUNDS] = 0;
+        roundStart = 1;
+    }
+
+    if (sample->deliveryRate > bbr->bwSamples[bbr->roundCount % BBR_BW_ROUNDS]) {
+        bbr->bwSamples[bbr->roundCount % BBR_BW_ROUNDS] = sample->deliveryRate;
+    }
+    bbr->btlBw = 0;
+    for (int i = 0; i < BBR_BW_ROUNDS; i++) {
+        if (bbr->bwSamples[i] > bbr->btlBw) {
+            bbr->btlBw = bbr->bwSamples[i];
+        }
+    }
+    return roundStart;
+}
+
+/**
+ * @brief bbrUpdateMode is a function that moves BBR through STARTUP, DRAIN, PROBE_BW and PROBE_RTT.
+ * 
+ * @param cc            The congestion control state.
+ * @param sample        The ACK sample.
+ * @param roundStart    Whether this ACK started a new round trip.
+ */
+static void bbrUpdateMode(struct CongestionControl *cc, const struct AckSample *sample, int roundStart) {
+    struct BbrState *bbr = &cc->state.bbr;
+    uint64_t now = sample->now;
+
+    // The pipe is full once the bandwidth estimate stops growing by 25% per round
+    if (roundStart && !bbr->filledPipe) {
+        if (bbr->btlBw >= bbr->fullBw + bbr->fullBw / 4) {
+            bbr->fullBw = bbr->btlBw;
+            bbr->fullBwCount = 0;
+        } else if (++bbr->fullBwCount >= BBR_FULL_BW_ROUNDS) {
+            bbr->filledPipe = 1;
+        }
+    }
+
+    if (bbr->mode == BBR_STARTUP && bbr->filledPipe) {
+        bbr->mode = BBR_DRAIN;
+        bbr->pacingGain = 1.0 / BBR_HIGH_GAIN;
+        bbr->cwndGain = BBR_HIGH_GAIN;
+    }
+    if (bbr->mode == BBR_DRAIN && sample->bytesInFlight <= bbrBdp(cc)) {
+        bbrEnterProbeBw(cc, now);
+    }
+
+    if (bbr->mode == BBR_PROBE_BW && bbr->minRtt != 0 && now - bbr->cycleStamp > bbr->minRtt) {
+        bbr->cycleIndex = (bbr->cycleIndex + 1) % 8;
+        bbr->cycleStamp = now;
+        bbr->pacingGain = bbrGainCycle[bbr->cycleIndex];
+    }
+
+    // Refresh a stale min RTT by briefly draining the queue
+    if (bbr->mode != BBR_PROBE_RTT && now - bbr->minRttStamp > BBR_MIN_RTT_WINDOW) {
+        bbr->mode = BBR_PROBE_RTT;
+        bbr->pacingGain = 1.0;
+        bbr->priorCwnd = cc->cwnd;
+        bbr->probeRttDone = now + BBR_PROBE_RTT_TIME;
+    }
+    if (bbr->mode == BBR_PROBE_RTT && now >= bbr->probeRttDone) {
+        bbr->minRttStamp = now;
+        if (cc->cwnd < bbr->priorCwnd) {
+            cc->cwnd = bbr->priorCwnd;
+        }
+        if (bbr->filledPipe) {
+            bbrEnterProbeBw(cc, now);
+        } else {
+            bbr->mode = BBR_STARTUP;
+            bbr->pacingGain = BBR_HIGH_GAIN;
+            bbr->cwndGain = BBR_HIGH_GAIN;
+        }
+    }
+}
+
+/**
+ * @brief bbrOnAck is a function that updates the bandwidth model and sizes the window to cwndGain times
+ *        the estimated bandwidth-delay product.
+ * 
+ * @param cc        The congestion control state.
+ * @param sample    The ACK sample.
+ */
+static void bbrOnAck(struct CongestionControl *cc, const struct AckSample *sample) {
+    struct BbrState *bbr = &cc->state.bbr;
+    int roundStart = bbrUpdateBandwidth(cc, sample);
+    uint64_t target;
+
+    bbrUpdateMode(cc, sample, roundStart);
+
+    target = (uint64_t) (bbrBdp(cc) * bbr->cwndGain) + 3 * cc->mss;
+    if (bbr->filledPipe) {
+        cc->cwnd = cc->cwnd + sample->ackedBytes < target ? cc->cwnd + sample->ackedBytes : target;
+    } else if (cc->cwnd < target || cc->delivered < CC_INITIAL_WINDOW * cc->mss) {
+        cc->cwnd += sample->ackedBytes;
+    }
+    if (cc->cwnd < BBR_MIN_CWND * cc->mss) {
+        cc->cwnd = BBR_MIN_CWND * cc->mss;
+    }
+}
+
+/**
+ * @brief bbrOnLoss is a function that reacts to loss. BBR does not treat loss as a congestion signal, but
+ *        a retransmit timeout means the model is stale, so the window restarts from one segment.
+ * 
+ * @param cc        The congestion control state.
+ * @param now       The current monotonic time (ns).
+ * @param timeout   Whether the loss was detected by the retransmit timer.
+ */
+static void bbrOnLoss(struct CongestionControl *cc, uint64_t now, int timeout) {
+    (void) now;
+
+    if (timeout) {
+        cc->state.bbr.priorCwnd = cc->cwnd;
+        cc->cwnd = cc->mss;
+    }
+}
+
+/**
+ * @brief bbrOnRttSample is a function that tracks the windowed minimum RTT.
+ * 
+ * @param cc        The congestion control state.
+ * @param rtt       The measured round trip time (ns).
+ * @param now       The current monotonic time (ns).
+ */
+static void bbrOnRttSample(struct CongestionControl *cc, uint64_t rtt, uint64_t now) {
+    struct BbrState *bbr = &cc->state.bbr;
+
+    if (bbr->minRtt == 0 || rtt <= bbr->minRtt || now - bbr->minRttStamp > BBR_MIN_RTT_WINDOW) {
+        bbr->minRtt = rtt;
+        bbr->minRttStamp = now;
+    }
+}
+
+/**
+ * @brief bbrPacingRate is a function that paces at pacingGain times the bottleneck bandwidth estimate.
+ * 
+ * @param cc    The congestion control state.
+ */
+static uint64_t bbrPacingRate(struct CongestionControl *cc) {
+    struct BbrState *bbr = &cc->state.bbr;
+
+    if (bbr->btlBw == 0) {
+        return cc->srtt == 0 ? 0 : (uint64_t) (BBR_HIGH_GAIN * cc->cwnd * NSEC_PER_SEC / cc->srtt);
+    }
+    return (uint64_t) (bbr->pacingGain * bbr->btlBw);
+}
+
+/**
+ * @brief bbrCwnd is a function that returns the BBR window, which PROBE_RTT caps at BBR_MIN_CWND segments.
+ * 
+ * @param cc    The congestion control state.
+ */
+static uint64_t bbrCwnd(struct CongestionControl *cc) {
+    if (cc->state.bbr.mode == BBR_PROBE_RTT && cc->cwnd > BBR_MIN_CWND * cc->mss) {
+        return BBR_MIN_CWND * cc->mss;
+    }
+    return cc->cwnd;
+}
+
+const struct CongestionOps bbrOps = {
+    .name = "bbr",
+    .init = bbrInit,
+    .onAck = bbrOnAck,
+    .onLoss = bbrOnLoss,
+    .onRttSample = bbrOnRttSample,
+    .pacingRate = bbrPacingRate,
+    .cwnd = bbrCwnd,
+};
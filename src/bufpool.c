@@ -0,0 +1,196 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+
+#include "./include/bufpool.h"
+
+/**
+ * The free list of the calling thread, for the pool it last used.
+ */
+struct BufferCache {
+    struct BufferPool   *pool;
+    unsigned int        count;
+    void                *bufs[BUFPOOL_CACHE_SIZE];
+};
+
+static __thread struct BufferCache cache;
+
+/**
+ * @brief mapChunk is a function that maps and touches one chunk, on huge pages if the pool asks for them
+ *        and the kernel has some to give, and otherwise on pages the kernel may still back with huge ones.
+ * 
+ * @param pool      The pool.
+ * @return          The chunk.
+ */
+static void *mapChunk(struct BufferPool *pool) {
+    void *chunk = MAP_FAILED;
+
+    if (__atomic_load_n(&pool->hugePages, __ATOMIC_RELAXED)) {
+        chunk = mmap(NULL, pool->chunkBytes, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB,
+                     -1, 0);
+        if (chunk == MAP_FAILED && __atomic_exchange_n(&pool->hugePages, 0, __ATOMIC_RELAXED)) {
+            perror("Warning: Failed to map huge pages, using normal pages");
+        }
+    }
+    if (chunk == MAP_FAILED) {
+        chunk = mmap(NULL, pool->chunkBytes, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (chunk == MAP_FAILED) {
+            perror("Error: Failed to allocate packet buffers");
+            exit(EXIT_FAILURE);
+        }
+        madvise(chunk, pool->chunkBytes, MADV_HUGEPAGE);
+    }
+    memset(chunk, 0, pool->chunkBytes);
+    return chunk;
+}
+
+/**
+ * @brief poolGrow is a function that adds a chunk of buffers to the shared free list. The chunk is mapped
+ *        and touched before the pool lock is taken, so other threads keep trading buffers meanwhile. The
+ *        pool lock must not be held.
+ * 
+ * @param pool      The pool.
+ */
+static void poolGrow(struct BufferPool *pool) {
+    char *chunk = mapChunk(pool);
+    void **chunks;
+
+    pthread_mutex_lock(&pool->lock);
+    chunks = realloc(pool->chunks, (pool->chunkCount + 1) * sizeof(void *));
+    if (chunks == NULL) {
+        perror("Error: Failed to allocate packet buffers");
+        exit(EXIT_FAILURE);
+    }
+    pool->chunks = chunks;
+    pool->chunks[pool->chunkCount++] = chunk;
+
+    for (size_t offset = 0; offset + pool->bufSize <= pool->chunkBytes; offset += pool->bufSize) {
+        *(void **) (chunk + offset) = pool->free;
+        pool->free = chunk + offset;
+    }
+    pthread_mutex_unlock(&pool->lock);
+}
+
+/**
+ * @brief bufferPoolInit is a function that sets up a pool with at least count buffers ready.
+ * 
+ * @param pool      The pool to initialize.
+ * @param bufSize   The size of each buffer.
+ * @param count     The number of buffers to allocate up front.
+ * @param hugePages Whether to back the pool with huge pages (MAP_HUGETLB).
+ */
+void bufferPoolInit(struct BufferPool *pool, size_t bufSize, size_t count, int hugePages) {
+    size_t allocated = 0;
+
+    memset(pool, 0, sizeof(*pool));
+    if (pthread_mutex_init(&pool->lock, NULL) != 0) {
+        fprintf(stderr, "Error: Failed to initialize packet buffers\n");
+        exit(EXIT_FAILURE);
+    }
+    pool->bufSize = (bufSize + BUFPOOL_CACHE_LINE - 1) / BUFPOOL_CACHE_LINE * BUFPOOL_CACHE_LINE;
+    pool->chunkBytes = (pool->bufSize + BUFPOOL_CHUNK_BYTES - 1) / BUFPOOL_CHUNK_BYTES * BUFPOOL_CHUNK_BYTES;
+    pool->hugePages = hugePages;
+    do {
+        poolGrow(pool);
+        allocated += pool->chunkBytes / pool->bufSize;
+    } while (allocated < count);
+}
+
+/**
+ * @brief bufferPoolDestroy is a function that unmaps every buffer of a pool, whether or not it was returned.
+ * 
+ * @param pool      The pool to free.
+ */
+void bufferPoolDestroy(struct BufferPool *pool) {
+    if (cache.pool == pool) {
+        cache.pool = NULL;
+        cache.count = 0;
+    }
+    for (unsigned int i = 0; i < pool->chunkCount; i++) {
+        munmap(pool->chunks[i], pool->chunkBytes);
+    }
+    free(pool->chunks);
+    pthread_mutex_destroy(&pool->lock);
+    memset(pool, 0, sizeof(*pool));
+}
+
+/**
+ * @brief cacheFlush is a function that moves buffers from the calling thread's free list to its pool's
+ *        shared list.
+ * 
+ * @param keep      How many buffers the thread keeps.
+ */
+static void cacheFlush(unsigned int keep) {
+    struct BufferPool *pool = cache.pool;
+
+    pthread_mutex_lock(&pool->lock);
+    while (cache.count > keep) {
+        void *buf = cache.bufs[--cache.count];
+
+        *(void **) buf = pool->free;
+        pool->free = buf;
+    }
+    pthread_mutex_unlock(&pool->lock);
+}
+
+/**
+ * @brief cacheBind is a function that makes the calling thread's free list hold buffers of a pool,
+ *        returning those of the last pool it used.
+ * 
+ * @param pool      The pool.
+ */
+static void cacheBind(struct BufferPool *pool) {
+    if (cache.pool == pool) {
+        return;
+    }
+    if (cache.pool != NULL && cache.count > 0) {
+        cacheFlush(0);
+    }
+    cache.pool = pool;
+}
+
+/**
+ * @brief bufferGet is a function that takes a buffer from a pool, from the calling thread's own free list
+ *        when it has one.
+ * 
+ * @param pool      The pool.
+ * @return          A buffer of pool->bufSize bytes.
+ */
+void *bufferGet(struct BufferPool *pool) {
+    cacheBind(pool);
+    if (cache.count == 0) {
+        pthread_mutex_lock(&pool->lock);
+        while (cache.count < BUFPOOL_BATCH) {
+            if (pool->free == NULL) {
+                if (cache.count > 0) {
+                    break;
+                }
+                pthread_mutex_unlock(&pool->lock);
+                poolGrow(pool);
+                pthread_mutex_lock(&pool->lock);
+                continue;
+            }
+            cache.bufs[cache.count++] = pool->free;
+            pool->free = *(void **) pool->free;
+        }
+        pthread_mutex_unlock(&pool->lock);
+    }
+    return cache.bufs[--cache.count];
+}
+
+/**
+ * @brief bufferPut is a function that returns a buffer to a pool, onto the calling thread's own free list
+ *        until that is full.
+ * 
+ * @param pool      The pool the buffer came from.
+ * @param buf       The buffer.
+ */
+void bufferPut(struct BufferPool *pool, void *buf) {
+    cacheBind(pool);
+    if (cache.count == BUFPOOL_CACHE_SIZE) {
+        cacheFlush(BUFPOOL_CACHE_SIZE - BUFPOOL_BATCH);
+    }
+    cache.bufs[cache.count++] = buf;
+}
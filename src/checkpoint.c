@@ -0,0 +1,492 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#include "./include/checkpoint.h"
+#include "./include/crc32c.h"
+
+/**
+ * Checkpoint file, all fields in network byte order:
+ * 
+ *   magic (8) | unit (8) | identity (28) | contiguous (8) | bitmap bytes (8) | bitmap | CRC32C (4)
+ * 
+ * Every byte below contiguous is written. Bit i of the bitmap (byte i / 8, least significant bit first)
+ * stands for the unit i units past contiguous. The CRC32C covers everything before it. The file is
+ * replaced by renaming a new one over it, so a crash leaves either the old or the new checkpoint.
+ */
+#define CHECKPOINT_MAGIC "RDTCKPT1"
+#define CHECKPOINT_IDENTITY_SIZE 28
+#define CHECKPOINT_HEADER_SIZE (8 + 8 + CHECKPOINT_IDENTITY_SIZE + 8 + 8)
+
+/**
+ * @brief storeBigEndian is a function that writes the low bytes of a value, most significant first.
+ * 
+ * @param out       Where to write.
+ * @param value     The value.
+ * @param bytes     How many bytes to write.
+ */
+static void storeBigEndian(unsigned char *out, uint64_t value, int bytes) {
+    for (int i = 0; i < bytes; i++) {
+        out[i] = value >> (8 * (bytes - 1 - i));
+    }
+}
+
+/**
+ * @brief loadBigEndian is a function that reads a value written by storeBigEndian.
+ * 
+ * @param in        Where to read.
+ * @param bytes     How many bytes to read.
+ */
+static uint64_t loadBigEndian(const unsigned char *in, int bytes) {
+    uint64_t value = 0;
+
+    for (int i = 0; i < bytes; i++) {
+        value = (value << 8) | in[i];
+    }
+    return value;
+}
+
+/**
+ * @brief encodeIdentity is a function that writes a file identity the way PACKET_OPT_IDENTITY carries it.
+ * 
+ * @param out       CHECKPOINT_IDENTITY_SIZE bytes.
+ * @param identity  The identity.
+ */
+static void encodeIdentity(unsigned char *out, const struct FileIdentity *identity) {
+    storeBigEndian(out, identity->length, 8);
+    storeBigEndian(out + 8, identity->size, 8);
+    storeBigEndian(out + 16, identity->mtimeNs, 8);
+    storeBigEndian(out + 24, identity->hash, 4);
+}
+
+/**
+ * @brief hashRange is a function that folds bytes of a file into a CRC32C.
+ * 
+ * @param fd        The file.
+ * @param offset    The offset of the bytes.
+ * @param length    The number of bytes.
+ * @param crc       The CRC32C so far.
+ * @return          0 on success, -1 if the bytes could not be read.
+ */
+static int hashRange(int fd, uint64_t offset, uint64_t length, uint32_t *crc) {
+    char buf[64 * 1024];
+
+    while (length > 0) {
+        ssize_t result = pread(fd, buf, length < sizeof(buf) ? length : sizeof(buf), offset);
+
+        if (result < 0 && errno == EINTR) {
+            continue;
+        }
+        if (result <= 0) {
+            return -1;
+        }
+        *crc = crc32c(*crc, buf, result);
+        offset += result;
+        length -= result;
+    }
+    return 0;
+}
+
+/**
+ * @brief checkpointIdentify is a function that identifies the file a sender is about to transfer: its
+ *        size and modification time, and a CRC32C of up to CHECKPOINT_SAMPLE_BYTES at each end of the
+ *        transferred bytes, which catches a file rewritten in place without reading all of it.
+ * 
+ * @param filename  The file.
+ * @param length    The number of bytes being transferred from its start.
+ * @param identity  Filled with the identity.
+ * @return          0 on success, -1 if the file cannot be read.
+ */
+int checkpointIdentify(const char *filename, uint64_t length, struct FileIdentity *identity) {
+    struct stat st;
+    uint64_t sample = length < CHECKPOINT_SAMPLE_BYTES ? length : CHECKPOINT_SAMPLE_BYTES;
+    uint64_t tail = length - sample > sample ? sample : length - sample;
+    int fd = open(filename, O_RDONLY);
+
+    if (fd < 0) {
+        return -1;
+    }
+    memset(identity, 0, sizeof(*identity));
+    if (fstat(fd, &st) < 0 || hashRange(fd, 0, sample, &identity->hash) < 0 ||
+        hashRange(fd, length - tail, tail, &identity->hash) < 0) {
+        close(fd);
+        return -1;
+    }
+    identity->length = length;
+    identity->size = st.st_size;
+    identity->mtimeNs = (uint64_t) st.st_mtim.tv_sec * NSEC_PER_SEC + st.st_mtim.tv_nsec;
+    close(fd);
+    return 0;
+}
+
+/**
+ * @brief checkpointKey is a function that condenses a file identity into 32 bits, which name the output
+ *        of a resumable transfer in a daemon's directory.
+ * 
+ * @param identity  The identity.
+ */
+uint32_t checkpointKey(const struct FileIdentity *identity) {
+    unsigned char encoded[CHECKPOINT_IDENTITY_SIZE];
+
+    encodeIdentity(encoded, identity);
+    return crc32c(0, encoded, sizeof(encoded));
+}
+
+/**
+ * @brief unitEnd is a function that returns the offset one past the end of a unit; the last unit ends
+ *        with the transfer.
+ * 
+ * @param checkpoint    The checkpoint.
+ * @param unit          The unit.
+ */
+static uint64_t unitEnd(const struct Checkpoint *checkpoint, uint64_t unit) {
+    uint64_t end = (unit + 1) * CHECKPOINT_UNIT;
+
+    return end < checkpoint->identity.length ? end : checkpoint->identity.length;
+}
+
+/**
+ * @brief markFlows is a function that sets the bit of every unit a flow has written in full. The caller
+ *        holds the checkpoint lock.
+ * 
+ * @param checkpoint    The checkpoint.
+ */
+static void markFlows(struct Checkpoint *checkpoint) {
+    for (unsigned int i = 0; i < checkpoint->flowCount; i++) {
+        const struct CheckpointFlow *flow = &checkpoint->flows[i];
+
+        for (uint64_t unit = (flow->start + CHECKPOINT_UNIT - 1) / CHECKPOINT_UNIT;
+             unit < checkpoint->units && unitEnd(checkpoint, unit) <= flow->end; unit++) {
+            checkpoint->bitmap[unit / 8] |= 1 << (unit % 8);
+        }
+    }
+}
+
+/**
+ * @brief checkpointLoad is a function that reads an earlier checkpoint of the same file. One that is
+ *        damaged, was made for another file or promises more than the output holds is ignored.
+ * 
+ * @param checkpoint    The checkpoint, with no unit set yet.
+ * @return              1 if some unit is already written, 0 to start over.
+ */
+static int checkpointLoad(struct Checkpoint *checkpoint) {
+    unsigned char identity[CHECKPOINT_IDENTITY_SIZE];
+    unsigned char *buf;
+    struct stat st;
+    size_t length;
+    size_t done = 0;
+    uint64_t first;
+    uint64_t last = 0;
+    int valid;
+    int fd = open(checkpoint->path, O_RDONLY);
+
+    if (fd < 0) {
+        return 0;
+    }
+    length = fstat(fd, &st) == 0 ? (size_t) st.st_size : 0;
+    if (length < CHECKPOINT_HEADER_SIZE + 4 || length > CHECKPOINT_HEADER_SIZE + checkpoint->units / 8 + 5) {
+        fprintf(stderr, "Warning: Checkpoint %s is damaged, starting over\n", checkpoint->path);
+        close(fd);
+        return 0;
+    }
+    buf = malloc(length);
+    if (buf == NULL) {
+        perror("Error: Failed to allocate checkpoint");
+        exit(EXIT_FAILURE);
+    }
+    while (done < length) {
+        ssize_t result = read(fd, buf + done, length - done);
+
+        if (result < 0 && errno == EINTR) {
+            continue;
+        }
+        if (result <= 0) {
+            break;
+        }
+        done += result;
+    }
+    close(fd);
+
+    encodeIdentity(identity, &checkpoint->identity);
+    first = loadBigEndian(buf + 44, 8);
+    valid = done == length && memcmp(buf, CHECKPOINT_MAGIC, 8) == 0 &&
+            crc32c(0, buf, length - 4) == loadBigEndian(buf + length - 4, 4) &&
+            loadBigEndian(buf + 52, 8) == length - CHECKPOINT_HEADER_SIZE - 4;
+    if (!valid) {
+        fprintf(stderr, "Warning: Checkpoint %s is damaged, starting over\n", checkpoint->path);
+        free(buf);
+        return 0;
+    }
+    if (loadBigEndian(buf + 8, 8) != CHECKPOINT_UNIT || memcmp(buf + 16, identity, sizeof(identity)) != 0 ||
+        first > checkpoint->identity.length) {
+        fprintf(stderr, "Warning: Checkpoint %s is for another file, starting over\n", checkpoint->path);
+        free(buf);
+        return 0;
+    }
+
+    // Units below contiguous, then the bitmap past it
+    first = (first + CHECKPOINT_UNIT - 1) / CHECKPOINT_UNIT;
+    for (uint64_t unit = 0; unit < checkpoint->units; unit++) {
+        uint64_t bit = unit - first;
+
+        if (unit < first || (bit / 8 < length - CHECKPOINT_HEADER_SIZE - 4 &&
+                             buf[CHECKPOINT_HEADER_SIZE + bit / 8] & (1 << (bit % 8)))) {
+            checkpoint->bitmap[unit / 8] |= 1 << (unit % 8);
+            last = unitEnd(checkpoint, unit);
+        }
+    }
+    free(buf);
+
+    if (fstat(checkpoint->fd, &st) < 0 || (uint64_t) st.st_size < last) {
+        fprintf(stderr, "Warning: Output is shorter than checkpoint %s, starting over\n", checkpoint->path);
+        memset(checkpoint->bitmap, 0, (checkpoint->units + 7) / 8);
+        return 0;
+    }
+    return last > 0;
+}
+
+/**
+ * @brief checkpointOpen is a function that starts the checkpoint of a resumable transfer and loads what
+ *        an earlier attempt left of it.
+ * 
+ * @param checkpoint    The checkpoint to initialize.
+ * @param path          The checkpoint file.
+ * @param fd            The output file.
+ * @param identity      The identity of the file being sent.
+ * @param flowCount     The number of flows the file is sent over.
+ * @return              1 if the output already holds some of the file, 0 if the transfer starts over.
+ */
+int checkpointOpen(struct Checkpoint *checkpoint, const char *path, int fd, const struct FileIdentity *identity,
+                   unsigned int flowCount) {
+    memset(checkpoint, 0, sizeof(*checkpoint));
+    snprintf(checkpoint->path, sizeof(checkpoint->path), "%s", path);
+    checkpoint->fd = fd;
+    checkpoint->identity = *identity;
+    checkpoint->units = (identity->length + CHECKPOINT_UNIT - 1) / CHECKPOINT_UNIT;
+    checkpoint->bitmap = calloc(checkpoint->units / 8 + 1, 1);
+    checkpoint->flows = calloc(flowCount > 0 ? flowCount : 1, sizeof(struct CheckpointFlow));
+    if (checkpoint->bitmap == NULL || checkpoint->flows == NULL) {
+        perror("Error: Failed to allocate checkpoint");
+        exit(EXIT_FAILURE);
+    }
+    checkpoint->flowCount = flowCount;
+    checkpoint->lastSave = monotonicNs();
+    if (pthread_mutex_init(&checkpoint->lock, NULL) != 0) {
+        fprintf(stderr, "Error: Failed to create checkpoint\n");
+        exit(EXIT_FAILURE);
+    }
+    return checkpointLoad(checkpoint);
+}
+
+/**
+ * @brief checkpointResume is a function that returns how many bytes from an offset on are already
+ *        written, in whole units, which is where a flow starting there resumes.
+ * 
+ * @param checkpoint    The checkpoint.
+ * @param offset        The start of the flow's range, which senders align to CHECKPOINT_UNIT.
+ */
+uint64_t checkpointResume(struct Checkpoint *checkpoint, uint64_t offset) {
+    uint64_t unit = offset / CHECKPOINT_UNIT;
+
+    if (offset % CHECKPOINT_UNIT != 0) {
+        return 0;
+    }
+    pthread_mutex_lock(&checkpoint->lock);
+    while (unit < checkpoint->units && checkpoint->bitmap[unit / 8] & (1 << (unit % 8))) {
+        unit++;
+    }
+    pthread_mutex_unlock(&checkpoint->lock);
+    return unit > offset / CHECKPOINT_UNIT ? unitEnd(checkpoint, unit - 1) - offset : 0;
+}
+
+/**
+ * @brief checkpointTrack is a function that starts following a flow, which writes from start on.
+ * 
+ * @param checkpoint    The checkpoint.
+ * @param flow          The index of the flow.
+ * @param start         The file offset of the flow's first segment.
+ */
+void checkpointTrack(struct Checkpoint *checkpoint, unsigned int flow, uint64_t start) {
+    pthread_mutex_lock(&checkpoint->lock);
+    if (flow < checkpoint->flowCount) {
+        checkpoint->flows[flow].start = start;
+        checkpoint->flows[flow].end = start;
+    }
+    pthread_mutex_unlock(&checkpoint->lock);
+}
+
+/**
+ * @brief checkpointWrite is a function that makes everything the flows have reported durable and then
+ *        replaces the checkpoint file. Only one thread at a time writes it.
+ * 
+ * @param checkpoint    The checkpoint.
+ * @return              0 on success, -1 on error.
+ */
+static int checkpointWrite(struct Checkpoint *checkpoint) {
+    char temporary[PATH_MAX + 4];
+    unsigned char *buf;
+    size_t length;
+    size_t done = 0;
+    uint64_t first = 0;
+    int failed;
+    int fd;
+
+    pthread_mutex_lock(&checkpoint->lock);
+    markFlows(checkpoint);
+    while (first < checkpoint->units && checkpoint->bitmap[first / 8] & (1 << (first % 8))) {
+        first++;
+    }
+    length = CHECKPOINT_HEADER_SIZE + (checkpoint->units - first + 7) / 8 + 4;
+    buf = calloc(length, 1);
+    if (buf == NULL) {
+        perror("Error: Failed to allocate checkpoint");
+        exit(EXIT_FAILURE);
+    }
+    memcpy(buf, CHECKPOINT_MAGIC, 8);
+    storeBigEndian(buf + 8, CHECKPOINT_UNIT, 8);
+    encodeIdentity(buf + 16, &checkpoint->identity);
+    storeBigEndian(buf + 44, first < checkpoint->units ? first * CHECKPOINT_UNIT : checkpoint->identity.length, 8);
+    storeBigEndian(buf + 52, length - CHECKPOINT_HEADER_SIZE - 4, 8);
+    for (uint64_t unit = first; unit < checkpoint->units; unit++) {
+        if (checkpoint->bitmap[unit / 8] & (1 << (unit % 8))) {
+            buf[CHECKPOINT_HEADER_SIZE + (unit - first) / 8] |= 1 << ((unit - first) % 8);
+        }
+    }
+    pthread_mutex_unlock(&checkpoint->lock);
+    storeBigEndian(buf + length - 4, crc32c(0, buf, length - 4), 4);
+
+    // The units were written before they were reported, so once the output is synced they are on disk
+    snprintf(temporary, sizeof(temporary), "%s.tmp", checkpoint->path);
+    fd = -1;
+    if (fdatasync(checkpoint->fd) == 0) {
+        fd = open(temporary, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    }
+    while (fd >= 0 && done < length) {
+        ssize_t result = write(fd, buf + done, length - done);
+
+        if (result < 0 && errno == EINTR) {
+            continue;
+        }
+        if (result <= 0) {
+            break;
+        }
+        done += result;
+    }
+    free(buf);
+
+    failed = fd < 0 || done < length || fsync(fd) < 0;
+    if (fd >= 0 && close(fd) < 0) {
+        failed = 1;
+    }
+    if (!failed && rename(temporary, checkpoint->path) < 0) {
+        failed = 1;
+    }
+    if (failed && !checkpoint->warned) {
+        fprintf(stderr, "Warning: Failed to save checkpoint %s: %s\n", checkpoint->path, strerror(errno));
+        checkpoint->warned = 1;
+    }
+    return failed ? -1 : 0;
+}
+
+/**
+ * @brief checkpointAdvance is a function that records a flow's progress after a pool thread wrote one of
+ *        its chunks, and saves the checkpoint if one is due and no other thread is saving it.
+ * 
+ * @param checkpoint    The checkpoint.
+ * @param flow          The index of the flow.
+ * @param end           The file offset the flow has written up to.
+ */
+void checkpointAdvance(struct Checkpoint *checkpoint, unsigned int flow, uint64_t end) {
+    int due;
+
+    pthread_mutex_lock(&checkpoint->lock);
+    if (flow < checkpoint->flowCount) {
+        checkpoint->flows[flow].end = end;
+    }
+    due = !checkpoint->saving && monotonicNs() - checkpoint->lastSave >= CHECKPOINT_INTERVAL_NS;
+    checkpoint->saving |= due;
+    pthread_mutex_unlock(&checkpoint->lock);
+
+    if (due) {
+        checkpointWrite(checkpoint);
+
+        pthread_mutex_lock(&checkpoint->lock);
+        checkpoint->saving = 0;
+        checkpoint->lastSave = monotonicNs();
+        pthread_mutex_unlock(&checkpoint->lock);
+    }
+}
+
+/**
+ * @brief checkpointForget is a function that drops what a flow wrote this time, once its digest showed the
+ *        bytes are not the sender's.
+ * 
+ * @param checkpoint    The checkpoint.
+ * @param flow          The index of the flow.
+ */
+void checkpointForget(struct Checkpoint *checkpoint, unsigned int flow) {
+    pthread_mutex_lock(&checkpoint->lock);
+    if (flow < checkpoint->flowCount) {
+        struct CheckpointFlow *range = &checkpoint->flows[flow];
+
+        for (uint64_t unit = (range->start + CHECKPOINT_UNIT - 1) / CHECKPOINT_UNIT;
+             unit < checkpoint->units && unitEnd(checkpoint, unit) <= range->end; unit++) {
+            checkpoint->bitmap[unit / 8] &= ~(1 << (unit % 8));
+        }
+        range->end = range->start;
+    }
+    pthread_mutex_unlock(&checkpoint->lock);
+}
+
+/**
+ * @brief checkpointSave is a function that saves the checkpoint now, unless a pool thread is saving it.
+ * 
+ * @param checkpoint    The checkpoint.
+ * @return              0 on success or if another thread is saving, -1 on error.
+ */
+int checkpointSave(struct Checkpoint *checkpoint) {
+    int result = 0;
+    int save;
+
+    pthread_mutex_lock(&checkpoint->lock);
+    save = !checkpoint->saving;
+    checkpoint->saving = 1;
+    pthread_mutex_unlock(&checkpoint->lock);
+
+    if (save) {
+        result = checkpointWrite(checkpoint);
+
+        pthread_mutex_lock(&checkpoint->lock);
+        checkpoint->saving = 0;
+        checkpoint->lastSave = monotonicNs();
+        pthread_mutex_unlock(&checkpoint->lock);
+    }
+    return result;
+}
+
+/**
+ * @brief checkpointRemove is a function that deletes the checkpoint file once the transfer is complete.
+ * 
+ * @param checkpoint    The checkpoint.
+ */
+void checkpointRemove(struct Checkpoint *checkpoint) {
+    if (unlink(checkpoint->path) < 0 && errno != ENOENT) {
+        fprintf(stderr, "Warning: Failed to remove checkpoint %s\n", checkpoint->path);
+    }
+}
+
+/**
+ * @brief checkpointDestroy is a function that frees a checkpoint no flow reports to any more.
+ * 
+ * @param checkpoint    The checkpoint.
+ */
+void checkpointDestroy(struct Checkpoint *checkpoint) {
+    free(checkpoint->bitmap);
+    free(checkpoint->flows);
+    pthread_mutex_destroy(&checkpoint->lock);
+}
@@ -0,0 +1,333 @@
+#include <string.h>
+
+#include "./include/compress.h"
+
+/**
+ * LZ block format, the LZ4 block format without its end-of-block rules. A block is a series of sequences,
+ * each a token byte, literals, and a match that copies earlier output:
+ * 
+ *   token | [literal length bytes] | literals | offset (2, little-endian) | [match length bytes]
+ * 
+ * The high nibble of the token is the literal count and the low nibble the match length minus
+ * COMPRESS_MIN_MATCH. A nibble of 15 is followed by bytes that are added to it until one is not 255. A
+ * block may end after the literals of any sequence.
+ */
+#define COMPRESS_MIN_MATCH 4
+#define COMPRESS_MAX_OFFSET 65535
+#define COMPRESS_MIN_GAIN 16            // A block must be at least 1/16 smaller than its input to be kept
+
+/**
+ * @brief read32 is a function that reads 4 bytes at any alignment.
+ * 
+ * @param data      Where to read.
+ */
+static uint32_t read32(const unsigned char *data) {
+    uint32_t value;
+
+    memcpy(&value, data, sizeof(value));
+    return value;
+}
+
+/**
+ * @brief matchLength is a function that counts how far two positions of the input hold the same bytes,
+ *        8 bytes at a time while they last.
+ * 
+ * @param src       The input.
+ * @param ref       The earlier position.
+ * @param ip        The later position.
+ * @param length    The input length.
+ */
+static size_t matchLength(const unsigned char *src, size_t ref, size_t ip, size_t length) {
+    size_t match = 0;
+
+    while (ip + match + sizeof(uint64_t) <= length) {
+        uint64_t a;
+        uint64_t b;
+
+        memcpy(&a, src + ref + match, sizeof(a));
+        memcpy(&b, src + ip + match, sizeof(b));
+        if (a != b) {
+#if defined(__GNUC__) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+            return match + (__builtin_ctzll(a ^ b) >> 3);
+#else
+            break;
+#endif
+        }
+        match += sizeof(uint64_t);
+    }
+    while (ip + match < length && src[ref + match] == src[ip + match]) {
+        match++;
+    }
+    return match;
+}
+
+/**
+ * @brief hashSequence is a function that hashes 4 bytes into the match table (Knuth's multiplicative hash).
+ * 
+ * @param sequence  The bytes.
+ */
+static uint32_t hashSequence(uint32_t sequence) {
+    return (sequence * 2654435761U) >> (32 - COMPRESS_HASH_BITS);
+}
+
+/**
+ * @brief lengthCost is a function that returns the bytes a length takes beyond its token nibble.
+ * 
+ * @param length    The literal count, or the match length minus COMPRESS_MIN_MATCH.
+ */
+static size_t lengthCost(size_t length) {
+    return length >= 15 ? 1 + (length - 15) / 255 : 0;
+}
+
+/**
+ * @brief putLength is a function that writes the bytes of a length beyond its token nibble.
+ * 
+ * @param out       Where to write.
+ * @param length    The literal count, or the match length minus COMPRESS_MIN_MATCH, at least 15.
+ * @return          Where the next byte goes.
+ */
+static unsigned char *putLength(unsigned char *out, size_t length) {
+    for (length -= 15; length >= 255; length -= 255) {
+        *out++ = 255;
+    }
+    *out++ = length;
+    return out;
+}
+
+/**
+ * @brief lzCompress is a function that compresses as much of its input as fits in the output: a greedy
+ *        parse against a table of the last position of each 4-byte sequence, which steps faster through
+ *        data that keeps failing to match. When the next sequence would not fit the block ends with as
+ *        many literals as still do. The table is not cleared between blocks: an entry left by an earlier
+ *        block is only a candidate position before the current one, and is checked like any other.
+ * 
+ * @param table     The match table.
+ * @param src       The input.
+ * @param srcLength The input length, at most COMPRESS_MAX_RAW; set to how much of it was compressed.
+ * @param dst       The output.
+ * @param capacity  The room in the output.
+ * @return          The length of the block.
+ */
+static size_t lzCompress(uint16_t *table, const unsigned char *src, size_t *srcLength, unsigned char *dst,
+                         size_t capacity) {
+    size_t length = *srcLength;
+    size_t ip = 0;
+    size_t anchor = 0;
+    unsigned char *op = dst;
+    unsigned char *end = dst + capacity;
+    size_t literals;
+
+    while (ip + COMPRESS_MIN_MATCH <= length) {
+        uint32_t sequence = read32(src + ip);
+        uint32_t hash = hashSequence(sequence);
+        size_t ref = table[hash];
+        size_t match;
+
+        table[hash] = ip + 1;
+        if (ref == 0 || ref > ip || ip + 1 - ref > COMPRESS_MAX_OFFSET || read32(src + ref - 1) != sequence) {
+            ip += 1 + ((ip - anchor) >> 6);
+            continue;
+        }
+        ref--;
+        match = COMPRESS_MIN_MATCH + matchLength(src, ref + COMPRESS_MIN_MATCH, ip + COMPRESS_MIN_MATCH, length);
+        while (ip > anchor && ref > 0 && src[ip - 1] == src[ref - 1]) {
+            ip--;
+            ref--;
+            match++;
+        }
+
+        literals = ip - anchor;
+        if ((size_t) (end - op) < 1 + lengthCost(literals) + literals + 2 + lengthCost(match - COMPRESS_MIN_MATCH)) {
+            break;
+        }
+        *op++ = (literals < 15 ? literals : 15) << 4 |
+                (match - COMPRESS_MIN_MATCH < 15 ? match - COMPRESS_MIN_MATCH : 15);
+        if (literals >= 15) {
+            op = putLength(op, literals);
+        }
+        memcpy(op, src + anchor, literals);
+        op += literals;
+        *op++ = (ip - ref) & 0xff;
+        *op++ = (ip - ref) >> 8;
+        if (match - COMPRESS_MIN_MATCH >= 15) {
+            op = putLength(op, match - COMPRESS_MIN_MATCH);
+        }
+        ip += match;
+        anchor = ip;
+    }
+
+    // The rest goes out as literals, as far as they fit
+    literals = length - anchor;
+    if ((size_t) (end - op) < 1 + literals) {
+        literals = end - op > 1 ? (size_t) (end - op) - 1 : 0;
+    }
+    while (literals > 0 && (size_t) (end - op) < 1 + lengthCost(literals) + literals) {
+        literals--;
+    }
+    if (literals > 0) {
+        *op++ = (literals < 15 ? literals : 15) << 4;
+        if (literals >= 15) {
+            op = putLength(op, literals);
+        }
+        memcpy(op, src + anchor, literals);
+        op += literals;
+    }
+    *srcLength = anchor + literals;
+    return op - dst;
+}
+
+/**
+ * @brief lzDecompress is a function that decodes an LZ block, checking every length and offset against
+ *        both buffers so a malformed block cannot read or write out of bounds.
+ * 
+ * @param src       The block.
+ * @param length    The block length.
+ * @param dst       The output.
+ * @param capacity  The room in the output.
+ * @return          The decoded length, or -1 if the block is malformed or does not fit.
+ */
+static ssize_t lzDecompress(const unsigned char *src, size_t length, unsigned char *dst, size_t capacity) {
+    size_t ip = 0;
+    size_t op = 0;
+
+    while (ip < length) {
+        unsigned int token = src[ip++];
+        size_t literals = token >> 4;
+        size_t match = token & 15;
+        size_t offset;
+        unsigned int extra;
+
+        if (literals == 15) {
+            do {
+                if (ip >= length) {
+                    return -1;
+                }
+                extra = src[ip++];
+                literals += extra;
+            } while (extra == 255);
+        }
+        if (literals > length - ip || literals > capacity - op) {
+            return -1;
+        }
+        memcpy(dst + op, src + ip, literals);
+        ip += literals;
+        op += literals;
+        if (ip == length) {
+            break;
+        }
+
+        if (length - ip < 2) {
+            return -1;
+        }
+        offset = src[ip] | src[ip + 1] << 8;
+        ip += 2;
+        if (match == 15) {
+            do {
+                if (ip >= length) {
+                    return -1;
+                }
+                extra = src[ip++];
+                match += extra;
+            } while (extra == 255);
+        }
+        match += COMPRESS_MIN_MATCH;
+        if (offset == 0 || offset > op || match > capacity - op) {
+            return -1;
+        }
+
+        // Matches are copied 8 bytes at a time, which may write past their end when there is room for it.
+        // Overlapping matches repeat the bytes they have just written, so those need an offset of 8 or more.
+        if (offset >= sizeof(uint64_t) && capacity - op >= match + sizeof(uint64_t)) {
+            for (size_t i = 0; i < match; i += sizeof(uint64_t)) {
+                memcpy(dst + op + i, dst + op + i - offset, sizeof(uint64_t));
+            }
+        } else if (offset >= match) {
+            memcpy(dst + op, dst + op - offset, match);
+        } else {
+            for (size_t i = 0; i < match; i++) {
+                dst[op + i] = dst[op + i - offset];
+            }
+        }
+        op += match;
+    }
+    return op;
+}
+
+/**
+ * @brief compressorInit is a function that prepares a compressor.
+ * 
+ * @param compressor    The compressor to initialize.
+ */
+void compressorInit(struct Compressor *compressor) {
+    memset(compressor, 0, sizeof(*compressor));
+}
+
+/**
+ * @brief compressSegment is a function that builds the payload of a compressed flow's segment from the
+ *        file bytes at the send point: an LZ block of as many of them as compress into it, or the bytes
+ *        themselves if they do not compress.
+ * 
+ * @param compressor    The compressor.
+ * @param raw           The file bytes from the send point on.
+ * @param rawLength     How many there are, at most COMPRESS_MAX_RAW.
+ * @param payload       The payload to build.
+ * @param capacity      The room in the payload.
+ * @param rawUsed       Set to how many file bytes the payload carries.
+ * @return              The payload size.
+ */
+size_t compressSegment(struct Compressor *compressor, const void *raw, size_t rawLength, void *payload,
+                       size_t capacity, size_t *rawUsed) {
+    unsigned char *out = payload;
+    size_t length;
+
+    if (compressor->skip > 0) {
+        compressor->skip--;
+    } else {
+        *rawUsed = rawLength;
+        length = lzCompress(compressor->table, raw, rawUsed, out + 1, capacity - 1);
+        if (*rawUsed > length && *rawUsed - length > length / COMPRESS_MIN_GAIN) {
+            compressor->backoff = 0;
+            out[0] = COMPRESS_FRAME_LZ;
+            return length + 1;
+        }
+        compressor->skip = compressor->backoff;
+        compressor->backoff = compressor->backoff == 0 ? 1 : compressor->backoff * 2;
+        if (compressor->backoff > COMPRESS_MAX_SKIP) {
+            compressor->backoff = COMPRESS_MAX_SKIP;
+        }
+    }
+
+    *rawUsed = rawLength < capacity - 1 ? rawLength : capacity - 1;
+    out[0] = COMPRESS_FRAME_RAW;
+    memcpy(out + 1, raw, *rawUsed);
+    return *rawUsed + 1;
+}
+
+/**
+ * @brief decompressSegment is a function that recovers the file bytes of a compressed flow's segment.
+ * 
+ * @param payload   The payload.
+ * @param length    The payload size.
+ * @param raw       Where to put the file bytes.
+ * @param capacity  The room there, COMPRESS_MAX_RAW for any valid segment.
+ * @return          The number of file bytes, or -1 if the payload is malformed.
+ */
+ssize_t decompressSegment(const void *payload, size_t length, void *raw, size_t capacity) {
+    const unsigned char *in = payload;
+
+    if (length == 0) {
+        return -1;
+    }
+    switch (in[0]) {
+        case COMPRESS_FRAME_RAW:
+            if (length - 1 > capacity) {
+                return -1;
+            }
+            memcpy(raw, in + 1, length - 1);
+            return length - 1;
+        case COMPRESS_FRAME_LZ:
+            return lzDecompress(in + 1, length - 1, raw, capacity);
+        default:
+            return -1;
+    }
+}
@@ -0,0 +1,142 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+
+#include "./include/congestion.h"
+#include "./include/timeutil.h"
+
+static const struct CongestionOps *algorithms[] = { &renoOps, &cubicOps, &bbrOps };
+
+/**
+ * @brief ccInit is a function that sets up congestion control with the named algorithm.
+ * 
+ * @param cc        The congestion control state to initialize.
+ * @param name      The algorithm name: "reno", "cubic" or "bbr".
+ * @param mss       The maximum segment size in bytes.
+ * @return          0 on success, -1 if the algorithm is unknown.
+ */
+int ccInit(struct CongestionControl *cc, const char *name, uint64_t mss) {
+    memset(cc, 0, sizeof(*cc));
+
+    for (size_t i = 0; i < sizeof(algorithms) / sizeof(algorithms[0]); i++) {
+        if (strcmp(algorithms[i]->name, name) == 0) {
+            cc->ops = algorithms[i];
+        }
+    }
+    if (cc->ops == NULL) {
+        return -1;
+    }
+
+    cc->mss = mss;
+    cc->cwnd = CC_INITIAL_WINDOW * mss;
+    cc->ssthresh = UINT64_MAX;
+    cc->deliveredTime = monotonicNs();
+    cc->ops->init(cc);
+    return 0;
+}
+
+/**
+ * @brief ccOnAck is a function that reports newly acknowledged data to the algorithm.
+ * 
+ * @param cc                    The congestion control state.
+ * @param ackedBytes            Payload bytes newly acknowledged.
+ * @param bytesInFlight         Payload bytes still in flight.
+ * @param priorDelivered        cc->delivered when the newest acknowledged segment was sent.
+ * @param priorDeliveredTime    cc->deliveredTime when the newest acknowledged segment was sent.
+ * @param sentTime              When the newest acknowledged segment was sent (ns).
+ * @param now                   The current monotonic time (ns).
+ */
+void ccOnAck(struct CongestionControl *cc, uint64_t ackedBytes, uint64_t bytesInFlight, uint64_t priorDelivered,
+             uint64_t priorDeliveredTime, uint64_t sentTime, uint64_t now) {
+    struct AckSample sample;
+
+    cc->delivered += ackedBytes;
+    cc->deliveredTime = now;
+
+    sample.ackedBytes = ackedBytes;
+    sample.bytesInFlight = bytesInFlight;
+    sample.priorDelivered = priorDelivered;
+    sample.deliveryRate = 0;
+    if (now > priorDeliveredTime && cc->delivered > priorDelivered) {
+        sample.deliveryRate = (cc->delivered - priorDelivered) * NSEC_PER_SEC / (now - priorDeliveredTime);
+    }
+    sample.sentTime = sentTime;
+    sample.inRecovery = sentTime < cc->lossEventTime;
+    sample.now = now;
+
+    cc->ops->onAck(cc, &sample);
+}
+
+/**
+ * @brief ccOnLoss is a function that reports a lost segment. Losses of segments sent before the previous
+ *        loss event are part of that event and are not reported again.
+ * 
+ * @param cc        The congestion control state.
+ * @param sentTime  When the lost segment was sent (ns).
+ * @param now       The current monotonic time (ns).
+ * @param timeout   Whether the loss was detected by the retransmit timer.
+ * @return          1 if this started a new loss event, 0 otherwise.
+ */
+int ccOnLoss(struct CongestionControl *cc, uint64_t sentTime, uint64_t now, int timeout) {
+    if (sentTime < cc->lossEventTime) {
+        return 0;
+    }
+    cc->lossEventTime = now;
+    cc->ops->onLoss(cc, now, timeout);
+    return 1;
+}
+
+/**
+ * @brief ccOnRttSample is a function that reports a round trip time measurement.
+ * 
+ * @param cc        The congestion control state.
+ * @param rtt       The measured round trip time (ns).
+ * @param srtt      The smoothed round trip time from the connection's RTT estimator (ns).
+ * @param now       The current monotonic time (ns).
+ */
+void ccOnRttSample(struct CongestionControl *cc, uint64_t rtt, uint64_t srtt, uint64_t now) {
+    cc->srtt = srtt;
+    if (cc->minRtt == 0 || rtt < cc->minRtt) {
+        cc->minRtt = rtt;
+    }
+    if (cc->ops->onRttSample != NULL) {
+        cc->ops->onRttSample(cc, rtt, now);
+    }
+}
+
+/**
+ * @brief ccPacingRate is a function that returns the rate the algorithm wants packets paced at.
+ * 
+ * @param cc        The congestion control state.
+ * @return          Bytes per second, or 0 if the algorithm has no estimate yet.
+ */
+uint64_t ccPacingRate(struct CongestionControl *cc) {
+    return cc->ops->pacingRate(cc);
+}
+
+/**
+ * @brief ccWindowPacingRate is a function that paces window-based algorithms at twice cwnd per RTT in slow
+ *        start and 1.25 times cwnd per RTT afterwards, so each window is spread over the round trip rather
+ *        than sent as one burst.
+ * 
+ * @param cc    The congestion control state.
+ */
+uint64_t ccWindowPacingRate(struct CongestionControl *cc) {
+    if (cc->srtt == 0) {
+        return 0;
+    }
+    if (cc->cwnd < cc->ssthresh) {
+        return 2 * cc->cwnd * NSEC_PER_SEC / cc->srtt;
+    }
+    return 5 * cc->cwnd * NSEC_PER_SEC / (4 * cc->srtt);
+}
+
+/**
+ * @brief ccCwnd is a function that returns how many payload bytes may be in flight.
+ * 
+ * @param cc        The congestion control state.
+ */
+uint64_t ccCwnd(struct CongestionControl *cc) {
+    return cc->ops->cwnd(cc);
+}
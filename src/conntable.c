@@ -0,0 +1,186 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "./include/conntable.h"
+
+/**
+ * @brief connKeyMake is a function that builds the key of a connection.
+ * 
+ * @param addr      The sender's address.
+ * @param connId    The connection ID from the sender's SYN.
+ */
+struct ConnKey connKeyMake(const struct sockaddr_in *addr, uint32_t connId) {
+    struct ConnKey key;
+
+    memset(&key, 0, sizeof(key));
+    key.addr = addr->sin_addr.s_addr;
+    key.port = addr->sin_port;
+    key.connId = connId;
+    return key;
+}
+
+/**
+ * @brief connKeyHash is a function that mixes every field of a key into a bucket hash.
+ * 
+ * @param key   The key.
+ */
+static size_t connKeyHash(const struct ConnKey *key) {
+    uint64_t hash = ((uint64_t) key->addr << 32) ^ ((uint64_t) key->port << 16) ^ key->connId;
+
+    // Finalizer of SplitMix64, so nearby ports and IDs spread over the buckets
+    hash ^= hash >> 30;
+    hash *= 0xbf58476d1ce4e5b9ULL;
+    hash ^= hash >> 27;
+    hash *= 0x94d049bb133111ebULL;
+    hash ^= hash >> 31;
+    return (size_t) hash;
+}
+
+/**
+ * @brief connKeyEqual is a function that compares two keys.
+ */
+static int connKeyEqual(const struct ConnKey *a, const struct ConnKey *b) {
+    return a->addr == b->addr && a->port == b->port && a->connId == b->connId;
+}
+
+/**
+ * @brief allocateBuckets is a function that allocates an empty bucket array.
+ * 
+ * @param bucketCount   The number of buckets.
+ */
+static struct ConnEntry **allocateBuckets(size_t bucketCount) {
+    struct ConnEntry **buckets = calloc(bucketCount, sizeof(struct ConnEntry *));
+
+    if (buckets == NULL) {
+        perror("Error: Failed to allocate connection table");
+        exit(EXIT_FAILURE);
+    }
+    return buckets;
+}
+
+/**
+ * @brief connTableInit is a function that creates an empty table.
+ * 
+ * @param table     The table to initialize.
+ */
+void connTableInit(struct ConnTable *table) {
+    table->buckets = allocateBuckets(CONN_TABLE_INITIAL_BUCKETS);
+    table->bucketCount = CONN_TABLE_INITIAL_BUCKETS;
+    table->count = 0;
+}
+
+/**
+ * @brief connTableDestroy is a function that frees a table. The values are not freed.
+ * 
+ * @param table     The table to free.
+ */
+void connTableDestroy(struct ConnTable *table) {
+    for (size_t i = 0; i < table->bucketCount; i++) {
+        struct ConnEntry *entry = table->buckets[i];
+
+        while (entry != NULL) {
+            struct ConnEntry *next = entry->next;
+            free(entry);
+            entry = next;
+        }
+    }
+    free(table->buckets);
+    memset(table, 0, sizeof(*table));
+}
+
+/**
+ * @brief connTableFind is a function that looks up a connection.
+ * 
+ * @param table     The table.
+ * @param key       The key to look up.
+ * @return          The value stored under key, or NULL if there is none.
+ */
+void *connTableFind(const struct ConnTable *table, const struct ConnKey *key) {
+    struct ConnEntry *entry = table->buckets[connKeyHash(key) & (table->bucketCount - 1)];
+
+    for (; entry != NULL; entry = entry->next) {
+        if (connKeyEqual(&entry->key, key)) {
+            return entry->value;
+        }
+    }
+    return NULL;
+}
+
+/**
+ * @brief connTableGrow is a function that doubles the bucket array and rehashes every entry.
+ * 
+ * @param table     The table.
+ */
+static void connTableGrow(struct ConnTable *table) {
+    size_t bucketCount = table->bucketCount * 2;
+    struct ConnEntry **buckets = allocateBuckets(bucketCount);
+
+    for (size_t i = 0; i < table->bucketCount; i++) {
+        struct ConnEntry *entry = table->buckets[i];
+
+        while (entry != NULL) {
+            struct ConnEntry *next = entry->next;
+            size_t bucket = connKeyHash(&entry->key) & (bucketCount - 1);
+
+            entry->next = buckets[bucket];
+            buckets[bucket] = entry;
+            entry = next;
+        }
+    }
+    free(table->buckets);
+    table->buckets = buckets;
+    table->bucketCount = bucketCount;
+}
+
+/**
+ * @brief connTableInsert is a function that stores a connection under a key that is not in the table.
+ * 
+ * @param table     The table.
+ * @param key       The key.
+ * @param value     The value to store.
+ */
+void connTableInsert(struct ConnTable *table, const struct ConnKey *key, void *value) {
+    struct ConnEntry *entry = malloc(sizeof(struct ConnEntry));
+    size_t bucket;
+
+    if (entry == NULL) {
+        perror("Error: Failed to allocate connection table");
+        exit(EXIT_FAILURE);
+    }
+    if (table->count >= table->bucketCount) {
+        connTableGrow(table);
+    }
+
+    bucket = connKeyHash(key) & (table->bucketCount - 1);
+    entry->key = *key;
+    entry->value = value;
+    entry->next = table->buckets[bucket];
+    table->buckets[bucket] = entry;
+    table->count++;
+}
+
+/**
+ * @brief connTableRemove is a function that removes a connection.
+ * 
+ * @param table     The table.
+ * @param key       The key to remove.
+ * @return          The value that was stored under key, or NULL if there was none.
+ */
+void *connTableRemove(struct ConnTable *table, const struct ConnKey *key) {
+    struct ConnEntry **link = &table->buckets[connKeyHash(key) & (table->bucketCount - 1)];
+
+    for (; *link != NULL; link = &(*link)->next) {
+        struct ConnEntry *entry = *link;
+
+        if (connKeyEqual(&entry->key, key)) {
+            void *value = entry->value;
+
+            *link = entry->next;
+            free(entry);
+            table->count--;
+            return value;
+        }
+    }
+    return NULL;
+}
@@ -0,0 +1,266 @@
+#include <string.h>
+#include <pthread.h>
+
+#include "./include/crc32c.h"
+
+#if defined(__x86_64__)
+#include <nmmintrin.h>
+#endif
+
+#define CRC32C_POLY 0x82f63b78      // Castagnoli polynomial, bit-reflected
+#define CRC32C_LONG 8192            // Lane lengths of the interleaved kernel; both powers of two
+#define CRC32C_SHORT 256
+
+typedef uint32_t (*Crc32cKernel)(uint32_t crc, const unsigned char *data, size_t length);
+
+static uint32_t crc32cTable[8][256];          // Slicing-by-8 tables of the portable kernel
+static uint32_t crc32cLongShift[4][256];      // Advance a CRC over CRC32C_LONG zero bytes
+static uint32_t crc32cShortShift[4][256];     // Advance a CRC over CRC32C_SHORT zero bytes
+static Crc32cKernel crc32cKernel;
+static const char *crc32cName;
+static pthread_once_t crc32cOnce = PTHREAD_ONCE_INIT;
+
+/**
+ * @brief gf2MatrixTimes is a function that multiplies a vector by a 32x32 matrix over GF(2).
+ * 
+ * @param matrix    The matrix, one column per bit of vector.
+ * @param vector    The vector.
+ */
+static uint32_t gf2MatrixTimes(const uint32_t *matrix, uint32_t vector) {
+    uint32_t sum = 0;
+
+    for (; vector != 0; vector >>= 1, matrix++) {
+        if (vector & 1) {
+            sum ^= *matrix;
+        }
+    }
+    return sum;
+}
+
+/**
+ * @brief gf2MatrixSquare is a function that squares a 32x32 matrix over GF(2).
+ * 
+ * @param square    Filled with the square.
+ * @param matrix    The matrix.
+ */
+static void gf2MatrixSquare(uint32_t *square, const uint32_t *matrix) {
+    for (int n = 0; n < 32; n++) {
+        square[n] = gf2MatrixTimes(matrix, matrix[n]);
+    }
+}
+
+/**
+ * @brief crc32cShiftTables is a function that builds the tables that advance a CRC over a run of zero
+ *        bytes, by squaring the operator for one zero bit until it covers the run.
+ * 
+ * @param tables    Filled with one table per byte of the CRC.
+ * @param length    The number of zero bytes, a power of two.
+ */
+static void crc32cShiftTables(uint32_t tables[4][256], size_t length) {
+    uint32_t even[32];
+    uint32_t odd[32];
+    uint32_t row = 1;
+
+    odd[0] = CRC32C_POLY;
+    for (int n = 1; n < 32; n++) {
+        odd[n] = row;
+        row <<= 1;
+    }
+    gf2MatrixSquare(even, odd);     // Two zero bits
+    gf2MatrixSquare(odd, even);     // Four zero bits
+
+    // Each square doubles the run, starting from one byte
+    for (;;) {
+        gf2MatrixSquare(even, odd);
+        length >>= 1;
+        if (length == 0) {
+            break;
+        }
+        gf2MatrixSquare(odd, even);
+        length >>= 1;
+        if (length == 0) {
+            memcpy(even, odd, sizeof(even));
+            break;
+        }
+    }
+
+    for (uint32_t n = 0; n < 256; n++) {
+        tables[0][n] = gf2MatrixTimes(even, n);
+        tables[1][n] = gf2MatrixTimes(even, n << 8);
+        tables[2][n] = gf2MatrixTimes(even, n << 16);
+        tables[3][n] = gf2MatrixTimes(even, n << 24);
+    }
+}
+
+/**
+ * @brief crc32cShift is a function that advances a CRC over a run of zero bytes with its shift tables.
+ */
+static inline uint32_t crc32cShift(uint32_t tables[4][256], uint32_t crc) {
+    return tables[0][crc & 0xff] ^ tables[1][(crc >> 8) & 0xff] ^ tables[2][(crc >> 16) & 0xff] ^
+           tables[3][crc >> 24];
+}
+
+/**
+ * @brief crc32cPortable is the kernel for CPUs without a CRC instruction. It folds in eight bytes per step
+ *        with slicing-by-8 tables.
+ */
+static uint32_t crc32cPortable(uint32_t crc, const unsigned char *data, size_t length) {
+    while (length > 0 && ((uintptr_t) data & 7) != 0) {
+        crc = crc32cTable[0][(crc ^ *data++) & 0xff] ^ (crc >> 8);
+        length--;
+    }
+
+    while (length >= 8) {
+        uint64_t word;
+
+        memcpy(&word, data, sizeof(word));
+#if __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+        word = __builtin_bswap64(word);
+#endif
+        word ^= crc;
+        crc = crc32cTable[7][word & 0xff] ^ crc32cTable[6][(word >> 8) & 0xff] ^
+              crc32cTable[5][(word >> 16) & 0xff] ^ crc32cTable[4][(word >> 24) & 0xff] ^
+              crc32cTable[3][(word >> 32) & 0xff] ^ crc32cTable[2][(word >> 40) & 0xff] ^
+              crc32cTable[1][(word >> 48) & 0xff] ^ crc32cTable[0][word >> 56];
+        data += 8;
+        length -= 8;
+    }
+
+    while (length > 0) {
+        crc = crc32cTable[0][(crc ^ *data++) & 0xff] ^ (crc >> 8);
+        length--;
+    }
+    return crc;
+}
+
+#if defined(__x86_64__)
+/**
+ * @brief crc32cInterleaved is a function that runs three SSE4.2 crc32 streams over consecutive lanes of
+ *        the buffer and joins them with the shift tables. The instruction takes three cycles but a new one
+ *        can start every cycle, so three independent streams keep it busy.
+ * 
+ * @param crc       The CRC so far.
+ * @param data      Eight-byte aligned data.
+ * @param length    The length, at least three lanes.
+ * @param lane      The lane length.
+ * @param shift     The shift tables for the lane length.
+ * @param rest      Set to the length left over.
+ * @return          The CRC, with data advanced past the lanes processed.
+ */
+__attribute__((target("sse4.2")))
+static uint64_t crc32cInterleaved(uint64_t crc, const unsigned char **data, size_t length, size_t lane,
+                                  uint32_t shift[4][256], size_t *rest) {
+    const unsigned char *next = *data;
+
+    while (length >= 3 * lane) {
+        const unsigned char *end = next + lane;
+        uint64_t crc1 = 0;
+        uint64_t crc2 = 0;
+
+        do {
+            uint64_t word0, word1, word2;
+
+            memcpy(&word0, next, sizeof(word0));
+            memcpy(&word1, next + lane, sizeof(word1));
+            memcpy(&word2, next + 2 * lane, sizeof(word2));
+            crc = _mm_crc32_u64(crc, word0);
+            crc1 = _mm_crc32_u64(crc1, word1);
+            crc2 = _mm_crc32_u64(crc2, word2);
+            next += 8;
+        } while (next < end);
+
+        crc = crc32cShift(shift, (uint32_t) crc) ^ crc1;
+        crc = crc32cShift(shift, (uint32_t) crc) ^ crc2;
+        next += 2 * lane;
+        length -= 3 * lane;
+    }
+
+    *data = next;
+    *rest = length;
+    return crc;
+}
+
+/**
+ * @brief crc32cSse42 is the kernel for CPUs with the SSE4.2 crc32 instruction: interleaved streams over
+ *        long and then short lanes, and a single stream for the tail.
+ */
+__attribute__((target("sse4.2")))
+static uint32_t crc32cSse42(uint32_t crc, const unsigned char *data, size_t length) {
+    uint64_t crc0 = crc;
+
+    while (length > 0 && ((uintptr_t) data & 7) != 0) {
+        crc0 = _mm_crc32_u8((uint32_t) crc0, *data++);
+        length--;
+    }
+
+    crc0 = crc32cInterleaved(crc0, &data, length, CRC32C_LONG, crc32cLongShift, &length);
+    crc0 = crc32cInterleaved(crc0, &data, length, CRC32C_SHORT, crc32cShortShift, &length);
+
+    while (length >= 8) {
+        uint64_t word;
+
+        memcpy(&word, data, sizeof(word));
+        crc0 = _mm_crc32_u64(crc0, word);
+        data += 8;
+        length -= 8;
+    }
+    while (length > 0) {
+        crc0 = _mm_crc32_u8((uint32_t) crc0, *data++);
+        length--;
+    }
+    return (uint32_t) crc0;
+}
+#endif
+
+/**
+ * @brief crc32cSetup is a function that builds the tables and picks the fastest kernel the CPU supports.
+ */
+static void crc32cSetup(void) {
+    for (uint32_t n = 0; n < 256; n++) {
+        uint32_t crc = n;
+
+        for (int bit = 0; bit < 8; bit++) {
+            crc = crc & 1 ? (crc >> 1) ^ CRC32C_POLY : crc >> 1;
+        }
+        crc32cTable[0][n] = crc;
+    }
+    for (uint32_t n = 0; n < 256; n++) {
+        for (int k = 1; k < 8; k++) {
+            crc32cTable[k][n] = crc32cTable[0][crc32cTable[k - 1][n] & 0xff] ^ (crc32cTable[k - 1][n] >> 8);
+        }
+    }
+
+    crc32cKernel = crc32cPortable;
+    crc32cName = "portable";
+#if defined(__x86_64__)
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("sse4.2")) {
+        crc32cShiftTables(crc32cLongShift, CRC32C_LONG);
+        crc32cShiftTables(crc32cShortShift, CRC32C_SHORT);
+        crc32cKernel = crc32cSse42;
+        crc32cName = "sse4.2";
+    }
+#endif
+}
+
+/**
+ * @brief crc32c is a function that computes the CRC32C (Castagnoli) of a buffer. Calls can be chained to
+ *        cover data in pieces: crc32c(crc32c(0, a, n), b, m) is the CRC of a followed by b.
+ * 
+ * @param crc       0 to start, or the CRC of the data before this piece.
+ * @param data      The data.
+ * @param length    The length of the data.
+ * @return          The CRC.
+ */
+uint32_t crc32c(uint32_t crc, const void *data, size_t length) {
+    pthread_once(&crc32cOnce, crc32cSetup);
+    return ~crc32cKernel(~crc, data, length);
+}
+
+/**
+ * @brief crc32cImplementation is a function that names the kernel crc32c runs on this CPU.
+ */
+const char *crc32cImplementation(void) {
+    pthread_once(&crc32cOnce, crc32cSetup);
+    return crc32cName;
+}
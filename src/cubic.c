@@ -0,0 +1,121 @@
+#include <stddef.h>
+#include <stdint.h>
+#include <math.h>
+
+#include "./include/congestion.h"
+#include "./include/timeutil.h"
+
+#define CUBIC_C 0.4             // Scaling constant of the cubic function (RFC 8312)
+#define CUBIC_BETA 0.7          // Multiplicative decrease factor (RFC 8312)
+
+/**
+ * @brief cubicInit is a function that resets the CUBIC state.
+ * 
+ * @param cc    The congestion control state.
+ */
+static void cubicInit(struct CongestionControl *cc) {
+    struct CubicState *cubic = &cc->state.cubic;
+
+    cubic->wMax = 0;
+    cubic->k = 0;
+    cubic->origin = 0;
+    cubic->wEst = 0;
+    cubic->epochStart = 0;
+}
+
+/**
+ * @brief cubicOnAck is a function that grows the window along W(t) = C(t - K)^3 + Wmax in congestion
+ *        avoidance, never more slowly than Reno would, and by the bytes acknowledged in slow start.
+ * 
+ * @param cc        The congestion control state.
+ * @param sample    The ACK sample.
+ */
+static void cubicOnAck(struct CongestionControl *cc, const struct AckSample *sample) {
+    struct CubicState *cubic = &cc->state.cubic;
+    double cwnd = (double) cc->cwnd / cc->mss;
+    double acked = (double) sample->ackedBytes / cc->mss;
+    double t, target;
+
+    if (sample->inRecovery) {
+        return;
+    }
+
+    if (cc->cwnd < cc->ssthresh) {
+        cc->cwnd += sample->ackedBytes;
+        return;
+    }
+
+    if (cubic->epochStart == 0) {
+        cubic->epochStart = sample->now;
+        if (cwnd < cubic->wMax) {
+            cubic->k = cbrt((cubic->wMax - cwnd) / CUBIC_C);
+            cubic->origin = cubic->wMax;
+        } else {
+            cubic->k = 0;
+            cubic->origin = cwnd;
+        }
+        cubic->wEst = cwnd;
+    }
+
+    // Aim for where the curve will be one RTT from now
+    t = (double) (sample->now - cubic->epochStart + cc->minRtt) / NSEC_PER_SEC;
+    target = cubic->origin + CUBIC_C * (t - cubic->k) * (t - cubic->k) * (t - cubic->k);
+
+    cubic->wEst += 3.0 * (1.0 - CUBIC_BETA) / (1.0 + CUBIC_BETA) * acked / cwnd;
+    if (target < cubic->wEst) {
+        target = cubic->wEst;
+    }
+
+    if (target > cwnd) {
+        cwnd += (target - cwnd) / cwnd * acked;
+    } else {
+        cwnd += 0.01 * acked / cwnd;
+    }
+    cc->cwnd = (uint64_t) (cwnd * cc->mss);
+}
+
+/**
+ * @brief cubicOnLoss is a function that remembers the window at the loss and reduces it by CUBIC_BETA, or
+ *        to one segment on a timeout. A loss below the previous maximum lowers Wmax further so that
+ *        competing flows converge (fast convergence).
+ * 
+ * @param cc        The congestion control state.
+ * @param now       The current monotonic time (ns).
+ * @param timeout   Whether the loss was detected by the retransmit timer.
+ */
+static void cubicOnLoss(struct CongestionControl *cc, uint64_t now, int timeout) {
+    struct CubicState *cubic = &cc->state.cubic;
+    double cwnd = (double) cc->cwnd / cc->mss;
+    uint64_t reduced = (uint64_t) (cc->cwnd * CUBIC_BETA);
+
+    (void) now;
+
+    if (cwnd < cubic->wMax) {
+        cubic->wMax = cwnd * (1.0 + CUBIC_BETA) / 2.0;
+    } else {
+        cubic->wMax = cwnd;
+    }
+    cubic->epochStart = 0;
+
+    cc->ssthresh = reduced > CC_MIN_WINDOW * cc->mss ? reduced : CC_MIN_WINDOW * cc->mss;
+    cc->cwnd = timeout ? cc->mss : cc->ssthresh;
+}
+
+/**
+ * @brief cubicCwnd is a function that returns the CUBIC congestion window.
+ * 
+ * @param cc    The congestion control state.
+ */
+static uint64_t cubicCwnd(struct CongestionControl *cc) {
+    return cc->cwnd;
+}
+
+const struct CongestionOps cubicOps = {
+    .name = "cubic",
+    .init = cubicInit,
+    .onAck = cubicOnAck,
+    .onLoss = cubicOnLoss,
+    .onRttSample = NULL,
+    .pacingRate = ccWindowPacingRate,
+    .cwnd = cubicCwnd,
+};
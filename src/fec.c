@@ -0,0 +1,547 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <pthread.h>
+
+#include "./include/fec.h"
+
+#if defined(__x86_64__)
+#include <immintrin.h>
+#endif
+
+#define GF_POLY 0x11d           // x^8 + x^4 + x^3 + x^2 + 1, with 2 as a generator
+#define FEC_LOSS_GAIN 0.25      // Weight of a new sample in the smoothed loss rate
+
+typedef void (*FecKernel)(unsigned char *dst, const unsigned char *src, uint8_t coefficient, size_t length);
+
+static uint8_t gfExp[2 * 255];
+static uint8_t gfLog[256];
+static uint8_t gfNibbles[256][2][16];     // Products of each coefficient with every low and high nibble
+static uint8_t fecCoefficients[FEC_MAX_PARITY][FEC_MAX_BLOCK];
+static FecKernel fecKernel;
+static const char *fecName;
+static pthread_once_t fecOnce = PTHREAD_ONCE_INIT;
+
+/**
+ * @brief gfMul is a function that multiplies two elements of GF(2^8).
+ */
+static uint8_t gfMul(uint8_t a, uint8_t b) {
+    if (a == 0 || b == 0) {
+        return 0;
+    }
+    return gfExp[gfLog[a] + gfLog[b]];
+}
+
+/**
+ * @brief gfInv is a function that returns the multiplicative inverse of a non-zero element of GF(2^8).
+ */
+static uint8_t gfInv(uint8_t a) {
+    return gfExp[255 - gfLog[a]];
+}
+
+/**
+ * @brief gfMulSize is a function that multiplies both bytes of a payload size by a coefficient, which is
+ *        how sizes are coded alongside the payloads.
+ */
+static uint16_t gfMulSize(uint8_t coefficient, uint16_t size) {
+    return (uint16_t) (gfMul(coefficient, size >> 8) << 8 | gfMul(coefficient, size & 0xff));
+}
+
+/**
+ * @brief gfInvert is a function that inverts a square matrix over GF(2^8) by Gauss-Jordan elimination.
+ * 
+ * @param matrix    The matrix, destroyed on return.
+ * @param inverse   Filled with the inverse.
+ * @param n         The order of the matrix.
+ * @return          0 on success, -1 if the matrix is singular.
+ */
+static int gfInvert(uint8_t matrix[][FEC_MAX_PARITY], uint8_t inverse[][FEC_MAX_PARITY], unsigned int n) {
+    for (unsigned int row = 0; row < n; row++) {
+        memset(inverse[row], 0, n);
+        inverse[row][row] = 1;
+    }
+
+    for (unsigned int col = 0; col < n; col++) {
+        unsigned int pivot = col;
+        uint8_t scale;
+
+        while (pivot < n && matrix[pivot][col] == 0) {
+            pivot++;
+        }
+        if (pivot == n) {
+            return -1;
+        }
+        for (unsigned int k = 0; k < n && pivot != col; k++) {
+            uint8_t swap = matrix[col][k];
+            matrix[col][k] = matrix[pivot][k];
+            matrix[pivot][k] = swap;
+            swap = inverse[col][k];
+            inverse[col][k] = inverse[pivot][k];
+            inverse[pivot][k] = swap;
+        }
+
+        scale = gfInv(matrix[col][col]);
+        for (unsigned int k = 0; k < n; k++) {
+            matrix[col][k] = gfMul(matrix[col][k], scale);
+            inverse[col][k] = gfMul(inverse[col][k], scale);
+        }
+        for (unsigned int row = 0; row < n; row++) {
+            uint8_t factor = matrix[row][col];
+
+            if (row == col || factor == 0) {
+                continue;
+            }
+            for (unsigned int k = 0; k < n; k++) {
+                matrix[row][k] ^= gfMul(factor, matrix[col][k]);
+                inverse[row][k] ^= gfMul(factor, inverse[col][k]);
+            }
+        }
+    }
+    return 0;
+}
+
+/**
+ * @brief fecMulAddPortable is the kernel for CPUs without byte shuffles. A coefficient of 1, which is all
+ *        of the XOR row, is a plain XOR eight bytes at a time; others look up both nibbles of each byte.
+ */
+static void fecMulAddPortable(unsigned char *dst, const unsigned char *src, uint8_t coefficient, size_t length) {
+    const uint8_t *low = gfNibbles[coefficient][0];
+    const uint8_t *high = gfNibbles[coefficient][1];
+    size_t i = 0;
+
+    if (coefficient == 1) {
+        for (; i + 8 <= length; i += 8) {
+            uint64_t a, b;
+
+            memcpy(&a, dst + i, sizeof(a));
+            memcpy(&b, src + i, sizeof(b));
+            a ^= b;
+            memcpy(dst + i, &a, sizeof(a));
+        }
+    }
+    for (; i < length; i++) {
+        dst[i] ^= low[src[i] & 0x0f] ^ high[src[i] >> 4];
+    }
+}
+
+#if defined(__x86_64__)
+/**
+ * @brief fecMulAddSsse3 is the SSSE3 kernel: pshufb looks up the products of sixteen low and sixteen high
+ *        nibbles at once.
+ */
+__attribute__((target("ssse3")))
+static void fecMulAddSsse3(unsigned char *dst, const unsigned char *src, uint8_t coefficient, size_t length) {
+    __m128i low = _mm_loadu_si128((const __m128i *) gfNibbles[coefficient][0]);
+    __m128i high = _mm_loadu_si128((const __m128i *) gfNibbles[coefficient][1]);
+    __m128i mask = _mm_set1_epi8(0x0f);
+    size_t i = 0;
+
+    for (; i + 16 <= length; i += 16) {
+        __m128i in = _mm_loadu_si128((const __m128i *) (src + i));
+        __m128i product = _mm_xor_si128(_mm_shuffle_epi8(low, _mm_and_si128(in, mask)),
+                                        _mm_shuffle_epi8(high, _mm_and_si128(_mm_srli_epi64(in, 4), mask)));
+
+        _mm_storeu_si128((__m128i *) (dst + i), _mm_xor_si128(_mm_loadu_si128((const __m128i *) (dst + i)), product));
+    }
+    fecMulAddPortable(dst + i, src + i, coefficient, length - i);
+}
+
+/**
+ * @brief fecMulAddAvx2 is the AVX2 kernel: the SSSE3 lookup on 32 bytes at a time.
+ */
+__attribute__((target("avx2")))
+static void fecMulAddAvx2(unsigned char *dst, const unsigned char *src, uint8_t coefficient, size_t length) {
+    __m256i low = _mm256_broadcastsi128_si256(_mm_loadu_si128((const __m128i *) gfNibbles[coefficient][0]));
+    __m256i high = _mm256_broadcastsi128_si256(_mm_loadu_si128((const __m128i *) gfNibbles[coefficient][1]));
+    __m256i mask = _mm256_set1_epi8(0x0f);
+    size_t i = 0;
+
+    for (; i + 32 <= length; i += 32) {
+        __m256i in = _mm256_loadu_si256((const __m256i *) (src + i));
+        __m256i product = _mm256_xor_si256(_mm256_shuffle_epi8(low, _mm256_and_si256(in, mask)),
+                                           _mm256_shuffle_epi8(high, _mm256_and_si256(_mm256_srli_epi64(in, 4), mask)));
+
+        _mm256_storeu_si256((__m256i *) (dst + i),
+                            _mm256_xor_si256(_mm256_loadu_si256((const __m256i *) (dst + i)), product));
+    }
+    fecMulAddPortable(dst + i, src + i, coefficient, length - i);
+}
+#endif
+
+/**
+ * @brief fecSetup is a function that builds the field tables and the code, and picks the fastest kernel
+ *        the CPU supports. The code is a Cauchy matrix 1 / (x_j + y_i) with x_j = FEC_MAX_BLOCK + j and
+ *        y_i = i, each column scaled so that row 0 is all ones. Scaling columns keeps every square
+ *        submatrix invertible, so any n parity rows rebuild any n missing segments.
+ */
+static void fecSetup(void) {
+    unsigned int x = 1;
+
+    for (int i = 0; i < 255; i++) {
+        gfExp[i] = x;
+        gfExp[i + 255] = x;
+        gfLog[x] = i;
+        x <<= 1;
+        if (x & 0x100) {
+            x ^= GF_POLY;
+        }
+    }
+    for (unsigned int c = 0; c < 256; c++) {
+        for (unsigned int n = 0; n < 16; n++) {
+            gfNibbles[c][0][n] = gfMul(c, n);
+            gfNibbles[c][1][n] = gfMul(c, n << 4);
+        }
+    }
+    for (unsigned int row = 0; row < FEC_MAX_PARITY; row++) {
+        for (unsigned int col = 0; col < FEC_MAX_BLOCK; col++) {
+            fecCoefficients[row][col] = gfMul(FEC_MAX_BLOCK ^ col, gfInv((FEC_MAX_BLOCK + row) ^ col));
+        }
+    }
+
+    fecKernel = fecMulAddPortable;
+    fecName = "portable";
+#if defined(__x86_64__)
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2")) {
+        fecKernel = fecMulAddAvx2;
+        fecName = "avx2";
+    } else if (__builtin_cpu_supports("ssse3")) {
+        fecKernel = fecMulAddSsse3;
+        fecName = "ssse3";
+    }
+#endif
+}
+
+/**
+ * @brief fecMulAdd is a function that adds a multiple of one buffer to another in GF(2^8).
+ * 
+ * @param dst           The buffer added to.
+ * @param src           The buffer multiplied.
+ * @param coefficient   The multiplier.
+ * @param length        The length of both buffers.
+ */
+void fecMulAdd(unsigned char *dst, const unsigned char *src, uint8_t coefficient, size_t length) {
+    pthread_once(&fecOnce, fecSetup);
+    if (coefficient != 0) {
+        fecKernel(dst, src, coefficient, length);
+    }
+}
+
+/**
+ * @brief fecEncode is a function that computes one parity segment of a block. Shorter segments count as
+ *        zero-padded to the longest, and their sizes are coded the same way so the receiver can restore
+ *        them.
+ * 
+ * @param row           The parity row, below FEC_MAX_PARITY.
+ * @param data          The payloads of the block's segments.
+ * @param sizes         Their sizes.
+ * @param count         The number of segments, at most FEC_MAX_BLOCK.
+ * @param parity        Filled with the parity payload; as large as the largest segment.
+ * @param codedSize     Set to the coded sizes.
+ * @return              The length of the parity payload.
+ */
+size_t fecEncode(unsigned int row, const void *const *data, const size_t *sizes, unsigned int count,
+                 unsigned char *parity, uint16_t *codedSize) {
+    size_t length = 0;
+    uint16_t size = 0;
+
+    pthread_once(&fecOnce, fecSetup);
+    for (unsigned int i = 0; i < count; i++) {
+        if (sizes[i] > length) {
+            length = sizes[i];
+        }
+    }
+
+    memset(parity, 0, length);
+    for (unsigned int i = 0; i < count; i++) {
+        uint8_t coefficient = fecCoefficients[row][i];
+
+        fecKernel(parity, data[i], coefficient, sizes[i]);
+        size ^= gfMulSize(coefficient, sizes[i]);
+    }
+    *codedSize = size;
+    return length;
+}
+
+/**
+ * @brief fecEncoderInit is a function that starts the sender side of FEC with no loss measured yet.
+ * 
+ * @param encoder       The encoder.
+ * @param blockSize     Data segments per block.
+ * @param maxParity     The most parity segments a block may get.
+ */
+void fecEncoderInit(struct FecEncoder *encoder, unsigned int blockSize, unsigned int maxParity) {
+    memset(encoder, 0, sizeof(*encoder));
+    encoder->blockSize = blockSize;
+    encoder->maxParity = maxParity;
+}
+
+/**
+ * @brief fecEncoderSample is a function that folds the losses since the last sample into the smoothed
+ *        loss rate once FEC_SAMPLE_SEGMENTS more data segments have been sent.
+ * 
+ * @param encoder   The encoder.
+ * @param sent      Data segments sent so far, retransmissions included.
+ * @param lost      Data segments lost so far, whether they were retransmitted or rebuilt from parity.
+ */
+void fecEncoderSample(struct FecEncoder *encoder, uint64_t sent, uint64_t lost) {
+    double sample;
+
+    if (sent - encoder->sampleSent < FEC_SAMPLE_SEGMENTS) {
+        return;
+    }
+    sample = lost > encoder->sampleLost ? (double) (lost - encoder->sampleLost) / (sent - encoder->sampleSent) : 0;
+    if (sample > 1) {
+        sample = 1;
+    }
+    encoder->lossRate += FEC_LOSS_GAIN * (sample - encoder->lossRate);
+    encoder->sampleSent = sent;
+    encoder->sampleLost = lost;
+}
+
+/**
+ * @brief fecEncoderParity is a function that returns how many parity segments the next block gets: the
+ *        fewest for which losing more of the block's segments, at the smoothed loss rate, is less likely
+ *        than FEC_TARGET_FAILURE. A clean path gets none.
+ * 
+ * @param encoder   The encoder.
+ */
+unsigned int fecEncoderParity(const struct FecEncoder *encoder) {
+    double p = encoder->lossRate;
+    unsigned int n = encoder->blockSize;
+    unsigned int parity = 0;
+    double pmf;
+    double tail;
+
+    if (p <= 0) {
+        return 0;
+    }
+    if (p >= 1) {
+        return encoder->maxParity;
+    }
+
+    // Binomial probabilities of exactly and more than parity losses in the block
+    pmf = pow(1 - p, n);
+    tail = 1 - pmf;
+    while (parity < encoder->maxParity && parity < n && tail > FEC_TARGET_FAILURE) {
+        pmf *= (double) (n - parity) / (parity + 1) * p / (1 - p);
+        tail -= pmf;
+        parity++;
+    }
+    return parity;
+}
+
+/**
+ * @brief fecDecoderInit is a function that allocates parity storage for every block a reassembly ring can
+ *        hold.
+ * 
+ * @param decoder       The decoder.
+ * @param capacity      The capacity of the ring in segments.
+ * @param blockSize     Data segments per block.
+ * @param maxParity     The most parity segments a block may get.
+ * @param mss           The largest payload.
+ */
+void fecDecoderInit(struct FecDecoder *decoder, uint32_t capacity, uint32_t blockSize, unsigned int maxParity,
+                    size_t mss) {
+    unsigned char *parity;
+
+    pthread_once(&fecOnce, fecSetup);
+    decoder->blockCount = capacity / blockSize + 2;
+    decoder->blockSize = blockSize;
+    decoder->maxParity = maxParity;
+    decoder->mss = mss;
+    decoder->repaired = 0;
+    decoder->blocks = calloc(decoder->blockCount, sizeof(struct FecBlock));
+    parity = malloc((size_t) decoder->blockCount * maxParity * mss);
+    decoder->scratch = malloc((maxParity + 1) * mss);
+    if (decoder->blocks == NULL || parity == NULL || decoder->scratch == NULL) {
+        perror("Error: Failed to allocate FEC decoder");
+        exit(EXIT_FAILURE);
+    }
+    for (uint32_t i = 0; i < decoder->blockCount; i++) {
+        decoder->blocks[i].parity = parity + (size_t) i * maxParity * mss;
+    }
+}
+
+/**
+ * @brief fecDecoderDestroy is a function that frees a decoder.
+ * 
+ * @param decoder   The decoder.
+ */
+void fecDecoderDestroy(struct FecDecoder *decoder) {
+    if (decoder->blocks != NULL) {
+        free(decoder->blocks[0].parity);
+    }
+    free(decoder->blocks);
+    free(decoder->scratch);
+    decoder->blocks = NULL;
+    decoder->scratch = NULL;
+}
+
+/**
+ * @brief fecDecoderStore is a function that keeps a parity segment for its block and rebuilds the block if
+ *        it now can be. Parity for a block that is already complete or does not fit the ring is dropped.
+ * 
+ * @param decoder       The decoder.
+ * @param buffer        The reassembly ring.
+ * @param firstSeq      The first segment of the block.
+ * @param count         The number of segments in the block.
+ * @param row           The parity row.
+ * @param codedSize     The coded sizes of the block's segments.
+ * @param data          The parity payload.
+ * @param length        Its length.
+ * @return              The number of segments rebuilt.
+ */
+unsigned int fecDecoderStore(struct FecDecoder *decoder, struct ReassemblyBuffer *buffer, uint32_t firstSeq,
+                             unsigned int count, unsigned int row, uint16_t codedSize, const void *data,
+                             size_t length) {
+    struct FecBlock *block;
+
+    if (row >= decoder->maxParity || count == 0 || count > decoder->blockSize || length > decoder->mss ||
+        firstSeq < buffer->firstSeq || (firstSeq - buffer->firstSeq) % decoder->blockSize != 0) {
+        return 0;
+    }
+    if (firstSeq + count <= buffer->cumulative || firstSeq + count - buffer->written > buffer->capacity) {
+        return 0;
+    }
+
+    block = &decoder->blocks[(firstSeq - buffer->firstSeq) / decoder->blockSize % decoder->blockCount];
+    if (block->firstSeq != firstSeq) {
+        block->firstSeq = firstSeq;
+        block->count = count;
+        block->rows = 0;
+    }
+    if (block->count != count || (block->rows & (1u << row))) {
+        return 0;
+    }
+
+    memcpy(block->parity + row * decoder->mss, data, length);
+    block->lengths[row] = length;
+    block->codedSizes[row] = codedSize;
+    block->rows |= 1u << row;
+    return fecDecoderRepair(decoder, buffer, firstSeq);
+}
+
+/**
+ * @brief fecDecoderRepair is a function that rebuilds the missing segments of a block once it holds at
+ *        least as many parity segments. Each parity row, less the segments that did arrive, leaves a
+ *        syndrome that combines only the missing ones; inverting their columns of the code recovers them.
+ *        The ring keeps every segment of a block with a hole, so the block is always there to subtract.
+ * 
+ * @param decoder   The decoder.
+ * @param buffer    The reassembly ring.
+ * @param seqNum    Any segment of the block, such as one that just arrived.
+ * @return          The number of segments rebuilt and stored in the ring.
+ */
+unsigned int fecDecoderRepair(struct FecDecoder *decoder, struct ReassemblyBuffer *buffer, uint32_t seqNum) {
+    uint8_t matrix[FEC_MAX_PARITY][FEC_MAX_PARITY];
+    uint8_t inverse[FEC_MAX_PARITY][FEC_MAX_PARITY];
+    unsigned int missing[FEC_MAX_PARITY];
+    unsigned int rows[FEC_MAX_PARITY];
+    uint16_t sizes[FEC_MAX_PARITY];
+    unsigned int missingCount = 0;
+    unsigned int held;
+    unsigned char *out = decoder->scratch + decoder->maxParity * decoder->mss;
+    struct FecBlock *block;
+    uint32_t firstSeq;
+    size_t length = 0;
+
+    if (seqNum < buffer->firstSeq) {
+        return 0;
+    }
+    firstSeq = seqNum - (seqNum - buffer->firstSeq) % decoder->blockSize;
+    block = &decoder->blocks[(firstSeq - buffer->firstSeq) / decoder->blockSize % decoder->blockCount];
+    if (block->firstSeq != firstSeq || block->rows == 0) {
+        return 0;
+    }
+    if (firstSeq < buffer->written) {
+        block->firstSeq = 0;
+        return 0;
+    }
+
+    held = __builtin_popcount(block->rows);
+    for (unsigned int i = 0; i < block->count; i++) {
+        if (!reassemblyHeld(buffer, firstSeq + i)) {
+            if (missingCount == held) {
+                return 0;
+            }
+            missing[missingCount++] = i;
+        }
+    }
+    if (missingCount == 0) {
+        block->firstSeq = 0;
+        return 0;
+    }
+
+    for (unsigned int row = 0, n = 0; n < missingCount; row++) {
+        if (block->rows & (1u << row)) {
+            rows[n++] = row;
+            if (block->lengths[row] > length) {
+                length = block->lengths[row];
+            }
+        }
+    }
+
+    // Syndromes: each parity row with the contribution of every segment that arrived taken out
+    for (unsigned int j = 0; j < missingCount; j++) {
+        unsigned char *syndrome = decoder->scratch + j * decoder->mss;
+        const unsigned char *parity = block->parity + rows[j] * decoder->mss;
+
+        memcpy(syndrome, parity, block->lengths[rows[j]]);
+        memset(syndrome + block->lengths[rows[j]], 0, length - block->lengths[rows[j]]);
+        sizes[j] = block->codedSizes[rows[j]];
+
+        for (unsigned int i = 0, k = 0; i < block->count; i++) {
+            uint8_t coefficient = fecCoefficients[rows[j]][i];
+            const char *data;
+            ssize_t dataSize;
+
+            if (k < missingCount && missing[k] == i) {
+                matrix[j][k++] = coefficient;
+                continue;
+            }
+            data = reassemblySegment(buffer, firstSeq + i, &dataSize);
+            if ((size_t) dataSize > length) {
+                block->firstSeq = 0;
+                return 0;
+            }
+            fecKernel(syndrome, (const unsigned char *) data, coefficient, dataSize);
+            sizes[j] ^= gfMulSize(coefficient, dataSize);
+        }
+    }
+
+    if (gfInvert(matrix, inverse, missingCount) < 0) {
+        block->firstSeq = 0;
+        return 0;
+    }
+
+    for (unsigned int k = 0; k < missingCount; k++) {
+        uint16_t size = 0;
+
+        memset(out, 0, length);
+        for (unsigned int j = 0; j < missingCount; j++) {
+            fecMulAdd(out, decoder->scratch + j * decoder->mss, inverse[k][j], length);
+            size ^= gfMulSize(inverse[k][j], sizes[j]);
+        }
+
+        // A size past the parity means the block was mixed up with another; the sender resends it instead
+        if (size > length) {
+            block->firstSeq = 0;
+            return k;
+        }
+        reassemblyStore(buffer, firstSeq + missing[k], out, size);
+        decoder->repaired++;
+    }
+
+    block->firstSeq = 0;
+    return missingCount;
+}
+
+/**
+ * @brief fecImplementation is a function that names the kernel GF(2^8) arithmetic runs on this CPU.
+ */
+const char *fecImplementation(void) {
+    pthread_once(&fecOnce, fecSetup);
+    return fecName;
+}
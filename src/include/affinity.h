@@ -0,0 +1,19 @@
+#ifndef AFFINITY_H
+#define AFFINITY_H
+
+#include <pthread.h>
+
+#define AFFINITY_MAX_CPUS 1024
+
+/**
+ * CPUs threads are pinned to, from a list such as "0-3,8". Threads take them in turn by index.
+ */
+struct CpuList {
+    unsigned int    count;          // 0 when threads are not pinned
+    unsigned int    cpus[AFFINITY_MAX_CPUS];
+};
+
+int cpuListParse(struct CpuList *list, const char *spec);
+void threadPin(pthread_t thread, const struct CpuList *list, unsigned int index);
+
+#endif
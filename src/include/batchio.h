@@ -0,0 +1,53 @@
+#ifndef BATCHIO_H
+#define BATCHIO_H
+
+#include <stddef.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+
+#include "bufpool.h"
+
+#define BATCH_DEFAULT_SIZE 32
+#define BATCH_MAX_SIZE 1024
+#define BATCH_GSO_MAX_SEGMENTS 64       // Kernel limit on datagrams per UDP_SEGMENT send or UDP_GRO receive
+#define BATCH_GSO_MAX_BYTES 65507       // Largest UDP payload over IPv4
+
+/**
+ * A set of datagram buffers that are sent with one sendmmsg or filled with one recvmmsg.
+ */
+struct BatchIO {
+    struct mmsghdr      *msgs;
+    struct iovec        *iovs;      // Two per datagram: its buffer and an optional attached payload
+    struct sockaddr_in  *addrs;
+    char                *buffers;
+    char                **slots;    // Buffer of each message when they come from a pool, NULL otherwise
+    struct BufferPool   *pool;
+    char                *controls;  // Ancillary data space, one slot per message
+    struct mmsghdr      *groups;    // Messages that each carry a run of queued datagrams, with UDP_SEGMENT
+    struct iovec        *datagrams; // Received datagrams, several per buffer when the kernel coalesced them
+    unsigned int        *sources;   // Message each received datagram came in, or first datagram of each group
+    size_t              bufSize;
+    unsigned int        capacity;
+    unsigned int        count;      // Datagrams queued for sending, or received by the last batchReceive
+    int                 gso;        // Queued datagrams are sent as UDP_SEGMENT super-buffers
+    int                 gro;        // Coalesced UDP_GRO buffers are split on receive
+};
+
+void batchInit(struct BatchIO *batch, unsigned int capacity, size_t bufSize);
+void batchDestroy(struct BatchIO *batch);
+int batchEnableGso(int sockfd, struct BatchIO *batch);
+int batchEnableGro(int sockfd, struct BatchIO *batch);
+void batchUsePool(struct BatchIO *batch, struct BufferPool *pool);
+int batchDetach(struct BatchIO *batch, unsigned int index);
+void *batchBuffer(struct BatchIO *batch, unsigned int index);
+void *batchData(struct BatchIO *batch, unsigned int index);
+size_t batchLength(struct BatchIO *batch, unsigned int index);
+struct sockaddr_in *batchAddress(struct BatchIO *batch, unsigned int index);
+void *batchNext(struct BatchIO *batch);
+void batchQueue(struct BatchIO *batch, size_t length, const struct sockaddr_in *addr, socklen_t addrLen);
+void batchAttach(struct BatchIO *batch, unsigned int index, const void *data, size_t length);
+int batchFull(struct BatchIO *batch);
+int batchFlush(int sockfd, struct BatchIO *batch);
+int batchReceive(int sockfd, struct BatchIO *batch, int flags);
+
+#endif
@@ -0,0 +1,36 @@
+#ifndef BUFPOOL_H
+#define BUFPOOL_H
+
+#include <stddef.h>
+#include <pthread.h>
+
+#define BUFPOOL_CACHE_LINE 64
+#define BUFPOOL_CHUNK_BYTES (2 * 1024 * 1024)   // Buffers are carved from chunks of one huge page
+#define BUFPOOL_CACHE_SIZE 64                   // Buffers each thread keeps for itself
+#define BUFPOOL_BATCH 32                        // Buffers moved between a thread and the shared list at once
+
+/**
+ * Fixed-size packet buffers, cache-line aligned and carved from chunks that are mapped and touched up
+ * front, so taking or returning one never allocates or faults. Each thread keeps a small free list of
+ * its own and only takes the pool lock to move BUFPOOL_BATCH buffers at a time to or from the shared
+ * list, so a buffer taken by one thread and returned by another costs no more than a local one. The
+ * pool grows by a chunk when every buffer is in use and never shrinks, so its users bound what they
+ * hold; the chunk is mapped before the lock is taken. A thread keeps the buffers on its list until it
+ * moves on to another pool, so a pool is only destroyed once its threads are done with it.
+ */
+struct BufferPool {
+    size_t          bufSize;        // Rounded up to a cache line
+    size_t          chunkBytes;
+    int             hugePages;      // Chunks are mapped with MAP_HUGETLB while the kernel has huge pages
+    pthread_mutex_t lock;           // Guards everything below
+    void            *free;          // Shared free list, linked through the first bytes of each buffer
+    void            **chunks;
+    unsigned int    chunkCount;
+};
+
+void bufferPoolInit(struct BufferPool *pool, size_t bufSize, size_t count, int hugePages);
+void bufferPoolDestroy(struct BufferPool *pool);
+void *bufferGet(struct BufferPool *pool);
+void bufferPut(struct BufferPool *pool, void *buf);
+
+#endif
@@ -0,0 +1,57 @@
+#ifndef CHECKPOINT_H
+#define CHECKPOINT_H
+
+#include <stdint.h>
+#include <limits.h>
+#include <pthread.h>
+
+#include "packet.h"
+#include "timeutil.h"
+
+#define CHECKPOINT_UNIT ((uint64_t) PACKET_DEFAULT_PAYLOAD * 1024)  // Bytes per bitmap bit; senders align ranges to it
+#define CHECKPOINT_INTERVAL_NS (2 * NSEC_PER_SEC)   // How often progress is made durable and saved
+#define CHECKPOINT_SAMPLE_BYTES (1024 * 1024)       // Bytes hashed at each end of a file for its identity
+#define CHECKPOINT_SUFFIX ".ckpt"
+
+/**
+ * The bytes one flow has written this time: start..end-1 of the file.
+ */
+struct CheckpointFlow {
+    uint64_t    start;
+    uint64_t    end;
+};
+
+/**
+ * Receiver-side record of how much of a resumable transfer is durably on disk, kept next to the output
+ * file. It holds the file identity, the offset below which every byte is written and a bitmap of the
+ * CHECKPOINT_UNIT units past it that are written too, such as the start of another flow's range. A rerun
+ * of the same file resumes each flow after the units its range already has. Flows report every chunk they
+ * write, and whichever pool thread finds a save due syncs the output and replaces the file.
+ */
+struct Checkpoint {
+    char                    path[PATH_MAX];
+    int                     fd;             // The output file, synced before every save
+    struct FileIdentity     identity;
+    uint64_t                units;
+    unsigned char           *bitmap;        // Bit u is set once unit u is durably written
+    struct CheckpointFlow   *flows;
+    unsigned int            flowCount;
+    pthread_mutex_t         lock;           // Guards everything below and the flows
+    uint64_t                lastSave;       // Monotonic time of the last save (ns)
+    int                     saving;
+    int                     warned;
+};
+
+int checkpointIdentify(const char *filename, uint64_t length, struct FileIdentity *identity);
+uint32_t checkpointKey(const struct FileIdentity *identity);
+int checkpointOpen(struct Checkpoint *checkpoint, const char *path, int fd, const struct FileIdentity *identity,
+                   unsigned int flowCount);
+uint64_t checkpointResume(struct Checkpoint *checkpoint, uint64_t offset);
+void checkpointTrack(struct Checkpoint *checkpoint, unsigned int flow, uint64_t start);
+void checkpointAdvance(struct Checkpoint *checkpoint, unsigned int flow, uint64_t end);
+void checkpointForget(struct Checkpoint *checkpoint, unsigned int flow);
+int checkpointSave(struct Checkpoint *checkpoint);
+void checkpointRemove(struct Checkpoint *checkpoint);
+void checkpointDestroy(struct Checkpoint *checkpoint);
+
+#endif
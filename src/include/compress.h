@@ -0,0 +1,35 @@
+#ifndef COMPRESS_H
+#define COMPRESS_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/types.h>
+
+#define COMPRESS_MAX_RAW (32 * 1024)    // File bytes one segment may carry, and what one decompresses to
+#define COMPRESS_HASH_BITS 12
+#define COMPRESS_MAX_SKIP 64            // Most segments sent raw without trying after incompressible data
+
+/**
+ * The first payload byte of every segment of a compressed flow says how the rest is encoded.
+ */
+#define COMPRESS_FRAME_RAW 0            // The file bytes as they are
+#define COMPRESS_FRAME_LZ 1             // An LZ block, see compress.c
+
+/**
+ * Compresses segment payloads one at a time. Each block only refers to itself, so every segment can be
+ * decoded on its own whatever happened to the others. Blocks that do not shrink by enough are sent raw,
+ * and after one the next few segments are sent raw without trying, twice as many each time up to
+ * COMPRESS_MAX_SKIP, so incompressible data costs little CPU.
+ */
+struct Compressor {
+    uint16_t        table[1 << COMPRESS_HASH_BITS];     // Last position + 1 of each hashed 4-byte sequence, 0 for none
+    unsigned int    skip;           // Segments left to send raw without trying
+    unsigned int    backoff;        // Segments to skip after the next one that does not compress
+};
+
+void compressorInit(struct Compressor *compressor);
+size_t compressSegment(struct Compressor *compressor, const void *raw, size_t rawLength, void *payload,
+                       size_t capacity, size_t *rawUsed);
+ssize_t decompressSegment(const void *payload, size_t length, void *raw, size_t capacity);
+
+#endif
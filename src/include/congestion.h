@@ -0,0 +1,99 @@
+#ifndef CONGESTION_H
+#define CONGESTION_H
+
+#include <stdint.h>
+
+#define CC_INITIAL_WINDOW 10    // Initial congestion window in segments
+#define CC_MIN_WINDOW 2         // Smallest congestion window after a fast retransmit, in segments
+
+struct CongestionControl;
+
+/**
+ * What the sender learned from one ACK.
+ */
+struct AckSample {
+    uint64_t    ackedBytes;     // Payload bytes newly acknowledged
+    uint64_t    bytesInFlight;  // Payload bytes still in flight after the ACK
+    uint64_t    priorDelivered; // Bytes delivered when the newest acknowledged segment was sent
+    uint64_t    deliveryRate;   // Delivery rate measured over that segment's flight in bytes/s, 0 if unknown
+    uint64_t    sentTime;       // Send time of the newest acknowledged segment (ns)
+    int         inRecovery;     // The segment was sent before the last loss event
+    uint64_t    now;
+};
+
+/**
+ * Operations every congestion control algorithm provides. cwnd and pacingRate are read by the send thread
+ * before each transmission, the other hooks are driven by the ACK loop and the retransmit timer.
+ */
+struct CongestionOps {
+    const char  *name;
+    void        (*init)(struct CongestionControl *cc);
+    void        (*onAck)(struct CongestionControl *cc, const struct AckSample *sample);
+    void        (*onLoss)(struct CongestionControl *cc, uint64_t now, int timeout);
+    void        (*onRttSample)(struct CongestionControl *cc, uint64_t rtt, uint64_t now);
+    uint64_t    (*pacingRate)(struct CongestionControl *cc);
+    uint64_t    (*cwnd)(struct CongestionControl *cc);
+};
+
+struct RenoState {
+    uint64_t    bytesAcked;     // Bytes acknowledged toward the next congestion avoidance increase
+};
+
+struct CubicState {
+    double      wMax;           // Window before the last reduction, in segments
+    double      k;              // Seconds until the cubic function returns to wMax
+    double      origin;         // Plateau of the cubic function, in segments
+    double      wEst;           // Reno-friendly window estimate, in segments
+    uint64_t    epochStart;     // Start of the current congestion avoidance epoch (ns), 0 if none
+};
+
+struct BbrState {
+    int         mode;
+    uint64_t    btlBw;          // Bottleneck bandwidth estimate in bytes/s
+    uint64_t    bwSamples[10];  // Highest delivery rate seen in each of the last rounds
+    uint64_t    roundCount;
+    uint64_t    nextRoundDelivered;
+    uint64_t    minRtt;
+    uint64_t    minRttStamp;
+    uint64_t    fullBw;
+    int         fullBwCount;
+    int         filledPipe;
+    int         cycleIndex;
+    uint64_t    cycleStamp;
+    uint64_t    probeRttDone;
+    uint64_t    priorCwnd;
+    double      pacingGain;
+    double      cwndGain;
+};
+
+struct CongestionControl {
+    const struct CongestionOps  *ops;
+    uint64_t    mss;
+    uint64_t    cwnd;           // Congestion window in payload bytes
+    uint64_t    ssthresh;
+    uint64_t    srtt;           // Smoothed RTT (ns), 0 until the first sample
+    uint64_t    minRtt;         // Lowest RTT seen (ns), 0 until the first sample
+    uint64_t    delivered;      // Payload bytes acknowledged so far
+    uint64_t    deliveredTime;  // Time delivered last grew (ns)
+    uint64_t    lossEventTime;  // Segments sent before this time belong to an already handled loss event
+    union {
+        struct RenoState    reno;
+        struct CubicState   cubic;
+        struct BbrState     bbr;
+    } state;
+};
+
+extern const struct CongestionOps renoOps;
+extern const struct CongestionOps cubicOps;
+extern const struct CongestionOps bbrOps;
+
+int ccInit(struct CongestionControl *cc, const char *name, uint64_t mss);
+void ccOnAck(struct CongestionControl *cc, uint64_t ackedBytes, uint64_t bytesInFlight, uint64_t priorDelivered,
+             uint64_t priorDeliveredTime, uint64_t sentTime, uint64_t now);
+int ccOnLoss(struct CongestionControl *cc, uint64_t sentTime, uint64_t now, int timeout);
+void ccOnRttSample(struct CongestionControl *cc, uint64_t rtt, uint64_t srtt, uint64_t now);
+uint64_t ccPacingRate(struct CongestionControl *cc);
+uint64_t ccCwnd(struct CongestionControl *cc);
+uint64_t ccWindowPacingRate(struct CongestionControl *cc);
+
+#endif
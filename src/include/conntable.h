@@ -0,0 +1,42 @@
+#ifndef CONNTABLE_H
+#define CONNTABLE_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <netinet/in.h>
+
+#define CONN_TABLE_INITIAL_BUCKETS 64   // Must be a power of two
+
+/**
+ * Identifies a connection: the sender's address and port and the connection ID from its SYN.
+ */
+struct ConnKey {
+    uint32_t    addr;       // Network byte order
+    uint16_t    port;       // Network byte order
+    uint32_t    connId;
+};
+
+struct ConnEntry {
+    struct ConnKey      key;
+    void                *value;
+    struct ConnEntry    *next;
+};
+
+/**
+ * Hash table of connections with separate chaining. It doubles its bucket array whenever it holds more
+ * entries than buckets. Not thread-safe.
+ */
+struct ConnTable {
+    struct ConnEntry    **buckets;
+    size_t              bucketCount;
+    size_t              count;
+};
+
+struct ConnKey connKeyMake(const struct sockaddr_in *addr, uint32_t connId);
+void connTableInit(struct ConnTable *table);
+void connTableDestroy(struct ConnTable *table);
+void *connTableFind(const struct ConnTable *table, const struct ConnKey *key);
+void connTableInsert(struct ConnTable *table, const struct ConnKey *key, void *value);
+void *connTableRemove(struct ConnTable *table, const struct ConnKey *key);
+
+#endif
@@ -0,0 +1,71 @@
+#ifndef FEC_H
+#define FEC_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "reassembly.h"
+
+#define FEC_MAX_BLOCK 64            // Data segments one block of parity protects
+#define FEC_MAX_PARITY 16           // Parity segments per block
+#define FEC_DEFAULT_PARITY 4
+#define FEC_SAMPLE_SEGMENTS 256     // Data transmissions per loss rate sample
+#define FEC_TARGET_FAILURE 0.01     // Chance of a block losing more segments than its parity can rebuild
+
+/**
+ * Sender side of forward error correction. Consecutive blocks of blockSize segments, counted from the
+ * first data segment, are each followed by parity segments. Row 0 of the code is the XOR of the block
+ * and every further row is a Reed-Solomon row, so a block with n parity segments survives any n losses.
+ * How many a block gets follows the loss rate measured on the path. Guarded by the send window lock.
+ */
+struct FecEncoder {
+    unsigned int    blockSize;
+    unsigned int    maxParity;
+    double          lossRate;       // Smoothed fraction of data segments lost on the path
+    uint64_t        sampleSent;     // Data transmissions when the current sample started
+    uint64_t        sampleLost;     // Losses counted when the current sample started
+};
+
+/**
+ * Parity held for a block until it is complete.
+ */
+struct FecBlock {
+    uint32_t        firstSeq;       // 0 for a free slot
+    uint16_t        count;          // Data segments in the block, fewer than blockSize for the last one
+    uint32_t        rows;           // Bit i is set when parity row i is held
+    uint16_t        lengths[FEC_MAX_PARITY];
+    uint16_t        codedSizes[FEC_MAX_PARITY];
+    unsigned char   *parity;        // maxParity payloads of mss bytes
+};
+
+/**
+ * Receiver side of forward error correction. A block whose missing segments are no more than the parity
+ * segments held for it is rebuilt in the reassembly ring, which keeps every segment of a block until the
+ * whole block is there. Guarded by the lock of the ring.
+ */
+struct FecDecoder {
+    struct FecBlock *blocks;        // One slot per block the ring can hold, by block number
+    uint32_t        blockCount;
+    uint32_t        blockSize;
+    unsigned int    maxParity;
+    size_t          mss;
+    unsigned char   *scratch;       // Syndromes and rebuilt payloads
+    uint32_t        repaired;       // Segments rebuilt so far
+};
+
+void fecMulAdd(unsigned char *dst, const unsigned char *src, uint8_t coefficient, size_t length);
+size_t fecEncode(unsigned int row, const void *const *data, const size_t *sizes, unsigned int count,
+                 unsigned char *parity, uint16_t *codedSize);
+void fecEncoderInit(struct FecEncoder *encoder, unsigned int blockSize, unsigned int maxParity);
+void fecEncoderSample(struct FecEncoder *encoder, uint64_t sent, uint64_t lost);
+unsigned int fecEncoderParity(const struct FecEncoder *encoder);
+void fecDecoderInit(struct FecDecoder *decoder, uint32_t capacity, uint32_t blockSize, unsigned int maxParity,
+                    size_t mss);
+void fecDecoderDestroy(struct FecDecoder *decoder);
+unsigned int fecDecoderStore(struct FecDecoder *decoder, struct ReassemblyBuffer *buffer, uint32_t firstSeq,
+                             unsigned int count, unsigned int row, uint16_t codedSize, const void *data,
+                             size_t length);
+unsigned int fecDecoderRepair(struct FecDecoder *decoder, struct ReassemblyBuffer *buffer, uint32_t seqNum);
+const char *fecImplementation(void);
+
+#endif
@@ -0,0 +1,17 @@
+#ifndef NETUTIL_H
+#define NETUTIL_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/socket.h>
+
+#include "packet.h"
+
+#define SOCKET_BUFFER_PER_DATAGRAM (2 * PACKET_MAX_SIZE)   // What a socket buffer is charged for a largest datagram
+
+int waitForPacket(int sockfd, uint64_t timeoutNs);
+int sendPacketTo(int sockfd, const struct Packet *packet, const struct sockaddr *addr, socklen_t addrLen);
+int recvPacketFrom(int sockfd, struct Packet *packet, struct sockaddr *addr, socklen_t *addrLen);
+size_t socketBufferSize(int sockfd, int receive, size_t bytes);
+
+#endif
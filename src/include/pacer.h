@@ -0,0 +1,27 @@
+#ifndef PACER_H
+#define PACER_H
+
+#include <stdint.h>
+
+#define PACER_SPIN_NS 10000     // Gaps shorter than this are spun rather than slept
+
+/**
+ * Token bucket pacer. Credit is kept in byte-nanoseconds per second so that refills at any rate are exact
+ * to the nanosecond. It may go negative when bytes are charged ahead of their release time, and that debt
+ * delays later releases. A rate of 0 disables pacing.
+ */
+struct Pacer {
+    uint64_t    rate;           // Target rate in bytes per second
+    uint64_t    burst;          // Bucket depth in bytes
+    int64_t     credit;         // Available tokens, scaled by NSEC_PER_SEC
+    uint64_t    lastRefill;     // Monotonic time of the last refill (ns)
+};
+
+void pacerInit(struct Pacer *pacer, uint64_t rate, uint64_t burst);
+void pacerSetRate(struct Pacer *pacer, uint64_t rate);
+uint64_t pacerReleaseTime(struct Pacer *pacer, uint64_t bytes);
+void pacerConsume(struct Pacer *pacer, uint64_t bytes);
+void pacerWait(struct Pacer *pacer, uint64_t bytes);
+void sleepUntilNs(uint64_t target);
+
+#endif
@@ -6,17 +6,136 @@
 #include <stdint.h>
 #include <sys/types.h>
 
+/**
+ * Wire format, all fields in network byte order:
+ *
+ *   0       1       2               4               8              12              16              20              24
+ *   +-------+-------+---------------+---------------+---------------+---------------+---------------+---------------+
+ *   |version| flags |  windowSize   |    seqNum     |    ackNum     |     tsVal     |     tsEcr     |   checksum    | payload
+ *   +-------+-------+---------------+---------------+---------------+---------------+---------------+---------------+
+ *
+ * The payload runs to the end of the datagram, so its length is not sent. Data segments are as large as
+ * the path carries, which the sender probes for (see pmtu.h), and are sent with DF set, so they are never
+ * IP-fragmented. The checksum is the CRC32C of the whole datagram with the checksum field zeroed.
+ */
+#define PACKET_VERSION 2
+#define PACKET_HEADER_SIZE 24
+#define PACKET_CHECKSUM_OFFSET 20
+#define PACKET_MAX_SIZE 8972                                        // 9000 jumbo MTU - 20 IPv4 - 8 UDP
+#define PACKET_MAX_PAYLOAD (PACKET_MAX_SIZE - PACKET_HEADER_SIZE)
+#define PACKET_DEFAULT_SIZE 1472                                    // 1500 MTU, for peers that take no more
+#define PACKET_DEFAULT_PAYLOAD (PACKET_DEFAULT_SIZE - PACKET_HEADER_SIZE)
+
+#define PACKET_FLAG_SYN 0x01
+#define PACKET_FLAG_ACK 0x02
+#define PACKET_FLAG_FIN 0x04
+#define PACKET_FLAG_PARITY 0x08
+#define PACKET_FLAG_PMTU 0x10
+
+/**
+ * A path MTU probe has the PMTU flag and a payload of padding. The receiver answers it with a header-only
+ * packet with the ACK and PMTU flags whose ackNum is the length of the probe datagram and whose tsEcr
+ * echoes its tsVal. Neither touches the sequence space.
+ */
+
+/**
+ * A parity segment protects the FEC block of data segments seqNum..seqNum+count-1. Its ackNum holds count
+ * in the upper 16 bits and the parity row in the lower 16, its windowSize holds the coded payload sizes,
+ * and its payload is the coded payloads, as long as the longest of them. See fec.h.
+ */
+#define PACKET_PARITY_COUNT_SHIFT 16
+#define PACKET_PARITY_ROW_MASK 0xffff
+
+/**
+ * SYN and SYN-ACK payloads carry options, each encoded as type, length and value bytes. Unknown options
+ * are skipped, so either side may add new ones.
+ */
+#define PACKET_OPT_WINDOW_SCALE 1   // 1 byte: windowSize in every packet from this side is shifted left by it
+#define PACKET_OPT_RANGE 2          // 8 bytes: file offset of the byte carried by the flow's first segment
+#define PACKET_OPT_FLOWS 3          // 2 bytes: number of parallel flows that together carry the file
+#define PACKET_OPT_CONNECTION_ID 4  // 4 bytes: random ID shared by every flow of one transfer
+#define PACKET_OPT_DIGEST 5         // 0 bytes: the FIN carries the CRC32C of the flow's whole range
+#define PACKET_OPT_ACK_FREQUENCY 6  // 6 bytes: segments per ACK (2) and maximum ACK delay in us (4) asked for
+#define PACKET_OPT_FEC 7            // 2 bytes: segments per FEC block (1) and most parity segments per block (1)
+#define PACKET_OPT_IDENTITY 8       // 28 bytes: transfer length (8), file size (8), mtime in ns (8) and hash (4)
+#define PACKET_OPT_RESUME 9         // 8 bytes: leading bytes of the flow's range the receiver already has
+#define PACKET_OPT_COMPRESSION 10   // 0 bytes: every data payload is a compressed block; the receiver echoes it
+#define PACKET_OPT_MAX_DATAGRAM 11  // 2 bytes: largest datagram the receiver takes, which it answers probes up to
+
+#define PACKET_MAX_WINDOW_SCALE 14
+
+/**
+ * Advertised windows count free reassembly slots as PACKET_DEFAULT_PAYLOAD bytes each, whatever size the
+ * sender's segments are, so a sender turns a window back into slots by dividing by it.
+ */
+#define PACKET_WINDOW_UNIT PACKET_DEFAULT_PAYLOAD
+
+/**
+ * The payload of a data ACK is a SACK bitmap. Bit i (byte i / 8, least significant bit first) is set when
+ * segment ackNum + PACKET_SACK_OFFSET + i has arrived; segment ackNum + 1 is the first hole by definition.
+ * The bitmap is trimmed after its last set bit, so in-order ACKs stay header-only. With FEC every data ACK
+ * starts with the 32-bit count of segments the receiver has rebuilt from parity, and the bitmap follows it.
+ */
+#define PACKET_SACK_OFFSET 2
+#define PACKET_MAX_SACK_BYTES 64
+#define PACKET_REPAIRED_SIZE 4
+
+/**
+ * A packet in host form. Only the header fields and the first dataSize bytes of data go on the wire.
+ */
 struct Packet {
-    uint16_t    sourcePort;
-    uint16_t    destinationPort;
     uint32_t    seqNum;
     uint32_t    ackNum;
     uint16_t    ackBit;
     uint16_t    synBit;
     uint16_t    finBit;
+    uint16_t    parityBit;
+    uint16_t    pmtuBit;
     uint16_t    windowSize;
+    uint32_t    tsVal;      // Sender's microsecond timestamp
+    uint32_t    tsEcr;      // Timestamp echoed back from the packet being answered
     ssize_t     dataSize;
-    char        data[1460];
+    char        data[PACKET_MAX_PAYLOAD];
+};
+
+/**
+ * Identifies the file a resumable transfer sends, so a receiver only resumes into output that came from
+ * the same file. See checkpoint.h.
+ */
+struct FileIdentity {
+    uint64_t    length;         // Bytes being transferred
+    uint64_t    size;           // Size of the whole file
+    uint64_t    mtimeNs;        // Modification time
+    uint32_t    hash;           // CRC32C of the start and end of the transferred bytes
 };
 
-#endif
\ No newline at end of file
+/**
+ * Connection options exchanged in the handshake.
+ */
+struct HandshakeOptions {
+    uint8_t     windowScale;
+    uint64_t    rangeOffset;    // Sent with flowCount, only when a file is split across flows
+    uint16_t    flowCount;      // 0 when the peer did not send it, which means a single flow
+    uint32_t    connectionId;   // 0 when the peer did not send it
+    uint8_t     digest;         // Whether the FIN carries a digest of the range
+    uint16_t    ackEvery;       // ACK frequency the sender asks for; 0 leaves it to the receiver
+    uint32_t    ackDelayUs;     // Maximum ACK delay the sender asks for; 0 leaves it to the receiver
+    uint8_t     fecBlock;       // Segments per FEC block, 0 without FEC; the receiver echoes what it accepts
+    uint8_t     fecParity;      // Most parity segments per block
+    uint8_t     resumable;      // Whether identity was sent, which asks the receiver to keep a checkpoint
+    struct FileIdentity identity;
+    uint64_t    resumeOffset;   // Bytes of the range the receiver already has; only a SYN-ACK sends it
+    uint8_t     compressed;     // Whether data payloads are compressed blocks
+    uint16_t    maxDatagram;    // Largest datagram the receiver takes, 0 when it sent none
+};
+
+void packetEncodeHeader(const struct Packet *packet, void *buf);
+void packetSetChecksum(void *buf, const void *payload, size_t payloadSize);
+int packetVerify(const void *buf, size_t length);
+int packetParseHeader(struct Packet *packet, const void *buf, size_t length);
+size_t packetSerialize(const struct Packet *packet, void *buf);
+int packetParse(struct Packet *packet, const void *buf, size_t length);
+void packetSetOptions(struct Packet *packet, const struct HandshakeOptions *options);
+void packetGetOptions(const struct Packet *packet, struct HandshakeOptions *options);
+
+#endif
@@ -0,0 +1,44 @@
+#ifndef PMTU_H
+#define PMTU_H
+
+#include <stddef.h>
+
+#include "timeutil.h"
+
+#define PMTU_MIN_SIZE 548           // The 576 bytes every IPv4 host takes, less the IPv4 and UDP headers
+#define PMTU_BASE_SIZE 1200         // BASE_PLPMTU: a datagram this size is taken to get through (RFC 8899)
+#define PMTU_ETHERNET_SIZE 1472     // A 1500-byte Ethernet MTU less the IPv4 and UDP headers
+#define PMTU_MAX_PROBES 3           // MAX_PROBES: sends of a probe before its size counts as too big
+#define PMTU_PROBES_PER_ROUND 7     // Sizes probed at once, so each round narrows the gap eightfold
+#define PMTU_SEARCH_STEP 32         // Closest the largest working and smallest failing sizes need to get
+#define PMTU_MIN_PROBE_TIMER (10 * NSEC_PER_MSEC)   // Least time a probe is given to be answered
+
+/**
+ * Datagram packetization layer path MTU discovery (DPLPMTUD, RFC 8899). The path is probed in rounds of
+ * padded datagrams of several sizes at once, each sent up to PMTU_MAX_PROBES times until it is answered.
+ * The first round tries the base, an Ethernet MTU and the largest datagram both ends take, so common links
+ * are settled in one round trip; if not even the base is answered, the second round looks below it, down to
+ * PMTU_MIN_SIZE. An answer confirms its size and every smaller one. A size still unanswered at the end of
+ * its round is taken to be too big, along with every larger one, since ICMP is ignored and only probes
+ * tell. Each later round spreads its probes evenly between the largest confirmed size and the smallest
+ * failed one, until the two are within PMTU_SEARCH_STEP. The search only does the bookkeeping; the caller
+ * sends the probes.
+ */
+struct PmtuSearch {
+    size_t          confirmed;      // Largest datagram size known to get through, 0 before any answer
+    size_t          failed;         // Smallest size known not to, one past the largest to try when none is
+    size_t          base;           // Size taken to get through on most paths, probed first
+    size_t          floor;          // Size used if no probe is ever answered
+    size_t          sizes[PMTU_PROBES_PER_ROUND];   // This round's probe sizes, ascending
+    unsigned int    count;
+    unsigned int    rounds;
+};
+
+void pmtuInit(struct PmtuSearch *search, size_t maxSize);
+unsigned int pmtuNextRound(struct PmtuSearch *search);
+int pmtuPending(const struct PmtuSearch *search, size_t size);
+void pmtuConfirm(struct PmtuSearch *search, size_t size);
+void pmtuTooBig(struct PmtuSearch *search, size_t size);
+size_t pmtuResult(const struct PmtuSearch *search);
+
+#endif
@@ -0,0 +1,42 @@
+#ifndef REASSEMBLY_H
+#define REASSEMBLY_H
+
+#include <stdint.h>
+#include <sys/types.h>
+
+#include "bufpool.h"
+
+/**
+ * Receive-side reassembly ring. Segments written..written+capacity-1 may be held, each in the slot
+ * seqNum % capacity. Segments below cumulative have all arrived; those below written have been taken by
+ * the disk writer and their slots are free again. With FEC the writer only takes whole blocks, so the
+ * segments of a block with a hole stay in the ring to rebuild it from parity. Each held segment is a
+ * buffer from the pool with its payload headroom bytes in, usually the very datagram it arrived in.
+ */
+struct ReassemblyBuffer {
+    char        **slots;        // Buffer of each held segment, NULL for an empty slot
+    struct BufferPool *pool;
+    size_t      headroom;       // Bytes before the payload in every buffer
+    ssize_t     *sizes;         // Payload size of each held segment, -1 for an empty slot
+    uint32_t    capacity;
+    size_t      mss;
+    uint32_t    firstSeq;       // Sequence number stored at file offset 0
+    uint32_t    cumulative;     // Lowest sequence number not yet received
+    uint32_t    written;        // Lowest sequence number not yet written
+    uint32_t    highest;        // One past the highest sequence number held
+    uint32_t    blockSize;      // Segments the writer takes together, 1 unless FEC is on
+};
+
+void reassemblyInit(struct ReassemblyBuffer *buffer, uint32_t capacity, struct BufferPool *pool, size_t headroom,
+                    size_t mss, uint32_t firstSeq);
+void reassemblyDestroy(struct ReassemblyBuffer *buffer);
+int reassemblyStore(struct ReassemblyBuffer *buffer, uint32_t seqNum, const void *data, ssize_t dataSize);
+int reassemblyAdopt(struct ReassemblyBuffer *buffer, uint32_t seqNum, void *datagram, ssize_t dataSize);
+const char *reassemblySegment(struct ReassemblyBuffer *buffer, uint32_t seqNum, ssize_t *dataSize);
+int reassemblyHeld(struct ReassemblyBuffer *buffer, uint32_t seqNum);
+uint32_t reassemblyReady(struct ReassemblyBuffer *buffer, int all);
+void reassemblyRelease(struct ReassemblyBuffer *buffer, uint32_t upTo);
+uint32_t reassemblyWindow(struct ReassemblyBuffer *buffer);
+size_t reassemblySack(struct ReassemblyBuffer *buffer, unsigned char *bitmap, size_t maxBytes);
+
+#endif
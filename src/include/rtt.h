@@ -0,0 +1,32 @@
+#ifndef RTT_H
+#define RTT_H
+
+#include <stdint.h>
+
+#include "timeutil.h"
+
+#define RTT_INITIAL_RTO (1 * NSEC_PER_SEC)      // RTO before the first sample (RFC 6298)
+#define RTT_MIN_RTO (200 * NSEC_PER_MSEC)
+#define RTT_MAX_RTO (10 * NSEC_PER_SEC)         // Backoff cap, well inside the receiver's idle timeout
+#define RTT_MAX_RETRIES 10                      // Retransmissions of one packet before the peer is given up on
+
+/**
+ * Round trip time estimator and retransmission timeout (RFC 6298). Samples come from timestamp echoes, so
+ * ACKs for retransmitted packets are as usable as any other.
+ */
+struct RttEstimator {
+    uint64_t    srtt;           // Smoothed RTT (ns), 0 until the first sample
+    uint64_t    rttvar;         // RTT variation (ns)
+    uint64_t    minRtt;         // Lowest RTT seen (ns)
+    uint64_t    latest;         // Most recent sample (ns)
+    uint64_t    rto;            // Retransmission timeout before backoff (ns)
+    int         backoff;        // Number of times the RTO has been doubled since the last sample
+};
+
+void rttInit(struct RttEstimator *rtt);
+void rttSample(struct RttEstimator *rtt, uint64_t sample);
+int rttSampleEcho(struct RttEstimator *rtt, uint32_t tsEcr, uint32_t now);
+void rttBackoff(struct RttEstimator *rtt);
+uint64_t rttCurrentRto(const struct RttEstimator *rtt);
+
+#endif
@@ -0,0 +1,67 @@
+#ifndef SOURCE_H
+#define SOURCE_H
+
+#include <stdint.h>
+#include <sys/types.h>
+
+#include "compress.h"
+
+#define SOURCE_PREFETCH_BYTES (8 * 1024 * 1024)    // How far ahead of the send point the mapping is faulted in
+#define SOURCE_PIPE_BYTES (1024 * 1024)             // Pipe buffer asked for, so a stream is read in large pieces
+#define SOURCE_STDIN "-"                            // File name that sends standard input
+
+/**
+ * Read-only view of the file being sent. Segments are taken straight from a shared mapping when the file
+ * can be mapped, and read with pread at their offset otherwise. There is no shared file position, so any
+ * segment can be built at any time.
+ * 
+ * Pipes, standard input and other files that cannot seek are streams. A stream is read once, in order and
+ * without blocking, into a ring of streamCapacity bytes that holds everything from the release point up.
+ * The sender releases bytes once no segment can need them again, and reads no further than the ring has
+ * room for, so a producer that runs ahead is held back by its full pipe. Its size is what has been read so
+ * far, and its length is only known at the end of the stream.
+ */
+struct SegmentSource {
+    int         fd;
+    const char  *map;           // NULL when the file is read with pread
+    uint64_t    size;           // For a stream, the bytes read so far
+    uint64_t    prefetched;     // End of the range last passed to MADV_WILLNEED
+    char        *stream;        // Ring of a stream's bytes, NULL for a file
+    size_t      streamCapacity;
+    uint64_t    released;       // Bytes of a stream before this offset are no longer needed
+    int         ended;          // The stream has reached its end
+};
+
+/**
+ * Compressed view of one range of a source. Each segment is a block of as many file bytes as compress into
+ * one payload, so where a segment starts in the file is only known once the ones before it are built. They
+ * are built in order just ahead of the send point, and kept in a ring by sequence number until the window
+ * moves past them since a retransmission must carry the same bytes.
+ */
+struct CompressedSource {
+    struct SegmentSource    *source;
+    struct Compressor       compressor;
+    char                    *payloads;      // capacity payloads of mss bytes
+    ssize_t                 *sizes;
+    uint32_t                capacity;
+    size_t                  mss;
+    uint32_t                prepared;       // Next segment to build
+    uint64_t                next;           // Offset of the next file byte to compress
+    uint64_t                end;            // End of the range
+    char                    *raw;           // File bytes of one block when the file is not mapped
+};
+
+int sourceOpen(struct SegmentSource *source, const char *filename, size_t streamCapacity);
+int sourceIsStream(const char *filename, uint64_t *size);
+void sourceClose(struct SegmentSource *source);
+const void *sourcePayload(struct SegmentSource *source, uint64_t offset, size_t length, void *buf);
+int sourceRead(struct SegmentSource *source);
+void sourceRelease(struct SegmentSource *source, uint64_t offset);
+int sourceWait(struct SegmentSource *source, uint64_t timeoutNs);
+void compressedInit(struct CompressedSource *compressed, struct SegmentSource *source, uint32_t firstSeq,
+                    uint64_t offset, uint64_t length, uint32_t capacity, size_t mss);
+void compressedDestroy(struct CompressedSource *compressed);
+int compressedPrepare(struct CompressedSource *compressed, uint32_t *digest, size_t *rawUsed);
+const void *compressedPayload(const struct CompressedSource *compressed, uint32_t seqNum, ssize_t *size);
+
+#endif
@@ -0,0 +1,42 @@
+#ifndef SPSC_H
+#define SPSC_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <pthread.h>
+
+#define SPSC_CACHE_LINE 64
+
+/**
+ * Bounded lock-free ring that passes fixed-size slots from exactly one producer thread to one consumer
+ * thread. Each side owns one index and keeps its own copy of the other's, refreshed only when the ring
+ * looks full or empty, and every group of fields one thread writes has its own cache lines, so in the
+ * steady state the threads only share the lines of the slots themselves. An index is stored with release
+ * ordering after its slots are written or read and loaded with acquire ordering before they are touched.
+ * A producer fills any number of slots and publishes them with a single store. A consumer with nothing to
+ * do can sleep in spscWait; the producer only takes the lock to wake it when it is actually asleep.
+ */
+struct SpscRing {
+    uint64_t        head __attribute__((aligned(SPSC_CACHE_LINE)));     // Next slot to read, owned by the consumer
+    uint64_t        tailSeen;       // The consumer's copy of tail
+    uint64_t        tail __attribute__((aligned(SPSC_CACHE_LINE)));     // Next slot to publish, owned by the producer
+    uint64_t        filled;         // Slots past tail the producer has filled but not published
+    uint64_t        headSeen;       // The producer's copy of head
+    int             sleeping __attribute__((aligned(SPSC_CACHE_LINE)));  // The consumer is in spscWait
+    pthread_mutex_t lock;           // Only taken to sleep and to wake a sleeper
+    pthread_cond_t  wake;
+    char            *slots;
+    size_t          slotSize;       // Rounded up to a cache line
+    uint64_t        mask;           // Capacity - 1, the capacity being a power of two
+};
+
+void spscInit(struct SpscRing *ring, uint64_t capacity, size_t slotSize);
+void spscDestroy(struct SpscRing *ring);
+void *spscSlot(struct SpscRing *ring);
+void spscPush(struct SpscRing *ring);
+void spscPublish(struct SpscRing *ring);
+void *spscFront(struct SpscRing *ring);
+void spscPop(struct SpscRing *ring);
+int spscWait(struct SpscRing *ring, uint64_t deadline);
+
+#endif
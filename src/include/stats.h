@@ -0,0 +1,159 @@
+#ifndef STATS_H
+#define STATS_H
+
+#include <stdint.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+#include "timeutil.h"
+
+#define STATS_CACHE_LINE 64
+#define STATS_HISTOGRAM_SUB_BUCKETS 16      // Buckets per power of two, so a bucket is at most 6% wide
+#define STATS_HISTOGRAM_BUCKETS (29 * STATS_HISTOGRAM_SUB_BUCKETS)     // Values up to 2^32
+#define STATS_TIMELINE_CAPACITY 1024
+#define STATS_TIMELINE_INTERVAL_NS (10 * NSEC_PER_MSEC)     // Doubled each time the timeline fills up
+#define STATS_MAX_FINISHED 64               // Finished connections kept for the dump
+
+/**
+ * Per-connection counters. Each thread that works on a connection has its own block of them.
+ */
+enum StatsCounter {
+    STAT_PACKETS_SENT,
+    STAT_BYTES_SENT,
+    STAT_PACKETS_RECEIVED,
+    STAT_BYTES_RECEIVED,
+    STAT_RETRANSMITS,
+    STAT_TIMEOUTS,          // Retransmission timer expiries
+    STAT_LOSS_EVENTS,       // Congestion responses to loss
+    STAT_DUPLICATES,        // Segments received again or outside the window
+    STAT_CORRUPT,           // Datagrams dropped for a bad checksum
+    STAT_PROBES,            // Zero-window probes
+    STAT_FEC_PARITY,        // FEC parity segments
+    STAT_FEC_REPAIRED,      // Segments the receiver rebuilt from parity
+    STAT_RESUMED,           // Bytes not sent because the receiver kept them from an interrupted transfer
+    STAT_COMPRESSED,        // File bytes carried by compressed segments
+    STAT_DELIVERED,         // Payload bytes acknowledged by the receiver, or written to disk by it
+    STAT_DISK_WRITES,
+    STAT_DISK_BLOCKED_NS,   // Time spent in write system calls
+    STAT_COUNT
+};
+
+/**
+ * The threads that update a connection's counters.
+ */
+enum StatsSlot {
+    STATS_SLOT_TX,          // The sender's transmit thread
+    STATS_SLOT_RX,          // The thread that reads the connection's socket and sends its ACKs
+    STATS_SLOT_DISK,        // The disk writer pool
+    STATS_SLOTS
+};
+
+/**
+ * Counters written by a single thread at a time, so updates need no locks or atomic read-modify-writes.
+ * They are stored atomically only so a dump can read them while they change. Each block has its own cache
+ * lines, so threads counting for the same connection never share one.
+ */
+struct StatsCounters {
+    uint64_t    value[STAT_COUNT];
+} __attribute__((aligned(STATS_CACHE_LINE)));
+
+/**
+ * Log-linear histogram: exact below STATS_HISTOGRAM_SUB_BUCKETS, then STATS_HISTOGRAM_SUB_BUCKETS
+ * buckets per power of two. Single writer, like the counters.
+ */
+struct StatsHistogram {
+    uint64_t    count;
+    uint64_t    sum;
+    uint64_t    min;
+    uint64_t    max;
+    uint64_t    buckets[STATS_HISTOGRAM_BUCKETS];
+};
+
+/**
+ * A point of the congestion timeline.
+ */
+struct StatsSample {
+    uint64_t    time;           // Since the connection started (ns)
+    uint64_t    cwnd;           // Bytes
+    uint64_t    pacingRate;     // Bytes per second, 0 if unpaced
+    uint64_t    bytesInFlight;
+    uint64_t    srtt;           // ns
+    uint64_t    delivered;      // Bytes acknowledged so far
+};
+
+/**
+ * Timeline of samples taken at most every interval. When it fills up every other sample is dropped and
+ * the interval doubles, so it covers the whole connection in bounded memory. Single writer.
+ */
+struct StatsTimeline {
+    uint64_t            start;      // Monotonic time sample times are relative to (ns)
+    uint64_t            interval;
+    uint64_t            next;       // Monotonic time the next sample is due (ns)
+    unsigned int        count;
+    struct StatsSample  samples[STATS_TIMELINE_CAPACITY];
+};
+
+/**
+ * Everything recorded about one connection. The histogram and timeline belong to the thread that takes
+ * its RTT samples: the sender's transmit thread, or the receiver's event loop.
+ */
+struct ConnStats {
+    struct StatsCounters    counters[STATS_SLOTS];
+    struct StatsHistogram   rtt;        // RTT samples (us)
+    struct StatsTimeline    timeline;
+    char                    peer[INET_ADDRSTRLEN + 6];
+    uint32_t                connectionId;
+    uint64_t                offset;     // File offset of the connection's range
+    uint64_t                datagramSize;   // Size of full data datagrams once settled, 0 before
+    uint64_t                start;      // Monotonic time it was registered (ns)
+    uint64_t                end;        // Monotonic time it was unregistered (ns), 0 while active
+    struct ConnStats        *prev;      // Links guarded by the registry lock
+    struct ConnStats        *next;
+};
+
+/**
+ * @brief statsAdd is a function that adds to a counter of the calling thread's block.
+ * 
+ * @param counters  The block of the calling thread.
+ * @param counter   The counter.
+ * @param amount    The amount to add.
+ */
+static inline void statsAdd(struct StatsCounters *counters, enum StatsCounter counter, uint64_t amount) {
+    uint64_t value = __atomic_load_n(&counters->value[counter], __ATOMIC_RELAXED);
+
+    __atomic_store_n(&counters->value[counter], value + amount, __ATOMIC_RELAXED);
+}
+
+/**
+ * @brief statsTimelineDue is a function that tells whether the timeline takes a sample now.
+ * 
+ * @param timeline  The timeline.
+ * @param now       The current monotonic time (ns).
+ */
+static inline int statsTimelineDue(const struct StatsTimeline *timeline, uint64_t now) {
+    return now >= timeline->next;
+}
+
+extern int traceFd;
+
+/**
+ * @brief traceEnabled is a function that tells whether events are traced, so callers can skip building them.
+ */
+static inline int traceEnabled(void) {
+    return traceFd >= 0;
+}
+
+void statsInit(const char *program, const char *path, const char *tracePath);
+void statsFinish(void);
+void statsDump(void);
+void statsConnInit(struct ConnStats *stats, const struct sockaddr_in *peer, uint32_t connectionId, uint64_t offset);
+void statsRegister(struct ConnStats *stats);
+void statsUnregister(struct ConnStats *stats);
+uint64_t statsTotal(const struct ConnStats *stats, enum StatsCounter counter);
+void statsHistogramRecord(struct StatsHistogram *histogram, uint64_t value);
+void statsTimelineRecord(struct StatsTimeline *timeline, uint64_t now, const struct StatsSample *sample);
+void traceEvent(const struct ConnStats *stats, uint64_t now, const char *name, const char *format, ...)
+    __attribute__((format(printf, 4, 5)));
+void traceFlush(void);
+
+#endif
@@ -0,0 +1,47 @@
+#ifndef TIMERWHEEL_H
+#define TIMERWHEEL_H
+
+#include <stdint.h>
+
+#include "timeutil.h"
+
+#define TIMER_WHEEL_SLOTS 1024                      // Must be a power of two
+#define TIMER_WHEEL_TICK_NS (1 * NSEC_PER_MSEC)     // Timers fire up to one tick late
+
+struct Timer;
+
+typedef void (*TimerHandler)(struct Timer *timer, void *arg, uint64_t now);
+
+/**
+ * A timer that lives inside the object it belongs to. While armed it is linked into the slot of its
+ * expiry tick.
+ */
+struct Timer {
+    struct Timer    *prev;
+    struct Timer    *next;
+    uint64_t        expires;    // Monotonic time it fires at (ns)
+    TimerHandler    handler;
+    void            *arg;
+    int             armed;
+};
+
+/**
+ * Hashed timing wheel. A timer is kept in the slot of its expiry tick modulo the wheel size, so arming
+ * and cancelling take constant time and advancing only visits the slots of the ticks that passed. Timers
+ * more than a revolution away stay in their slot until their turn comes round. Not thread-safe; each
+ * event loop owns its own.
+ */
+struct TimerWheel {
+    struct Timer    slots[TIMER_WHEEL_SLOTS];   // List heads
+    uint64_t        tick;                       // Next tick to process
+    unsigned int    count;                      // Armed timers
+};
+
+void timerInit(struct Timer *timer, TimerHandler handler, void *arg);
+void timerWheelInit(struct TimerWheel *wheel, uint64_t now);
+void timerArm(struct TimerWheel *wheel, struct Timer *timer, uint64_t expires);
+void timerCancel(struct TimerWheel *wheel, struct Timer *timer);
+void timerWheelAdvance(struct TimerWheel *wheel, uint64_t now);
+uint64_t timerWheelNextWakeup(struct TimerWheel *wheel);
+
+#endif
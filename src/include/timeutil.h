@@ -0,0 +1,43 @@
+#ifndef TIMEUTIL_H
+#define TIMEUTIL_H
+
+#include <stdint.h>
+#include <time.h>
+
+#define NSEC_PER_SEC 1000000000ULL
+#define NSEC_PER_MSEC 1000000ULL
+#define NSEC_PER_USEC 1000ULL
+
+/**
+ * @brief monotonicNs is a function that returns the current CLOCK_MONOTONIC time in nanoseconds.
+ */
+static inline uint64_t monotonicNs(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t) ts.tv_sec * NSEC_PER_SEC + (uint64_t) ts.tv_nsec;
+}
+
+/**
+ * @brief timestampUs is a function that returns a 32-bit microsecond timestamp for timestamp echo. It wraps
+ *        about every 71 minutes, so only differences are meaningful. 0 is never returned because it means
+ *        "no timestamp".
+ */
+static inline uint32_t timestampUs(void) {
+    uint32_t ts = (uint32_t) (monotonicNs() / NSEC_PER_USEC);
+
+    return ts ? ts : 1;
+}
+
+/**
+ * @brief nsToTimespec is a function that converts a nanosecond timestamp to a struct timespec.
+ * 
+ * @param ns    The time in nanoseconds.
+ */
+static inline struct timespec nsToTimespec(uint64_t ns) {
+    struct timespec ts;
+    ts.tv_sec = ns / NSEC_PER_SEC;
+    ts.tv_nsec = ns % NSEC_PER_SEC;
+    return ts;
+}
+
+#endif
@@ -0,0 +1,83 @@
+#ifndef WINDOW_H
+#define WINDOW_H
+
+#include <stdint.h>
+#include <sys/types.h>
+
+#define WINDOW_LAST_UNKNOWN UINT32_MAX      // lastSeq of a window whose final segment is not built yet
+
+/**
+ * A segment that has been handed to the network and is waiting to be acknowledged. While it is in flight
+ * it is on the window's list of transmissions in the order they were sent, and while it is marked lost it
+ * is on the window's retransmission queue instead.
+ */
+struct Segment {
+    uint32_t    seqNum;
+    ssize_t     dataSize;
+    uint64_t    firstSentTime;  // Monotonic time of the first transmission (ns)
+    uint64_t    sentTime;       // Monotonic time of the most recent transmission (ns)
+    uint64_t    deadline;       // Monotonic time at which the segment is retransmitted (ns)
+    uint64_t    delivered;      // Bytes delivered when the segment was last sent
+    uint64_t    deliveredTime;  // Time delivered last grew before the segment was sent (ns)
+    uint64_t    parityTime;     // Monotonic time the last parity of its FEC block was sent (ns), 0 if none
+    int         retransmits;
+    int         acked;          // Acknowledged cumulatively or selectively
+    int         lost;           // Marked for retransmission and no longer counted in flight
+    int         outstanding;    // On the list of transmissions in flight
+    struct Segment *sentPrev;   // Neighbours on the list of transmissions
+    struct Segment *sentNext;
+    struct Segment *lostPrev;   // Neighbours in the retransmission queue
+    struct Segment *lostNext;
+};
+
+/**
+ * Selective-repeat send window. Segments base..nextSeq-1 are in flight and are stored in a ring
+ * indexed by sequence number, so the window never holds more than capacity segments. Transmissions
+ * in flight are also linked oldest first, so the retransmission timer and RACK only look at the oldest
+ * ones, and segments marked lost are queued for retransmission, so no call walks the whole window. Only
+ * the sender's transmit thread touches it.
+ */
+struct SendWindow {
+    struct Segment  *segments;
+    uint32_t        capacity;
+    uint32_t        base;       // Oldest unacknowledged sequence number
+    uint32_t        nextSeq;    // Next sequence number that has never been sent
+    uint32_t        lastSeq;    // Final sequence number of the transfer, WINDOW_LAST_UNKNOWN until it is known
+    uint64_t        bytesInFlight;  // Payload bytes sent, not acknowledged and not marked lost
+    uint64_t        rwnd;       // Receiver's advertised window (bytes)
+    uint32_t        rightEdge;  // Highest sequence number the receiver has room for
+    uint32_t        probes;     // Zero-window probes sent since the last ACK
+    uint64_t        rackXmitTime;   // Send time of the most recently sent segment known delivered (ns)
+    uint64_t        rackRtt;        // RTT measured on that segment (ns)
+    uint32_t        highestAcked;   // Highest sequence number acknowledged in any way
+    uint32_t        reordering;     // Most segments seen delivered out of order, raises the dupthresh
+    uint64_t        reorderTime;    // Longest delivery delay seen behind a later segment (ns)
+    uint64_t        rackDeadline;   // When RACK next needs to look for losses (ns), UINT64_MAX if it does not
+    uint32_t        lossMarked;     // Highest sequence number the duplicate threshold has been applied below
+    struct Segment  *sentHead;      // Oldest transmission in flight
+    struct Segment  *sentTail;
+    struct Segment  *lostHead;      // Retransmission queue, in the order segments were marked lost
+    struct Segment  *lostTail;
+};
+
+void windowInit(struct SendWindow *window, uint32_t capacity, uint32_t firstSeq, uint32_t lastSeq);
+void windowDestroy(struct SendWindow *window);
+int windowDone(struct SendWindow *window);
+int windowHasRoom(struct SendWindow *window);
+int windowReceiverHasRoom(struct SendWindow *window);
+void windowSetReceiverWindow(struct SendWindow *window, uint32_t ackNum, uint64_t rwnd, uint32_t mss);
+uint32_t windowInFlight(struct SendWindow *window);
+struct Segment *windowGet(struct SendWindow *window, uint32_t seqNum);
+struct Segment *windowAdd(struct SendWindow *window, ssize_t dataSize);
+uint64_t windowAckCumulative(struct SendWindow *window, uint32_t ackNum, uint64_t now, struct Segment *newest);
+uint64_t windowAckSelective(struct SendWindow *window, uint32_t seqNum, uint64_t now, struct Segment *newest);
+struct Segment *windowDetectLosses(struct SendWindow *window, uint64_t now, uint64_t reorderWindow, uint32_t dupThresh);
+void windowProtect(struct SendWindow *window, uint32_t firstSeq, uint32_t lastSeq, uint64_t now);
+void windowMarkLost(struct SendWindow *window, struct Segment *segment);
+void windowRetransmitted(struct SendWindow *window, struct Segment *segment);
+void windowSent(struct SendWindow *window, struct Segment *segment, uint64_t now, uint64_t deadline);
+struct Segment *windowExpire(struct SendWindow *window, uint64_t now);
+struct Segment *windowNextRetransmit(struct SendWindow *window);
+uint64_t windowEarliestDeadline(struct SendWindow *window);
+
+#endif
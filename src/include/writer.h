@@ -0,0 +1,89 @@
+#ifndef WRITER_H
+#define WRITER_H
+
+#include <stdint.h>
+#include <pthread.h>
+#include <sys/types.h>
+
+#include "checkpoint.h"
+#include "pacer.h"
+#include "reassembly.h"
+#include "stats.h"
+
+#define WRITER_ALIGN 4096                       // File offset and memory alignment of every write
+#define WRITER_CHUNK_BYTES (1024 * 1024)        // Segments are coalesced into writes of this size
+
+struct WriterPool;
+
+/**
+ * The file a transfer is written to. Every flow's writer shares it and writes at its own offsets.
+ */
+struct OutputFile {
+    int     fd;
+    int     directFd;       // Opened with O_DIRECT for aligned full chunks, -1 if not used
+};
+
+/**
+ * Called by a pool thread, with the pool lock held, each time it has drained a writer: the ring has room
+ * again or the writer has finished closing. It must not call back into the writer.
+ */
+typedef void (*WriterProgress)(void *arg);
+
+/**
+ * Disk writer stage of the receiver. The network thread stores segments in the reassembly ring under lock
+ * and notifies the writer, which queues it on its pool; a pool thread copies each in-order run into an
+ * aligned staging chunk, frees the slots and writes the chunk when it is full. Segments of a compressed
+ * flow are decompressed on the way, so the network thread never does. While the disk or the write rate
+ * holds the writer back the ring fills up, which shrinks the window advertised to the sender.
+ */
+struct DiskWriter {
+    struct ReassemblyBuffer *buffer;
+    struct OutputFile       *file;
+    char                    *stage;
+    size_t                  stageFill;
+    off_t                   stageOffset;    // File offset of the staging chunk
+    struct Pacer            pacer;          // Limits the write rate; rate 0 disables it
+    int                     digesting;      // Whether to keep a digest of everything written
+    uint32_t                digest;         // CRC32C of the data staged so far
+    char                    *raw;           // Decompressed segment, NULL unless the flow is compressed
+    struct StatsCounters    *stats;         // Counts the writes and the time they block, NULL for none
+    struct Checkpoint       *checkpoint;    // Told of every chunk written, NULL for none
+    unsigned int            checkpointFlow; // The flow's index in the checkpoint
+    struct WriterPool       *pool;
+    WriterProgress          progress;
+    void                    *progressArg;
+    pthread_mutex_t         lock;           // Guards buffer, closing and result
+    int                     closing;
+    int                     result;         // 1 once closed, -1 after a write error, 0 before either
+    struct DiskWriter       *queueNext;     // The fields below are guarded by the pool lock
+    int                     scheduled;      // Queued or being drained by a pool thread
+    int                     rescan;         // Notified again while being drained
+};
+
+/**
+ * Threads that drain disk writers, so any number of connections share a fixed number of blocking writes.
+ * A writer is queued at most once and drained by one thread at a time.
+ */
+struct WriterPool {
+    pthread_t               *threads;
+    unsigned int            threadCount;
+    struct DiskWriter       *queueHead;
+    struct DiskWriter       *queueTail;
+    pthread_mutex_t         lock;
+    pthread_cond_t          ready;
+    int                     stopping;
+};
+
+int outputOpen(struct OutputFile *file, const char *filename, int direct);
+void outputClose(struct OutputFile *file);
+void writerPoolInit(struct WriterPool *pool, unsigned int threadCount);
+void writerPoolDestroy(struct WriterPool *pool);
+void writerOpen(struct DiskWriter *writer, struct WriterPool *pool, struct OutputFile *file, off_t offset,
+                struct ReassemblyBuffer *buffer, uint64_t writeRate, WriterProgress progress, void *progressArg);
+void writerDecompress(struct DiskWriter *writer);
+void writerNotify(struct DiskWriter *writer);
+void writerClose(struct DiskWriter *writer);
+int writerClosed(struct DiskWriter *writer);
+void writerDestroy(struct DiskWriter *writer);
+
+#endif
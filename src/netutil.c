@@ -0,0 +1,104 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <errno.h>
+#include <limits.h>
+#include <poll.h>
+#include <sys/socket.h>
+
+#include "./include/netutil.h"
+#include "./include/timeutil.h"
+
+/**
+ * @brief waitForPacket is a function that waits until a datagram can be read from a socket.
+ * 
+ * @param sockfd        The file descriptor of the socket.
+ * @param timeoutNs     How long to wait (ns).
+ * @return              1 if a datagram is ready, 0 if the timeout expired.
+ */
+int waitForPacket(int sockfd, uint64_t timeoutNs) {
+    struct pollfd pfd = { .fd = sockfd, .events = POLLIN, .revents = 0 };
+    uint64_t deadline = monotonicNs() + timeoutNs;
+
+    for (;;) {
+        uint64_t now = monotonicNs();
+        struct timespec timeout = nsToTimespec(deadline > now ? deadline - now : 0);
+        int ready = ppoll(&pfd, 1, &timeout, NULL);
+
+        if (ready > 0) {
+            return 1;
+        }
+        if (ready == 0) {
+            return 0;
+        }
+        if (errno != EINTR) {
+            perror("Error: Failed to wait for packet");
+            exit(EXIT_FAILURE);
+        }
+    }
+}
+
+/**
+ * @brief sendPacketTo is a function that sends one packet in wire format.
+ * 
+ * @param sockfd        The file descriptor of the socket.
+ * @param packet        The packet to send.
+ * @param addr          The destination address.
+ * @param addrLen       The size of the destination address.
+ * @return              0 on success, -1 on error.
+ */
+int sendPacketTo(int sockfd, const struct Packet *packet, const struct sockaddr *addr, socklen_t addrLen) {
+    char buf[PACKET_MAX_SIZE];
+    size_t length = packetSerialize(packet, buf);
+
+    if (sendto(sockfd, buf, length, 0, addr, addrLen) < 0) {
+        return -1;
+    }
+    return 0;
+}
+
+/**
+ * @brief recvPacketFrom is a function that receives one datagram and parses it.
+ * 
+ * @param sockfd        The file descriptor of the socket.
+ * @param packet        The packet to fill.
+ * @param addr          Filled with the source address.
+ * @param addrLen       The size of addr; updated to the size of the source address.
+ * @return              1 if a packet was received, 0 if the datagram was malformed or corrupted and dropped,
+ *                      -1 on error.
+ */
+int recvPacketFrom(int sockfd, struct Packet *packet, struct sockaddr *addr, socklen_t *addrLen) {
+    char buf[PACKET_MAX_SIZE];
+    ssize_t length = recvfrom(sockfd, buf, sizeof(buf), MSG_TRUNC, addr, addrLen);
+
+    if (length < 0) {
+        return -1;
+    }
+    return packetParse(packet, buf, length) == 0 && packetVerify(buf, length);
+}
+
+/**
+ * @brief socketBufferSize is a function that asks for a socket buffer of the given size, past the
+ *        net.core.rmem_max or wmem_max limit when the process is allowed to (SO_RCVBUFFORCE,
+ *        SO_SNDBUFFORCE), and returns the size the kernel granted.
+ * 
+ * @param sockfd        The file descriptor of the socket.
+ * @param receive       1 for the receive buffer, 0 for the send buffer.
+ * @param bytes         The size wanted, counted the way the kernel charges datagrams against it.
+ * @return              The size granted.
+ */
+size_t socketBufferSize(int sockfd, int receive, size_t bytes) {
+    // The kernel doubles what it is asked for to leave room for its own bookkeeping
+    int size = bytes / 2 > INT_MAX ? INT_MAX : (int) (bytes / 2);
+    int granted = 0;
+    socklen_t length = sizeof(granted);
+
+    if (setsockopt(sockfd, SOL_SOCKET, receive ? SO_RCVBUFFORCE : SO_SNDBUFFORCE, &size, sizeof(size)) < 0) {
+        setsockopt(sockfd, SOL_SOCKET, receive ? SO_RCVBUF : SO_SNDBUF, &size, sizeof(size));
+    }
+    if (getsockopt(sockfd, SOL_SOCKET, receive ? SO_RCVBUF : SO_SNDBUF, &granted, &length) < 0 || granted < 0) {
+        return 0;
+    }
+    return granted;
+}
@@ -0,0 +1,138 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <errno.h>
+#include <time.h>
+
+#include "./include/pacer.h"
+#include "./include/timeutil.h"
+
+/**
+ * @brief pacerRefill is a function that adds the tokens earned since the last refill, up to the burst size.
+ * 
+ * @param pacer     The pacer.
+ * @param now       The current monotonic time (ns).
+ * @param cap       The bucket depth in bytes.
+ */
+static void pacerRefill(struct Pacer *pacer, uint64_t now, uint64_t cap) {
+    int64_t limit = (int64_t) (cap * NSEC_PER_SEC);
+    uint64_t elapsed = now > pacer->lastRefill ? now - pacer->lastRefill : 0;
+
+    pacer->lastRefill = now;
+    if (pacer->credit >= limit) {
+        pacer->credit = limit;
+    } else if (elapsed >= (uint64_t) (limit - pacer->credit) / pacer->rate) {
+        pacer->credit = limit;
+    } else {
+        pacer->credit += (int64_t) (elapsed * pacer->rate);
+    }
+}
+
+/**
+ * @brief pacerInit is a function that initializes a pacer with a full bucket.
+ * 
+ * @param pacer     The pacer to initialize.
+ * @param rate      The target rate in bytes per second, or 0 for no pacing.
+ * @param burst     The number of bytes that may be sent back to back.
+ */
+void pacerInit(struct Pacer *pacer, uint64_t rate, uint64_t burst) {
+    pacer->rate = rate;
+    pacer->burst = burst;
+    pacer->credit = (int64_t) (burst * NSEC_PER_SEC);
+    pacer->lastRefill = monotonicNs();
+}
+
+/**
+ * @brief pacerSetRate is a function that changes the target rate. Tokens earned at the old rate are kept.
+ * 
+ * @param pacer     The pacer.
+ * @param rate      The new target rate in bytes per second, or 0 for no pacing.
+ */
+void pacerSetRate(struct Pacer *pacer, uint64_t rate) {
+    if (rate == pacer->rate) {
+        return;
+    }
+    if (pacer->rate != 0) {
+        pacerRefill(pacer, monotonicNs(), pacer->burst);
+    } else {
+        pacer->lastRefill = monotonicNs();
+    }
+    pacer->rate = rate;
+}
+
+/**
+ * @brief pacerReleaseTime is a function that returns the earliest time at which bytes may be sent.
+ * 
+ * @param pacer     The pacer.
+ * @param bytes     The number of bytes about to be sent.
+ * @return          A monotonic time (ns); now if the bytes may be sent immediately.
+ */
+uint64_t pacerReleaseTime(struct Pacer *pacer, uint64_t bytes) {
+    uint64_t now = monotonicNs();
+    int64_t need = (int64_t) (bytes * NSEC_PER_SEC);
+
+    if (pacer->rate == 0) {
+        return now;
+    }
+    pacerRefill(pacer, now, bytes > pacer->burst ? bytes : pacer->burst);
+    if (pacer->credit >= need) {
+        return now;
+    }
+    return now + ((uint64_t) (need - pacer->credit) + pacer->rate - 1) / pacer->rate;
+}
+
+/**
+ * @brief pacerConsume is a function that charges bytes to the bucket without waiting. Bytes sent ahead of
+ *        their release time leave a debt that pushes back later releases.
+ * 
+ * @param pacer     The pacer.
+ * @param bytes     The number of bytes being sent.
+ */
+void pacerConsume(struct Pacer *pacer, uint64_t bytes) {
+    if (pacer->rate != 0) {
+        pacer->credit -= (int64_t) (bytes * NSEC_PER_SEC);
+    }
+}
+
+/**
+ * @brief pacerWait is a function that blocks until bytes may be sent and then takes their tokens.
+ * 
+ * @param pacer     The pacer.
+ * @param bytes     The number of bytes about to be sent.
+ */
+void pacerWait(struct Pacer *pacer, uint64_t bytes) {
+    uint64_t release;
+
+    if (pacer->rate == 0) {
+        return;
+    }
+
+    release = pacerReleaseTime(pacer, bytes);
+    if (release > pacer->lastRefill) {
+        sleepUntilNs(release);
+        pacerRefill(pacer, release, bytes > pacer->burst ? bytes : pacer->burst);
+    }
+    pacerConsume(pacer, bytes);
+}
+
+/**
+ * @brief sleepUntilNs is a function that waits until an absolute monotonic time. The kernel timer is used
+ *        for the bulk of the wait and the last PACER_SPIN_NS are spun, since timer wakeups are too coarse
+ *        for the gaps between packets at high rates.
+ * 
+ * @param target    The monotonic time to wait for (ns).
+ */
+void sleepUntilNs(uint64_t target) {
+    uint64_t now = monotonicNs();
+
+    if (target > now + PACER_SPIN_NS) {
+        struct timespec wakeup = nsToTimespec(target - PACER_SPIN_NS);
+        while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &wakeup, NULL) == EINTR) {
+        }
+    }
+    while (monotonicNs() < target) {
+#if defined(__x86_64__) || defined(__i386__)
+        __builtin_ia32_pause();
+#endif
+    }
+}
@@ -0,0 +1,321 @@
+#include <string.h>
+#include <arpa/inet.h>
+
+#include "./include/packet.h"
+#include "./include/crc32c.h"
+
+/**
+ * @brief packetEncodeHeader is a function that writes the wire header of a packet with a zero checksum.
+ *        The payload, if any, belongs at buf + PACKET_HEADER_SIZE; packetSetChecksum seals the datagram
+ *        once it is in place.
+ * 
+ * @param packet    The packet.
+ * @param buf       A buffer of at least PACKET_HEADER_SIZE bytes.
+ */
+void packetEncodeHeader(const struct Packet *packet, void *buf) {
+    unsigned char *out = buf;
+    uint16_t windowSize = htons(packet->windowSize);
+    uint32_t fields[4] = { htonl(packet->seqNum), htonl(packet->ackNum), htonl(packet->tsVal), htonl(packet->tsEcr) };
+
+    out[0] = PACKET_VERSION;
+    out[1] = (packet->synBit ? PACKET_FLAG_SYN : 0) |
+             (packet->ackBit ? PACKET_FLAG_ACK : 0) |
+             (packet->finBit ? PACKET_FLAG_FIN : 0) |
+             (packet->parityBit ? PACKET_FLAG_PARITY : 0) |
+             (packet->pmtuBit ? PACKET_FLAG_PMTU : 0);
+    memcpy(out + 2, &windowSize, sizeof(windowSize));
+    memcpy(out + 4, fields, sizeof(fields));
+    memset(out + PACKET_CHECKSUM_OFFSET, 0, 4);
+}
+
+/**
+ * @brief packetSetChecksum is a function that stores the checksum of a datagram in its header. The
+ *        payload does not have to follow the header in memory, so one sent from elsewhere is covered too.
+ * 
+ * @param buf           The header, written by packetEncodeHeader.
+ * @param payload       The payload.
+ * @param payloadSize   The payload size.
+ */
+void packetSetChecksum(void *buf, const void *payload, size_t payloadSize) {
+    unsigned char *out = buf;
+    uint32_t checksum;
+
+    memset(out + PACKET_CHECKSUM_OFFSET, 0, 4);
+    checksum = htonl(crc32c(crc32c(0, out, PACKET_HEADER_SIZE), payload, payloadSize));
+    memcpy(out + PACKET_CHECKSUM_OFFSET, &checksum, sizeof(checksum));
+}
+
+/**
+ * @brief packetVerify is a function that checks the checksum of a received datagram.
+ * 
+ * @param buf       The datagram.
+ * @param length    The length of the datagram, at least PACKET_HEADER_SIZE.
+ * @return          1 if the datagram is intact, 0 if it was corrupted.
+ */
+int packetVerify(const void *buf, size_t length) {
+    static const unsigned char zeros[4];
+    const unsigned char *in = buf;
+    uint32_t checksum;
+    uint32_t crc;
+
+    memcpy(&checksum, in + PACKET_CHECKSUM_OFFSET, sizeof(checksum));
+    crc = crc32c(0, in, PACKET_CHECKSUM_OFFSET);
+    crc = crc32c(crc, zeros, sizeof(zeros));
+    crc = crc32c(crc, in + PACKET_HEADER_SIZE, length - PACKET_HEADER_SIZE);
+    return crc == ntohl(checksum);
+}
+
+/**
+ * @brief packetParseHeader is a function that reads the wire header of a datagram. dataSize is set from
+ *        the datagram length but the payload is left in place at buf + PACKET_HEADER_SIZE.
+ * 
+ * @param packet    The packet to fill.
+ * @param buf       The datagram.
+ * @param length    The length of the datagram.
+ * @return          0 on success, -1 if the datagram is truncated, oversized or from another version.
+ */
+int packetParseHeader(struct Packet *packet, const void *buf, size_t length) {
+    const unsigned char *in = buf;
+    uint16_t windowSize;
+    uint32_t fields[4];
+
+    if (length < PACKET_HEADER_SIZE || length > PACKET_MAX_SIZE || in[0] != PACKET_VERSION) {
+        return -1;
+    }
+
+    memcpy(&windowSize, in + 2, sizeof(windowSize));
+    memcpy(fields, in + 4, sizeof(fields));
+
+    packet->synBit = (in[1] & PACKET_FLAG_SYN) != 0;
+    packet->ackBit = (in[1] & PACKET_FLAG_ACK) != 0;
+    packet->finBit = (in[1] & PACKET_FLAG_FIN) != 0;
+    packet->parityBit = (in[1] & PACKET_FLAG_PARITY) != 0;
+    packet->pmtuBit = (in[1] & PACKET_FLAG_PMTU) != 0;
+    packet->windowSize = ntohs(windowSize);
+    packet->seqNum = ntohl(fields[0]);
+    packet->ackNum = ntohl(fields[1]);
+    packet->tsVal = ntohl(fields[2]);
+    packet->tsEcr = ntohl(fields[3]);
+    packet->dataSize = length - PACKET_HEADER_SIZE;
+    return 0;
+}
+
+/**
+ * @brief packetSerialize is a function that writes a packet and its payload in wire format.
+ * 
+ * @param packet    The packet.
+ * @param buf       A buffer of at least PACKET_MAX_SIZE bytes.
+ * @return          The length of the datagram.
+ */
+size_t packetSerialize(const struct Packet *packet, void *buf) {
+    packetEncodeHeader(packet, buf);
+    memcpy((char *) buf + PACKET_HEADER_SIZE, packet->data, packet->dataSize);
+    packetSetChecksum(buf, (char *) buf + PACKET_HEADER_SIZE, packet->dataSize);
+    return PACKET_HEADER_SIZE + packet->dataSize;
+}
+
+/**
+ * @brief packetParse is a function that reads a datagram in wire format, payload included.
+ * 
+ * @param packet    The packet to fill.
+ * @param buf       The datagram.
+ * @param length    The length of the datagram.
+ * @return          0 on success, -1 if the datagram is malformed.
+ */
+int packetParse(struct Packet *packet, const void *buf, size_t length) {
+    if (packetParseHeader(packet, buf, length) < 0) {
+        return -1;
+    }
+    memcpy(packet->data, (const char *) buf + PACKET_HEADER_SIZE, packet->dataSize);
+    return 0;
+}
+
+/**
+ * @brief packetSetOptions is a function that writes handshake options as the payload of a SYN or SYN-ACK.
+ * 
+ * @param packet    The packet.
+ * @param options   The options to send.
+ */
+void packetSetOptions(struct Packet *packet, const struct HandshakeOptions *options) {
+    unsigned char *out = (unsigned char *) packet->data;
+    size_t length = 0;
+
+    out[length++] = PACKET_OPT_WINDOW_SCALE;
+    out[length++] = 1;
+    out[length++] = options->windowScale;
+
+    if (options->flowCount > 1) {
+        out[length++] = PACKET_OPT_RANGE;
+        out[length++] = 8;
+        for (int shift = 56; shift >= 0; shift -= 8) {
+            out[length++] = options->rangeOffset >> shift;
+        }
+        out[length++] = PACKET_OPT_FLOWS;
+        out[length++] = 2;
+        out[length++] = options->flowCount >> 8;
+        out[length++] = options->flowCount;
+    }
+
+    if (options->digest) {
+        out[length++] = PACKET_OPT_DIGEST;
+        out[length++] = 0;
+    }
+
+    if (options->ackEvery != 0 || options->ackDelayUs != 0) {
+        out[length++] = PACKET_OPT_ACK_FREQUENCY;
+        out[length++] = 6;
+        out[length++] = options->ackEvery >> 8;
+        out[length++] = options->ackEvery;
+        for (int shift = 24; shift >= 0; shift -= 8) {
+            out[length++] = options->ackDelayUs >> shift;
+        }
+    }
+
+    if (options->fecBlock != 0) {
+        out[length++] = PACKET_OPT_FEC;
+        out[length++] = 2;
+        out[length++] = options->fecBlock;
+        out[length++] = options->fecParity;
+    }
+
+    if (options->resumable) {
+        const uint64_t fields[3] = { options->identity.length, options->identity.size, options->identity.mtimeNs };
+
+        out[length++] = PACKET_OPT_IDENTITY;
+        out[length++] = 28;
+        for (int i = 0; i < 3; i++) {
+            for (int shift = 56; shift >= 0; shift -= 8) {
+                out[length++] = fields[i] >> shift;
+            }
+        }
+        for (int shift = 24; shift >= 0; shift -= 8) {
+            out[length++] = options->identity.hash >> shift;
+        }
+    }
+
+    if (options->resumeOffset != 0) {
+        out[length++] = PACKET_OPT_RESUME;
+        out[length++] = 8;
+        for (int shift = 56; shift >= 0; shift -= 8) {
+            out[length++] = options->resumeOffset >> shift;
+        }
+    }
+
+    if (options->compressed) {
+        out[length++] = PACKET_OPT_COMPRESSION;
+        out[length++] = 0;
+    }
+
+    if (options->maxDatagram != 0) {
+        out[length++] = PACKET_OPT_MAX_DATAGRAM;
+        out[length++] = 2;
+        out[length++] = options->maxDatagram >> 8;
+        out[length++] = options->maxDatagram;
+    }
+
+    if (options->connectionId != 0) {
+        out[length++] = PACKET_OPT_CONNECTION_ID;
+        out[length++] = 4;
+        for (int shift = 24; shift >= 0; shift -= 8) {
+            out[length++] = options->connectionId >> shift;
+        }
+    }
+
+    packet->dataSize = length;
+}
+
+/**
+ * @brief packetGetOptions is a function that reads the handshake options of a SYN or SYN-ACK. Options that
+ *        are absent keep their defaults.
+ * 
+ * @param packet    The packet.
+ * @param options   Filled with the options.
+ */
+void packetGetOptions(const struct Packet *packet, struct HandshakeOptions *options) {
+    const unsigned char *in = (const unsigned char *) packet->data;
+    size_t length = packet->dataSize > 0 ? (size_t) packet->dataSize : 0;
+    size_t pos = 0;
+
+    memset(options, 0, sizeof(*options));
+    while (pos + 2 <= length && pos + 2 + in[pos + 1] <= length) {
+        const unsigned char *value = in + pos + 2;
+
+        switch (in[pos]) {
+            case PACKET_OPT_WINDOW_SCALE:
+                if (in[pos + 1] == 1 && value[0] <= PACKET_MAX_WINDOW_SCALE) {
+                    options->windowScale = value[0];
+                }
+                break;
+            case PACKET_OPT_RANGE:
+                if (in[pos + 1] == 8) {
+                    for (int i = 0; i < 8; i++) {
+                        options->rangeOffset = (options->rangeOffset << 8) | value[i];
+                    }
+                }
+                break;
+            case PACKET_OPT_FLOWS:
+                if (in[pos + 1] == 2) {
+                    options->flowCount = (uint16_t) (value[0] << 8 | value[1]);
+                }
+                break;
+            case PACKET_OPT_DIGEST:
+                options->digest = 1;
+                break;
+            case PACKET_OPT_ACK_FREQUENCY:
+                if (in[pos + 1] == 6) {
+                    options->ackEvery = (uint16_t) (value[0] << 8 | value[1]);
+                    for (int i = 2; i < 6; i++) {
+                        options->ackDelayUs = (options->ackDelayUs << 8) | value[i];
+                    }
+                }
+                break;
+            case PACKET_OPT_FEC:
+                if (in[pos + 1] == 2) {
+                    options->fecBlock = value[0];
+                    options->fecParity = value[1];
+                }
+                break;
+            case PACKET_OPT_IDENTITY:
+                if (in[pos + 1] == 28) {
+                    uint64_t fields[3] = { 0, 0, 0 };
+
+                    for (int i = 0; i < 24; i++) {
+                        fields[i / 8] = (fields[i / 8] << 8) | value[i];
+                    }
+                    for (int i = 24; i < 28; i++) {
+                        options->identity.hash = (options->identity.hash << 8) | value[i];
+                    }
+                    options->identity.length = fields[0];
+                    options->identity.size = fields[1];
+                    options->identity.mtimeNs = fields[2];
+                    options->resumable = 1;
+                }
+                break;
+            case PACKET_OPT_RESUME:
+                if (in[pos + 1] == 8) {
+                    for (int i = 0; i < 8; i++) {
+                        options->resumeOffset = (options->resumeOffset << 8) | value[i];
+                    }
+                }
+                break;
+            case PACKET_OPT_COMPRESSION:
+                options->compressed = 1;
+                break;
+            case PACKET_OPT_MAX_DATAGRAM:
+                if (in[pos + 1] == 2) {
+                    options->maxDatagram = (uint16_t) (value[0] << 8 | value[1]);
+                }
+                break;
+            case PACKET_OPT_CONNECTION_ID:
+                if (in[pos + 1] == 4) {
+                    for (int i = 0; i < 4; i++) {
+                        options->connectionId = (options->connectionId << 8) | value[i];
+                    }
+                }
+                break;
+            default:
+                break;
+        }
+        pos += 2 + in[pos + 1];
+    }
+}
@@ -0,0 +1,109 @@
+#include <string.h>
+
+#include "./include/pmtu.h"
+
+/**
+ * @brief pmtuInit is a function that starts a search for the largest datagram the path carries.
+ * 
+ * @param search    The search to initialize.
+ * @param maxSize   The largest datagram to try, which both ends must take.
+ */
+void pmtuInit(struct PmtuSearch *search, size_t maxSize) {
+    memset(search, 0, sizeof(*search));
+    search->base = maxSize < PMTU_BASE_SIZE ? maxSize : PMTU_BASE_SIZE;
+    search->floor = maxSize < PMTU_MIN_SIZE ? maxSize : PMTU_MIN_SIZE;
+    search->failed = maxSize + 1;
+}
+
+/**
+ * @brief addProbe is a function that adds a size to the round being planned, unless it is already known
+ *        or not above the last one added.
+ * 
+ * @param search    The search.
+ * @param size      The datagram size.
+ */
+static void addProbe(struct PmtuSearch *search, size_t size) {
+    if (search->count < PMTU_PROBES_PER_ROUND && pmtuPending(search, size) &&
+        (search->count == 0 || size > search->sizes[search->count - 1])) {
+        search->sizes[search->count++] = size;
+    }
+}
+
+/**
+ * @brief pmtuNextRound is a function that closes the current round, taking the smallest size it left
+ *        unanswered to be too big, and plans the next one in search->sizes.
+ * 
+ * @param search    The search.
+ * @return          The number of sizes to probe, 0 once the search is over.
+ */
+unsigned int pmtuNextRound(struct PmtuSearch *search) {
+    for (unsigned int i = 0; i < search->count; i++) {
+        if (pmtuPending(search, search->sizes[i])) {
+            pmtuTooBig(search, search->sizes[i]);
+            break;
+        }
+    }
+    search->count = 0;
+
+    if (search->rounds == 0) {
+        addProbe(search, search->base);
+        addProbe(search, search->failed - 1 < PMTU_ETHERNET_SIZE ? search->failed - 1 : PMTU_ETHERNET_SIZE);
+        addProbe(search, search->failed - 1);
+    } else if (search->rounds == 1 && search->confirmed == 0) {
+        // Not even the base got through, so the path is narrower than most: look below it, down to the floor
+        for (unsigned int i = 0; i < PMTU_PROBES_PER_ROUND; i++) {
+            addProbe(search, search->floor + (search->failed - 1 - search->floor) * i / PMTU_PROBES_PER_ROUND);
+        }
+    } else if (search->confirmed != 0 && search->failed - search->confirmed > PMTU_SEARCH_STEP) {
+        for (unsigned int i = 1; i <= PMTU_PROBES_PER_ROUND; i++) {
+            addProbe(search, search->confirmed + (search->failed - search->confirmed) * i / (PMTU_PROBES_PER_ROUND + 1));
+        }
+    }
+    search->rounds++;
+    return search->count;
+}
+
+/**
+ * @brief pmtuPending is a function that tells whether a size is still to be settled.
+ * 
+ * @param search    The search.
+ * @param size      The datagram size.
+ */
+int pmtuPending(const struct PmtuSearch *search, size_t size) {
+    return size > search->confirmed && size < search->failed;
+}
+
+/**
+ * @brief pmtuConfirm is a function that records the answer to a probe.
+ * 
+ * @param search    The search.
+ * @param size      The size of the probe that was answered.
+ */
+void pmtuConfirm(struct PmtuSearch *search, size_t size) {
+    if (pmtuPending(search, size)) {
+        search->confirmed = size;
+    }
+}
+
+/**
+ * @brief pmtuTooBig is a function that records that a size does not get through, as when it goes
+ *        unanswered or the local interface refuses it.
+ * 
+ * @param search    The search.
+ * @param size      The datagram size.
+ */
+void pmtuTooBig(struct PmtuSearch *search, size_t size) {
+    if (pmtuPending(search, size)) {
+        search->failed = size;
+    }
+}
+
+/**
+ * @brief pmtuResult is a function that returns the datagram size to use: the largest confirmed, or the
+ *        floor if no probe was ever answered.
+ * 
+ * @param search    The search.
+ */
+size_t pmtuResult(const struct PmtuSearch *search) {
+    return search->confirmed != 0 ? search->confirmed : search->floor;
+}
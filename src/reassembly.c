@@ -0,0 +1,229 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "./include/reassembly.h"
+
+/**
+ * @brief reassemblyInit is a function that allocates an empty reassembly ring.
+ * 
+ * @param buffer    The buffer to initialize.
+ * @param capacity  The number of segments that may be held, which is also the advertised window.
+ * @param pool      The pool segments are held in, whose buffers fit headroom + mss bytes.
+ * @param headroom  The bytes before the payload in every buffer, the packet header of adopted datagrams.
+ * @param mss       The payload size of every segment but the last.
+ * @param firstSeq  The sequence number of the first data segment.
+ */
+void reassemblyInit(struct ReassemblyBuffer *buffer, uint32_t capacity, struct BufferPool *pool, size_t headroom,
+                    size_t mss, uint32_t firstSeq) {
+    buffer->slots = calloc(capacity, sizeof(char *));
+    buffer->sizes = malloc(capacity * sizeof(ssize_t));
+    if (buffer->slots == NULL || buffer->sizes == NULL) {
+        perror("Error: Failed to allocate reassembly buffer");
+        exit(EXIT_FAILURE);
+    }
+    for (uint32_t i = 0; i < capacity; i++) {
+        buffer->sizes[i] = -1;
+    }
+    buffer->pool = pool;
+    buffer->headroom = headroom;
+    buffer->capacity = capacity;
+    buffer->mss = mss;
+    buffer->firstSeq = firstSeq;
+    buffer->cumulative = firstSeq;
+    buffer->written = firstSeq;
+    buffer->highest = firstSeq;
+    buffer->blockSize = 1;
+}
+
+/**
+ * @brief reassemblyDestroy is a function that frees a reassembly ring and returns the segments it still
+ *        holds to their pool.
+ * 
+ * @param buffer    The buffer to free.
+ */
+void reassemblyDestroy(struct ReassemblyBuffer *buffer) {
+    for (uint32_t i = 0; i < buffer->capacity; i++) {
+        if (buffer->slots[i] != NULL) {
+            bufferPut(buffer->pool, buffer->slots[i]);
+        }
+    }
+    free(buffer->slots);
+    free(buffer->sizes);
+    buffer->slots = NULL;
+    buffer->sizes = NULL;
+}
+
+/**
+ * @brief reassemblyAccepts is a function that tells whether a segment is new and fits in the window.
+ * 
+ * @param buffer    The reassembly buffer.
+ * @param seqNum    The sequence number of the segment.
+ * @param dataSize  The payload size.
+ */
+static int reassemblyAccepts(struct ReassemblyBuffer *buffer, uint32_t seqNum, ssize_t dataSize) {
+    return seqNum >= buffer->cumulative && seqNum - buffer->written < buffer->capacity && dataSize >= 0 &&
+           (size_t) dataSize <= buffer->mss && buffer->sizes[seqNum % buffer->capacity] < 0;
+}
+
+/**
+ * @brief reassemblyHold is a function that puts an accepted segment's buffer in its slot and advances the
+ *        cumulative point past it.
+ * 
+ * @param buffer    The reassembly buffer.
+ * @param seqNum    The sequence number of the segment.
+ * @param held      The buffer, with the payload headroom bytes in.
+ * @param dataSize  The payload size.
+ */
+static void reassemblyHold(struct ReassemblyBuffer *buffer, uint32_t seqNum, char *held, ssize_t dataSize) {
+    uint32_t slot = seqNum % buffer->capacity;
+
+    buffer->slots[slot] = held;
+    buffer->sizes[slot] = dataSize;
+    if (seqNum >= buffer->highest) {
+        buffer->highest = seqNum + 1;
+    }
+
+    while (buffer->cumulative - buffer->written < buffer->capacity &&
+           buffer->sizes[buffer->cumulative % buffer->capacity] >= 0) {
+        buffer->cumulative++;
+    }
+}
+
+/**
+ * @brief reassemblyStore is a function that keeps a copy of a received segment until it can be written
+ *        in order.
+ * 
+ * @param buffer    The reassembly buffer.
+ * @param seqNum    The sequence number of the segment.
+ * @param data      The payload.
+ * @param dataSize  The payload size, at most mss.
+ * @return          1 if the segment is new, 0 if it is a duplicate or outside the window.
+ */
+int reassemblyStore(struct ReassemblyBuffer *buffer, uint32_t seqNum, const void *data, ssize_t dataSize) {
+    char *held;
+
+    if (!reassemblyAccepts(buffer, seqNum, dataSize)) {
+        return 0;
+    }
+    held = bufferGet(buffer->pool);
+    memcpy(held + buffer->headroom, data, dataSize);
+    reassemblyHold(buffer, seqNum, held, dataSize);
+    return 1;
+}
+
+/**
+ * @brief reassemblyAdopt is a function that keeps a received datagram itself until its segment can be
+ *        written in order, instead of copying the payload out of it.
+ * 
+ * @param buffer    The reassembly buffer.
+ * @param seqNum    The sequence number of the segment.
+ * @param datagram  A buffer from the ring's pool holding the datagram, its payload headroom bytes in.
+ * @param dataSize  The payload size, at most mss.
+ * @return          1 if the segment is new and the ring now owns the buffer, 0 if it is a duplicate or
+ *                  outside the window and the buffer stays with the caller.
+ */
+int reassemblyAdopt(struct ReassemblyBuffer *buffer, uint32_t seqNum, void *datagram, ssize_t dataSize) {
+    if (!reassemblyAccepts(buffer, seqNum, dataSize)) {
+        return 0;
+    }
+    reassemblyHold(buffer, seqNum, datagram, dataSize);
+    return 1;
+}
+
+/**
+ * @brief reassemblySegment is a function that returns a segment received in order and not yet released.
+ * 
+ * @param buffer    The reassembly buffer.
+ * @param seqNum    A sequence number in written..cumulative-1.
+ * @param dataSize  Set to the payload size of the segment.
+ * @return          The payload, which stays in place until the segment is released.
+ */
+const char *reassemblySegment(struct ReassemblyBuffer *buffer, uint32_t seqNum, ssize_t *dataSize) {
+    uint32_t slot = seqNum % buffer->capacity;
+
+    *dataSize = buffer->sizes[slot];
+    return buffer->slots[slot] + buffer->headroom;
+}
+
+/**
+ * @brief reassemblyHeld is a function that tells whether a segment has arrived.
+ * 
+ * @param buffer    The reassembly buffer.
+ * @param seqNum    The sequence number.
+ */
+int reassemblyHeld(struct ReassemblyBuffer *buffer, uint32_t seqNum) {
+    if (seqNum < buffer->cumulative) {
+        return 1;
+    }
+    return seqNum - buffer->written < buffer->capacity && buffer->sizes[seqNum % buffer->capacity] >= 0;
+}
+
+/**
+ * @brief reassemblyReady is a function that returns the end of the in-order run the writer may take: the
+ *        cumulative point, rounded down to a block boundary unless the rest of the run is wanted too.
+ * 
+ * @param buffer    The reassembly buffer.
+ * @param all       Whether to include a partial last block, as when nothing more will arrive.
+ */
+uint32_t reassemblyReady(struct ReassemblyBuffer *buffer, int all) {
+    if (all) {
+        return buffer->cumulative;
+    }
+    return buffer->cumulative - (buffer->cumulative - buffer->firstSeq) % buffer->blockSize;
+}
+
+/**
+ * @brief reassemblyRelease is a function that frees the slots of every segment below upTo, which must
+ *        all have been received in order, and returns their buffers to the pool.
+ * 
+ * @param buffer    The reassembly buffer.
+ * @param upTo      The lowest sequence number that is kept.
+ */
+void reassemblyRelease(struct ReassemblyBuffer *buffer, uint32_t upTo) {
+    while (buffer->written < upTo) {
+        uint32_t slot = buffer->written % buffer->capacity;
+
+        bufferPut(buffer->pool, buffer->slots[slot]);
+        buffer->slots[slot] = NULL;
+        buffer->sizes[slot] = -1;
+        buffer->written++;
+    }
+}
+
+/**
+ * @brief reassemblyWindow is a function that returns how many segments past the cumulative point the
+ *        buffer can still accept.
+ * 
+ * @param buffer    The reassembly buffer.
+ */
+uint32_t reassemblyWindow(struct ReassemblyBuffer *buffer) {
+    return buffer->written + buffer->capacity - buffer->cumulative;
+}
+
+/**
+ * @brief reassemblySack is a function that builds the SACK bitmap of the segments held above the first
+ *        hole, in the layout described in packet.h.
+ * 
+ * @param buffer    The reassembly buffer.
+ * @param bitmap    Filled with the bitmap.
+ * @param maxBytes  The size of bitmap.
+ * @return          The length of the bitmap up to its last set bit, 0 if nothing is held out of order.
+ */
+size_t reassemblySack(struct ReassemblyBuffer *buffer, unsigned char *bitmap, size_t maxBytes) {
+    uint32_t first = buffer->cumulative + 1;
+    size_t length = 0;
+
+    for (uint32_t seq = first; seq < buffer->highest && seq - first < maxBytes * 8; seq++) {
+        uint32_t bit = seq - first;
+
+        if (bit % 8 == 0) {
+            bitmap[bit / 8] = 0;
+        }
+        if (buffer->sizes[seq % buffer->capacity] >= 0) {
+            bitmap[bit / 8] |= 1 << (bit % 8);
+            length = bit / 8 + 1;
+        }
+    }
+    return length;
+}
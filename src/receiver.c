@@ -1,256 +1,1699 @@
+#define _GNU_SOURCE
 #include <stdio.h>
 #include <stdlib.h>
+#include <stddef.h>
 #include <string.h>
+#include <limits.h>
 #include <arpa/inet.h>
 #include <netinet/in.h>
 
 #include <sys/types.h>
 #include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
 #include <unistd.h>
 
 #include <pthread.h>
 #include <errno.h>
 
 #include "./include/packet.h"
+#include "./include/netutil.h"
+#include "./include/rtt.h"
+#include "./include/timeutil.h"
+#include "./include/batchio.h"
+#include "./include/bufpool.h"
+#include "./include/reassembly.h"
+#include "./include/writer.h"
+#include "./include/conntable.h"
+#include "./include/timerwheel.h"
+#include "./include/stats.h"
+#include "./include/fec.h"
+#include "./include/checkpoint.h"
+#include "./include/affinity.h"
+
+#define IDLE_TIMEOUT_SEC 30     // How long the sender may stay silent before the transfer is abandoned
+#define SEQ_NUM 1               // Sequence number of the sender's first data segment
+#define RECV_ISN 1000           // Sequence number of the receiver's SYN-ACK
+#define RECV_WINDOW_SIZE 4096   // Segments the reassembly ring holds
+#define MAX_EVENT_LOOPS 64
+#define MIN_POOL_SHARE (2 * FEC_MAX_BLOCK)  // Least a connection may hold, so a block with a hole and the next fit
+#define DEFAULT_EVENT_LOOPS 8   // At most this many by default, one per CPU
+#define DEFAULT_DISK_WRITERS 4
+#define EPOLL_MAX_EVENTS 64
+#define READ_BUDGET 16          // Batches read from one socket before the other sockets get a turn
+#define HOUSEKEEPING_NS (1 * NSEC_PER_SEC)  // How often transfers missing flows are checked
+#define DEFAULT_ACK_EVERY 2     // In-order segments per ACK
+#define DEFAULT_ACK_DELAY_US 1000           // Longest an in-order segment waits for its ACK
+#define MAX_ACK_DELAY_US 100000             // Cap on the delay a sender may ask for
+
+// A sender backed off to the largest RTO must still be heard from before the idle timeout fires
+#if RTT_MAX_RTO > IDLE_TIMEOUT_SEC * NSEC_PER_SEC / 2
+#error "RTT_MAX_RTO must stay within half of IDLE_TIMEOUT_SEC"
+#endif
+
+/**
+ * Tunables set from the command line.
+ */
+struct RecvOptions {
+    unsigned int batchSize;     // Datagrams per recvmmsg/sendmmsg
+    unsigned int windowSize;    // Segments the reassembly ring holds, advertised to the sender
+    unsigned int poolSegments;  // Segments held across every connection, 0 for one window
+    unsigned long long int writeRate;   // Disk write limit in bytes per second per transfer, 0 for none
+    int direct;                 // Write with O_DIRECT
+    int offload;                // Receive coalesced UDP_GRO buffers
+    unsigned int loops;         // Event loop threads, 0 for one per CPU
+    unsigned int writers;       // Disk writer threads shared by every connection
+    int daemon;                 // Serve transfers until killed, each to its own file in a directory
+    unsigned int ackEvery;      // In-order segments per ACK unless the sender asks otherwise
+    unsigned int ackDelayUs;    // Maximum ACK delay unless the sender asks otherwise
+    const char  *statsPath;     // JSON statistics written at the end and on SIGUSR1
+    const char  *tracePath;     // qlog event trace
+    struct CpuList cpus;        // CPUs the event loops and then the disk writers are pinned to in turn
+    int         hugePages;      // Back the packet buffer pool with huge pages
+};
+
+struct RecvOptions recvOptions = { BATCH_DEFAULT_SIZE, RECV_WINDOW_SIZE, 0, 0, 0, 0, 0, DEFAULT_DISK_WRITERS, 0,
+                                   DEFAULT_ACK_EVERY, DEFAULT_ACK_DELAY_US, NULL, NULL, { 0 }, 0 };
+
+enum ConnState {
+    CONN_HANDSHAKE,     // SYN-ACK sent, waiting for the sender's ACK or first segment
+    CONN_DATA,          // Receiving segments
+    CONN_DRAINING,      // FIN received, waiting for the writer to write the rest
+    CONN_CLOSING,       // FIN+ACK sent, waiting for the sender's ACK
+    CONN_RELEASING,     // Finished, waiting for the writer pool to let go of the connection
+};
 
 /**
- * @brief connectSocket is a function that initializes a three-way handshake connection with a sender.
+ * One file being received, over one or more flows. Guarded by the receiver lock.
+ */
+struct Transfer {
+    struct ConnKey      key;
+    struct OutputFile   output;
+    char                filename[PATH_MAX];
+    unsigned int        flowCount;
+    unsigned int        accepted;       // Flows whose SYN arrived
+    unsigned int        finished;       // Flows that are done, whether or not they succeeded
+    int                 failed;
+    uint64_t            lastSyn;        // Monotonic time the last flow was accepted (ns)
+    int                 resumable;      // The sender identified its file, so progress is checkpointed
+    struct Checkpoint   checkpoint;
+    struct Transfer     *next;
+};
+
+struct EventLoop;
+
+/**
+ * One flow, received on its own socket connected to the sender. Owned by one event loop, which is the only
+ * thread that touches it apart from the fields guarded by the loop lock.
+ */
+struct Connection {
+    struct ConnKey      key;
+    int                 sockfd;
+    struct sockaddr_in  senderAddr;
+    struct EventLoop    *loop;
+    struct Transfer     *transfer;
+    enum ConnState      state;
+    uint32_t            seqNum;         // The receiver's sequence number
+    uint32_t            synSeqNum;      // Sequence number of the sender's SYN
+    uint32_t            peerTsVal;      // Timestamp of the SYN being answered, echoed in the SYN-ACK, 0 for none
+    uint32_t            finSeqNum;      // Sequence number of the sender's FIN
+    int                 digest;         // The sender sends the CRC32C of the range with its FIN
+    int                 compressed;     // Every data payload is a compressed block
+    int                 finDigestSent;
+    uint32_t            finDigest;
+    uint64_t            offset;         // File offset of the flow's first segment
+    uint64_t            resumed;        // Bytes of the range an earlier attempt wrote, which are not sent again
+    unsigned int        checkpointFlow; // The flow's index in its transfer's checkpoint
+    uint64_t            writeRate;
+    struct RttEstimator rtt;
+    int                 retries;        // Retransmissions of the SYN-ACK or FIN+ACK
+    uint64_t            lastHeard;      // Monotonic time of the sender's last packet (ns)
+    struct Timer        timer;          // Retransmission or idle timeout, depending on state
+    struct ReassemblyBuffer reassembly;
+    struct DiskWriter   writer;
+    int                 writerOpen;
+    int                 writerClosing;
+    uint32_t            advertisedEdge; // Highest sequence number the last ACK made room for
+    unsigned int        bufferSlots;    // Largest datagrams the socket's receive buffer holds, at most the ring
+    unsigned int        ackEvery;       // In-order segments per ACK
+    uint64_t            ackDelay;       // Longest an in-order segment waits for its ACK (ns)
+    unsigned int        unacked;        // In-order segments received since the last ACK
+    uint32_t            ackTsVal;       // Timestamp of the oldest segment waiting for its ACK
+    struct Timer        ackTimer;       // Sends the delayed ACK
+    unsigned int        fecBlock;       // Segments per FEC block, 0 without FEC
+    unsigned int        fecParity;      // Most parity segments per block
+    struct FecDecoder   fec;            // Guarded by the writer lock, like the ring
+    int                 failed;
+    int                 readable;       // Queued on the loop's ready list
+    int                 released;       // Queued on the loop's release list
+    struct Connection   *readyNext;
+    struct Connection   *releaseNext;
+    struct Connection   *workNext;      // Links the mailbox contents the loop is handling
+    struct Connection   *mailNext;      // The fields below are guarded by the loop lock
+    int                 pending;        // Queued for the loop after its writer made progress
+    struct ConnStats    stats;          // The loop counts in the RX slot and the writer pool in the disk slot
+};
+
+/**
+ * An event loop thread. It waits on the sockets of its connections with edge-triggered epoll and runs
+ * their timers on its own timer wheel. Other threads hand it work through the mailbox and its eventfd.
+ */
+struct EventLoop {
+    struct Receiver     *receiver;
+    int                 epfd;
+    int                 wakefd;         // eventfd written whenever the mailbox gets something
+    int                 listener;       // The listening socket on loop 0, -1 on the others
+    pthread_t           thread;
+    struct TimerWheel   wheel;
+    struct Timer        housekeeping;   // Loop 0 only
+    struct BatchIO      recvBatch;      // Shared by every socket of the loop
+    struct BatchIO      ackBatch;
+    int                 groWarned;
+    struct Connection   *ready;         // Sockets that still had datagrams after their read budget
+    struct Connection   *release;       // Connections to free at the end of the iteration
+    pthread_mutex_t     lock;           // Guards the mailbox
+    struct Connection   *incoming;      // New connections accepted by loop 0
+    struct Connection   *pending;       // Connections whose writer made progress
+};
+
+/**
+ * State shared by every event loop.
+ */
+struct Receiver {
+    unsigned short int  port;
+    const char          *destination;   // The output file, or the output directory of a daemon
+    unsigned long long int writeRate;
+    struct OutputFile   output;         // The output file when not a daemon
+    struct EventLoop    *loops;
+    unsigned int        loopCount;
+    struct WriterPool   pool;
+    struct BufferPool   buffers;        // Receive batches and reassembly rings, shared by every thread
+    unsigned int        flows;          // Connections sharing the pool, changed under the lock and read atomically
+    pthread_mutex_t     lock;           // Guards everything below
+    struct ConnTable    connections;    // Flows by sender address, port and connection ID
+    struct ConnTable    transfers;      // Transfers by sender address and connection ID
+    struct Transfer     *transferList;
+    unsigned int        nextLoop;
+    unsigned int        served;         // Transfers accepted so far
+    int                 stopping;
+};
+
+static void connFinish(struct Connection *conn);
+
+/**
+ * @brief receiveWindowScale is a function that returns the smallest shift that lets the whole reassembly
+ *        ring be advertised in the 16-bit windowSize field.
+ */
+static uint8_t receiveWindowScale(void) {
+    uint64_t bytes = (uint64_t) recvOptions.windowSize * PACKET_WINDOW_UNIT;
+    uint8_t scale = 0;
+
+    while ((bytes >> scale) > UINT16_MAX && scale < PACKET_MAX_WINDOW_SCALE) {
+        scale++;
+    }
+    return scale;
+}
+
+/**
+ * @brief advertisedWindow is a function that encodes a window in bytes for the windowSize field, rounding
+ *        down so the sender is never promised more room than there is.
  * 
- * @param sockfd        The file descriptor of the socket
- * @param senderAddr    The address of the sender
- * @param addrLen       The length of the sender address
- * @param seqNum        The sequence number of the receiver
+ * @param bytes     The free space in the reassembly ring.
  */
-void connectSocket(int sockfd, struct sockaddr *senderAddr, socklen_t addrLen, int *seqNum) {
-    struct Packet *recvPacket;
-    struct Packet *sendPacket;
-    int connectionEstablished = 0;
+static uint16_t advertisedWindow(uint64_t bytes) {
+    uint64_t scaled = bytes >> receiveWindowScale();
 
-    recvPacket = malloc(sizeof(struct Packet));
-    sendPacket = malloc(sizeof(struct Packet));
+    return scaled > UINT16_MAX ? UINT16_MAX : (uint16_t) scaled;
+}
 
-    // Begin three-way handshake
-    while (!connectionEstablished) {
-        if (recvfrom(sockfd, recvPacket, sizeof(struct Packet), 0, senderAddr, &addrLen) < 0) {
-            perror("Error: Failed to begin three-way handshake.");
-            exit(EXIT_FAILURE);
+/**
+ * @brief wakeLoop is a function that wakes an event loop to read its mailbox.
+ * 
+ * @param loop      The event loop.
+ */
+static void wakeLoop(struct EventLoop *loop) {
+    uint64_t one = 1;
+
+    if (write(loop->wakefd, &one, sizeof(one)) < 0 && errno != EAGAIN) {
+        perror("Error: Failed to wake event loop");
+        exit(EXIT_FAILURE);
+    }
+}
+
+/**
+ * @brief transferKey is a function that returns the key a flow's transfer is found by: the sender's
+ *        address and connection ID. A sender that sends no connection ID runs a single flow, which is then
+ *        told apart by its port.
+ * 
+ * @param senderAddr    The address of the sender.
+ * @param connectionId  The connection ID from the SYN, 0 if there was none.
+ */
+static struct ConnKey transferKey(const struct sockaddr_in *senderAddr, uint32_t connectionId) {
+    struct ConnKey key = connKeyMake(senderAddr, connectionId);
+
+    if (connectionId != 0) {
+        key.port = 0;
+    }
+    return key;
+}
+
+/**
+ * @brief transferComplete is a function that ends a transfer once every flow is done. A daemon closes the
+ *        file and reports it; otherwise the receiver stops. The caller holds the receiver lock.
+ * 
+ * @param receiver      The receiver.
+ * @param transfer      The transfer.
+ */
+static void transferComplete(struct Receiver *receiver, struct Transfer *transfer) {
+    connTableRemove(&receiver->transfers, &transfer->key);
+    for (struct Transfer **link = &receiver->transferList; *link != NULL; link = &(*link)->next) {
+        if (*link == transfer) {
+            *link = transfer->next;
+            break;
+        }
+    }
+
+    // A failed transfer leaves its checkpoint for the next attempt
+    if (transfer->resumable) {
+        if (transfer->failed) {
+            checkpointSave(&transfer->checkpoint);
+        } else {
+            checkpointRemove(&transfer->checkpoint);
+        }
+        checkpointDestroy(&transfer->checkpoint);
+    }
+
+    if (!recvOptions.daemon) {
+        receiver->stopping = 1;
+        for (unsigned int i = 0; i < receiver->loopCount; i++) {
+            wakeLoop(&receiver->loops[i]);
+        }
+        free(transfer);
+        return;
+    }
+
+    outputClose(&transfer->output);
+    if (transfer->failed) {
+        fprintf(stderr, "Error: Transfer to %s failed\n", transfer->filename);
+    } else {
+        printf("Received %s\n", transfer->filename);
+        fflush(stdout);
+    }
+    free(transfer);
+}
+
+/**
+ * @brief transferOpen is a function that starts a transfer for the first flow of a sender. A sender that
+ *        identifies its file gets a checkpoint next to the output, and if an earlier attempt at the same
+ *        file left one the output is kept for the flows to resume into; otherwise the output starts empty.
+ *        A daemon names a resumable transfer's output after the file identity, so a rerun finds it. The
+ *        caller holds the receiver lock.
+ * 
+ * @param receiver      The receiver.
+ * @param key           The key of the transfer.
+ * @param senderAddr    The address of the sender.
+ * @param options       The handshake options of the first SYN.
+ * @return              The transfer, or NULL if it cannot be received.
+ */
+static struct Transfer *transferOpen(struct Receiver *receiver, const struct ConnKey *key,
+                                     const struct sockaddr_in *senderAddr, const struct HandshakeOptions *options) {
+    struct Transfer *transfer;
+    char host[INET_ADDRSTRLEN];
+    char path[PATH_MAX + sizeof(CHECKPOINT_SUFFIX)];
+    int resumed = 0;
+
+    // Without -D only the first sender is served
+    if (!recvOptions.daemon && receiver->served > 0) {
+        return NULL;
+    }
+
+    transfer = calloc(1, sizeof(struct Transfer));
+    if (transfer == NULL) {
+        perror("Error: Failed to allocate transfer");
+        exit(EXIT_FAILURE);
+    }
+    transfer->key = *key;
+    transfer->flowCount = options->flowCount > 1 ? options->flowCount : 1;
+
+    if (!recvOptions.daemon) {
+        snprintf(transfer->filename, sizeof(transfer->filename), "%s", receiver->destination);
+        transfer->output = receiver->output;
+    } else {
+        inet_ntop(AF_INET, &senderAddr->sin_addr, host, sizeof(host));
+        if (options->resumable) {
+            snprintf(transfer->filename, sizeof(transfer->filename), "%s/%s-%08x", receiver->destination, host,
+                     checkpointKey(&options->identity));
+        } else if (options->connectionId != 0) {
+            snprintf(transfer->filename, sizeof(transfer->filename), "%s/%s-%08x", receiver->destination, host,
+                     options->connectionId);
+        } else {
+            snprintf(transfer->filename, sizeof(transfer->filename), "%s/%s-%u", receiver->destination, host,
+                     ntohs(senderAddr->sin_port));
+        }
+        for (struct Transfer *other = receiver->transferList; other != NULL; other = other->next) {
+            if (strcmp(other->filename, transfer->filename) == 0) {
+                fprintf(stderr, "Error: %s is already being received\n", transfer->filename);
+                free(transfer);
+                return NULL;
+            }
+        }
+        if (outputOpen(&transfer->output, transfer->filename, recvOptions.direct) < 0) {
+            fprintf(stderr, "Error: Unable to open file %s\n", transfer->filename);
+            free(transfer);
+            return NULL;
+        }
+    }
+
+    snprintf(path, sizeof(path), "%s%s", transfer->filename, CHECKPOINT_SUFFIX);
+    if (options->resumable) {
+        transfer->resumable = 1;
+        resumed = checkpointOpen(&transfer->checkpoint, path, transfer->output.fd, &options->identity,
+                                 transfer->flowCount);
+    } else {
+        unlink(path);
+    }
+    if (!resumed && ftruncate(transfer->output.fd, 0) < 0) {
+        fprintf(stderr, "Error: Unable to truncate file %s\n", transfer->filename);
+        if (transfer->resumable) {
+            checkpointDestroy(&transfer->checkpoint);
+        }
+        if (recvOptions.daemon) {
+            outputClose(&transfer->output);
+        }
+        free(transfer);
+        return NULL;
+    }
+
+    connTableInsert(&receiver->transfers, key, transfer);
+    transfer->next = receiver->transferList;
+    receiver->transferList = transfer;
+    receiver->served++;
+    return transfer;
+}
+
+/**
+ * @brief openFlowSocket is a function that creates a socket on the receiver's port. Every socket on the
+ *        port shares it through SO_REUSEPORT, and one connected to a sender gets all of that sender's
+ *        packets, so each flow is received on its own socket.
+ * 
+ *        Its receive buffer is sized to hold a whole window of the largest datagrams, so a sender that
+ *        keeps to the window never overflows it.
+ * 
+ * @param port          The port to receive data on
+ * @param peer          The sender to connect the socket to, or NULL for the listening socket
+ * @param bufferSlots   Filled with the segments the receive buffer holds, at most the ring's
+ * @return              The file descriptor of the socket
+ */
+static int openFlowSocket(unsigned short int port, const struct sockaddr_in *peer, unsigned int *bufferSlots) {
+    struct sockaddr_in receiverAddr;
+    int sockfd;
+    int on = 1;
+    size_t granted;
+
+    sockfd = socket(AF_INET, SOCK_DGRAM, 0);
+    if (sockfd == -1) {
+        perror("socket");
+        exit(EXIT_FAILURE);
+    }
+    if (setsockopt(sockfd, SOL_SOCKET, SO_REUSEPORT, &on, sizeof(on)) < 0) {
+        perror("setsockopt");
+        exit(EXIT_FAILURE);
+    }
+    granted = socketBufferSize(sockfd, 1, (size_t) recvOptions.windowSize * SOCKET_BUFFER_PER_DATAGRAM);
+    *bufferSlots = granted / SOCKET_BUFFER_PER_DATAGRAM < recvOptions.windowSize
+                   ? (unsigned int) (granted / SOCKET_BUFFER_PER_DATAGRAM) : recvOptions.windowSize;
+    if (*bufferSlots == 0) {
+        *bufferSlots = 1;
+    }
+
+    memset(&receiverAddr, 0, sizeof(receiverAddr));
+    receiverAddr.sin_family = AF_INET;
+    receiverAddr.sin_port = htons(port);
+    receiverAddr.sin_addr.s_addr = htonl(INADDR_ANY);
+    if (bind(sockfd, (struct sockaddr *)&receiverAddr, sizeof(receiverAddr)) == -1) {
+        perror("bind");
+        exit(EXIT_FAILURE);
+    }
+
+    if (peer != NULL && connect(sockfd, (const struct sockaddr *) peer, sizeof(*peer)) == -1) {
+        perror("connect");
+        exit(EXIT_FAILURE);
+    }
+    return sockfd;
+}
+
+/**
+ * @brief connAbort is a function that gives up on a connection after its error was reported. Without -D
+ *        the receiver exits, saving what it has of a resumable transfer first; a daemon only fails the
+ *        connection's transfer.
+ * 
+ * @param conn      The connection.
+ */
+static void connAbort(struct Connection *conn) {
+    if (!recvOptions.daemon) {
+        if (conn->transfer->resumable) {
+            checkpointSave(&conn->transfer->checkpoint);
+        }
+        exit(EXIT_FAILURE);
+    }
+    conn->failed = 1;
+    connFinish(conn);
+}
+
+/**
+ * @brief connDigestMismatch is a function that tells whether the sender's digest of the flow's range
+ *        disagrees with what the writer wrote. The writer must be done.
+ * 
+ * @param conn      The connection.
+ */
+static int connDigestMismatch(struct Connection *conn) {
+    return conn->digest && (!conn->finDigestSent || conn->finDigest != conn->writer.digest);
+}
+
+/**
+ * @brief connSenderGone is a function that tells whether a failed receive or send on a flow's socket only
+ *        means the sender has exited. The socket is connected, so once the sender's port is closed the
+ *        next FIN+ACK draws an ICMP port unreachable and the socket reports ECONNREFUSED. That is the end
+ *        of the flow once everything is written and matches the digest, and an error before then.
+ * 
+ * @param conn      The connection.
+ * @param error     The errno of the failed call.
+ */
+static int connSenderGone(struct Connection *conn, int error) {
+    if (error != ECONNREFUSED) {
+        return 0;
+    }
+    return conn->state == CONN_CLOSING ||
+           (conn->state == CONN_DRAINING && writerClosed(&conn->writer) > 0 && !connDigestMismatch(conn));
+}
+
+/**
+ * @brief poolShare is a function that returns how many pool buffers each connection may fill with segments:
+ *        an even share of the pool's budget, so the pool stops growing once every connection holds its
+ *        share and further data waits at the sender.
+ * 
+ * @param receiver  The receiver.
+ */
+static uint32_t poolShare(struct Receiver *receiver) {
+    unsigned int flows = __atomic_load_n(&receiver->flows, __ATOMIC_RELAXED);
+    uint32_t budget = recvOptions.poolSegments != 0 ? recvOptions.poolSegments : recvOptions.windowSize;
+    uint32_t share = flows > 1 ? budget / flows : budget;
+
+    return share > MIN_POOL_SHARE ? share : MIN_POOL_SHARE;
+}
+
+/**
+ * @brief connLimit is a function that returns the most segments the connection may advertise at once: what
+ *        its socket buffer holds and its share of the pool.
+ * 
+ * @param conn      The connection.
+ */
+static uint32_t connLimit(struct Connection *conn) {
+    uint32_t share = poolShare(conn->loop->receiver);
+
+    return share < conn->bufferSlots ? share : conn->bufferSlots;
+}
+
+/**
+ * @brief connWindow is a function that returns how many segments past the cumulative point the sender may
+ *        send: what the reassembly ring can still accept, but no more than the socket buffer holds or
+ *        than the connection's share of the pool has left once the segments waiting for the writer are
+ *        counted. The caller holds the writer lock.
+ * 
+ * @param conn      The connection.
+ */
+static uint32_t connWindow(struct Connection *conn) {
+    uint32_t window = reassemblyWindow(&conn->reassembly);
+    uint32_t waiting = conn->reassembly.cumulative - conn->reassembly.written;
+    uint32_t share = poolShare(conn->loop->receiver);
+    uint32_t pooled = share > waiting ? share - waiting : 0;
+
+    window = window < conn->bufferSlots ? window : conn->bufferSlots;
+    return window < pooled ? window : pooled;
+}
+
+/**
+ * @brief sendSynAck is a function that sends the second packet of the handshake. It advertises the empty
+ *        reassembly ring and the window scale used in every later ACK, where a resumed flow starts, and the
+ *        largest datagram the sender may probe the path for.
+ * 
+ * @param conn      The connection.
+ * @return          0 on success, -1 on error.
+ */
+static int sendSynAck(struct Connection *conn) {
+    struct Packet packet;
+    struct HandshakeOptions options = { .windowScale = receiveWindowScale(), .fecBlock = conn->fecBlock,
+                                        .fecParity = conn->fecParity, .resumeOffset = conn->resumed,
+                                        .compressed = conn->compressed, .maxDatagram = PACKET_MAX_SIZE };
+
+    memset(&packet, 0, sizeof(packet));
+    packet.synBit = 1;
+    packet.ackBit = 1;
+    packet.seqNum = conn->seqNum;
+    packet.ackNum = conn->synSeqNum;
+    packet.windowSize = advertisedWindow((uint64_t) connLimit(conn) * PACKET_WINDOW_UNIT);
+    packet.tsVal = timestampUs();
+    packet.tsEcr = conn->peerTsVal;
+    packetSetOptions(&packet, &options);
+    return sendPacketTo(conn->sockfd, &packet, (struct sockaddr *) &conn->senderAddr, sizeof(conn->senderAddr));
+}
+
+/**
+ * @brief sendFinAck is a function that acknowledges the sender's FIN and sends the receiver's FIN with it.
+ * 
+ * @param conn      The connection.
+ * @return          0 on success, -1 on error.
+ */
+static int sendFinAck(struct Connection *conn) {
+    struct Packet packet;
+
+    memset(&packet, 0, sizeof(packet));
+    packet.seqNum = conn->seqNum;
+    packet.ackBit = 1;
+    packet.ackNum = conn->finSeqNum;
+    packet.finBit = 1;
+    packet.tsVal = timestampUs();
+    return sendPacketTo(conn->sockfd, &packet, (struct sockaddr *) &conn->senderAddr, sizeof(conn->senderAddr));
+}
+
+/**
+ * @brief sendProbeAck is a function that answers a path MTU probe with its length, so the sender knows
+ *        datagrams that large reach us.
+ * 
+ * @param conn      The connection.
+ * @param probe     The probe.
+ * @param length    The length of the probe datagram.
+ * @return          0 on success, -1 on error.
+ */
+static int sendProbeAck(struct Connection *conn, const struct Packet *probe, size_t length) {
+    struct Packet packet;
+
+    memset(&packet, 0, offsetof(struct Packet, data));
+    packet.seqNum = conn->seqNum;
+    packet.ackBit = 1;
+    packet.pmtuBit = 1;
+    packet.ackNum = length;
+    packet.tsVal = timestampUs();
+    packet.tsEcr = probe->tsVal;
+    return sendPacketTo(conn->sockfd, &packet, (struct sockaddr *) &conn->senderAddr, sizeof(conn->senderAddr));
+}
+
+/**
+ * @brief queueAck is a function that queues an ACK of the highest in-order segment in the loop's ACK
+ *        batch, with the room left in the reassembly ring and, with FEC, the count of rebuilt segments.
+ *        The caller holds the writer lock.
+ * 
+ * @param conn      The connection.
+ * @param tsEcr     The timestamp to echo, 0 for none.
+ * @param sack      Whether to report what is held beyond the first gap.
+ * @return          0 on success, -1 if a full batch could not be sent.
+ */
+static int queueAck(struct Connection *conn, uint32_t tsEcr, int sack) {
+    struct BatchIO *batch = &conn->loop->ackBatch;
+    struct Packet packet;
+
+    memset(&packet, 0, offsetof(struct Packet, data));
+    packet.seqNum = conn->seqNum;
+    packet.ackBit = 1;
+    packet.ackNum = conn->reassembly.cumulative - 1;
+    packet.windowSize = advertisedWindow((uint64_t) connWindow(conn) * PACKET_WINDOW_UNIT);
+    packet.tsEcr = tsEcr;
+    if (conn->fecBlock != 0) {
+        uint32_t repaired = htonl(conn->fec.repaired);
+
+        memcpy(packet.data, &repaired, sizeof(repaired));
+        packet.dataSize = PACKET_REPAIRED_SIZE;
+    }
+    if (sack) {
+        packet.dataSize += reassemblySack(&conn->reassembly, (unsigned char *) packet.data + packet.dataSize,
+                                          PACKET_MAX_SACK_BYTES);
+    }
+
+    // Coalesced receives can bring in more datagrams than the ACK batch holds
+    if (batchFull(batch) && batchFlush(conn->sockfd, batch) < 0) {
+        return -1;
+    }
+    size_t length = packetSerialize(&packet, batchNext(batch));
+    batchQueue(batch, length, &conn->senderAddr, sizeof(conn->senderAddr));
+    statsAdd(&conn->stats.counters[STATS_SLOT_RX], STAT_PACKETS_SENT, 1);
+    statsAdd(&conn->stats.counters[STATS_SLOT_RX], STAT_BYTES_SENT, length);
+    if (traceEnabled()) {
+        traceEvent(&conn->stats, monotonicNs(), "transport:packet_sent",
+                   "\"header\": {\"packet_type\": \"ack\", \"packet_number\": %u}, \"raw\": {\"length\": %zu}, "
+                   "\"frames\": [{\"frame_type\": \"ack\", \"largest_acknowledged\": %u, \"sack_bytes\": %zd}]",
+                   packet.seqNum, length, packet.ackNum, packet.dataSize);
+    }
+    conn->advertisedEdge = conn->reassembly.cumulative + connWindow(conn) - 1;
+
+    // Every ACK covers the segments whose ACK was being delayed
+    conn->unacked = 0;
+    timerCancel(&conn->loop->wheel, &conn->ackTimer);
+    return 0;
+}
+
+/**
+ * @brief queueWindowUpdate is a function that announces a window the writer has reopened by a good amount;
+ *        the sender may be waiting on it. The caller holds the writer lock.
+ * 
+ * @param conn      The connection.
+ * @return          0 on success, -1 if a full batch could not be sent.
+ */
+static int queueWindowUpdate(struct Connection *conn) {
+    int32_t updateStep = connLimit(conn) / 2 > 0 ? connLimit(conn) / 2 : 1;
+    uint32_t edge = conn->reassembly.cumulative + connWindow(conn) - 1;
+
+    // The edge moves back when more connections share the pool
+    if ((int32_t) (edge - conn->advertisedEdge) < updateStep) {
+        return 0;
+    }
+    return queueAck(conn, 0, 0);
+}
+
+/**
+ * @brief connProgress is called by a writer pool thread after it drained the connection's writer. It
+ *        queues the connection for its event loop, which may reopen the window or finish the connection.
+ * 
+ * @param arg   The connection.
+ */
+static void connProgress(void *arg) {
+    struct Connection *conn = arg;
+    struct EventLoop *loop = conn->loop;
+    int wake = 0;
+
+    pthread_mutex_lock(&loop->lock);
+    if (!conn->pending) {
+        conn->pending = 1;
+        conn->mailNext = loop->pending;
+        loop->pending = conn;
+        wake = 1;
+    }
+    pthread_mutex_unlock(&loop->lock);
+
+    if (wake) {
+        wakeLoop(loop);
+    }
+}
+
+/**
+ * @brief connAckTimeout is the delayed ACK timer handler: in-order segments waited long enough for more
+ *        to share their ACK.
+ * 
+ * @param timer     The connection's ACK timer.
+ * @param arg       The connection.
+ * @param now       The current monotonic time (ns).
+ */
+static void connAckTimeout(struct Timer *timer, void *arg, uint64_t now) {
+    struct Connection *conn = arg;
+    int result = 0;
+
+    (void) timer;
+    (void) now;
+    if (conn->state != CONN_DATA || conn->unacked == 0) {
+        return;
+    }
+
+    pthread_mutex_lock(&conn->writer.lock);
+    result = queueAck(conn, conn->ackTsVal, 1);
+    pthread_mutex_unlock(&conn->writer.lock);
+
+    if (result < 0 || batchFlush(conn->sockfd, &conn->loop->ackBatch) < 0) {
+        perror("Error: Failed to send ACK during data transfer.");
+        connAbort(conn);
+    }
+}
+
+/**
+ * @brief connEstablish is a function that completes the handshake and readies the flow for data.
+ * 
+ * @param conn      The connection.
+ */
+static void connEstablish(struct Connection *conn) {
+    conn->seqNum++;
+    conn->state = CONN_DATA;
+    reassemblyInit(&conn->reassembly, recvOptions.windowSize, &conn->loop->receiver->buffers, PACKET_HEADER_SIZE,
+                   PACKET_MAX_PAYLOAD, SEQ_NUM);
+    if (conn->fecBlock != 0) {
+        fecDecoderInit(&conn->fec, recvOptions.windowSize, conn->fecBlock, conn->fecParity, PACKET_MAX_PAYLOAD);
+        conn->reassembly.blockSize = conn->fecBlock;
+    }
+    conn->advertisedEdge = SEQ_NUM - 1 + connLimit(conn);
+    writerOpen(&conn->writer, &conn->loop->receiver->pool, &conn->transfer->output, conn->offset, &conn->reassembly,
+               conn->writeRate, connProgress, conn);
+    conn->writer.digesting = conn->digest;
+    if (conn->compressed) {
+        writerDecompress(&conn->writer);
+    }
+    conn->writer.stats = &conn->stats.counters[STATS_SLOT_DISK];
+    if (conn->transfer->resumable) {
+        conn->writer.checkpoint = &conn->transfer->checkpoint;
+        conn->writer.checkpointFlow = conn->checkpointFlow;
+    }
+    conn->writerOpen = 1;
+    timerArm(&conn->loop->wheel, &conn->timer, conn->lastHeard + IDLE_TIMEOUT_SEC * NSEC_PER_SEC);
+}
+
+/**
+ * @brief connStartClosing is a function that sends the FIN+ACK once the writer has written everything.
+ *        It is retransmitted with exponential backoff until the sender acknowledges it or gives up.
+ * 
+ * @param conn      The connection.
+ * @param now       The current monotonic time (ns).
+ */
+static void connStartClosing(struct Connection *conn, uint64_t now) {
+    conn->state = CONN_CLOSING;
+    conn->retries = 0;
+    if (sendFinAck(conn) < 0) {
+        if (connSenderGone(conn, errno)) {
+            connFinish(conn);
+            return;
         }
+        perror("Error: Failed to send second packet during disconnect.");
+        connAbort(conn);
+        return;
+    }
+    timerArm(&conn->loop->wheel, &conn->timer, now + rttCurrentRto(&conn->rtt));
+}
+
+/**
+ * @brief connTimeout is the timer handler of a connection: it retransmits the SYN-ACK or FIN+ACK, or gives
+ *        up on a sender that stopped responding.
+ * 
+ * @param timer     The connection's timer.
+ * @param arg       The connection.
+ * @param now       The current monotonic time (ns).
+ */
+static void connTimeout(struct Timer *timer, void *arg, uint64_t now) {
+    struct Connection *conn = arg;
+    struct TimerWheel *wheel = &conn->loop->wheel;
 
-        if (recvPacket->synBit == 1) {
-            sendPacket->synBit = 1;
-            sendPacket->ackBit = 1;
-            sendPacket->seqNum = *seqNum;
-            sendPacket->ackNum = recvPacket->seqNum;
-            
-            if (sendto(sockfd, sendPacket, sizeof(struct Packet), 0, senderAddr, addrLen) < 0) {
+    switch (conn->state) {
+        case CONN_HANDSHAKE:
+            rttBackoff(&conn->rtt);
+            if (++conn->retries > RTT_MAX_RETRIES) {
+                fprintf(stderr, "Error: Sender did not complete the handshake\n");
+                connAbort(conn);
+                break;
+            }
+            // The resend answers no SYN, so echoing the old one's timestamp would hand the sender an RTT
+            // sample inflated by our own timer
+            conn->peerTsVal = 0;
+            if (sendSynAck(conn) < 0) {
                 perror("Error: Failed to send second packet in three-way handshake.");
-                exit(EXIT_FAILURE);
+                connAbort(conn);
+            } else {
+                timerArm(wheel, timer, now + rttCurrentRto(&conn->rtt));
+            }
+            break;
+        case CONN_DATA:
+            if (now - conn->lastHeard >= IDLE_TIMEOUT_SEC * NSEC_PER_SEC) {
+                fprintf(stderr, "Error: Sender stopped responding during data transfer\n");
+                connAbort(conn);
+            } else {
+                timerArm(wheel, timer, conn->lastHeard + IDLE_TIMEOUT_SEC * NSEC_PER_SEC);
+            }
+            break;
+        case CONN_CLOSING:
+            rttBackoff(&conn->rtt);
+            if (++conn->retries > RTT_MAX_RETRIES) {
+                // Everything is written, so the transfer itself succeeded
+                fprintf(stderr, "Error: Sender did not acknowledge the FIN\n");
+                connFinish(conn);
+            } else if (sendFinAck(conn) < 0) {
+                if (connSenderGone(conn, errno)) {
+                    connFinish(conn);
+                } else {
+                    perror("Error: Failed to send second packet during disconnect.");
+                    connAbort(conn);
+                }
+            } else {
+                timerArm(wheel, timer, now + rttCurrentRto(&conn->rtt));
             }
-            *seqNum = *seqNum + 1;
+            break;
+        default:
+            break;
+    }
+}
 
-            if (recvfrom(sockfd, recvPacket, sizeof(struct Packet), 0, senderAddr, &addrLen) < 0) {
-                perror("Error: Failed to receive third packet in three-way handshake.");
-                exit(EXIT_FAILURE);
+/**
+ * @brief connStart is a function that registers a new connection with its event loop and sends the
+ *        SYN-ACK, starting the handshake.
+ * 
+ * @param conn      The connection.
+ * @param now       The current monotonic time (ns).
+ */
+static void connStart(struct Connection *conn, uint64_t now) {
+    struct EventLoop *loop = conn->loop;
+    struct epoll_event event = { .events = EPOLLIN | EPOLLET, .data.ptr = conn };
+
+    if (epoll_ctl(loop->epfd, EPOLL_CTL_ADD, conn->sockfd, &event) < 0) {
+        perror("Error: Failed to watch flow socket");
+        exit(EXIT_FAILURE);
+    }
+    if (recvOptions.offload && batchEnableGro(conn->sockfd, &loop->recvBatch) < 0 && !loop->groWarned) {
+        fprintf(stderr, "Warning: UDP_GRO is not supported, receiving one datagram per message\n");
+        loop->groWarned = 1;
+    }
+
+    conn->state = CONN_HANDSHAKE;
+    conn->lastHeard = now;
+    rttInit(&conn->rtt);
+    timerInit(&conn->timer, connTimeout, conn);
+    timerInit(&conn->ackTimer, connAckTimeout, conn);
+    if (sendSynAck(conn) < 0) {
+        perror("Error: Failed to send second packet in three-way handshake.");
+        connAbort(conn);
+        return;
+    }
+    timerArm(&loop->wheel, &conn->timer, now + rttCurrentRto(&conn->rtt));
+}
+
+/**
+ * @brief connHandleBatch is a function that runs a batch of the flow's datagrams through its state
+ *        machine. Segments are held in the reassembly ring until they are contiguous and then handed to
+ *        the writer pool, so a loss only costs the missing segment and a slow disk never stalls the
+ *        socket. Every segment is answered with a cumulative ACK of the highest in-order sequence number,
+ *        a SACK bitmap of the segments held past the first gap and the space left in the ring, which is
+ *        the sender's flow-control window. Zero-length segments are window probes and get the same ACK.
+ *        Datagrams whose checksum does not match are dropped and counted. Segments that arrive in order
+ *        share an ACK between every ackEvery of them, or after ackDelay if fewer arrive. With FEC, parity
+ *        segments rebuild what their block is missing straight into the ring, which is acknowledged at once.
+ * 
+ * @param conn      The connection.
+ * @param count     The number of datagrams in the loop's receive batch.
+ * @param now       The current monotonic time (ns).
+ * @return          0 on success, -1 if an ACK could not be sent.
+ */
+static int connHandleBatch(struct Connection *conn, int count, uint64_t now) {
+    struct BatchIO *batch = &conn->loop->recvBatch;
+    struct StatsCounters *counters = &conn->stats.counters[STATS_SLOT_RX];
+    int locked = 0;
+    int finReceived = 0;
+    int result = 0;
+
+    for (int i = 0; i < count && result == 0; i++) {
+        char *datagram = batchData(batch, i);
+        struct Packet packet;
+
+        statsAdd(counters, STAT_PACKETS_RECEIVED, 1);
+        statsAdd(counters, STAT_BYTES_RECEIVED, batchLength(batch, i));
+        if (packetParseHeader(&packet, datagram, batchLength(batch, i)) < 0) {
+            continue;
+        }
+        if (!packetVerify(datagram, batchLength(batch, i))) {
+            statsAdd(counters, STAT_CORRUPT, 1);
+            continue;
+        }
+        conn->lastHeard = now;
+
+        // Path MTU probes only follow our SYN-ACK and take no part in the sequence space
+        if (packet.pmtuBit == 1) {
+            if (sendProbeAck(conn, &packet, batchLength(batch, i)) < 0) {
+                result = -1;
             }
+            continue;
+        }
+
+        if (conn->state == CONN_HANDSHAKE) {
+            if (packet.synBit == 1) {
+                // Our SYN-ACK was lost
+                conn->peerTsVal = packet.tsVal;
+                if (sendSynAck(conn) < 0) {
+                    result = -1;
+                }
+                continue;
+            }
+            if (packet.ackBit == 1 && packet.ackNum == conn->seqNum) {
+                if (rttSampleEcho(&conn->rtt, packet.tsEcr, timestampUs())) {
+                    statsHistogramRecord(&conn->stats.rtt, conn->rtt.latest / NSEC_PER_USEC);
+                }
+                connEstablish(conn);
+                continue;
+            }
+            // Data means the sender has our SYN-ACK, so the segment is received like any other
+            connEstablish(conn);
+        }
+
+        if (conn->state == CONN_CLOSING) {
+            if (packet.ackBit == 1 && packet.ackNum == conn->seqNum) {
+                connFinish(conn);
+            } else if (packet.finBit == 1 && sendFinAck(conn) < 0) {
+                result = -1;
+            }
+            continue;
+        }
+
+        if (conn->state != CONN_DATA) {
+            continue;
+        }
+
+        // The sender only sends its FIN once everything is acknowledged, so the ring holds the rest of the file
+        if (packet.finBit == 1) {
+            conn->state = CONN_DRAINING;
+            conn->finSeqNum = packet.seqNum;
+            if (packet.dataSize >= (ssize_t) sizeof(conn->finDigest)) {
+                memcpy(&conn->finDigest, datagram + PACKET_HEADER_SIZE, sizeof(conn->finDigest));
+                conn->finDigest = ntohl(conn->finDigest);
+                conn->finDigestSent = 1;
+            }
+            finReceived = 1;
+            continue;
+        }
 
-            if (recvPacket->ackBit == 1 && recvPacket->ackNum == sendPacket->seqNum) {
-                connectionEstablished = 1;
+        // Late handshake retransmissions carry no data
+        if (packet.synBit == 1) {
+            continue;
+        }
+
+        if (!locked) {
+            pthread_mutex_lock(&conn->writer.lock);
+            locked = 1;
+        }
+
+        if (packet.parityBit == 1) {
+            unsigned int repaired = 0;
+
+            statsAdd(counters, STAT_FEC_PARITY, 1);
+            if (conn->fecBlock != 0) {
+                repaired = fecDecoderStore(&conn->fec, &conn->reassembly, packet.seqNum,
+                                           packet.ackNum >> PACKET_PARITY_COUNT_SHIFT,
+                                           packet.ackNum & PACKET_PARITY_ROW_MASK, packet.windowSize,
+                                           datagram + PACKET_HEADER_SIZE, packet.dataSize);
+            }
+            if (traceEnabled()) {
+                traceEvent(&conn->stats, now, "transport:packet_received",
+                           "\"header\": {\"packet_type\": \"parity\", \"packet_number\": %u}, "
+                           "\"raw\": {\"length\": %zu}, \"repaired\": %u", packet.seqNum, batchLength(batch, i),
+                           repaired);
             }
-            else {
-                perror("Error: Failed to establish connection at the third stage.");
+            if (repaired > 0) {
+                statsAdd(counters, STAT_FEC_REPAIRED, repaired);
+                result = queueAck(conn, packet.tsVal, 1);
             }
+            continue;
         }
-        else {
-            perror("Error: Failed to establish connection at the first stage.");
+
+        // Anything but the next segment in a hole-free ring is acknowledged at once, so the sender learns
+        // of losses, recoveries, duplicates and probes without delay. In-order segments share their ACKs.
+        uint32_t expected = conn->reassembly.cumulative;
+        int holes = conn->reassembly.highest > expected;
+        unsigned int repaired = 0;
+        int stored;
+
+        // A datagram with a pool buffer of its own is kept as it is, and the batch takes a fresh buffer
+        if (batch->pool != NULL) {
+            stored = reassemblyAdopt(&conn->reassembly, packet.seqNum, datagram, packet.dataSize);
+            if (stored) {
+                batchDetach(batch, i);
+            }
+        } else {
+            stored = reassemblyStore(&conn->reassembly, packet.seqNum, datagram + PACKET_HEADER_SIZE,
+                                     packet.dataSize);
+        }
+
+        // A segment that arrives after its block's parity may be what the parity was waiting for
+        if (stored && conn->fecBlock != 0) {
+            repaired = fecDecoderRepair(&conn->fec, &conn->reassembly, packet.seqNum);
+            statsAdd(counters, STAT_FEC_REPAIRED, repaired);
         }
+
+        if (packet.dataSize == 0) {
+            statsAdd(counters, STAT_PROBES, 1);
+        } else if (!stored) {
+            statsAdd(counters, STAT_DUPLICATES, 1);
+        }
+        if (traceEnabled()) {
+            traceEvent(&conn->stats, now, "transport:packet_received",
+                       "\"header\": {\"packet_type\": \"data\", \"packet_number\": %u}, \"raw\": {\"length\": %zu}, "
+                       "\"duplicate\": %s", packet.seqNum, batchLength(batch, i),
+                       !stored && packet.dataSize > 0 ? "true" : "false");
+        }
+
+        if (!stored || holes || packet.seqNum != expected || repaired > 0) {
+            result = queueAck(conn, packet.tsVal, 1);
+        } else if (conn->unacked++ == 0) {
+            // A shared ACK echoes its oldest segment, so the sender's RTT includes the delay (RFC 7323)
+            conn->ackTsVal = packet.tsVal;
+        }
+        if (result == 0 && conn->unacked >= conn->ackEvery) {
+            result = queueAck(conn, conn->ackTsVal, 1);
+        } else if (conn->unacked > 0 && !conn->ackTimer.armed) {
+            timerArm(&conn->loop->wheel, &conn->ackTimer, now + conn->ackDelay);
+        }
+    }
+
+    if (locked) {
+        if (result == 0 && conn->state == CONN_DATA) {
+            result = queueWindowUpdate(conn);
+        }
+        writerNotify(&conn->writer);
+        pthread_mutex_unlock(&conn->writer.lock);
+    }
+
+    if (finReceived) {
+        timerCancel(&conn->loop->wheel, &conn->timer);
+        timerCancel(&conn->loop->wheel, &conn->ackTimer);
+        conn->writerClosing = 1;
+        writerClose(&conn->writer);
     }
 
-    free(recvPacket);
-    free(sendPacket);
+    if (batchFlush(conn->sockfd, &conn->loop->ackBatch) < 0) {
+        result = -1;
+    }
+    return result;
 }
 
 /**
- * @brief disconnectSocket is a function that terminates a connection with a sender.
+ * @brief connReceive is a function that reads the datagrams queued on a flow's socket. Edge-triggered
+ *        epoll only reports new datagrams, so the socket is read until it is empty, or queued on the ready
+ *        list to be read again after the other sockets if it used up its budget.
  * 
- * @param sockfd        The file descriptor of the socket
- * @param senderAddr    The address of the sender
- * @param addrLen       The length of the sender address
- * @param seqNum        The sequence number of the receiver
+ * @param conn      The connection.
+ * @param now       The current monotonic time (ns).
  */
-void disconnectSocket(int sockfd, struct sockaddr *senderAddr, socklen_t addrLen, int *seqNum) {
-    struct Packet *recvPacket;
-    struct Packet *sendPacket;
-    int connectionFinished = 0;
+static void connReceive(struct Connection *conn, uint64_t now) {
+    struct EventLoop *loop = conn->loop;
 
-    recvPacket = malloc(sizeof(struct Packet));
-    sendPacket = malloc(sizeof(struct Packet));
+    for (int round = 0; round < READ_BUDGET; round++) {
+        int received;
 
-    // Begin disconnection
-    while (!connectionFinished) {
-        // Check that a second FIN packet is received
-        if (recvfrom(sockfd, recvPacket, sizeof(struct Packet), 0, senderAddr, &addrLen) < 0) {
-            perror("Error: Failed to receive fourth packet during disconnect.");
-            exit(EXIT_FAILURE);
+        if (conn->state == CONN_RELEASING) {
+            return;
         }
+        received = batchReceive(conn->sockfd, &loop->recvBatch, MSG_DONTWAIT);
+        if (received < 0 && connSenderGone(conn, errno)) {
+            connFinish(conn);
+            return;
+        }
+        if (received < 0) {
+            perror("Error: Failed to receive packet during data transfer.");
+            connAbort(conn);
+            return;
+        }
+        if (received == 0) {
+            return;
+        }
+        if (connHandleBatch(conn, received, now) < 0) {
+            if (connSenderGone(conn, errno)) {
+                connFinish(conn);
+                return;
+            }
+            perror("Error: Failed to send ACK during data transfer.");
+            connAbort(conn);
+            return;
+        }
+    }
 
-        sendPacket->seqNum = *seqNum;
-        sendPacket->ackBit = 1;
-        sendPacket->ackNum = recvPacket->seqNum;
-        
-        // Send an acknowledgment for the second FIN packet
-        if (sendto(sockfd, sendPacket, sizeof(struct Packet), 0, senderAddr, addrLen) < 0) {
-            perror("Error: Failed to send second packet during disconnect.");
-            exit(EXIT_FAILURE);
+    conn->readable = 1;
+    conn->readyNext = loop->ready;
+    loop->ready = conn;
+}
+
+/**
+ * @brief connProgressed is a function that acts on writer progress: a reopened window is announced, a
+ *        drained writer lets the connection close and a failed one aborts it.
+ * 
+ * @param conn      The connection.
+ * @param now       The current monotonic time (ns).
+ */
+static void connProgressed(struct Connection *conn, uint64_t now) {
+    int result;
+    int closed;
+
+    switch (conn->state) {
+        case CONN_DATA:
+            pthread_mutex_lock(&conn->writer.lock);
+            result = queueWindowUpdate(conn);
+            pthread_mutex_unlock(&conn->writer.lock);
+
+            if (result < 0 || batchFlush(conn->sockfd, &conn->loop->ackBatch) < 0) {
+                perror("Error: Failed to send ACK during data transfer.");
+                connAbort(conn);
+            } else if (writerClosed(&conn->writer) < 0) {
+                connAbort(conn);
+            }
+            break;
+        case CONN_DRAINING:
+            closed = writerClosed(&conn->writer);
+            if (closed > 0 && connDigestMismatch(conn)) {
+                fprintf(stderr, "Error: Digest mismatch for the range at offset %llu\n",
+                        (unsigned long long int) conn->offset);
+                if (conn->transfer->resumable) {
+                    checkpointForget(&conn->transfer->checkpoint, conn->checkpointFlow);
+                }
+                connAbort(conn);
+            } else if (closed > 0) {
+                connStartClosing(conn, now);
+            } else if (closed < 0) {
+                connAbort(conn);
+            }
+            break;
+        case CONN_RELEASING:
+            connFinish(conn);
+            break;
+        default:
+            break;
+    }
+}
+
+/**
+ * @brief connFinish is a function that ends a connection. It is freed at the end of the loop iteration,
+ *        once the writer pool is done with it.
+ * 
+ * @param conn      The connection.
+ */
+static void connFinish(struct Connection *conn) {
+    struct EventLoop *loop = conn->loop;
+
+    timerCancel(&loop->wheel, &conn->timer);
+    timerCancel(&loop->wheel, &conn->ackTimer);
+    conn->state = CONN_RELEASING;
+    if (conn->writerOpen && !conn->writerClosing) {
+        conn->writerClosing = 1;
+        writerClose(&conn->writer);
+    }
+    if (!conn->released) {
+        conn->released = 1;
+        conn->releaseNext = loop->release;
+        loop->release = conn;
+    }
+}
+
+/**
+ * @brief connRelease is a function that frees a finished connection unless the writer pool still has
+ *        work for it, in which case its progress brings the connection back here. The last flow of a
+ *        transfer completes it.
+ * 
+ * @param conn      The connection.
+ * @return          1 if the connection was freed, 0 if not yet.
+ */
+static int connRelease(struct Connection *conn) {
+    struct EventLoop *loop = conn->loop;
+    struct Receiver *receiver = loop->receiver;
+    struct Transfer *transfer = conn->transfer;
+
+    if (conn->writerOpen) {
+        int closed = writerClosed(&conn->writer);
+
+        if (closed == 0) {
+            return 0;
         }
+        conn->failed |= closed < 0;
+        writerDestroy(&conn->writer);
+        reassemblyDestroy(&conn->reassembly);
+        if (conn->fecBlock != 0) {
+            fecDecoderDestroy(&conn->fec);
+        }
+    }
+    close(conn->sockfd);
+    if (statsTotal(&conn->stats, STAT_CORRUPT) > 0) {
+        fprintf(stderr, "Warning: Dropped %llu corrupt segments\n",
+                (unsigned long long int) statsTotal(&conn->stats, STAT_CORRUPT));
+    }
+    statsUnregister(&conn->stats);
+
+    pthread_mutex_lock(&loop->lock);
+    for (struct Connection **link = &loop->pending; conn->pending && *link != NULL; link = &(*link)->mailNext) {
+        if (*link == conn) {
+            *link = conn->mailNext;
+            break;
+        }
+    }
+    pthread_mutex_unlock(&loop->lock);
+    for (struct Connection **link = &loop->ready; conn->readable && *link != NULL; link = &(*link)->readyNext) {
+        if (*link == conn) {
+            *link = conn->readyNext;
+            break;
+        }
+    }
 
-        *seqNum = *seqNum + 1;
+    pthread_mutex_lock(&receiver->lock);
+    connTableRemove(&receiver->connections, &conn->key);
+    __atomic_sub_fetch(&receiver->flows, 1, __ATOMIC_RELAXED);
+    transfer->failed |= conn->failed;
+    if (++transfer->finished == transfer->flowCount) {
+        transferComplete(receiver, transfer);
+    }
+    pthread_mutex_unlock(&receiver->lock);
 
-        sendPacket->seqNum = *seqNum;
-        sendPacket->ackBit = 1;
-        sendPacket->ackNum = recvPacket->seqNum;
-        sendPacket->finBit = 1;
+    free(conn);
+    return 1;
+}
 
-        // Send a FIN packet to the sender
-        if (sendto(sockfd, sendPacket, sizeof(struct Packet), 0, senderAddr, addrLen) < 0) {
-            perror("Error: Failed to send third packet during disconnect.");
-            exit(EXIT_FAILURE);
+/**
+ * @brief acceptFlow is a function that accepts the SYN of a new flow. The flow gets its own socket
+ *        connected to the sender and is handed to an event loop in turn. A SYN repeated before that socket
+ *        was connected is answered by the connection's own handshake timer.
+ * 
+ * @param receiver      The receiver.
+ * @param senderAddr    The address of the sender.
+ * @param syn           The SYN.
+ * @param now           The current monotonic time (ns).
+ */
+static void acceptFlow(struct Receiver *receiver, const struct sockaddr_in *senderAddr, const struct Packet *syn,
+                       uint64_t now) {
+    struct HandshakeOptions options;
+    struct ConnKey key;
+    struct ConnKey tkey;
+    struct Transfer *transfer;
+    struct Connection *conn;
+    struct EventLoop *loop;
+
+    packetGetOptions(syn, &options);
+    key = connKeyMake(senderAddr, options.connectionId);
+    tkey = transferKey(senderAddr, options.connectionId);
+
+    pthread_mutex_lock(&receiver->lock);
+    if (receiver->stopping || connTableFind(&receiver->connections, &key) != NULL) {
+        pthread_mutex_unlock(&receiver->lock);
+        return;
+    }
+    transfer = connTableFind(&receiver->transfers, &tkey);
+    if (transfer == NULL) {
+        transfer = transferOpen(receiver, &tkey, senderAddr, &options);
+    }
+    if (transfer == NULL || transfer->accepted >= transfer->flowCount) {
+        pthread_mutex_unlock(&receiver->lock);
+        return;
+    }
+
+    conn = calloc(1, sizeof(struct Connection));
+    if (conn == NULL) {
+        perror("Error: Failed to allocate connection");
+        exit(EXIT_FAILURE);
+    }
+    conn->key = key;
+    conn->sockfd = openFlowSocket(receiver->port, senderAddr, &conn->bufferSlots);
+    conn->senderAddr = *senderAddr;
+    conn->transfer = transfer;
+    conn->seqNum = RECV_ISN;
+    conn->synSeqNum = syn->seqNum;
+    conn->peerTsVal = syn->tsVal;
+    conn->offset = options.rangeOffset;
+    conn->digest = options.digest;
+    conn->compressed = options.compressed;
+
+    // A resumed flow starts after what its range already has, and its digest covers only the rest
+    if (transfer->resumable) {
+        conn->resumed = checkpointResume(&transfer->checkpoint, options.rangeOffset);
+        conn->offset += conn->resumed;
+        conn->checkpointFlow = transfer->accepted;
+        checkpointTrack(&transfer->checkpoint, conn->checkpointFlow, conn->offset);
+    }
+
+    // A sender may ask for its own ACK frequency, within what the ring and the timers allow
+    conn->ackEvery = options.ackEvery != 0 ? options.ackEvery : recvOptions.ackEvery;
+    if (conn->ackEvery > recvOptions.windowSize / 4) {
+        conn->ackEvery = recvOptions.windowSize / 4 > 0 ? recvOptions.windowSize / 4 : 1;
+    }
+    conn->ackDelay = (uint64_t) (options.ackDelayUs != 0 ? options.ackDelayUs : recvOptions.ackDelayUs) * NSEC_PER_USEC;
+    if (conn->ackDelay > MAX_ACK_DELAY_US * NSEC_PER_USEC) {
+        conn->ackDelay = MAX_ACK_DELAY_US * NSEC_PER_USEC;
+    }
+
+    // FEC blocks must leave the ring room while one waits for its parity
+    conn->fecBlock = options.fecBlock;
+    if (conn->fecBlock > FEC_MAX_BLOCK) {
+        conn->fecBlock = FEC_MAX_BLOCK;
+    }
+    if (conn->fecBlock > recvOptions.windowSize / 4) {
+        conn->fecBlock = recvOptions.windowSize / 4;
+    }
+    conn->fecParity = options.fecParity < conn->fecBlock ? options.fecParity : conn->fecBlock;
+    if (conn->fecParity > FEC_MAX_PARITY) {
+        conn->fecParity = FEC_MAX_PARITY;
+    }
+    if (conn->fecBlock < 2 || conn->fecParity == 0) {
+        conn->fecBlock = 0;
+        conn->fecParity = 0;
+    }
+    conn->writeRate = receiver->writeRate / transfer->flowCount;    // The write limit is shared by every flow
+    statsConnInit(&conn->stats, senderAddr, options.connectionId, options.rangeOffset);
+    statsRegister(&conn->stats);
+
+    transfer->accepted++;
+    transfer->lastSyn = now;
+    __atomic_add_fetch(&receiver->flows, 1, __ATOMIC_RELAXED);
+    connTableInsert(&receiver->connections, &key, conn);
+    loop = &receiver->loops[receiver->nextLoop++ % receiver->loopCount];
+    conn->loop = loop;
+    pthread_mutex_unlock(&receiver->lock);
+
+    pthread_mutex_lock(&loop->lock);
+    conn->mailNext = loop->incoming;
+    loop->incoming = conn;
+    pthread_mutex_unlock(&loop->lock);
+    wakeLoop(loop);
+}
+
+/**
+ * @brief listenerReceive is a function that reads every datagram queued on the listening socket. Only
+ *        SYNs are expected there; everything else belongs to a flow whose socket was not connected yet and
+ *        is retransmitted by the sender.
+ * 
+ * @param loop      Loop 0.
+ * @param now       The current monotonic time (ns).
+ */
+static void listenerReceive(struct EventLoop *loop, uint64_t now) {
+    int received;
+
+    while ((received = batchReceive(loop->listener, &loop->recvBatch, MSG_DONTWAIT)) > 0) {
+        for (int i = 0; i < received; i++) {
+            struct Packet syn;
+
+            if (packetParse(&syn, batchData(&loop->recvBatch, i), batchLength(&loop->recvBatch, i)) < 0 ||
+                !packetVerify(batchData(&loop->recvBatch, i), batchLength(&loop->recvBatch, i)) ||
+                syn.synBit != 1 || syn.ackBit == 1) {
+                continue;
+            }
+            acceptFlow(loop->receiver, batchAddress(&loop->recvBatch, i), &syn, now);
         }
+    }
+    if (received < 0) {
+        perror("Error: Failed to begin three-way handshake.");
+        exit(EXIT_FAILURE);
+    }
+}
+
+/**
+ * @brief housekeeping is the timer handler of loop 0 that gives up on transfers whose remaining flows did
+ *        not connect within the idle timeout.
+ * 
+ * @param timer     The housekeeping timer.
+ * @param arg       Loop 0.
+ * @param now       The current monotonic time (ns).
+ */
+static void housekeeping(struct Timer *timer, void *arg, uint64_t now) {
+    struct EventLoop *loop = arg;
+    struct Receiver *receiver = loop->receiver;
+    struct Transfer *transfer;
+    struct Transfer *next;
 
-        // Check that the ACK for the receiver FIN is received, and finish the disconnection
-        if (recvfrom(sockfd, recvPacket, sizeof(struct Packet), 0, senderAddr, &addrLen) < 0) {
-            perror("Error: Failed to receive fourth packet during disconnect.");
+    pthread_mutex_lock(&receiver->lock);
+    for (transfer = receiver->transferList; transfer != NULL; transfer = next) {
+        next = transfer->next;
+        if (transfer->accepted == transfer->flowCount || now - transfer->lastSyn < IDLE_TIMEOUT_SEC * NSEC_PER_SEC) {
+            continue;
+        }
+
+        fprintf(stderr, "Error: Only %u of %u flows connected\n", transfer->accepted, transfer->flowCount);
+        if (!recvOptions.daemon) {
             exit(EXIT_FAILURE);
         }
-        else {
-            connectionFinished = 1;
+        transfer->flowCount = transfer->accepted;
+        transfer->failed = 1;
+        if (transfer->finished == transfer->flowCount) {
+            transferComplete(receiver, transfer);
         }
     }
+    pthread_mutex_unlock(&receiver->lock);
 
-    free(recvPacket);
-    free(sendPacket);
+    timerArm(&loop->wheel, timer, now + HOUSEKEEPING_NS);
 }
 
 /**
- * @brief receiveData is a function that receives data from a sender.
+ * @brief readMailbox is a function that starts the connections handed to a loop and acts on the progress
+ *        of their writers.
  * 
- * @param sockfd            The file descriptor of the socket
- * @param senderAddr        The address of the sender
- * @param addrLen           The length of the sender address
- * @param seqNum            The sequence number of the receiver
- * @param destinationFile   The file to write the data to
- * @param writeRate         The rate at which to write data to the file
+ * @param loop      The event loop.
+ * @param now       The current monotonic time (ns).
  */
-void receiveData(int sockfd, struct sockaddr *senderAddr, socklen_t addrLen, int *seqNum, char* destinationFile, unsigned long long int writeRate) {
-    struct Packet *recvPacket;
-    struct Packet *sendPacket;
-    int initDisconnect = 0;
-    int expectedAckNum = 1;
-
-    recvPacket = malloc(sizeof(struct Packet));
-    sendPacket = malloc(sizeof(struct Packet));
-    
-    // Open the file
-    FILE* file = fopen(destinationFile, "w+");
-    if (file == NULL) {
-        fprintf(stderr, "Error: Unable to open file %s\n", destinationFile);
+static void readMailbox(struct EventLoop *loop, uint64_t now) {
+    struct Connection *incoming = NULL;
+    struct Connection *pending = NULL;
+    uint64_t count;
+
+    if (read(loop->wakefd, &count, sizeof(count)) < 0 && errno != EAGAIN) {
+        perror("Error: Failed to read event loop wakeups");
         exit(EXIT_FAILURE);
     }
 
-    while (!initDisconnect) {
-        // Check for incoming data
-        if (recvfrom(sockfd, recvPacket, sizeof(struct Packet), 0, senderAddr, &addrLen) < 0) {
-            perror("Error: Failed to receive packet during data transfer.");
+    // A pool thread may queue a connection again while it is handled, so the lists are relinked first
+    pthread_mutex_lock(&loop->lock);
+    for (struct Connection *conn = loop->incoming; conn != NULL; conn = conn->mailNext) {
+        conn->workNext = incoming;
+        incoming = conn;
+    }
+    for (struct Connection *conn = loop->pending; conn != NULL; conn = conn->mailNext) {
+        conn->pending = 0;
+        conn->workNext = pending;
+        pending = conn;
+    }
+    loop->incoming = NULL;
+    loop->pending = NULL;
+    pthread_mutex_unlock(&loop->lock);
+
+    for (struct Connection *conn = incoming; conn != NULL; conn = conn->workNext) {
+        connStart(conn, now);
+    }
+    for (struct Connection *conn = pending; conn != NULL; conn = conn->workNext) {
+        connProgressed(conn, now);
+    }
+}
+
+/**
+ * @brief eventLoopRun is an event loop thread. Each turn waits for socket events, mailbox wakeups or the
+ *        next timer, handles them, and frees the connections that finished.
+ * 
+ * @param arg   The event loop.
+ */
+static void *eventLoopRun(void *arg) {
+    struct EventLoop *loop = arg;
+    struct Receiver *receiver = loop->receiver;
+    struct epoll_event events[EPOLL_MAX_EVENTS];
+
+    for (;;) {
+        uint64_t now = monotonicNs();
+        uint64_t wakeup = timerWheelNextWakeup(&loop->wheel);
+        int timeout = -1;
+        int ready;
+        int stopping;
+
+        if (loop->ready != NULL) {
+            timeout = 0;
+        } else if (wakeup != UINT64_MAX) {
+            timeout = wakeup > now ? (int) ((wakeup - now + NSEC_PER_MSEC - 1) / NSEC_PER_MSEC) : 0;
+        }
+
+        ready = epoll_wait(loop->epfd, events, EPOLL_MAX_EVENTS, timeout);
+        if (ready < 0 && errno != EINTR) {
+            perror("Error: Failed to wait for events");
             exit(EXIT_FAILURE);
         }
+        now = monotonicNs();
 
-        // If a packet with the FIN bit is received, begin disconnect
-        if (recvPacket->finBit == 1) {
-            initDisconnect = 1;
-            expectedAckNum = recvPacket->seqNum + 1;
-        }
-        else {
-            // Check for packet loss
-            while (recvPacket->seqNum < expectedAckNum) {
-                sendPacket->seqNum = *seqNum;
-                sendPacket->ackBit = 0;
-                sendPacket->ackNum = expectedAckNum;
-                
-                if (sendto(sockfd, sendPacket, sizeof(struct Packet), 0, senderAddr, addrLen) < 0) {
-                    perror("Error: Failed to send NACK for packet loss during data transfer.");
-                    exit(EXIT_FAILURE);
-                }
+        for (int i = 0; i < ready; i++) {
+            void *source = events[i].data.ptr;
 
-                *seqNum++;
+            if (source == &loop->wakefd) {
+                readMailbox(loop, now);
+            } else if (source == &loop->listener) {
+                listenerReceive(loop, now);
+            } else {
+                struct Connection *conn = source;
 
-                if (recvfrom(sockfd, recvPacket, sizeof(struct Packet), 0, senderAddr, &addrLen) < 0) {
-                    perror("Error: Failed to receive packet during data transfer.");
-                    exit(EXIT_FAILURE);
+                if (!conn->readable) {
+                    conn->readable = 1;
+                    conn->readyNext = loop->ready;
+                    loop->ready = conn;
                 }
             }
+        }
+
+        // Sockets with datagrams left after their budget go back on the list for the next turn
+        struct Connection *readable = loop->ready;
+        loop->ready = NULL;
+        while (readable != NULL) {
+            struct Connection *conn = readable;
+
+            readable = conn->readyNext;
+            conn->readable = 0;
+            connReceive(conn, now);
+        }
+
+        timerWheelAdvance(&loop->wheel, now);
+
+        struct Connection *release = loop->release;
+        loop->release = NULL;
+        while (release != NULL) {
+            struct Connection *conn = release;
+
+            release = conn->releaseNext;
+            conn->released = 0;
+            connRelease(conn);
+        }
+
+        pthread_mutex_lock(&receiver->lock);
+        stopping = receiver->stopping;
+        pthread_mutex_unlock(&receiver->lock);
+        if (stopping) {
+            break;
+        }
+    }
+    traceFlush();
+    return NULL;
+}
+
+/**
+ * @brief eventLoopInit is a function that creates an event loop's epoll instance, wakeup eventfd and
+ *        batches.
+ * 
+ * @param loop          The event loop to initialize.
+ * @param receiver      The receiver.
+ * @param listener      The listening socket for loop 0, -1 for the others.
+ */
+static void eventLoopInit(struct EventLoop *loop, struct Receiver *receiver, int listener) {
+    struct epoll_event event = { .events = EPOLLIN | EPOLLET };
+
+    memset(loop, 0, sizeof(*loop));
+    loop->receiver = receiver;
+    loop->listener = listener;
+    loop->epfd = epoll_create1(EPOLL_CLOEXEC);
+    loop->wakefd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (loop->epfd < 0 || loop->wakefd < 0) {
+        perror("Error: Failed to create event loop");
+        exit(EXIT_FAILURE);
+    }
+    if (pthread_mutex_init(&loop->lock, NULL) != 0) {
+        fprintf(stderr, "Error: Failed to create event loop\n");
+        exit(EXIT_FAILURE);
+    }
 
-            fwrite(recvPacket->data, 1, recvPacket->dataSize, file);
-            fflush(file);
+    event.data.ptr = &loop->wakefd;
+    if (epoll_ctl(loop->epfd, EPOLL_CTL_ADD, loop->wakefd, &event) < 0) {
+        perror("Error: Failed to create event loop");
+        exit(EXIT_FAILURE);
+    }
+    if (listener >= 0) {
+        event.data.ptr = &loop->listener;
+        if (epoll_ctl(loop->epfd, EPOLL_CTL_ADD, listener, &event) < 0) {
+            perror("Error: Failed to create event loop");
+            exit(EXIT_FAILURE);
         }
     }
 
-    fclose(file);
-    free(recvPacket);
-    free(sendPacket);
+    batchInit(&loop->recvBatch, recvOptions.batchSize, PACKET_MAX_SIZE);
+    batchUsePool(&loop->recvBatch, &receiver->buffers);
+    batchInit(&loop->ackBatch, recvOptions.batchSize, PACKET_DEFAULT_SIZE);
+    timerWheelInit(&loop->wheel, monotonicNs());
+    if (listener >= 0) {
+        timerInit(&loop->housekeeping, housekeeping, loop);
+        timerArm(&loop->wheel, &loop->housekeeping, monotonicNs() + HOUSEKEEPING_NS);
+    }
 }
 
 /**
- * @brief rrecv is a function that receives data from a sender.
+ * @brief eventLoopDestroy is a function that frees a stopped event loop.
+ * 
+ * @param loop      The event loop.
+ */
+static void eventLoopDestroy(struct EventLoop *loop) {
+    batchDestroy(&loop->recvBatch);
+    batchDestroy(&loop->ackBatch);
+    close(loop->wakefd);
+    close(loop->epfd);
+    pthread_mutex_destroy(&loop->lock);
+}
+
+/**
+ * @brief rrecv is a function that receives data from senders. Flows are accepted on a listening socket,
+ *        each given its own socket connected to its sender and spread over the event loop threads, and
+ *        their data is written by a shared pool of disk writers. Without -D the first sender's file is
+ *        written to destinationFile and the receiver returns once it is complete; with -D every transfer
+ *        is written to its own file in the destinationFile directory until the receiver is killed.
  * 
  * @param myUDPport         The port to receive data on
- * @param destinationFile   The file to write the data to
+ * @param destinationFile   The file to write the data to, or the directory for a daemon
  * @param writeRate         The rate at which to write data to the file
  */
 void rrecv(unsigned short int myUDPport,
-           char* destinationFile, 
+           char* destinationFile,
            unsigned long long int writeRate) {
+    struct Receiver receiver;
+    struct stat destinationStat;
     int sockfd;
-    struct sockaddr_in receiverAddr, senderAddr;
-    socklen_t addrLen = sizeof(senderAddr);
-    int *seqNum;
-    int *ackNum;
+    unsigned int bufferSlots;
 
-    // Create UDP socket
-    sockfd = socket(AF_INET, SOCK_DGRAM, 0);
-    if (sockfd == -1) {
-        perror("socket");
-        exit(EXIT_FAILURE);
-    }
+    memset(&receiver, 0, sizeof(receiver));
+    receiver.port = myUDPport;
+    receiver.destination = destinationFile;
+    receiver.writeRate = writeRate;
 
-    // Set up the receiver address
-    memset(&receiverAddr, 0, sizeof(receiverAddr));
-    receiverAddr.sin_family = AF_INET;
-    receiverAddr.sin_port = htons(myUDPport);
-    receiverAddr.sin_addr.s_addr = htonl(INADDR_ANY);
+    // Create the listening UDP socket
+    sockfd = openFlowSocket(myUDPport, NULL, &bufferSlots);
+    if (bufferSlots < recvOptions.windowSize) {
+        fprintf(stderr, "Warning: Socket receive buffers hold %u of the %u segment window, which is limited to "
+                "them; raise net.core.rmem_max\n", bufferSlots, recvOptions.windowSize);
+    }
 
-    // Bind the socket
-    if (bind(sockfd, (struct sockaddr *)&receiverAddr, sizeof(receiverAddr)) == -1) {
-        perror("bind");
+    // Open the file, or check the directory every transfer goes to
+    if (!recvOptions.daemon && outputOpen(&receiver.output, destinationFile, recvOptions.direct) < 0) {
+        fprintf(stderr, "Error: Unable to open file %s\n", destinationFile);
+        exit(EXIT_FAILURE);
+    }
+    if (recvOptions.daemon && (stat(destinationFile, &destinationStat) < 0 || !S_ISDIR(destinationStat.st_mode))) {
+        fprintf(stderr, "Error: %s is not a directory\n", destinationFile);
         exit(EXIT_FAILURE);
     }
 
-    // Allocate memory for sequence and acknowledgment numbers
-    seqNum = malloc(sizeof(int));
-    ackNum = malloc(sizeof(int));
-    *seqNum = 1000;
+    if (pthread_mutex_init(&receiver.lock, NULL) != 0) {
+        fprintf(stderr, "Error: Failed to start receiver\n");
+        exit(EXIT_FAILURE);
+    }
+    connTableInit(&receiver.connections);
+    connTableInit(&receiver.transfers);
+    writerPoolInit(&receiver.pool, recvOptions.writers);
 
-    // Connect to sender
-    connectSocket(sockfd, (struct sockaddr *)&senderAddr, addrLen, seqNum);
+    receiver.loopCount = recvOptions.loops;
+    if (receiver.loopCount == 0) {
+        long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+        receiver.loopCount = cpus < 1 ? 1 : cpus > DEFAULT_EVENT_LOOPS ? DEFAULT_EVENT_LOOPS : (unsigned int) cpus;
+    }
+    // Only the receive batches and the threads' free lists are filled up front. The pool grows as the rings
+    // fill, and each connection only advertises room for its share of -P, which bounds how far it grows.
+    bufferPoolInit(&receiver.buffers, PACKET_MAX_SIZE, (size_t) receiver.loopCount *
+                   (recvOptions.batchSize + BUFPOOL_CACHE_SIZE) + (size_t) recvOptions.writers * BUFPOOL_CACHE_SIZE,
+                   recvOptions.hugePages);
+    receiver.loops = calloc(receiver.loopCount, sizeof(struct EventLoop));
+    if (receiver.loops == NULL) {
+        perror("Error: Failed to allocate event loops");
+        exit(EXIT_FAILURE);
+    }
+    for (unsigned int i = 0; i < receiver.loopCount; i++) {
+        eventLoopInit(&receiver.loops[i], &receiver, i == 0 ? sockfd : -1);
+    }
+    for (unsigned int i = 0; i < receiver.loopCount; i++) {
+        if (pthread_create(&receiver.loops[i].thread, NULL, eventLoopRun, &receiver.loops[i]) != 0) {
+            perror("Error: failed to create event loop thread");
+            exit(EXIT_FAILURE);
+        }
+        threadPin(receiver.loops[i].thread, &recvOptions.cpus, i);
+    }
+    for (unsigned int i = 0; i < receiver.pool.threadCount; i++) {
+        threadPin(receiver.pool.threads[i], &recvOptions.cpus, receiver.loopCount + i);
+    }
 
-    // Receive data
-    receiveData(sockfd, (struct sockaddr *)&senderAddr, addrLen, seqNum, destinationFile, writeRate);
+    for (unsigned int i = 0; i < receiver.loopCount; i++) {
+        if (pthread_join(receiver.loops[i].thread, NULL) != 0) {
+            perror("pthread_join");
+            exit(EXIT_FAILURE);
+        }
+        eventLoopDestroy(&receiver.loops[i]);
+    }
 
-    // Disconnect from sender
-    disconnectSocket(sockfd, (struct sockaddr *)&senderAddr, addrLen, seqNum);
+    // Every connection is gone once the transfer completed, so the pool has nothing left to write
+    writerPoolDestroy(&receiver.pool);
+    bufferPoolDestroy(&receiver.buffers);
+    connTableDestroy(&receiver.connections);
+    connTableDestroy(&receiver.transfers);
+    pthread_mutex_destroy(&receiver.lock);
+    free(receiver.loops);
 
-    // Close the socket and free memory
+    // Close the file and the listening socket
+    if (!recvOptions.daemon) {
+        outputClose(&receiver.output);
+    }
     close(sockfd);
-    free(seqNum);
-    free(ackNum);
 }
 
 int main(int argc, char** argv) {
@@ -260,13 +1703,99 @@ int main(int argc, char** argv) {
     // command line.
 
     unsigned short int udpPort;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "B:w:P:r:dGL:W:Da:A:S:Q:C:H")) != -1) {
+        switch (opt) {
+            case 'B':
+                recvOptions.batchSize = strtoul(optarg, NULL, 10);
+                if (recvOptions.batchSize == 0 || recvOptions.batchSize > BATCH_MAX_SIZE) {
+                    fprintf(stderr, "Error: Batch size must be between 1 and %d\n", BATCH_MAX_SIZE);
+                    exit(1);
+                }
+                break;
+            case 'w':
+                recvOptions.windowSize = strtoul(optarg, NULL, 10);
+                if (recvOptions.windowSize == 0) {
+                    fprintf(stderr, "Error: Window size must be at least 1 segment\n");
+                    exit(1);
+                }
+                break;
+            case 'P':
+                recvOptions.poolSegments = strtoul(optarg, NULL, 10);
+                if (recvOptions.poolSegments == 0) {
+                    fprintf(stderr, "Error: Pool size must be at least 1 segment\n");
+                    exit(1);
+                }
+                break;
+            case 'r':
+                recvOptions.writeRate = strtoull(optarg, NULL, 10);
+                break;
+            case 'd':
+                recvOptions.direct = 1;
+                break;
+            case 'G':
+                recvOptions.offload = 1;
+                break;
+            case 'L':
+                recvOptions.loops = strtoul(optarg, NULL, 10);
+                if (recvOptions.loops == 0 || recvOptions.loops > MAX_EVENT_LOOPS) {
+                    fprintf(stderr, "Error: Event loops must be between 1 and %d\n", MAX_EVENT_LOOPS);
+                    exit(1);
+                }
+                break;
+            case 'W':
+                recvOptions.writers = strtoul(optarg, NULL, 10);
+                if (recvOptions.writers == 0) {
+                    fprintf(stderr, "Error: At least 1 disk writer is needed\n");
+                    exit(1);
+                }
+                break;
+            case 'D':
+                recvOptions.daemon = 1;
+                break;
+            case 'S':
+                recvOptions.statsPath = optarg;
+                break;
+            case 'Q':
+                recvOptions.tracePath = optarg;
+                break;
+            case 'H':
+                recvOptions.hugePages = 1;
+                break;
+            case 'C':
+                if (cpuListParse(&recvOptions.cpus, optarg) < 0) {
+                    fprintf(stderr, "Error: CPU list must be numbers and ranges such as 0-3,8\n");
+                    exit(1);
+                }
+                break;
+            case 'a':
+                recvOptions.ackEvery = strtoul(optarg, NULL, 10);
+                if (recvOptions.ackEvery == 0) {
+                    fprintf(stderr, "Error: Segments per ACK must be at least 1\n");
+                    exit(1);
+                }
+                break;
+            case 'A':
+                recvOptions.ackDelayUs = strtoul(optarg, NULL, 10);
+                if (recvOptions.ackDelayUs == 0 || recvOptions.ackDelayUs > MAX_ACK_DELAY_US) {
+                    fprintf(stderr, "Error: Maximum ACK delay must be between 1 and %d us\n", MAX_ACK_DELAY_US);
+                    exit(1);
+                }
+                break;
+            default:
+                argc = 0;
+        }
+    }
 
-    if (argc != 3) {
-        fprintf(stderr, "usage: %s UDP_port filename_to_write\n\n", argv[0]);
+    if (argc - optind != 2) {
+        fprintf(stderr, "usage: %s [-B batch_size] [-w window_segments] [-P pool_segments] [-r write_bytes_per_sec] [-d] [-G] [-L event_loops] [-W disk_writers] [-D] [-a segments_per_ack] [-A max_ack_delay_us] [-S stats_json] [-Q qlog_trace] [-C cpu_list] [-H] UDP_port filename_to_write|output_dir\n\n", argv[0]);
         exit(1);
     }
 
-    udpPort = (unsigned short int) atoi(argv[1]);
-    
-    rrecv(udpPort, "testfile", 0);
-}
\ No newline at end of file
+    udpPort = (unsigned short int) atoi(argv[optind]);
+
+    statsInit("rrecv", recvOptions.statsPath, recvOptions.tracePath);
+    rrecv(udpPort, argv[optind + 1], recvOptions.writeRate);
+    statsFinish();
+}
@@ -0,0 +1,483 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <signal.h>
+#include <errno.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/epoll.h>
+#include <sys/timerfd.h>
+#include <unistd.h>
+
+#include "./include/conntable.h"
+#include "./include/timeutil.h"
+
+#define RELAY_MAX_DATAGRAM 65536
+#define RELAY_SOCKET_BUFFER (80 * 1024 * 1024)  // A receive window of the largest datagrams, so the kernel drops
+                                                // nothing the relay did not mean to
+#define RELAY_MAX_EVENTS 64
+#define RELAY_HEAP_INITIAL 1024
+
+/**
+ * Impairments set from the command line. Loss, duplication, reordering, jitter and the bandwidth cap apply
+ * to the sender's datagrams; the receiver's only see the delay and their own loss rate.
+ */
+struct RelayOptions {
+    double      loss;           // Probability a data datagram is dropped
+    double      ackLoss;        // Probability a datagram from the receiver is dropped
+    double      duplicate;      // Probability a data datagram is sent twice
+    double      reorder;        // Probability a data datagram is held back so later ones overtake it
+    uint64_t    reorderDelay;   // How long a reordered datagram is held back (ns)
+    uint64_t    delay;          // One-way delay in each direction (ns)
+    uint64_t    jitter;         // Data datagrams get up to this much extra delay (ns)
+    uint64_t    rate;           // Bottleneck rate in bytes per second, 0 for none
+    uint64_t    queue;          // Bytes the bottleneck queues before it drops
+    uint64_t    seed;
+    size_t      maxDatagram;    // Larger datagrams are dropped in either direction, as by a small path MTU
+};
+
+struct RelayOptions relayOptions = { 0, 0, 0, 0, 1 * NSEC_PER_MSEC, 0, 0, 0, 256 * 1024, 1, RELAY_MAX_DATAGRAM };
+
+/**
+ * A sender seen by the relay. Its datagrams go to the receiver from a socket of its own, so the receiver
+ * sees a distinct address for every flow, and the receiver's answers on that socket go back to it.
+ */
+struct Client {
+    struct sockaddr_in  addr;
+    int                 upstream;
+};
+
+/**
+ * A datagram waiting for its release time.
+ */
+struct Delayed {
+    uint64_t        release;    // Monotonic time it is sent (ns)
+    uint64_t        order;      // Breaks ties so equal release times keep their arrival order
+    struct Client   *client;
+    int             reverse;    // From the receiver to the client
+    size_t          length;
+    char            data[];
+};
+
+/**
+ * Datagrams in flight through the relay, as a binary min-heap on release time.
+ */
+struct DelayQueue {
+    struct Delayed  **items;
+    size_t          count;
+    size_t          capacity;
+    uint64_t        nextOrder;
+};
+
+struct RelayCounters {
+    unsigned long long int forwarded;
+    unsigned long long int lost;
+    unsigned long long int queueDrops;
+    unsigned long long int duplicated;
+    unsigned long long int reordered;
+    unsigned long long int tooBig;
+    unsigned long long int reverseForwarded;
+    unsigned long long int reverseLost;
+};
+
+static volatile sig_atomic_t stopping;
+static uint64_t randomState;
+
+/**
+ * @brief randomUniform is a function that returns a pseudo-random number in [0, 1) from xorshift64*, so a
+ *        seed reproduces the same impairments.
+ */
+static double randomUniform(void) {
+    randomState ^= randomState >> 12;
+    randomState ^= randomState << 25;
+    randomState ^= randomState >> 27;
+    return (double) ((randomState * 0x2545f4914f6cdd1dULL) >> 11) / (double) (1ULL << 53);
+}
+
+/**
+ * @brief delayedBefore is a function that orders two datagrams by release time, then arrival.
+ */
+static int delayedBefore(const struct Delayed *a, const struct Delayed *b) {
+    return a->release < b->release || (a->release == b->release && a->order < b->order);
+}
+
+/**
+ * @brief queuePush is a function that adds a copy of a datagram to the delay queue.
+ * 
+ * @param queue     The delay queue.
+ * @param client    The client the datagram belongs to.
+ * @param reverse   Whether it goes from the receiver to the client.
+ * @param data      The datagram.
+ * @param length    Its length.
+ * @param release   When to send it (ns).
+ */
+static void queuePush(struct DelayQueue *queue, struct Client *client, int reverse, const char *data, size_t length,
+                      uint64_t release) {
+    struct Delayed *item = malloc(sizeof(struct Delayed) + length);
+    size_t index;
+
+    if (item == NULL) {
+        perror("Error: Failed to allocate datagram");
+        exit(EXIT_FAILURE);
+    }
+    if (queue->count == queue->capacity) {
+        queue->capacity = queue->capacity ? 2 * queue->capacity : RELAY_HEAP_INITIAL;
+        queue->items = realloc(queue->items, queue->capacity * sizeof(struct Delayed *));
+        if (queue->items == NULL) {
+            perror("Error: Failed to allocate delay queue");
+            exit(EXIT_FAILURE);
+        }
+    }
+
+    item->release = release;
+    item->order = queue->nextOrder++;
+    item->client = client;
+    item->reverse = reverse;
+    item->length = length;
+    memcpy(item->data, data, length);
+
+    for (index = queue->count++; index > 0 && delayedBefore(item, queue->items[(index - 1) / 2]); index = (index - 1) / 2) {
+        queue->items[index] = queue->items[(index - 1) / 2];
+    }
+    queue->items[index] = item;
+}
+
+/**
+ * @brief queuePop is a function that removes the datagram released first.
+ * 
+ * @param queue     The delay queue, which must not be empty.
+ */
+static struct Delayed *queuePop(struct DelayQueue *queue) {
+    struct Delayed *first = queue->items[0];
+    struct Delayed *last = queue->items[--queue->count];
+    size_t index = 0;
+
+    for (;;) {
+        size_t child = 2 * index + 1;
+
+        if (child >= queue->count) {
+            break;
+        }
+        if (child + 1 < queue->count && delayedBefore(queue->items[child + 1], queue->items[child])) {
+            child++;
+        }
+        if (!delayedBefore(queue->items[child], last)) {
+            break;
+        }
+        queue->items[index] = queue->items[child];
+        index = child;
+    }
+    if (queue->count > 0) {
+        queue->items[index] = last;
+    }
+    return first;
+}
+
+/**
+ * @brief openSocket is a function that creates a UDP socket with large buffers, past net.core.rmem_max
+ *        and wmem_max when the relay is allowed to, bound to a port or connected to a peer.
+ * 
+ * @param port      The port to bind, 0 for an ephemeral one.
+ * @param peer      The peer to connect to, or NULL.
+ */
+static int openSocket(unsigned short int port, const struct sockaddr_in *peer) {
+    struct sockaddr_in addr;
+    int size = RELAY_SOCKET_BUFFER / 2;     // The kernel doubles it
+    int sockfd = socket(AF_INET, SOCK_DGRAM | SOCK_NONBLOCK, 0);
+
+    if (sockfd < 0) {
+        perror("socket");
+        exit(EXIT_FAILURE);
+    }
+    if (setsockopt(sockfd, SOL_SOCKET, SO_RCVBUFFORCE, &size, sizeof(size)) < 0) {
+        setsockopt(sockfd, SOL_SOCKET, SO_RCVBUF, &size, sizeof(size));
+    }
+    if (setsockopt(sockfd, SOL_SOCKET, SO_SNDBUFFORCE, &size, sizeof(size)) < 0) {
+        setsockopt(sockfd, SOL_SOCKET, SO_SNDBUF, &size, sizeof(size));
+    }
+
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(port);
+    addr.sin_addr.s_addr = htonl(INADDR_ANY);
+    if (bind(sockfd, (struct sockaddr *) &addr, sizeof(addr)) < 0) {
+        perror("bind");
+        exit(EXIT_FAILURE);
+    }
+    if (peer != NULL && connect(sockfd, (const struct sockaddr *) peer, sizeof(*peer)) < 0) {
+        perror("connect");
+        exit(EXIT_FAILURE);
+    }
+    return sockfd;
+}
+
+/**
+ * @brief impairForward is a function that decides the fate of a datagram from a client: it may be too big
+ *        for the path, lost, dropped by a full bottleneck queue, or delayed by the bottleneck, the link delay, jitter and
+ *        reordering, and it may be duplicated.
+ * 
+ * @param queue         The delay queue.
+ * @param client        The client.
+ * @param data          The datagram.
+ * @param length        Its length.
+ * @param now           The current monotonic time (ns).
+ * @param linkFree      When the bottleneck finishes sending what it holds (ns).
+ * @param counters      The relay's counters.
+ */
+static void impairForward(struct DelayQueue *queue, struct Client *client, const char *data, size_t length,
+                          uint64_t now, uint64_t *linkFree, struct RelayCounters *counters) {
+    int copies = 1 + (randomUniform() < relayOptions.duplicate);
+
+    if (length > relayOptions.maxDatagram) {
+        counters->tooBig++;
+        return;
+    }
+    if (copies > 1) {
+        counters->duplicated++;
+    }
+    for (int copy = 0; copy < copies; copy++) {
+        uint64_t release = now;
+
+        if (randomUniform() < relayOptions.loss) {
+            counters->lost++;
+            continue;
+        }
+
+        // The bottleneck serializes datagrams at its rate behind a drop-tail queue
+        if (relayOptions.rate != 0) {
+            uint64_t start = *linkFree > now ? *linkFree : now;
+
+            if ((start - now) * relayOptions.rate / NSEC_PER_SEC + length > relayOptions.queue) {
+                counters->queueDrops++;
+                continue;
+            }
+            *linkFree = start + length * NSEC_PER_SEC / relayOptions.rate;
+            release = *linkFree;
+        }
+
+        release += relayOptions.delay;
+        if (relayOptions.jitter != 0) {
+            release += (uint64_t) (randomUniform() * relayOptions.jitter);
+        }
+        if (randomUniform() < relayOptions.reorder) {
+            release += relayOptions.reorderDelay;
+            counters->reordered++;
+        }
+        queuePush(queue, client, 0, data, length, release);
+    }
+}
+
+/**
+ * @brief findClient is a function that returns the client of an address, creating it on its first
+ *        datagram.
+ */
+static struct Client *findClient(struct ConnTable *clients, int epfd, const struct sockaddr_in *addr,
+                                 const struct sockaddr_in *receiverAddr) {
+    struct ConnKey key = connKeyMake(addr, 0);
+    struct Client *client = connTableFind(clients, &key);
+    struct epoll_event event = { .events = EPOLLIN };
+
+    if (client != NULL) {
+        return client;
+    }
+    client = calloc(1, sizeof(struct Client));
+    if (client == NULL) {
+        perror("Error: Failed to allocate client");
+        exit(EXIT_FAILURE);
+    }
+    client->addr = *addr;
+    client->upstream = openSocket(0, receiverAddr);
+    event.data.ptr = client;
+    if (epoll_ctl(epfd, EPOLL_CTL_ADD, client->upstream, &event) < 0) {
+        perror("Error: Failed to watch socket");
+        exit(EXIT_FAILURE);
+    }
+    connTableInsert(clients, &key, client);
+    return client;
+}
+
+static void onSignal(int signal) {
+    (void) signal;
+    stopping = 1;
+}
+
+/**
+ * @brief relay is a function that forwards datagrams between senders and a receiver on this host with the
+ *        configured impairments, until it is interrupted.
+ * 
+ * @param port          The port senders send to.
+ * @param receiverAddr  The address of the receiver.
+ */
+static void relay(unsigned short int port, const struct sockaddr_in *receiverAddr) {
+    struct ConnTable clients;
+    struct DelayQueue queue;
+    struct RelayCounters counters;
+    struct epoll_event events[RELAY_MAX_EVENTS];
+    uint64_t linkFree = 0;
+    static char buffer[RELAY_MAX_DATAGRAM];
+    int front = openSocket(port, NULL);
+    int epfd = epoll_create1(EPOLL_CLOEXEC);
+    int timerfd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+    struct epoll_event event = { .events = EPOLLIN, .data.ptr = NULL };
+    struct epoll_event timerEvent = { .events = EPOLLIN, .data.ptr = &timerfd };
+
+    if (epfd < 0 || timerfd < 0 || epoll_ctl(epfd, EPOLL_CTL_ADD, front, &event) < 0 ||
+        epoll_ctl(epfd, EPOLL_CTL_ADD, timerfd, &timerEvent) < 0) {
+        perror("Error: Failed to watch socket");
+        exit(EXIT_FAILURE);
+    }
+    connTableInit(&clients);
+    memset(&queue, 0, sizeof(queue));
+    memset(&counters, 0, sizeof(counters));
+
+    while (!stopping) {
+        struct itimerspec wakeup;
+        uint64_t now;
+        int ready;
+
+        // The timer fires at the next release with nanosecond precision, so small delays stay accurate
+        memset(&wakeup, 0, sizeof(wakeup));
+        if (queue.count > 0) {
+            wakeup.it_value = nsToTimespec(queue.items[0]->release);
+        }
+        if (timerfd_settime(timerfd, TFD_TIMER_ABSTIME, &wakeup, NULL) < 0) {
+            perror("Error: Failed to arm timer");
+            exit(EXIT_FAILURE);
+        }
+
+        ready = epoll_wait(epfd, events, RELAY_MAX_EVENTS, -1);
+        if (ready < 0 && errno != EINTR) {
+            perror("Error: Failed to wait for datagrams");
+            exit(EXIT_FAILURE);
+        }
+        now = monotonicNs();
+
+        for (int i = 0; i < ready; i++) {
+            struct Client *client = events[i].data.ptr;
+            ssize_t length;
+            uint64_t expirations;
+
+            if (events[i].data.ptr == &timerfd) {
+                if (read(timerfd, &expirations, sizeof(expirations)) < 0 && errno != EAGAIN) {
+                    perror("Error: Failed to read timer");
+                    exit(EXIT_FAILURE);
+                }
+            } else if (client == NULL) {
+                struct sockaddr_in from;
+                socklen_t fromLen = sizeof(from);
+
+                while ((length = recvfrom(front, buffer, sizeof(buffer), 0, (struct sockaddr *) &from, &fromLen)) >= 0) {
+                    impairForward(&queue, findClient(&clients, epfd, &from, receiverAddr), buffer, length, now,
+                                  &linkFree, &counters);
+                    fromLen = sizeof(from);
+                }
+            } else {
+                while ((length = recv(client->upstream, buffer, sizeof(buffer), 0)) >= 0) {
+                    if ((size_t) length > relayOptions.maxDatagram) {
+                        counters.tooBig++;
+                        continue;
+                    }
+                    if (randomUniform() < relayOptions.ackLoss) {
+                        counters.reverseLost++;
+                        continue;
+                    }
+                    queuePush(&queue, client, 1, buffer, length, now + relayOptions.delay);
+                }
+            }
+        }
+
+        while (queue.count > 0 && queue.items[0]->release <= now) {
+            struct Delayed *item = queuePop(&queue);
+
+            if (item->reverse) {
+                sendto(front, item->data, item->length, 0, (struct sockaddr *) &item->client->addr,
+                       sizeof(item->client->addr));
+                counters.reverseForwarded++;
+            } else {
+                send(item->client->upstream, item->data, item->length, 0);
+                counters.forwarded++;
+            }
+            free(item);
+        }
+    }
+
+    fprintf(stderr, "relay: forwarded %llu, lost %llu, queue drops %llu, duplicated %llu, reordered %llu, "
+            "too big %llu; reverse forwarded %llu, lost %llu\n", counters.forwarded, counters.lost,
+            counters.queueDrops, counters.duplicated, counters.reordered, counters.tooBig,
+            counters.reverseForwarded, counters.reverseLost);
+}
+
+int main(int argc, char** argv) {
+    struct sockaddr_in receiverAddr;
+    struct sigaction action;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "l:a:u:o:R:d:j:b:q:s:m:")) != -1) {
+        switch (opt) {
+            case 'l':
+                relayOptions.loss = strtod(optarg, NULL);
+                break;
+            case 'a':
+                relayOptions.ackLoss = strtod(optarg, NULL);
+                break;
+            case 'u':
+                relayOptions.duplicate = strtod(optarg, NULL);
+                break;
+            case 'o':
+                relayOptions.reorder = strtod(optarg, NULL);
+                break;
+            case 'R':
+                relayOptions.reorderDelay = strtoull(optarg, NULL, 10) * NSEC_PER_USEC;
+                break;
+            case 'd':
+                relayOptions.delay = strtoull(optarg, NULL, 10) * NSEC_PER_USEC;
+                break;
+            case 'j':
+                relayOptions.jitter = strtoull(optarg, NULL, 10) * NSEC_PER_USEC;
+                break;
+            case 'b':
+                relayOptions.rate = strtoull(optarg, NULL, 10);
+                break;
+            case 'q':
+                relayOptions.queue = strtoull(optarg, NULL, 10);
+                break;
+            case 's':
+                relayOptions.seed = strtoull(optarg, NULL, 10);
+                break;
+            case 'm':
+                relayOptions.maxDatagram = strtoull(optarg, NULL, 10);
+                break;
+            default:
+                argc = 0;
+        }
+    }
+
+    if (argc - optind != 3) {
+        fprintf(stderr, "usage: %s [-l loss] [-a ack_loss] [-u duplicate] [-o reorder] [-R reorder_delay_us] [-d delay_us] [-j jitter_us] [-b bytes_per_sec] [-q queue_bytes] [-s seed] [-m max_datagram] listen_port receiver_hostname receiver_port\n\n", argv[0]);
+        exit(1);
+    }
+
+    memset(&receiverAddr, 0, sizeof(receiverAddr));
+    receiverAddr.sin_family = AF_INET;
+    receiverAddr.sin_port = htons(atoi(argv[optind + 2]));
+    if (inet_pton(AF_INET, argv[optind + 1], &receiverAddr.sin_addr) != 1) {
+        fprintf(stderr, "Error: Invalid receiver address %s\n", argv[optind + 1]);
+        exit(1);
+    }
+
+    // Zero would keep xorshift at zero forever
+    randomState = relayOptions.seed ? relayOptions.seed : 1;
+
+    memset(&action, 0, sizeof(action));
+    action.sa_handler = onSignal;
+    sigaction(SIGINT, &action, NULL);
+    sigaction(SIGTERM, &action, NULL);
+
+    relay((unsigned short int) atoi(argv[optind]), &receiverAddr);
+    return EXIT_SUCCESS;
+}
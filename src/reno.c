@@ -0,0 +1,73 @@
+#include <stddef.h>
+#include <stdint.h>
+
+#include "./include/congestion.h"
+
+/**
+ * @brief renoInit is a function that resets the NewReno state.
+ * 
+ * @param cc    The congestion control state.
+ */
+static void renoInit(struct CongestionControl *cc) {
+    cc->state.reno.bytesAcked = 0;
+}
+
+/**
+ * @brief renoOnAck is a function that grows the window by the bytes acknowledged in slow start, and by one
+ *        segment per window of acknowledged bytes in congestion avoidance.
+ * 
+ * @param cc        The congestion control state.
+ * @param sample    The ACK sample.
+ */
+static void renoOnAck(struct CongestionControl *cc, const struct AckSample *sample) {
+    struct RenoState *reno = &cc->state.reno;
+
+    if (sample->inRecovery) {
+        return;
+    }
+
+    if (cc->cwnd < cc->ssthresh) {
+        cc->cwnd += sample->ackedBytes;
+        return;
+    }
+
+    reno->bytesAcked += sample->ackedBytes;
+    if (reno->bytesAcked >= cc->cwnd) {
+        reno->bytesAcked -= cc->cwnd;
+        cc->cwnd += cc->mss;
+    }
+}
+
+/**
+ * @brief renoOnLoss is a function that halves the window, or collapses it to one segment on a timeout.
+ * 
+ * @param cc        The congestion control state.
+ * @param now       The current monotonic time (ns).
+ * @param timeout   Whether the loss was detected by the retransmit timer.
+ */
+static void renoOnLoss(struct CongestionControl *cc, uint64_t now, int timeout) {
+    (void) now;
+
+    cc->ssthresh = cc->cwnd / 2 > CC_MIN_WINDOW * cc->mss ? cc->cwnd / 2 : CC_MIN_WINDOW * cc->mss;
+    cc->cwnd = timeout ? cc->mss : cc->ssthresh;
+    cc->state.reno.bytesAcked = 0;
+}
+
+/**
+ * @brief renoCwnd is a function that returns the NewReno congestion window.
+ * 
+ * @param cc    The congestion control state.
+ */
+static uint64_t renoCwnd(struct CongestionControl *cc) {
+    return cc->cwnd;
+}
+
+const struct CongestionOps renoOps = {
+    .name = "reno",
+    .init = renoInit,
+    .onAck = renoOnAck,
+    .onLoss = renoOnLoss,
+    .onRttSample = NULL,
+    .pacingRate = ccWindowPacingRate,
+    .cwnd = renoCwnd,
+};
@@ -0,0 +1,95 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+
+#include "./include/rtt.h"
+#include "./include/timeutil.h"
+
+/**
+ * @brief rttInit is a function that resets an estimator to the initial RTO.
+ * 
+ * @param rtt   The estimator to initialize.
+ */
+void rttInit(struct RttEstimator *rtt) {
+    rtt->srtt = 0;
+    rtt->rttvar = 0;
+    rtt->minRtt = 0;
+    rtt->latest = 0;
+    rtt->rto = RTT_INITIAL_RTO;
+    rtt->backoff = 0;
+}
+
+/**
+ * @brief rttSample is a function that folds a round trip measurement into SRTT and RTTVAR and recomputes
+ *        the RTO as SRTT + 4 * RTTVAR. A fresh sample also clears any backoff.
+ * 
+ * @param rtt       The estimator.
+ * @param sample    The measured round trip time (ns).
+ */
+void rttSample(struct RttEstimator *rtt, uint64_t sample) {
+    if (rtt->srtt == 0) {
+        rtt->srtt = sample;
+        rtt->rttvar = sample / 2;
+    } else {
+        uint64_t delta = rtt->srtt > sample ? rtt->srtt - sample : sample - rtt->srtt;
+        rtt->rttvar = (3 * rtt->rttvar + delta) / 4;
+        rtt->srtt = (7 * rtt->srtt + sample) / 8;
+    }
+    if (rtt->minRtt == 0 || sample < rtt->minRtt) {
+        rtt->minRtt = sample;
+    }
+    rtt->latest = sample;
+
+    rtt->rto = rtt->srtt + 4 * rtt->rttvar;
+    if (rtt->rto < RTT_MIN_RTO) {
+        rtt->rto = RTT_MIN_RTO;
+    } else if (rtt->rto > RTT_MAX_RTO) {
+        rtt->rto = RTT_MAX_RTO;
+    }
+    rtt->backoff = 0;
+}
+
+/**
+ * @brief rttSampleEcho is a function that takes a sample from the timestamp a peer echoed back.
+ * 
+ * @param rtt       The estimator.
+ * @param tsEcr     The echoed timestamp (us), 0 if the peer echoed nothing.
+ * @param now       timestampUs() when the echo arrived.
+ * @return          1 if a sample was taken, 0 otherwise.
+ */
+int rttSampleEcho(struct RttEstimator *rtt, uint32_t tsEcr, uint32_t now) {
+    uint32_t elapsed;
+
+    if (tsEcr == 0) {
+        return 0;
+    }
+    // Unsigned subtraction handles the 32-bit microsecond clock wrapping
+    elapsed = now - tsEcr;
+    if (elapsed > RTT_MAX_RTO / NSEC_PER_USEC) {
+        return 0;
+    }
+    rttSample(rtt, (uint64_t) (elapsed ? elapsed : 1) * NSEC_PER_USEC);
+    return 1;
+}
+
+/**
+ * @brief rttBackoff is a function that doubles the RTO after a retransmission timeout.
+ * 
+ * @param rtt   The estimator.
+ */
+void rttBackoff(struct RttEstimator *rtt) {
+    if ((rtt->rto << rtt->backoff) < RTT_MAX_RTO) {
+        rtt->backoff++;
+    }
+}
+
+/**
+ * @brief rttCurrentRto is a function that returns the RTO with backoff applied.
+ * 
+ * @param rtt   The estimator.
+ */
+uint64_t rttCurrentRto(const struct RttEstimator *rtt) {
+    uint64_t rto = rtt->rto << rtt->backoff;
+
+    return rto < RTT_MAX_RTO ? rto : RTT_MAX_RTO;
+}
@@ -1,113 +1,721 @@
 #include <stdio.h>
 #include <stdlib.h>
+#include <stddef.h>
+#include <limits.h>
 #include <string.h>
 #include <arpa/inet.h>
 #include <netinet/in.h>
 
 #include <sys/types.h>
 #include <sys/socket.h>
+#include <sys/eventfd.h>
+#include <sys/random.h>
+#include <sys/stat.h>
 #include <unistd.h>
 
 #include <pthread.h>
+#include <poll.h>
+#include <sched.h>
 #include <errno.h>
 
 #include "./include/packet.h"
+#include "./include/affinity.h"
+#include "./include/batchio.h"
+#include "./include/checkpoint.h"
+#include "./include/netutil.h"
+#include "./include/congestion.h"
+#include "./include/crc32c.h"
+#include "./include/fec.h"
+#include "./include/pacer.h"
+#include "./include/pmtu.h"
+#include "./include/rtt.h"
+#include "./include/source.h"
+#include "./include/spsc.h"
+#include "./include/stats.h"
+#include "./include/timeutil.h"
+#include "./include/window.h"
 
-#define MAX_DATA_SIZE 1024
-#define MAX_WINDOW_SIZE 10
-#define TIMOUT_SEC 1 
+#define MAX_WINDOW_SIZE 4096
 #define SEQ_NUM 1
-#define MSS 1460
-#define DECREASE_RATE 2
-#define INCREASE_RATE 1
-#define SECOND 1
 #define FIN_BIT_SENT 1
+#define DUP_ACK_THRESHOLD 3     // Segments SACKed above a hole that mark it lost
+#define BATCH_SLACK_NS 50000    // Segments the pacer releases this close together share a system call
+#define PROBE_MAX_INTERVAL_NS (1 * NSEC_PER_SEC)    // Zero-window probes back off up to this interval
+#define MAX_FLOWS 256
+#define RANGE_ALIGN CHECKPOINT_UNIT    // Ranges start 4 KB aligned on a checkpoint unit, so they are resumable
+#define ACK_RING_SIZE 1024      // ACKs the receive thread can hand over before it waits for the send thread
+#define ACK_SACK_BYTES (MAX_WINDOW_SIZE / 8)    // SACK bitmap bytes that can cover segments in flight
+#define STREAM_POLL_NS (1 * NSEC_PER_MSEC)      // Longest ACKs wait while the send thread waits on a stream
+#define STREAM_MIN_BUFFER (1024 * 1024)         // Holds a FEC block of the largest segments and a block to compress
 
-pthread_mutex_t threadLock;
-int continueThread = 1; 
-int sendRate = 1;
-int startDisconnect = 0;
-int globalSeqNum = SEQ_NUM;
+/**
+ * Options set from the command line.
+ */
+struct SendOptions {
+    uint64_t    maxRate;        // Pacing ceiling in bytes per second, 0 for none
+    uint64_t    burst;          // Bytes the pacer lets out back to back, 0 for four of the flow's datagrams
+    const char  *congestion;    // Congestion control algorithm
+    unsigned int batchSize;     // Datagrams per sendmmsg/recvmmsg
+    int         offload;        // Send batches as UDP_SEGMENT super-buffers
+    unsigned int flows;         // Parallel flows the file is split across
+    int         digest;         // Send a CRC32C of each flow's range with its FIN
+    unsigned int ackEvery;      // Segments per ACK to ask the receiver for, 0 for its default
+    unsigned int ackDelayUs;    // Maximum ACK delay to ask the receiver for, 0 for its default
+    const char  *statsPath;     // JSON statistics written at the end and on SIGUSR1
+    const char  *tracePath;     // qlog event trace
+    unsigned int fecBlock;      // Segments per FEC block, 0 to send no parity
+    unsigned int fecParity;     // Most parity segments per block
+    int         resumable;      // Identify the file, so a rerun after an interruption only sends what is missing
+    int         compress;       // Compress segment payloads if the receiver can take them
+    struct CpuList cpus;        // CPUs the flows' send and receive threads are pinned to in turn
+    size_t      maxDatagram;    // Largest datagram to probe the path for
+    size_t      streamBuffer;   // Bytes of a stream held for retransmission, 0 for what the window can have in flight
+};
+
+struct SendOptions sendOptions = { 0, 0, "cubic", BATCH_DEFAULT_SIZE, 0, 1, 0, 0, 0, NULL, NULL,
+                                   0, FEC_DEFAULT_PARITY, 0, 0, { 0 }, PACKET_MAX_SIZE, 0 };
 
 struct SendThreadArgs {
-    FILE* file;
-    int currentSeq;
+    struct SegmentSource *source;
     int sockfd;
     struct sockaddr_in *receiverAddr;
-    unsigned long long int* bytesTransferred;
-    unsigned long long int bytesToTransfer;
+    struct SendWindow *window;
+    struct CongestionControl *cc;
+    struct RttEstimator *rtt;
+    uint64_t offset;                        // File offset of the flow's first segment
+    unsigned long long int bytesToTransfer; // Bytes in the flow's range, the most to send until a stream ends
+    size_t mss;                             // Payload of a full segment, from the datagram size the path takes
     socklen_t addrLen;
+    uint32_t digest;                        // CRC32C of the segments below digestSeq
+    uint32_t digestSeq;                     // Next segment to fold into the digest on its first send
+    struct ConnStats *stats;
+    struct FecEncoder *fec;                 // NULL when the receiver takes no parity
+    char *fecScratch;                       // The payloads of a block when the file is not mapped
+    struct CompressedSource *compressed;    // NULL unless the receiver takes compressed segments
+    struct SpscRing *acks;                  // ACKs from the receive thread
+    uint32_t peerRepaired;                  // Segments the receiver reports rebuilding from parity
+    int doneFd;                             // eventfd written once every segment is acknowledged
 };
 
 /**
- * @brief *sendPacketsContinuously is a function that sends data to the receiver until told to join the main 
- *         thread if duplicate acks or packet loss occurs.
+ * An ACK as the receive thread hands it over. Everything it updates belongs to the send thread.
+ */
+struct AckEvent {
+    uint64_t    receivedTime;   // Monotonic time it arrived (ns)
+    uint32_t    receivedStamp;  // timestampUs() when it arrived, for its RTT sample
+    uint32_t    ackNum;
+    uint32_t    tsEcr;
+    uint32_t    repaired;       // Segments the receiver rebuilt from parity, 0 without FEC
+    uint64_t    rwnd;           // Advertised window in bytes
+    uint16_t    sackBytes;
+    unsigned char sack[ACK_SACK_BYTES];
+};
+
+/**
+ * One flow of a transfer: a byte range of the file sent over its own socket, with its own sequence
+ * space, window and congestion state.
+ */
+struct FlowArgs {
+    struct sockaddr_in receiverAddr;
+    const char *filename;
+    uint64_t offset;
+    uint64_t length;
+    uint16_t flowCount;
+    uint32_t connectionId;      // Shared by every flow, so the receiver can tell transfers apart
+    const struct FileIdentity *identity;    // NULL unless the transfer is resumable
+    unsigned int index;
+    pthread_t thread;
+};
+
+/**
+ * @brief segmentSize is a function that returns the payload size of a data segment.
+ * 
+ * @param seqNum            The sequence number of the segment.
+ * @param bytesToTransfer   The number of bytes in the whole transfer.
+ * @param mss               The payload size of a full segment.
+ */
+static ssize_t segmentSize(uint32_t seqNum, unsigned long long int bytesToTransfer, size_t mss) {
+    unsigned long long int offset = (unsigned long long int) (seqNum - SEQ_NUM) * mss;
+
+    return (bytesToTransfer - offset) < mss ? (ssize_t) (bytesToTransfer - offset) : (ssize_t) mss;
+}
+
+/**
+ * @brief payloadSize is a function that returns the payload size of a data segment that is built.
+ * 
+ * @param packetArgs    SendThreadArgs of the transfer.
+ * @param seqNum        The sequence number of the segment.
+ */
+static ssize_t payloadSize(struct SendThreadArgs *packetArgs, uint32_t seqNum) {
+    ssize_t size;
+
+    if (packetArgs->compressed != NULL) {
+        compressedPayload(packetArgs->compressed, seqNum, &size);
+        return size;
+    }
+    return segmentSize(seqNum, packetArgs->bytesToTransfer, packetArgs->mss);
+}
+
+/**
+ * @brief segmentPayload is a function that returns the payload of a data segment: its block when the flow
+ *        is compressed, and otherwise the file bytes at its offset, in place when the file is mapped.
+ * 
+ * @param packetArgs    SendThreadArgs of the transfer.
+ * @param seqNum        The sequence number of the segment.
+ * @param buf           A buffer of packetArgs->mss bytes, used when the file is not mapped.
+ * @param size          Set to the payload size.
+ */
+static const void *segmentPayload(struct SendThreadArgs *packetArgs, uint32_t seqNum, void *buf, ssize_t *size) {
+    const void *payload;
+
+    if (packetArgs->compressed != NULL) {
+        return compressedPayload(packetArgs->compressed, seqNum, size);
+    }
+    *size = segmentSize(seqNum, packetArgs->bytesToTransfer, packetArgs->mss);
+    payload = sourcePayload(packetArgs->source, packetArgs->offset + (uint64_t) (seqNum - SEQ_NUM) * packetArgs->mss,
+                            *size, buf);
+    if (payload == NULL) {
+        fprintf(stderr, "Error: Short read for segment %u\n", seqNum);
+        exit(EXIT_FAILURE);
+    }
+    return payload;
+}
+
+/**
+ * @brief queueSegment is a function that writes a data segment's header into the next slot of a batch.
+ *        The payload and timestamp are filled in by flushSegments, once the batch is full or due.
+ * 
+ * @param packetArgs    SendThreadArgs of the transfer.
+ * @param batch         The batch to queue the segment in.
+ * @param seqNum        The sequence number of the segment.
+ */
+static void queueSegment(struct SendThreadArgs *packetArgs, struct BatchIO *batch, uint32_t seqNum) {
+    struct Packet header;
+
+    memset(&header, 0, offsetof(struct Packet, data));
+    header.seqNum = seqNum;
+    packetEncodeHeader(&header, batchNext(batch));
+    batchQueue(batch, PACKET_HEADER_SIZE, packetArgs->receiverAddr, packetArgs->addrLen);
+}
+
+/**
+ * @brief queueParity is a function that writes the header of a parity segment into the next slot of a
+ *        batch. The parity itself is computed by flushSegments.
+ * 
+ * @param packetArgs    SendThreadArgs of the transfer.
+ * @param batch         The batch to queue the segment in.
+ * @param firstSeq      The first segment of the FEC block.
+ * @param count         The number of segments in the block.
+ * @param row           The parity row.
+ */
+static void queueParity(struct SendThreadArgs *packetArgs, struct BatchIO *batch, uint32_t firstSeq,
+                        unsigned int count, unsigned int row) {
+    struct Packet header;
+
+    memset(&header, 0, offsetof(struct Packet, data));
+    header.seqNum = firstSeq;
+    header.parityBit = 1;
+    header.ackNum = count << PACKET_PARITY_COUNT_SHIFT | row;
+    packetEncodeHeader(&header, batchNext(batch));
+    batchQueue(batch, PACKET_HEADER_SIZE, packetArgs->receiverAddr, packetArgs->addrLen);
+}
+
+/**
+ * @brief loadBlock is a function that finds the payloads of every segment of a FEC block.
+ * 
+ * @param packetArgs    SendThreadArgs of the transfer.
+ * @param firstSeq      The first segment of the block.
+ * @param count         The number of segments in the block.
+ * @param data          Filled with the payloads.
+ * @param sizes         Filled with their sizes.
+ */
+static void loadBlock(struct SendThreadArgs *packetArgs, uint32_t firstSeq, unsigned int count, const void **data,
+                      size_t *sizes) {
+    for (unsigned int i = 0; i < count; i++) {
+        ssize_t size;
+
+        data[i] = segmentPayload(packetArgs, firstSeq + i, packetArgs->fecScratch + i * packetArgs->mss, &size);
+        sizes[i] = size;
+    }
+}
+
+/**
+ * @brief flushSegments is a function that attaches the payload of every queued segment straight from the
+ *        file at its offset, or from its block when the flow is compressed, checksums it, and sends the
+ *        whole batch with one system call. New segments are first sent in order, so those also extend the
+ *        digest of the range; compressed flows take theirs over the file bytes as blocks are built.
+ *        Parity segments are computed here from their block, which is loaded once for all of its rows.
+ * 
+ * @param packetArgs    SendThreadArgs of the transfer.
+ * @param batch         The batch to send.
+ */
+static void flushSegments(struct SendThreadArgs *packetArgs, struct BatchIO *batch) {
+    const void *blockData[FEC_MAX_BLOCK];
+    size_t blockSizes[FEC_MAX_BLOCK];
+    uint32_t blockSeq = 0;      // First segment of the block in blockData, 0 for none
+
+    for (unsigned int i = 0; i < batch->count; i++) {
+        char *datagram = batchBuffer(batch, i);
+        struct Packet header;
+        ssize_t dataSize;
+        const void *payload;
+
+        packetParseHeader(&header, datagram, PACKET_HEADER_SIZE);
+        if (header.parityBit) {
+            unsigned int count = header.ackNum >> PACKET_PARITY_COUNT_SHIFT;
+
+            if (header.seqNum != blockSeq) {
+                loadBlock(packetArgs, header.seqNum, count, blockData, blockSizes);
+                blockSeq = header.seqNum;
+            }
+            dataSize = fecEncode(header.ackNum & PACKET_PARITY_ROW_MASK, blockData, blockSizes, count,
+                                 (unsigned char *) datagram + PACKET_HEADER_SIZE, &header.windowSize);
+            payload = datagram + PACKET_HEADER_SIZE;
+        } else {
+            payload = segmentPayload(packetArgs, header.seqNum, datagram + PACKET_HEADER_SIZE, &dataSize);
+        }
+        header.tsVal = timestampUs();
+        packetEncodeHeader(&header, datagram);
+        packetSetChecksum(datagram, payload, dataSize);
+        batchAttach(batch, i, payload, dataSize);
+
+        if (sendOptions.digest && packetArgs->compressed == NULL && !header.parityBit &&
+            header.seqNum == packetArgs->digestSeq) {
+            packetArgs->digest = crc32c(packetArgs->digest, payload, dataSize);
+            packetArgs->digestSeq++;
+        }
+    }
+
+    if (batchFlush(packetArgs->sockfd, batch) < 0) {
+        perror("Error: Failed to send data packet.");
+        exit(EXIT_FAILURE);
+    }
+}
+
+/**
+ * @brief sendWindowProbe is a function that sends a zero-length segment to make the receiver repeat its
+ *        cumulative ACK and current window.
+ * 
+ * @param packetArgs    SendThreadArgs of the transfer.
+ */
+static void sendWindowProbe(struct SendThreadArgs *packetArgs) {
+    struct Packet probe;
+
+    memset(&probe, 0, offsetof(struct Packet, data));
+    probe.seqNum = packetArgs->window->base - 1;
+    probe.tsVal = timestampUs();
+    if (sendPacketTo(packetArgs->sockfd, &probe, (struct sockaddr *) packetArgs->receiverAddr, packetArgs->addrLen) < 0) {
+        perror("Error: Failed to send window probe.");
+        exit(EXIT_FAILURE);
+    }
+    statsAdd(&packetArgs->stats->counters[STATS_SLOT_TX], STAT_PROBES, 1);
+    statsAdd(&packetArgs->stats->counters[STATS_SLOT_TX], STAT_PACKETS_SENT, 1);
+    statsAdd(&packetArgs->stats->counters[STATS_SLOT_TX], STAT_BYTES_SENT, PACKET_HEADER_SIZE);
+}
+
+/**
+ * @brief processAcks is a function that applies every ACK the receive thread has handed over: RTT samples,
+ *        the receiver's window, cumulative and selective acknowledgment, and the congestion response, and
+ *        then marks the holes the scoreboard shows as lost and samples the loss rate and the timeline. With
+ *        no ACK to apply it returns at once unless RACK's timer has run out.
+ * 
+ * @param packetArgs    SendThreadArgs of the transfer.
+ */
+static void processAcks(struct SendThreadArgs *packetArgs) {
+    struct SendWindow *window = packetArgs->window;
+    struct CongestionControl *cc = packetArgs->cc;
+    struct RttEstimator *rtt = packetArgs->rtt;
+    struct ConnStats *stats = packetArgs->stats;
+    struct StatsCounters *counters = &stats->counters[STATS_SLOT_TX];
+    struct AckEvent *ack;
+    struct Segment *lost;
+    uint64_t now;
+
+    // Without new ACKs the scoreboard only changes once RACK's timer runs out
+    if (spscFront(packetArgs->acks) == NULL && monotonicNs() < window->rackDeadline) {
+        return;
+    }
+    while ((ack = spscFront(packetArgs->acks)) != NULL) {
+        struct Segment newest;
+        uint64_t ackedBytes = 0;
+
+        // Every echoed timestamp is a valid sample, including ones for retransmitted segments
+        if (rttSampleEcho(rtt, ack->tsEcr, ack->receivedStamp)) {
+            ccOnRttSample(cc, rtt->latest, rtt->srtt, ack->receivedTime);
+            statsHistogramRecord(&stats->rtt, rtt->latest / NSEC_PER_USEC);
+        }
+
+        // ACKs older than the cumulative point may carry a stale window
+        window->probes = 0;
+        if (ack->ackNum + 1 >= window->base) {
+            windowSetReceiverWindow(window, ack->ackNum, ack->rwnd, packetArgs->mss);
+        }
+
+        memset(&newest, 0, sizeof(newest));
+        if (ack->ackNum >= window->base && ack->ackNum < window->nextSeq) {
+            ackedBytes += windowAckCumulative(window, ack->ackNum, ack->receivedTime, &newest);
+        }
+        if (ack->repaired > packetArgs->peerRepaired) {
+            statsAdd(counters, STAT_FEC_REPAIRED, ack->repaired - packetArgs->peerRepaired);
+            packetArgs->peerRepaired = ack->repaired;
+        }
+        for (unsigned int bit = 0; bit < ack->sackBytes * 8u; bit++) {
+            if (ack->sack[bit / 8] & (1 << (bit % 8))) {
+                ackedBytes += windowAckSelective(window, ack->ackNum + PACKET_SACK_OFFSET + bit, ack->receivedTime,
+                                                 &newest);
+            }
+        }
+
+        if (ackedBytes > 0) {
+            ccOnAck(cc, ackedBytes, window->bytesInFlight, newest.delivered, newest.deliveredTime, newest.sentTime,
+                    ack->receivedTime);
+            statsAdd(counters, STAT_DELIVERED, ackedBytes);
+        }
+        spscPop(packetArgs->acks);
+    }
+
+    // Only the holes the scoreboard shows are marked for retransmission
+    now = monotonicNs();
+    lost = windowDetectLosses(window, now, rtt->minRtt / 4, DUP_ACK_THRESHOLD);
+    if (lost != NULL) {
+        if (ccOnLoss(cc, lost->sentTime, now, 0)) {
+            statsAdd(counters, STAT_LOSS_EVENTS, 1);
+        }
+        if (traceEnabled()) {
+            traceEvent(stats, now, "recovery:packet_lost",
+                       "\"header\": {\"packet_number\": %u}, \"trigger\": \"reordering_threshold\"",
+                       lost->seqNum);
+        }
+    }
+
+    // Every loss counts towards the redundancy, whether it was retransmitted or rebuilt from parity
+    if (packetArgs->fec != NULL) {
+        uint64_t retransmits = statsTotal(stats, STAT_RETRANSMITS);
+
+        fecEncoderSample(packetArgs->fec, window->nextSeq - SEQ_NUM + retransmits, retransmits + packetArgs->peerRepaired);
+    }
+
+    if (statsTimelineDue(&stats->timeline, now)) {
+        struct StatsSample sample = { .cwnd = ccCwnd(cc), .pacingRate = ccPacingRate(cc),
+                                      .bytesInFlight = window->bytesInFlight, .srtt = rtt->srtt,
+                                      .delivered = statsTotal(stats, STAT_DELIVERED) };
+
+        statsTimelineRecord(&stats->timeline, now, &sample);
+        if (traceEnabled()) {
+            traceEvent(stats, now, "recovery:metrics_updated",
+                       "\"congestion_window\": %llu, \"bytes_in_flight\": %llu, \"smoothed_rtt\": %.3f, "
+                       "\"latest_rtt\": %.3f, \"min_rtt\": %.3f, \"pacing_rate\": %llu",
+                       (unsigned long long int) sample.cwnd, (unsigned long long int) sample.bytesInFlight,
+                       (double) rtt->srtt / NSEC_PER_MSEC, (double) rtt->latest / NSEC_PER_MSEC,
+                       (double) rtt->minRtt / NSEC_PER_MSEC, (unsigned long long int) sample.pacingRate * 8);
+        }
+    }
+}
+
+/**
+ * @brief streamReady is a function that reads a streamed source far enough to build the next new segment,
+ *        and a byte more, so a full segment is known not to be the last. Bytes no segment is built from
+ *        again are released first: those before the oldest segment in flight, or before its FEC block while
+ *        the block's parity may still be computed, and those already compressed. Once the stream ends or
+ *        fills the range, the range's length and the flow's last segment are set.
+ * 
+ * @param packetArgs    SendThreadArgs of the transfer.
+ * @return              1 if the next segment can be built, 0 if the stream has to be waited for.
+ */
+static int streamReady(struct SendThreadArgs *packetArgs) {
+    struct SendWindow *window = packetArgs->window;
+    struct CompressedSource *compressed = packetArgs->compressed;
+    struct SegmentSource *source = packetArgs->source;
+    uint32_t keep = window->base;
+    uint64_t need;
+
+    if (window->lastSeq != WINDOW_LAST_UNKNOWN) {
+        return 1;
+    }
+    if (compressed != NULL) {
+        sourceRelease(source, compressed->next);
+        need = compressed->next - packetArgs->offset + COMPRESS_MAX_RAW + 1;
+    } else {
+        if (packetArgs->fec != NULL) {
+            keep -= (keep - SEQ_NUM) % packetArgs->fec->blockSize;
+        }
+        sourceRelease(source, packetArgs->offset + (uint64_t) (keep - SEQ_NUM) * packetArgs->mss);
+        need = (uint64_t) (window->nextSeq - SEQ_NUM + 1) * packetArgs->mss + 1;
+    }
+    if (need > packetArgs->bytesToTransfer) {
+        need = packetArgs->bytesToTransfer;
+    }
+
+    while (source->size - packetArgs->offset < need && !source->ended) {
+        int result = sourceRead(source);
+
+        if (result < 0) {
+            perror("Error: Failed to read the stream");
+            exit(EXIT_FAILURE);
+        }
+        if (result == 0) {
+            return 0;
+        }
+    }
+
+    if (source->ended || source->size - packetArgs->offset >= packetArgs->bytesToTransfer) {
+        if (source->size - packetArgs->offset < packetArgs->bytesToTransfer) {
+            packetArgs->bytesToTransfer = source->size - packetArgs->offset;
+        }
+        if (compressed == NULL) {
+            window->lastSeq = SEQ_NUM + (packetArgs->bytesToTransfer + packetArgs->mss - 1) / packetArgs->mss - 1;
+        } else {
+            compressed->end = packetArgs->offset + packetArgs->bytesToTransfer;
+            if (compressed->next == compressed->end) {
+                window->lastSeq = window->nextSeq - 1;
+            }
+        }
+    }
+    return 1;
+}
+
+/**
+ * @brief *sendPacketsContinuously is a function that runs for the whole transfer and owns all of the
+ *         flow's state, so it takes no locks: before every decision it applies the ACKs the receive thread
+ *         has handed over through the ring, and it sleeps on the ring when it has nothing to do. It
+ *         retransmits segments that are marked lost or whose deadline has passed, and otherwise sends new segments while the
+ *         congestion window and the receiver's advertised window have room. A closed receiver window is
+ *         probed with a backoff. Every transmission is paced at the congestion controller's rate, and
+ *         segments the pacer releases within BATCH_SLACK_NS of each other go out in one sendmmsg. With
+ *         FEC the first transmission of the last segment of a block is followed by as many parity
+ *         segments as the measured loss rate calls for. Parity is paced but not counted in flight. A
+ *         compressed flow builds each new segment just before it is needed, and a stream is read just
+ *         before its bytes are; while the producer is behind, the thread waits on it instead of the ring.
  * 
  * @param arg   SendThreadArgs with values ready to send to receiver.
  */
 void *sendPacketsContinuously(void *arg) {
-    struct Packet currPacket;
     struct SendThreadArgs *packetArgs = (struct SendThreadArgs *) arg;
-    long int currentLine = (packetArgs->currentSeq - 1) * MSS;
+    struct SendWindow *window = packetArgs->window;
+    struct CongestionControl *cc = packetArgs->cc;
+    struct RttEstimator *rtt = packetArgs->rtt;
+    struct ConnStats *stats = packetArgs->stats;
+    struct StatsCounters *counters = &stats->counters[STATS_SLOT_TX];
+    struct FecEncoder *fec = packetArgs->fec;
+    struct CompressedSource *compressed = packetArgs->compressed;
+    struct SegmentSource *source = packetArgs->source;
+    struct BatchIO batch;
+    struct Pacer pacer;
+    uint64_t probeTime = 0;         // When the next zero-window probe is due, 0 if none is armed
+    uint64_t probeInterval = 0;
+    uint64_t done = 1;
 
-    if (fseek(packetArgs->file, currentLine, SEEK_SET) != 0) {
-        perror("Error - wrong seek line");
+    batchInit(&batch, sendOptions.batchSize, PACKET_HEADER_SIZE + packetArgs->mss);
+    if (sendOptions.offload && batchEnableGso(packetArgs->sockfd, &batch) < 0) {
+        fprintf(stderr, "Warning: UDP_SEGMENT is not supported, sending one datagram per message\n");
     }
+    pacerInit(&pacer, 0, sendOptions.burst != 0 ? sendOptions.burst : 4 * (PACKET_HEADER_SIZE + packetArgs->mss));
 
-    while ((packetArgs->bytesTransferred <= packetArgs->bytesToTransfer) && (!feof(packetArgs->file)) && (continueThread)) {
-        
-        currPacket.seqNum = packetArgs->currentSeq;
-        currPacket.ackNum = 0;
-        currPacket.ackBit = 0;
-        currPacket.finBit = 0;
-        currPacket.dataSize = fread(&currPacket.data, 1, MSS, packetArgs->file);
+    for (processAcks(packetArgs); !windowDone(window); processAcks(packetArgs)) {
+        uint64_t now = monotonicNs();
+        struct Segment *expired = windowExpire(window, now);
+        struct Segment *segment;
+        uint64_t cwnd;
+        uint64_t limit;
+        uint64_t rate;
+        int streamBehind = 0;       // The next new segment waits on bytes the stream does not have yet
 
-        if (currPacket.dataSize == 0) {
-            currPacket.finBit = 1;
+        // Each timeout that starts a new loss event doubles the RTO
+        if (expired != NULL) {
+            statsAdd(counters, STAT_TIMEOUTS, 1);
+            if (traceEnabled()) {
+                traceEvent(stats, now, "recovery:packet_lost",
+                           "\"header\": {\"packet_number\": %u}, \"trigger\": \"retransmission_timeout\"",
+                           expired->seqNum);
+            }
+        }
+        if (expired != NULL && ccOnLoss(cc, expired->sentTime, now, 1)) {
+            statsAdd(counters, STAT_LOSS_EVENTS, 1);
+            rttBackoff(rtt);
         }
+        cwnd = ccCwnd(cc);
+        limit = cwnd < window->rwnd ? cwnd : window->rwnd;
 
-        if (sendto(packetArgs->sockfd, &currPacket, sizeof(currPacket), 0, packetArgs->receiverAddr, packetArgs->addrLen) < 0) {
-            perror("Error: Failed to send first packet during disconnect.");
-            exit(EXIT_FAILURE);
+        rate = ccPacingRate(cc);
+        if (sendOptions.maxRate != 0 && (rate == 0 || rate > sendOptions.maxRate)) {
+            rate = sendOptions.maxRate;
         }
+        pacerSetRate(&pacer, rate);
 
-        sleep(SECOND / sendRate);
-        packetArgs->currentSeq++;
-        globalSeqNum++;
-        sendRate = sendRate + INCREASE_RATE;
-    }
+        // Send what is batched before waiting on the pacer
+        uint64_t release = pacerReleaseTime(&pacer, PACKET_HEADER_SIZE + packetArgs->mss);
+        if (release > now + BATCH_SLACK_NS) {
+            flushSegments(packetArgs, &batch);
+            sleepUntilNs(release);
+            continue;
+        }
 
-    if (feof(packetArgs->file) || (packetArgs->bytesTransferred >= packetArgs->bytesToTransfer)) {
-        currPacket.seqNum = packetArgs->currentSeq;
-        currPacket.ackNum = 0;
-        currPacket.ackBit = 0;
-        currPacket.finBit = 1;
-        if (sendto(packetArgs->sockfd, &currPacket, sizeof(currPacket), 0, packetArgs->receiverAddr, packetArgs->addrLen) < 0) {
-            perror("Error: Failed to send first packet during disconnect.");
-            exit(EXIT_FAILURE);
+        // A stream is read just ahead of the segments built from it
+        if (source->stream != NULL && windowHasRoom(window) &&
+            (compressed == NULL || compressed->prepared == window->nextSeq)) {
+            streamBehind = !streamReady(packetArgs);
+
+            // A stream that ends after its last segment was acknowledged leaves nothing to wait for
+            if (windowDone(window)) {
+                continue;
+            }
         }
-        currPacket.seqNum++;
-        globalSeqNum++;
-        if (sendto(packetArgs->sockfd, &currPacket, sizeof(currPacket), 0, packetArgs->receiverAddr, packetArgs->addrLen) < 0) {
-            perror("Error: Failed to send first packet during disconnect.");
-            exit(EXIT_FAILURE);
+
+        // Compressed segments are built one ahead of the send point. The ring slot of the next segment is
+        // free whenever the window has room for it, and the range's last segment is known once a block
+        // reaches its end.
+        if (compressed != NULL && compressed->prepared == window->nextSeq && windowHasRoom(window) && !streamBehind) {
+            size_t rawUsed;
+            int last = compressedPrepare(compressed, sendOptions.digest ? &packetArgs->digest : NULL, &rawUsed);
+
+            if (last < 0) {
+                fprintf(stderr, "Error: Short read for segment %u\n", window->nextSeq);
+                exit(EXIT_FAILURE);
+            }
+            statsAdd(counters, STAT_COMPRESSED, rawUsed);
+            if (last) {
+                window->lastSeq = window->nextSeq;
+            }
+            continue;
+        }
+
+        // Holes are filled before new data. The oldest hole may always go out so recovery cannot stall.
+        segment = windowNextRetransmit(window);
+        if (segment != NULL && (window->bytesInFlight < cwnd || segment->seqNum == window->base)) {
+            if (segment->retransmits >= RTT_MAX_RETRIES) {
+                fprintf(stderr, "Error: Receiver stopped acknowledging segment %u\n", segment->seqNum);
+                exit(EXIT_FAILURE);
+            }
+            windowRetransmitted(window, segment);
+        } else if (windowHasRoom(window) && windowReceiverHasRoom(window) && !streamBehind &&
+                   window->bytesInFlight + payloadSize(packetArgs, window->nextSeq) <= limit) {
+            segment = windowAdd(window, payloadSize(packetArgs, window->nextSeq));
+            probeTime = 0;
+        } else if (batch.count > 0) {
+            flushSegments(packetArgs, &batch);
+            continue;
+        } else {
+            // Nothing to send until an ACK arrives or a deadline passes
+            uint64_t deadline = windowEarliestDeadline(window);
+
+            if (window->rackDeadline < deadline) {
+                deadline = window->rackDeadline;
+            }
+
+            // With nothing in flight only a probe can bring news of the receiver's window opening
+            if (windowInFlight(window) == 0 && !windowReceiverHasRoom(window)) {
+                if (probeTime == 0) {
+                    probeInterval = rttCurrentRto(rtt);
+                    probeTime = now + probeInterval;
+                } else if (now >= probeTime) {
+                    if (++window->probes > RTT_MAX_RETRIES) {
+                        fprintf(stderr, "Error: Receiver stopped answering window probes\n");
+                        exit(EXIT_FAILURE);
+                    }
+                    sendWindowProbe(packetArgs);
+                    probeInterval = 2 * probeInterval < PROBE_MAX_INTERVAL_NS ? 2 * probeInterval : PROBE_MAX_INTERVAL_NS;
+                    probeTime = now + probeInterval;
+                }
+                deadline = probeTime;
+            }
+
+            // A producer that is behind is waited on, but ACKs for what is in flight are not kept waiting long.
+            // A full ring is only emptied by ACKs.
+            if (streamBehind && source->size - source->released < source->streamCapacity) {
+                uint64_t wait = deadline > now ? deadline - now : 0;
+
+                if (windowInFlight(window) > 0 && wait > STREAM_POLL_NS) {
+                    wait = STREAM_POLL_NS;
+                }
+                if (sourceWait(source, wait) < 0) {
+                    perror("Error: Failed to wait for the stream");
+                    exit(EXIT_FAILURE);
+                }
+                continue;
+            }
+            spscWait(packetArgs->acks, deadline);
+            continue;
+        }
+
+        // Stamp the segment as it is queued, since ACKs for it may be processed before the batch is flushed
+        pacerConsume(&pacer, PACKET_HEADER_SIZE + segment->dataSize);
+        windowSent(window, segment, now, now + rttCurrentRto(rtt));
+        segment->delivered = cc->delivered;
+        segment->deliveredTime = cc->deliveredTime;
+        queueSegment(packetArgs, &batch, segment->seqNum);
+
+        statsAdd(counters, STAT_PACKETS_SENT, 1);
+        statsAdd(counters, STAT_BYTES_SENT, PACKET_HEADER_SIZE + segment->dataSize);
+        if (segment->retransmits > 0) {
+            statsAdd(counters, STAT_RETRANSMITS, 1);
+        }
+        if (traceEnabled()) {
+            traceEvent(stats, now, "transport:packet_sent",
+                       "\"header\": {\"packet_type\": \"data\", \"packet_number\": %u}, \"raw\": {\"length\": %zd}, "
+                       "\"retransmission\": %s", segment->seqNum, PACKET_HEADER_SIZE + segment->dataSize,
+                       segment->retransmits > 0 ? "true" : "false");
+        }
+
+        // A block's parity follows the first transmission of its last segment
+        if (fec != NULL && segment->retransmits == 0 &&
+            ((segment->seqNum - SEQ_NUM) % fec->blockSize == fec->blockSize - 1 || segment->seqNum == window->lastSeq)) {
+            uint32_t lastSeq = segment->seqNum;
+            unsigned int count = (lastSeq - SEQ_NUM) % fec->blockSize + 1;
+            uint32_t firstSeq = lastSeq - count + 1;
+            unsigned int parity = fecEncoderParity(fec);
+            ssize_t paritySize = 0;
+
+            for (uint32_t seqNum = firstSeq; seqNum <= lastSeq; seqNum++) {
+                ssize_t size = payloadSize(packetArgs, seqNum);
+                paritySize = size > paritySize ? size : paritySize;
+            }
+
+            for (unsigned int row = 0; row < parity; row++) {
+                if (batchFull(&batch)) {
+                    flushSegments(packetArgs, &batch);
+                }
+                queueParity(packetArgs, &batch, firstSeq, count, row);
+                pacerConsume(&pacer, PACKET_HEADER_SIZE + paritySize);
+                statsAdd(counters, STAT_FEC_PARITY, 1);
+                statsAdd(counters, STAT_PACKETS_SENT, 1);
+                statsAdd(counters, STAT_BYTES_SENT, PACKET_HEADER_SIZE + paritySize);
+                if (traceEnabled()) {
+                    traceEvent(stats, now, "transport:packet_sent",
+                               "\"header\": {\"packet_type\": \"parity\", \"packet_number\": %u}, "
+                               "\"raw\": {\"length\": %zd}, \"block_length\": %u, \"row\": %u",
+                               firstSeq, PACKET_HEADER_SIZE + paritySize, count, row);
+                }
+            }
+            if (parity > 0) {
+                windowProtect(window, firstSeq, lastSeq, now);
+            }
+        }
+
+        if (batchFull(&batch)) {
+            flushSegments(packetArgs, &batch);
         }
-        startDisconnect = 1;
     }
 
+    // Let the receive thread know it can stop
+    if (write(packetArgs->doneFd, &done, sizeof(done)) < 0) {
+        perror("Error: Failed to signal the end of the transfer");
+        exit(EXIT_FAILURE);
+    }
+    batchDestroy(&batch);
+    traceFlush();
+    return NULL;
 }
 
 /**
  * @brief sendPacket function to send packet to receiver.
  * 
  * @param sockfd            The file descriptor of the socket.
+ * @param packet            The packet to send.
  * @param receiverAddr     The address of the receiver.           
  * @param addrLen           The size of the receiver address.
  */
-int sendPacket(int sockfd, struct Packet packet, struct sockaddr_in receiverAddr, socklen_t addrLen) {
-    ssize_t bytesSent = sendto(sockfd, &packet, sizeof(packet), 0,
-                                (struct sockaddr *)&receiverAddr, addrLen);
-    if (bytesSent == -1) {
+int sendPacket(int sockfd, const struct Packet *packet, const struct sockaddr_in *receiverAddr, socklen_t addrLen) {
+    if (sendPacketTo(sockfd, packet, (const struct sockaddr *)receiverAddr, addrLen) < 0) {
         perror("sendto");
         return -1;
     }
@@ -116,39 +724,69 @@ int sendPacket(int sockfd, struct Packet packet, struct sockaddr_in receiverAddr
 
 /**
  * @brief connectToReceiver is a function that initializes a three-way handshake connection with a receiver.
+ *        The SYN is retransmitted with exponential backoff until the receiver answers.
  * 
  * @param sockfd            The file descriptor of the socket.
  * @param sendingPacket    The packet to send to the receiver.
  * @param receivePacket    The packet to receive from the receiver.
  * @param receiverAddr     The address of the receiver.           
  * @param addrLen           The size of the receiver address.
+ * @param rtt               The RTT estimator of the connection.
+ * @param options           The handshake options to send.
+ * @param peer              Filled with the receiver's handshake options.
+ * @param rwnd              Filled with the receiver's initial window (bytes).
  */
-void connectToReceiver(int sockfd, struct Packet sendingPacket, struct Packet receivePacket, 
-             struct sockaddr_in receiverAddr, socklen_t addrLen) {
+void connectToReceiver(int sockfd, struct Packet *sendingPacket, struct Packet *receivePacket, 
+             const struct sockaddr_in *receiverAddr, socklen_t addrLen, struct RttEstimator *rtt,
+             const struct HandshakeOptions *options, struct HandshakeOptions *peer, uint64_t *rwnd) {
     
     int connectionFinished = 0;
     int currentSeqNum = SEQ_NUM;
+    int retries = 0;
+    struct sockaddr_in from;
+    socklen_t fromLen = sizeof(from);
 
     while(!connectionFinished) {
-        sendingPacket.seqNum = currentSeqNum;
-        sendingPacket.synBit = 1;
+        sendingPacket->seqNum = currentSeqNum;
+        sendingPacket->synBit = 1;
+        sendingPacket->tsVal = timestampUs();
+        packetSetOptions(sendingPacket, options);
 
         if (sendPacket(sockfd, sendingPacket, receiverAddr, addrLen) < 0) {
             perror("Error: Failed to send first packet during disconnect.");
             exit(EXIT_FAILURE);
         }
 
-        if (recvfrom(sockfd, &receivePacket, sizeof(receivePacket), 0, (struct sockaddr *)&receiverAddr, &addrLen) < 0) {
+        if (!waitForPacket(sockfd, rttCurrentRto(rtt))) {
+            rttBackoff(rtt);
+            if (++retries > RTT_MAX_RETRIES) {
+                fprintf(stderr, "Error: Receiver did not answer the handshake\n");
+                exit(EXIT_FAILURE);
+            }
+            continue;
+        }
+
+        int received = recvPacketFrom(sockfd, receivePacket, (struct sockaddr *)&from, &fromLen);
+        if (received < 0) {
             perror("Error: Failed to receive first packet during disconnect.");
             exit(EXIT_FAILURE);
         }
+        if (received == 0) {
+            continue;
+        }
 
-        if (receivePacket.ackBit != sendingPacket.synBit) {
-            printf(stderr, "Error: Invalid sequence number\n");
+        if (receivePacket->ackBit != sendingPacket->synBit) {
+            fprintf(stderr, "Error: Invalid sequence number\n");
         } else {
+            rttSampleEcho(rtt, receivePacket->tsEcr, timestampUs());
+            packetGetOptions(receivePacket, peer);
+            *rwnd = (uint64_t) receivePacket->windowSize << peer->windowScale;
             currentSeqNum++;
-            sendingPacket.ackNum = receivePacket.seqNum;
-            sendingPacket.ackBit = receivePacket.synBit;
+            sendingPacket->dataSize = 0;
+            sendingPacket->ackNum = receivePacket->seqNum;
+            sendingPacket->ackBit = receivePacket->synBit;
+            sendingPacket->tsVal = timestampUs();
+            sendingPacket->tsEcr = receivePacket->tsVal;
             if (sendPacket(sockfd, sendingPacket, receiverAddr, addrLen) < 0) {
                 perror("Error: Failed to send third packet during disconnect.");
                 exit(EXIT_FAILURE);
@@ -160,23 +798,118 @@ void connectToReceiver(int sockfd, struct Packet sendingPacket, struct Packet re
 }
 
 /**
- * @brief disconnectFromReceiver is a function that terminates a connection with a receiver.
+ * @brief discoverPathMtu is a function that probes for the largest datagram that reaches the receiver, as
+ *        laid out in pmtu.h. The probes of a round are sent again until each is answered, up to PMTU_MAX_PROBES
+ *        times; a size the local interface refuses is too big straight away. Probes wait an RTT and four
+ *        deviations for their answers rather than the RTO, whose floor would make a search that finds the
+ *        path narrower than both ends take a matter of seconds.
+ * 
+ * @param sockfd            The file descriptor of the socket, which sends with DF set.
+ * @param receiverAddr      The address of the receiver.
+ * @param addrLen           The size of the receiver address.
+ * @param rtt               The RTT estimator of the connection.
+ * @param maxSize           The largest datagram both ends take.
+ * @param stats             The statistics of the connection, for the trace.
+ * @return                  The datagram size to send.
+ */
+static size_t discoverPathMtu(int sockfd, const struct sockaddr_in *receiverAddr, socklen_t addrLen,
+                              struct RttEstimator *rtt, size_t maxSize, const struct ConnStats *stats) {
+    struct PmtuSearch search;
+    struct Packet probe;
+    struct Packet answer;
+    struct sockaddr_in from;
+    socklen_t fromLen;
+    uint64_t timer = rtt->srtt + 4 * rtt->rttvar;
+
+    if (rtt->srtt == 0 || timer > rttCurrentRto(rtt)) {
+        timer = rttCurrentRto(rtt);
+    } else if (timer < PMTU_MIN_PROBE_TIMER) {
+        timer = PMTU_MIN_PROBE_TIMER;
+    }
+    memset(&probe, 0, sizeof(probe));
+    probe.pmtuBit = 1;
+    pmtuInit(&search, maxSize);
+
+    while (pmtuNextRound(&search) > 0) {
+        for (unsigned int attempt = 0; attempt < PMTU_MAX_PROBES; attempt++) {
+            unsigned int pending = 0;
+
+            for (unsigned int i = 0; i < search.count; i++) {
+                if (!pmtuPending(&search, search.sizes[i])) {
+                    continue;
+                }
+                probe.dataSize = search.sizes[i] - PACKET_HEADER_SIZE;
+                probe.tsVal = timestampUs();
+                if (sendPacketTo(sockfd, &probe, (const struct sockaddr *) receiverAddr, addrLen) == 0) {
+                    pending++;
+                } else if (errno == EMSGSIZE) {
+                    pmtuTooBig(&search, search.sizes[i]);
+                } else {
+                    perror("Error: Failed to send path MTU probe");
+                    exit(EXIT_FAILURE);
+                }
+            }
+            if (pending == 0) {
+                break;
+            }
+
+            // Answers to probes of an earlier round, or late ones for sizes since found too big, are ignored
+            uint64_t deadline = monotonicNs() + timer;
+            while (pending > 0 && monotonicNs() < deadline && waitForPacket(sockfd, deadline - monotonicNs())) {
+                fromLen = sizeof(from);
+                int received = recvPacketFrom(sockfd, &answer, (struct sockaddr *) &from, &fromLen);
+
+                if (received < 0) {
+                    perror("Error: Failed to receive path MTU probe answer");
+                    exit(EXIT_FAILURE);
+                }
+                if (received && answer.pmtuBit && answer.ackBit && pmtuPending(&search, answer.ackNum)) {
+                    pmtuConfirm(&search, answer.ackNum);
+                    pending = 0;
+                    for (unsigned int i = 0; i < search.count; i++) {
+                        pending += pmtuPending(&search, search.sizes[i]);
+                    }
+                }
+            }
+        }
+    }
+
+    if (search.confirmed == 0) {
+        fprintf(stderr, "Warning: No path MTU probe was answered, sending %zu-byte datagrams\n", pmtuResult(&search));
+    }
+    if (traceEnabled()) {
+        traceEvent(stats, monotonicNs(), "connectivity:mtu_updated", "\"new\": %zu, \"done\": true",
+                   pmtuResult(&search));
+    }
+    return pmtuResult(&search);
+}
+
+/**
+ * @brief disconnectFromReceiver is a function that terminates a connection with a receiver. The FIN is
+ *        retransmitted until it is acknowledged, and after the final ACK the sender lingers for two RTOs
+ *        to answer a FIN+ACK that is repeated because that ACK was lost. The FIN carries the payload of
+ *        sendingPacket, which is the digest of the range when one was negotiated.
  * 
  * @param sockfd            The file descriptor of the socket.
  * @param sendingPacket    The packet to send to the receiver.
  * @param receivePacket    The packet to receive from the receiver.
  * @param receiverAddr     The address of the receiver.    
- * @param currentSeqNum     The current sequence number.       
+ * @param currentSeqNum     The sequence number of the FIN.       
  * @param addrLen           The size of the receiver address.
+ * @param rtt               The RTT estimator of the connection.
  */
-void disconnectFromReceiver(int sockfd, struct Packet sendingPacket, struct Packet receivePacket, 
-                struct sockaddr_in receiverAddr, int currentSeqNum, socklen_t addrLen) {
+void disconnectFromReceiver(int sockfd, struct Packet *sendingPacket, struct Packet *receivePacket, 
+                const struct sockaddr_in *receiverAddr, int currentSeqNum, socklen_t addrLen, struct RttEstimator *rtt) {
     int connectionFinished = 0;
+    int retries = 0;
+    struct sockaddr_in from;
+    socklen_t fromLen = sizeof(from);
 
     while(!connectionFinished) {
-        sendingPacket.seqNum = globalSeqNum;
-        sendingPacket.finBit = 1;
-        sendingPacket.ackBit = 0;
+        sendingPacket->seqNum = currentSeqNum;
+        sendingPacket->finBit = 1;
+        sendingPacket->ackBit = 0;
+        sendingPacket->tsVal = timestampUs();
 
         // Send FIN
         if (sendPacket(sockfd, sendingPacket, receiverAddr, addrLen) < 0) {
@@ -184,19 +917,35 @@ void disconnectFromReceiver(int sockfd, struct Packet sendingPacket, struct Pack
             exit(EXIT_FAILURE);
         }
 
-        // Receive ACKd FIN
-        if (recvfrom(sockfd, &receivePacket, sizeof(receivePacket), 0, (struct sockaddr *)&receiverAddr, &addrLen) < 0) {
-            perror("Error: Failed to receive first packet during disconnect.");
-            exit(EXIT_FAILURE);
-        }   
+        // Receive ACKd FIN, skipping late ACKs for data segments
+        uint64_t deadline = monotonicNs() + rttCurrentRto(rtt);
+        int answered = 0;
+        while (!answered && monotonicNs() < deadline && waitForPacket(sockfd, deadline - monotonicNs())) {
+            int received = recvPacketFrom(sockfd, receivePacket, (struct sockaddr *)&from, &fromLen);
+            if (received < 0) {
+                perror("Error: Failed to receive first packet during disconnect.");
+                exit(EXIT_FAILURE);
+            }
+            answered = received && receivePacket->finBit;
+        }
+        if (!answered) {
+            rttBackoff(rtt);
+            if (++retries > RTT_MAX_RETRIES) {
+                fprintf(stderr, "Error: Receiver did not acknowledge the FIN\n");
+                return;
+            }
+            continue;
+        }
 
-        if (receivePacket.ackBit != sendingPacket.finBit) {
-            printf(stderr, "Error: Invalid sequence number\n");
+        if (receivePacket->ackBit != sendingPacket->finBit) {
+            fprintf(stderr, "Error: Invalid sequence number\n");
         } else {
-            globalSeqNum++;
-            sendingPacket.ackNum = receivePacket.seqNum;
-            sendingPacket.ackBit = 1;
-            sendingPacket.seqNum = globalSeqNum;
+            sendingPacket->ackNum = receivePacket->seqNum;
+            sendingPacket->ackBit = 1;
+            sendingPacket->finBit = 0;
+            sendingPacket->dataSize = 0;
+            sendingPacket->seqNum = currentSeqNum + 1;
+            sendingPacket->tsEcr = receivePacket->tsVal;
             if (sendPacket(sockfd, sendingPacket, receiverAddr, addrLen) < 0) {
                 perror("Error: Failed to send third packet during disconnect.");
                 exit(EXIT_FAILURE);
@@ -205,33 +954,66 @@ void disconnectFromReceiver(int sockfd, struct Packet sendingPacket, struct Pack
             }
         }
     }
+
+    // Linger so a lost final ACK can be sent again. The FIN+ACK has arrived, so the backoff spent waiting
+    // for the receiver to drain its writes does not apply.
+    uint64_t lingerEnd = monotonicNs() + 2 * rtt->rto;
+    while (monotonicNs() < lingerEnd && waitForPacket(sockfd, lingerEnd - monotonicNs())) {
+        int received = recvPacketFrom(sockfd, receivePacket, (struct sockaddr *)&from, &fromLen);
+        if (received < 0) {
+            break;
+        }
+        if (received && receivePacket->finBit && receivePacket->ackBit) {
+            sendPacket(sockfd, sendingPacket, receiverAddr, addrLen);
+        }
+    }
 }
 
 /**
- * @brief rsend is a function that sends data to the receiver address.
+ * @brief sendFlow is a function that sends one byte range of the file over its own connection. Flows
+ *        share nothing, so each runs on its own cores.
  * 
- * @param hostname          Host address of the receiver.   
- * @param hostUDPport       The port to send data on.
- * @param filename          The filename of the file.
- * @param bytesToTransfer   The number of bytes to send to the receiver.    
+ * @param arg   FlowArgs of the range.
  */
-void rsend(char* hostname, 
-            unsigned short int hostUDPport, 
-            char* filename, 
-            unsigned long long int bytesToTransfer) 
+static void *sendFlow(void *arg)
 {
+    struct FlowArgs *flow = (struct FlowArgs *) arg;
     int sockfd;
-    struct sockaddr_in receiverAddr;
-    char buffer[MAX_DATA_SIZE];
+    struct sockaddr_in receiverAddr = flow->receiverAddr;
     struct Packet senderPacket;
     struct Packet receivePacket; 
-    unsigned int currentSeqNum = SEQ_NUM;
-    unsigned int currentAckNum;
     pthread_t senderThreadId;
-    unsigned long long int* bytesTransferred = 0;
-    unsigned int cwnd = 1;
     struct SendThreadArgs sendArgs;
+    struct SendWindow window;
+    struct CongestionControl cc;
+    struct RttEstimator rtt;
+    struct BatchIO ackBatch;
+    struct SegmentSource source;
+    struct HandshakeOptions options = { .rangeOffset = flow->offset, .flowCount = flow->flowCount,
+                                        .connectionId = flow->connectionId, .digest = sendOptions.digest,
+                                        .ackEvery = sendOptions.ackEvery, .ackDelayUs = sendOptions.ackDelayUs,
+                                        .fecBlock = sendOptions.fecBlock, .fecParity = sendOptions.fecParity,
+                                        .resumable = flow->identity != NULL, .compressed = sendOptions.compress };
+    struct HandshakeOptions peer;
+    uint64_t rwnd;
+    unsigned long long int bytesToTransfer = flow->length;
     socklen_t addrLen;
+    uint32_t lastSeq;
+    struct ConnStats stats;
+    struct StatsCounters *counters = &stats.counters[STATS_SLOT_RX];
+    struct FecEncoder fec;
+    uint64_t resumed = 0;
+    struct CompressedSource compressed;
+    struct SpscRing acks;
+    size_t datagramSize;
+    size_t mss;
+    size_t streamBuffer;
+
+    memset(&senderPacket, 0, sizeof(senderPacket));
+    memset(&receivePacket, 0, sizeof(receivePacket));
+    if (flow->identity != NULL) {
+        options.identity = *flow->identity;
+    }
 
     // Create UDP Socket 
     sockfd = socket(AF_INET, SOCK_DGRAM, 0);
@@ -240,91 +1022,351 @@ void rsend(char* hostname,
         exit(EXIT_FAILURE);
     }
 
-    // Initialize receiver address 
-    memset(&receiverAddr, 0, sizeof(receiverAddr));
-    receiverAddr.sin_family = AF_INET;
-    receiverAddr.sin_port = htons(hostUDPport);
-    inet_pton(AF_INET, hostname, &receiverAddr.sin_addr);
+    // Datagrams go out with DF set and are never fragmented. ICMP does not lower what the kernel lets out,
+    // so only the probes decide the datagram size.
+    int pmtuDiscover = IP_PMTUDISC_PROBE;
+    if (setsockopt(sockfd, IPPROTO_IP, IP_MTU_DISCOVER, &pmtuDiscover, sizeof(pmtuDiscover)) < 0) {
+        perror("Warning: Failed to set IP_MTU_DISCOVER");
+    }
+
+    // A whole window may be handed to the kernel at once when the pacer lets it, and sending should not
+    // stall on the send buffer while the device queue drains
+    socketBufferSize(sockfd, 0, (size_t) MAX_WINDOW_SIZE * SOCKET_BUFFER_PER_DATAGRAM);
+
+    // Every segment in flight may be answered by its own ACK, and the ACK thread may be slow to wake
+    socketBufferSize(sockfd, 1, (size_t) MAX_WINDOW_SIZE * 2 *
+                     (PACKET_HEADER_SIZE + PACKET_REPAIRED_SIZE + PACKET_MAX_SACK_BYTES));
+
+    statsConnInit(&stats, &receiverAddr, flow->connectionId, flow->offset);
+    statsRegister(&stats);
 
+    // The sender never receives data, so its window scale stays 0
     addrLen = sizeof(receiverAddr);
-    connectToReceiver(sockfd, senderPacket, receivePacket, receiverAddr, addrLen);
+    rttInit(&rtt);
+    connectToReceiver(sockfd, &senderPacket, &receivePacket, &receiverAddr, addrLen, &rtt, &options, &peer, &rwnd);
 
-    // Open the file
-    FILE* file = fopen(filename, "r");
-    if (file == NULL) {
-        fprintf(stderr, "Error: Unable to open file %s\n", filename);
+    // Receivers that take nothing larger than an Ethernet MTU do not say so, and are not probed
+    if (peer.maxDatagram != 0) {
+        datagramSize = discoverPathMtu(sockfd, &receiverAddr, addrLen, &rtt,
+                                       peer.maxDatagram < sendOptions.maxDatagram ? peer.maxDatagram
+                                                                                  : sendOptions.maxDatagram,
+                                       &stats);
+    } else {
+        datagramSize = PACKET_DEFAULT_SIZE < sendOptions.maxDatagram ? PACKET_DEFAULT_SIZE : sendOptions.maxDatagram;
+    }
+    mss = datagramSize - PACKET_HEADER_SIZE;
+    __atomic_store_n(&stats.datagramSize, datagramSize, __ATOMIC_RELAXED);
+
+    // Windows are advertised in units of PACKET_WINDOW_UNIT per free slot, and a slot holds one segment
+    rwnd = rwnd / PACKET_WINDOW_UNIT * mss;
+
+    // Open the file. A stream keeps what the window can have in flight unless it is told to keep less.
+    streamBuffer = sendOptions.streamBuffer != 0 ? sendOptions.streamBuffer : MAX_WINDOW_SIZE * mss + COMPRESS_MAX_RAW;
+    if (sourceOpen(&source, flow->filename, streamBuffer) < 0) {
+        fprintf(stderr, "Error: Unable to open file %s\n", flow->filename);
+        exit(EXIT_FAILURE);
+    }
+
+    // Never send past the end of the file; a stream's end is only found by reading it
+    if (source.stream == NULL && source.size < flow->offset + bytesToTransfer) {
+        bytesToTransfer = source.size > flow->offset ? source.size - flow->offset : 0;
+    }
+
+    // The receiver kept the start of the range from an interrupted attempt, so the flow starts after it
+    if (options.resumable && peer.resumeOffset > 0) {
+        resumed = peer.resumeOffset < bytesToTransfer ? peer.resumeOffset : bytesToTransfer;
+        bytesToTransfer -= resumed;
+        statsAdd(counters, STAT_RESUMED, resumed);
+    }
+    lastSeq = source.stream != NULL && bytesToTransfer > 0 ? WINDOW_LAST_UNKNOWN
+                                                           : SEQ_NUM + (bytesToTransfer + mss - 1) / mss - 1;
+
+    // How many compressed segments the range takes is only known when the last one is built
+    if (sendOptions.compress && !peer.compressed) {
+        fprintf(stderr, "Warning: Receiver does not take compressed segments, sending them raw\n");
+    } else if (peer.compressed && bytesToTransfer > 0) {
+        lastSeq = WINDOW_LAST_UNKNOWN;
+    }
+
+    windowInit(&window, MAX_WINDOW_SIZE, SEQ_NUM, lastSeq);
+    windowSetReceiverWindow(&window, SEQ_NUM - 1, rwnd, mss);
+    if (ccInit(&cc, sendOptions.congestion, mss) < 0) {
+        fprintf(stderr, "Error: Unknown congestion control algorithm %s\n", sendOptions.congestion);
         exit(EXIT_FAILURE);
     }
+    if (rtt.srtt != 0) {
+        ccOnRttSample(&cc, rtt.latest, rtt.srtt, monotonicNs());
+    }
 
-    sendArgs.file = file;
-    sendArgs.currentSeq = 1;
+    sendArgs.source = &source;
     sendArgs.sockfd = sockfd;
     sendArgs.receiverAddr = &receiverAddr;
-    sendArgs.bytesTransferred = bytesTransferred;
+    sendArgs.window = &window;
+    sendArgs.cc = &cc;
+    sendArgs.rtt = &rtt;
+    sendArgs.offset = flow->offset + resumed;
     sendArgs.bytesToTransfer = bytesToTransfer;
+    sendArgs.mss = mss;
     sendArgs.addrLen = addrLen;
+    sendArgs.digest = 0;
+    sendArgs.digestSeq = SEQ_NUM;
+    sendArgs.stats = &stats;
+    sendArgs.fec = NULL;
+    sendArgs.fecScratch = NULL;
+    sendArgs.compressed = NULL;
+    sendArgs.acks = &acks;
+    sendArgs.peerRepaired = 0;
+    spscInit(&acks, ACK_RING_SIZE, sizeof(struct AckEvent));
+    sendArgs.doneFd = eventfd(0, EFD_CLOEXEC);
+    if (sendArgs.doneFd < 0) {
+        perror("Error: Failed to create eventfd");
+        exit(EXIT_FAILURE);
+    }
+    if (peer.compressed) {
+        compressedInit(&compressed, &source, SEQ_NUM, sendArgs.offset, bytesToTransfer, MAX_WINDOW_SIZE, mss);
+        sendArgs.compressed = &compressed;
+    }
 
-    if (pthread_mutex_init(&threadLock, NULL) != 0) { 
-        printf("\n mutex init has failed\n"); 
-        exit(EXIT_FAILURE); 
-    } 
+    // The receiver answers with the FEC it takes, if any
+    if (peer.fecBlock != 0 && peer.fecParity != 0) {
+        fecEncoderInit(&fec, peer.fecBlock, peer.fecParity);
+        sendArgs.fec = &fec;
+        sendArgs.fecScratch = malloc(peer.fecBlock * mss);
+        if (sendArgs.fecScratch == NULL) {
+            perror("Error: Failed to allocate FEC buffer");
+            exit(EXIT_FAILURE);
+        }
+    } else if (sendOptions.fecBlock != 0) {
+        fprintf(stderr, "Warning: Receiver does not take FEC, sending without parity\n");
+    }
 
     if (pthread_create(&senderThreadId, NULL, sendPacketsContinuously, (void *)&sendArgs)) {
         perror("Error: failed to create transmission thread");
         exit(EXIT_FAILURE);
     }
+    threadPin(senderThreadId, &sendOptions.cpus, 2 * flow->index);
+    threadPin(pthread_self(), &sendOptions.cpus, 2 * flow->index + 1);
 
-    globalSeqNum = 1;
+    // Read ACKs until the send thread has every segment acknowledged. Every ACK queued on the socket is
+    // drained with one recvmmsg, checked, and handed to the send thread through the ring in one publish;
+    // the send thread owns everything the ACKs update, so this thread takes no locks.
+    batchInit(&ackBatch, sendOptions.batchSize, PACKET_DEFAULT_SIZE);
+    for (;;) {
+        struct pollfd fds[2] = { { .fd = sockfd, .events = POLLIN }, { .fd = sendArgs.doneFd, .events = POLLIN } };
+        int received;
 
-    int disconnect = 0;
-    while (!disconnect) {
-        struct Packet ackPacket;
-
-        if (startDisconnect) {
-            disconnect = 1;
+        if (poll(fds, 2, -1) < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            perror("Error: Failed to wait for ACK packets");
+            exit(EXIT_FAILURE);
+        }
+        if (fds[1].revents & POLLIN) {
             break;
         }
-
-        if (recvfrom(sockfd, &ackPacket, sizeof(ackPacket), 0, (struct sockaddr *)&receiverAddr, &addrLen) < 0) {
+        received = batchReceive(sockfd, &ackBatch, MSG_DONTWAIT);
+        if (received < 0) {
             perror("Error: Failed to receive ACK packet - Handling Acks\n");
             exit(EXIT_FAILURE);
         }
 
-        if ((ackPacket.ackNum >= currentSeqNum)) {
-            globalSeqNum = ackPacket.ackNum + 1;
-        } else {
-            // Finish sending data because of packet loss and end thread and join it back
-            pthread_mutex_lock(&threadLock);
-            continueThread = 0;
-            pthread_mutex_unlock(&threadLock);
-            if (pthread_join(senderThreadId, NULL) != 0) {
-                perror("pthread_join");
-                exit(EXIT_FAILURE);
+        uint64_t now = monotonicNs();
+        uint32_t stamp = timestampUs();
+
+        for (int i = 0; i < received; i++) {
+            struct Packet ackPacket;
+            struct AckEvent *ack;
+            const char *sack;
+            ssize_t sackBytes;
+
+            statsAdd(counters, STAT_PACKETS_RECEIVED, 1);
+            statsAdd(counters, STAT_BYTES_RECEIVED, batchLength(&ackBatch, i));
+            if (packetParse(&ackPacket, batchData(&ackBatch, i), batchLength(&ackBatch, i)) < 0) {
+                continue;
+            }
+            if (!packetVerify(batchData(&ackBatch, i), batchLength(&ackBatch, i))) {
+                statsAdd(counters, STAT_CORRUPT, 1);
+                continue;
+            }
+            if (!ackPacket.ackBit || ackPacket.synBit || ackPacket.finBit || ackPacket.pmtuBit) {
+                continue;
+            }
+            if (traceEnabled()) {
+                traceEvent(&stats, now, "transport:packet_received",
+                           "\"header\": {\"packet_type\": \"ack\", \"packet_number\": %u}, \"raw\": {\"length\": %zu}, "
+                           "\"frames\": [{\"frame_type\": \"ack\", \"largest_acknowledged\": %u, \"sack_bytes\": %zd}]",
+                           ackPacket.seqNum, batchLength(&ackBatch, i), ackPacket.ackNum, ackPacket.dataSize);
             }
 
-            sendRate = sendRate / DECREASE_RATE;
-
-            // sendArgs added to last send that has been acknowledged
-            sendArgs.file = file;
-            sendArgs.currentSeq = globalSeqNum;
-            sendArgs.sockfd = sockfd;
-            sendArgs.receiverAddr = &receiverAddr;
-            sendArgs.bytesTransferred = bytesTransferred;
-            sendArgs.bytesToTransfer = bytesToTransfer;
-            sendArgs.addrLen = addrLen;
-
-            // start sending again 
-            pthread_mutex_lock(&threadLock);
-            continueThread = 1;
-            pthread_mutex_unlock(&threadLock);
-            if (pthread_create(&senderThreadId, NULL, sendPacketsContinuously, (void *)&sendArgs)) {
-                perror("Error: failed to create transmission thread");
-                exit(EXIT_FAILURE);
+            // A full ring means the send thread is behind; what is already filled goes to it while we wait
+            while ((ack = spscSlot(&acks)) == NULL) {
+                spscPublish(&acks);
+                sched_yield();
+            }
+            ack->receivedTime = now;
+            ack->receivedStamp = stamp;
+            ack->ackNum = ackPacket.ackNum;
+            ack->tsEcr = ackPacket.tsEcr;
+            ack->rwnd = ((uint64_t) ackPacket.windowSize << peer.windowScale) / PACKET_WINDOW_UNIT * mss;
+            ack->repaired = 0;
+
+            // The payload is a SACK bitmap of the segments held above the first hole, after the count of
+            // rebuilt segments with FEC. Bits past ACK_SACK_BYTES are beyond anything in flight.
+            sack = ackPacket.data;
+            sackBytes = ackPacket.dataSize;
+            if (sendArgs.fec != NULL && sackBytes >= PACKET_REPAIRED_SIZE) {
+                memcpy(&ack->repaired, sack, sizeof(ack->repaired));
+                ack->repaired = ntohl(ack->repaired);
+                sack += PACKET_REPAIRED_SIZE;
+                sackBytes -= PACKET_REPAIRED_SIZE;
             }
+            ack->sackBytes = sackBytes < ACK_SACK_BYTES ? sackBytes : ACK_SACK_BYTES;
+            memcpy(ack->sack, sack, ack->sackBytes);
+            spscPush(&acks);
         }
-   }
-   // Start disconnecting from receiver
-   disconnectFromReceiver(sockfd, senderPacket, receivePacket, receiverAddr, globalSeqNum, addrLen);
+        spscPublish(&acks);
+    }
+
+    if (pthread_join(senderThreadId, NULL) != 0) {
+        perror("pthread_join");
+        exit(EXIT_FAILURE);
+    }
+
+    if (statsTotal(&stats, STAT_CORRUPT) > 0) {
+        fprintf(stderr, "Warning: Dropped %llu corrupt ACKs\n", (unsigned long long int) statsTotal(&stats, STAT_CORRUPT));
+    }
+
+    // Start disconnecting from receiver, with the digest of the range in the FIN if it was asked for. The
+    // handshake left its flags in the packet.
+    memset(&senderPacket, 0, offsetof(struct Packet, data));
+    if (sendOptions.digest) {
+        uint32_t digest = htonl(sendArgs.digest);
+
+        memcpy(senderPacket.data, &digest, sizeof(digest));
+        senderPacket.dataSize = sizeof(digest);
+    }
+    disconnectFromReceiver(sockfd, &senderPacket, &receivePacket, &receiverAddr, window.lastSeq + 1, addrLen, &rtt);
+
+    statsUnregister(&stats);
+    traceFlush();
+    batchDestroy(&ackBatch);
+    free(sendArgs.fecScratch);
+    spscDestroy(&acks);
+    close(sendArgs.doneFd);
+    if (sendArgs.compressed != NULL) {
+        compressedDestroy(&compressed);
+    }
+    windowDestroy(&window);
+    sourceClose(&source);
+    close(sockfd);
+    return NULL;
+}
+
+/**
+ * @brief rsend is a function that sends data to the receiver address. With more than one flow the file
+ *        is split into equal byte ranges that are sent in parallel; the receiver writes each one at its
+ *        offset. A resumable transfer identifies the file in every SYN, and each flow skips the start of
+ *        its range that the receiver kept from an interrupted attempt at the same file. A stream, such as
+ *        a pipe, is sent over one flow from its start until it ends.
+ * 
+ * @param hostname          Host address of the receiver.   
+ * @param hostUDPport       The port to send data on.
+ * @param filename          The filename of the file, SOURCE_STDIN for standard input.
+ * @param bytesToTransfer   The most bytes to send to the receiver.    
+ */
+void rsend(char* hostname, 
+            unsigned short int hostUDPport, 
+            char* filename, 
+            unsigned long long int bytesToTransfer) 
+{
+    struct sockaddr_in receiverAddr;
+    struct FlowArgs *flows;
+    uint64_t fileSize;
+    int stream;
+    uint64_t rangeSize;
+    uint16_t flowCount;
+    uint32_t connectionId = 0;
+    struct FileIdentity identity;
+
+    // Initialize receiver address 
+    memset(&receiverAddr, 0, sizeof(receiverAddr));
+    receiverAddr.sin_family = AF_INET;
+    receiverAddr.sin_port = htons(hostUDPport);
+    inet_pton(AF_INET, hostname, &receiverAddr.sin_addr);
+
+    // Never send past the end of the file
+    stream = sourceIsStream(filename, &fileSize);
+    if (stream < 0) {
+        fprintf(stderr, "Error: Unable to open file %s\n", filename);
+        exit(EXIT_FAILURE);
+    }
+    if (!stream && fileSize < bytesToTransfer) {
+        bytesToTransfer = fileSize;
+    }
+
+    // A stream is read once, in order, so it can neither be split nor identified
+    if (stream && sendOptions.flows > 1) {
+        fprintf(stderr, "Warning: A stream cannot be split, sending it over one flow\n");
+    }
+    if (stream && sendOptions.resumable) {
+        fprintf(stderr, "Warning: A stream cannot be resumed, sending it from the start\n");
+        sendOptions.resumable = 0;
+    }
+    if (sendOptions.resumable && checkpointIdentify(filename, bytesToTransfer, &identity) < 0) {
+        fprintf(stderr, "Error: Unable to read file %s\n", filename);
+        exit(EXIT_FAILURE);
+    }
+
+    // Aligned ranges of equal size; a small file uses fewer flows than asked for
+    if (stream) {
+        rangeSize = bytesToTransfer;
+        flowCount = 1;
+    } else {
+        rangeSize = (bytesToTransfer + sendOptions.flows - 1) / sendOptions.flows;
+        rangeSize = (rangeSize + RANGE_ALIGN - 1) / RANGE_ALIGN * RANGE_ALIGN;
+        flowCount = rangeSize > 0 ? (bytesToTransfer + rangeSize - 1) / rangeSize : 1;
+    }
+
+    // The rate ceiling is for the whole transfer, so every flow gets an equal share
+    if (sendOptions.maxRate != 0) {
+        sendOptions.maxRate = sendOptions.maxRate / flowCount > 0 ? sendOptions.maxRate / flowCount : 1;
+    }
+
+    // A receiver serving many senders tells transfers from the same host apart by this ID; 0 means none
+    while (connectionId == 0) {
+        if (getrandom(&connectionId, sizeof(connectionId), 0) != sizeof(connectionId)) {
+            perror("Error: Failed to generate connection ID");
+            exit(EXIT_FAILURE);
+        }
+    }
+
+    flows = calloc(flowCount, sizeof(struct FlowArgs));
+    if (flows == NULL) {
+        perror("Error: Failed to allocate flows");
+        exit(EXIT_FAILURE);
+    }
+    for (uint16_t i = 0; i < flowCount; i++) {
+        flows[i].receiverAddr = receiverAddr;
+        flows[i].filename = filename;
+        flows[i].offset = i * rangeSize;
+        flows[i].length = bytesToTransfer - flows[i].offset < rangeSize ? bytesToTransfer - flows[i].offset : rangeSize;
+        flows[i].flowCount = flowCount;
+        flows[i].connectionId = connectionId;
+        flows[i].identity = sendOptions.resumable ? &identity : NULL;
+        flows[i].index = i;
+        if (pthread_create(&flows[i].thread, NULL, sendFlow, &flows[i])) {
+            perror("Error: failed to create flow thread");
+            exit(EXIT_FAILURE);
+        }
+    }
+    for (uint16_t i = 0; i < flowCount; i++) {
+        if (pthread_join(flows[i].thread, NULL) != 0) {
+            perror("pthread_join");
+            exit(EXIT_FAILURE);
+        }
+    }
+    free(flows);
 }
 
 
@@ -337,18 +1379,118 @@ int main(int argc, char** argv) {
     unsigned long long int bytesToTransfer;
     char* hostname = NULL;
     char* filename = NULL;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "r:b:c:B:Gj:Va:A:S:Q:F:P:RzC:M:W:")) != -1) {
+        switch (opt) {
+            case 'r':
+                sendOptions.maxRate = strtoull(optarg, NULL, 10);
+                break;
+            case 'b':
+                sendOptions.burst = strtoull(optarg, NULL, 10);
+                break;
+            case 'c':
+                sendOptions.congestion = optarg;
+                break;
+            case 'B':
+                sendOptions.batchSize = strtoul(optarg, NULL, 10);
+                if (sendOptions.batchSize == 0 || sendOptions.batchSize > BATCH_MAX_SIZE) {
+                    fprintf(stderr, "Error: Batch size must be between 1 and %d\n", BATCH_MAX_SIZE);
+                    exit(1);
+                }
+                break;
+            case 'G':
+                sendOptions.offload = 1;
+                break;
+            case 'a':
+                sendOptions.ackEvery = strtoul(optarg, NULL, 10);
+                if (sendOptions.ackEvery == 0 || sendOptions.ackEvery > UINT16_MAX) {
+                    fprintf(stderr, "Error: Segments per ACK must be between 1 and %d\n", UINT16_MAX);
+                    exit(1);
+                }
+                break;
+            case 'A':
+                sendOptions.ackDelayUs = strtoul(optarg, NULL, 10);
+                if (sendOptions.ackDelayUs == 0) {
+                    fprintf(stderr, "Error: Maximum ACK delay must be at least 1 us\n");
+                    exit(1);
+                }
+                break;
+            case 'V':
+                sendOptions.digest = 1;
+                break;
+            case 'R':
+                sendOptions.resumable = 1;
+                break;
+            case 'z':
+                sendOptions.compress = 1;
+                break;
+            case 'C':
+                if (cpuListParse(&sendOptions.cpus, optarg) < 0) {
+                    fprintf(stderr, "Error: CPU list must be numbers and ranges such as 0-3,8\n");
+                    exit(1);
+                }
+                break;
+            case 'M':
+                sendOptions.maxDatagram = strtoul(optarg, NULL, 10);
+                if (sendOptions.maxDatagram < PMTU_MIN_SIZE || sendOptions.maxDatagram > PACKET_MAX_SIZE) {
+                    fprintf(stderr, "Error: Maximum datagram size must be between %d and %d bytes\n", PMTU_MIN_SIZE,
+                            PACKET_MAX_SIZE);
+                    exit(1);
+                }
+                break;
+            case 'W':
+                sendOptions.streamBuffer = strtoull(optarg, NULL, 10);
+                if (sendOptions.streamBuffer < STREAM_MIN_BUFFER) {
+                    fprintf(stderr, "Error: Stream buffer must be at least %d bytes\n", STREAM_MIN_BUFFER);
+                    exit(1);
+                }
+                break;
+            case 'F':
+                sendOptions.fecBlock = strtoul(optarg, NULL, 10);
+                if (sendOptions.fecBlock < 2 || sendOptions.fecBlock > FEC_MAX_BLOCK) {
+                    fprintf(stderr, "Error: FEC block size must be between 2 and %d segments\n", FEC_MAX_BLOCK);
+                    exit(1);
+                }
+                break;
+            case 'P':
+                sendOptions.fecParity = strtoul(optarg, NULL, 10);
+                if (sendOptions.fecParity == 0 || sendOptions.fecParity > FEC_MAX_PARITY) {
+                    fprintf(stderr, "Error: Parity per FEC block must be between 1 and %d\n", FEC_MAX_PARITY);
+                    exit(1);
+                }
+                break;
+            case 'S':
+                sendOptions.statsPath = optarg;
+                break;
+            case 'Q':
+                sendOptions.tracePath = optarg;
+                break;
+            case 'j':
+                sendOptions.flows = strtoul(optarg, NULL, 10);
+                if (sendOptions.flows == 0 || sendOptions.flows > MAX_FLOWS) {
+                    fprintf(stderr, "Error: Flow count must be between 1 and %d\n", MAX_FLOWS);
+                    exit(1);
+                }
+                break;
+            default:
+                argc = 0;
+        }
+    }
 
-    if (argc != 5) {
-        fprintf(stderr, "usage: %s receiver_hostname receiver_port filename_to_xfer bytes_to_xfer\n\n", argv[0]);
+    if (argc - optind != 3 && argc - optind != 4) {
+        fprintf(stderr, "usage: %s [-r max_bytes_per_sec] [-b burst_bytes] [-c reno|cubic|bbr] [-B batch_size] [-G] [-j flows] [-V] [-a segments_per_ack] [-A max_ack_delay_us] [-S stats_json] [-Q qlog_trace] [-F fec_block_segments] [-P max_parity_per_block] [-R] [-z] [-C cpu_list] [-M max_datagram_bytes] [-W stream_buffer_bytes] receiver_hostname receiver_port filename_to_xfer|- [bytes_to_xfer]\n\n", argv[0]);
         exit(1);
     } 
 
-    hostname = argv[1];
-    hostUDPport = (unsigned short int) atoi(argv[2]);
-    filename = argv[3];
-    bytesToTransfer = atoll(argv[4]);
+    hostname = argv[optind];
+    hostUDPport = (unsigned short int) atoi(argv[optind + 1]);
+    filename = argv[optind + 2];
+    bytesToTransfer = argc - optind == 4 ? strtoull(argv[optind + 3], NULL, 10) : ULLONG_MAX;
 
+    statsInit("rsend", sendOptions.statsPath, sendOptions.tracePath);
     rsend(hostname, hostUDPport, filename, bytesToTransfer);
+    statsFinish();
 
     return (EXIT_SUCCESS);
 }
@@ -0,0 +1,335 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "./include/source.h"
+#include "./include/crc32c.h"
+#include "./include/timeutil.h"
+
+/**
+ * @brief sourceOpen is a function that opens a file for sending and maps it if possible, or sets up the
+ *        ring of a stream.
+ * 
+ * @param source            The source to initialize.
+ * @param filename          The file to send, SOURCE_STDIN for standard input.
+ * @param streamCapacity    The size of the ring if the file is a stream.
+ * @return                  0 on success, -1 if the file cannot be opened.
+ */
+int sourceOpen(struct SegmentSource *source, const char *filename, size_t streamCapacity) {
+    struct stat st;
+
+    memset(source, 0, sizeof(*source));
+    source->fd = strcmp(filename, SOURCE_STDIN) == 0 ? dup(STDIN_FILENO) : open(filename, O_RDONLY);
+    if (source->fd < 0) {
+        return -1;
+    }
+    if (fstat(source->fd, &st) < 0) {
+        close(source->fd);
+        return -1;
+    }
+
+    // Anything but a regular file is read once as a stream. A bigger pipe lets each read take more.
+    if (!S_ISREG(st.st_mode)) {
+        source->stream = malloc(streamCapacity);
+        if (source->stream == NULL) {
+            close(source->fd);
+            return -1;
+        }
+        source->streamCapacity = streamCapacity;
+        fcntl(source->fd, F_SETPIPE_SZ, SOURCE_PIPE_BYTES);
+        return 0;
+    }
+    source->size = st.st_size;
+
+    // Empty files cannot be mapped and are read with pread instead
+    if (source->size > 0) {
+        void *map = mmap(NULL, source->size, PROT_READ, MAP_SHARED, source->fd, 0);
+        if (map != MAP_FAILED) {
+            source->map = map;
+            madvise(map, source->size, MADV_SEQUENTIAL);
+        }
+    }
+    return 0;
+}
+
+/**
+ * @brief sourceIsStream is a function that tells whether a file would be sent as a stream.
+ * 
+ * @param filename  The file to send, SOURCE_STDIN for standard input.
+ * @param size      Set to the size of a regular file.
+ * @return          1 if it is a stream, 0 if it is a regular file, -1 if it cannot be found.
+ */
+int sourceIsStream(const char *filename, uint64_t *size) {
+    struct stat st;
+
+    if (strcmp(filename, SOURCE_STDIN) == 0 ? fstat(STDIN_FILENO, &st) < 0 : stat(filename, &st) < 0) {
+        return -1;
+    }
+    *size = st.st_size;
+    return !S_ISREG(st.st_mode);
+}
+
+/**
+ * @brief sourceClose is a function that unmaps and closes a source.
+ * 
+ * @param source    The source to close.
+ */
+void sourceClose(struct SegmentSource *source) {
+    if (source->map != NULL) {
+        munmap((void *) source->map, source->size);
+    }
+    free(source->stream);
+    close(source->fd);
+    memset(source, 0, sizeof(*source));
+    source->fd = -1;
+}
+
+/**
+ * @brief sourcePrefetch is a function that asks the kernel to fault in the mapping ahead of offset, one
+ *        SOURCE_PREFETCH_BYTES chunk at a time.
+ * 
+ * @param source    The mapped source.
+ * @param offset    The offset being sent.
+ */
+static void sourcePrefetch(struct SegmentSource *source, uint64_t offset) {
+    long pageSize = sysconf(_SC_PAGESIZE);
+    uint64_t start;
+    uint64_t end;
+
+    if (offset + SOURCE_PREFETCH_BYTES / 2 < source->prefetched || source->prefetched >= source->size) {
+        return;
+    }
+
+    start = source->prefetched > offset ? source->prefetched : offset;
+    start -= start % pageSize;
+    end = offset + SOURCE_PREFETCH_BYTES;
+    if (end > source->size) {
+        end = source->size;
+    }
+    madvise((void *) (source->map + start), end - start, MADV_WILLNEED);
+    source->prefetched = end;
+}
+
+/**
+ * @brief streamPayload is a function that returns bytes of a stream that are in its ring, in place unless
+ *        they wrap around its end.
+ * 
+ * @param source    The stream.
+ * @param offset    The offset of the payload in the stream.
+ * @param length    The length of the payload.
+ * @param buf       A buffer of at least length bytes, used when the payload wraps.
+ * @return          A pointer to the payload, or NULL if it was already released.
+ */
+static const void *streamPayload(struct SegmentSource *source, uint64_t offset, size_t length, void *buf) {
+    size_t start = offset % source->streamCapacity;
+    size_t first = source->streamCapacity - start;
+
+    if (offset < source->released) {
+        return NULL;
+    }
+    if (length <= first) {
+        return source->stream + start;
+    }
+    memcpy(buf, source->stream + start, first);
+    memcpy((char *) buf + first, source->stream, length - first);
+    return buf;
+}
+
+/**
+ * @brief sourcePayload is a function that returns the bytes of the file at an offset. A mapped file is
+ *        returned in place; otherwise the bytes are read into buf. A stream only has the bytes read into
+ *        its ring and not yet released.
+ * 
+ * @param source    The source.
+ * @param offset    The offset of the payload in the file.
+ * @param length    The length of the payload.
+ * @param buf       A buffer of at least length bytes, used when the file is not mapped.
+ * @return          A pointer to the payload, or NULL if it could not be read in full.
+ */
+const void *sourcePayload(struct SegmentSource *source, uint64_t offset, size_t length, void *buf) {
+    size_t done = 0;
+
+    if (offset + length > source->size) {
+        return NULL;
+    }
+    if (source->stream != NULL) {
+        return streamPayload(source, offset, length, buf);
+    }
+    if (source->map != NULL) {
+        sourcePrefetch(source, offset);
+        return source->map + offset;
+    }
+
+    while (done < length) {
+        ssize_t result = pread(source->fd, (char *) buf + done, length - done, offset + done);
+        if (result < 0 && errno == EINTR) {
+            continue;
+        }
+        if (result <= 0) {
+            return NULL;
+        }
+        done += result;
+    }
+    return buf;
+}
+
+/**
+ * @brief sourceRead is a function that reads what a stream has ready into the free part of its ring,
+ *        without blocking.
+ * 
+ * @param source    The stream.
+ * @return          1 if bytes were read or the stream ended, 0 if it had nothing ready or the ring is full,
+ *                  -1 on error.
+ */
+int sourceRead(struct SegmentSource *source) {
+    struct pollfd pfd = { .fd = source->fd, .events = POLLIN, .revents = 0 };
+    size_t start = source->size % source->streamCapacity;
+    uint64_t room = source->released + source->streamCapacity - source->size;
+    ssize_t result;
+
+    if (source->ended || room == 0) {
+        return 0;
+    }
+    result = poll(&pfd, 1, 0);
+    if (result <= 0) {
+        return result < 0 && errno != EINTR ? -1 : 0;
+    }
+
+    if (room > source->streamCapacity - start) {
+        room = source->streamCapacity - start;
+    }
+    result = read(source->fd, source->stream + start, room);
+    if (result < 0) {
+        return errno == EINTR || errno == EAGAIN ? 0 : -1;
+    }
+    if (result == 0) {
+        source->ended = 1;
+    }
+    source->size += result;
+    return 1;
+}
+
+/**
+ * @brief sourceRelease is a function that frees the ring space of a stream's bytes before an offset, which
+ *        no segment will be built from again.
+ * 
+ * @param source    The stream.
+ * @param offset    The offset of the first byte still needed.
+ */
+void sourceRelease(struct SegmentSource *source, uint64_t offset) {
+    if (offset > source->released) {
+        source->released = offset < source->size ? offset : source->size;
+    }
+}
+
+/**
+ * @brief sourceWait is a function that waits until a stream has bytes ready or ends.
+ * 
+ * @param source    The stream.
+ * @param timeoutNs How long to wait (ns).
+ * @return          1 if the stream is ready, 0 if the timeout expired, -1 on error.
+ */
+int sourceWait(struct SegmentSource *source, uint64_t timeoutNs) {
+    struct pollfd pfd = { .fd = source->fd, .events = POLLIN, .revents = 0 };
+    struct timespec timeout = nsToTimespec(timeoutNs);
+    int ready = ppoll(&pfd, 1, &timeout, NULL);
+
+    if (ready < 0) {
+        return errno == EINTR ? 0 : -1;
+    }
+    return ready;
+}
+
+/**
+ * @brief compressedInit is a function that sets up the compressed view of a range of a source.
+ * 
+ * @param compressed    The view to initialize.
+ * @param source        The source.
+ * @param firstSeq      The sequence number of the first segment.
+ * @param offset        The offset of the range in the file.
+ * @param length        The length of the range.
+ * @param capacity      The most segments in flight at once, the size of the ring.
+ * @param mss           The largest payload.
+ */
+void compressedInit(struct CompressedSource *compressed, struct SegmentSource *source, uint32_t firstSeq,
+                    uint64_t offset, uint64_t length, uint32_t capacity, size_t mss) {
+    memset(compressed, 0, sizeof(*compressed));
+    compressed->source = source;
+    compressorInit(&compressed->compressor);
+    compressed->payloads = malloc((size_t) capacity * mss);
+    compressed->sizes = calloc(capacity, sizeof(ssize_t));
+    compressed->raw = source->map == NULL ? malloc(COMPRESS_MAX_RAW) : NULL;
+    if (compressed->payloads == NULL || compressed->sizes == NULL || (source->map == NULL && compressed->raw == NULL)) {
+        perror("Error: Failed to allocate compressed source");
+        exit(EXIT_FAILURE);
+    }
+    compressed->capacity = capacity;
+    compressed->mss = mss;
+    compressed->prepared = firstSeq;
+    compressed->next = offset;
+    compressed->end = offset + length;
+}
+
+/**
+ * @brief compressedDestroy is a function that frees the compressed view of a source.
+ * 
+ * @param compressed    The view to free.
+ */
+void compressedDestroy(struct CompressedSource *compressed) {
+    free(compressed->payloads);
+    free(compressed->sizes);
+    free(compressed->raw);
+    memset(compressed, 0, sizeof(*compressed));
+}
+
+/**
+ * @brief compressedPrepare is a function that builds the next segment. Its slot in the ring must no
+ *        longer be in flight, which holds whenever the send window has room for it.
+ * 
+ * @param compressed    The view.
+ * @param digest        A CRC32C to extend with the file bytes of the segment, or NULL.
+ * @param rawUsed       Set to how many file bytes the segment carries.
+ * @return              1 if the segment is the last of the range, 0 if more follow, -1 if the file could
+ *                      not be read.
+ */
+int compressedPrepare(struct CompressedSource *compressed, uint32_t *digest, size_t *rawUsed) {
+    uint64_t available = compressed->end - compressed->next;
+    size_t length = available < COMPRESS_MAX_RAW ? available : COMPRESS_MAX_RAW;
+    uint32_t slot = compressed->prepared % compressed->capacity;
+    const void *raw = sourcePayload(compressed->source, compressed->next, length, compressed->raw);
+
+    if (raw == NULL) {
+        return -1;
+    }
+    compressed->sizes[slot] = compressSegment(&compressed->compressor, raw, length,
+                                              compressed->payloads + (size_t) slot * compressed->mss,
+                                              compressed->mss, rawUsed);
+    if (digest != NULL) {
+        *digest = crc32c(*digest, raw, *rawUsed);
+    }
+    compressed->next += *rawUsed;
+    compressed->prepared++;
+    return compressed->next == compressed->end;
+}
+
+/**
+ * @brief compressedPayload is a function that returns a segment built earlier that is still in flight.
+ * 
+ * @param compressed    The view.
+ * @param seqNum        The sequence number of the segment.
+ * @param size          Set to the payload size.
+ * @return              The payload.
+ */
+const void *compressedPayload(const struct CompressedSource *compressed, uint32_t seqNum, ssize_t *size) {
+    uint32_t slot = seqNum % compressed->capacity;
+
+    *size = compressed->sizes[slot];
+    return compressed->payloads + (size_t) slot * compressed->mss;
+}
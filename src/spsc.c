@@ -0,0 +1,151 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "./include/spsc.h"
+#include "./include/timeutil.h"
+
+/**
+ * @brief spscInit is a function that allocates an empty ring.
+ * 
+ * @param ring      The ring to initialize.
+ * @param capacity  The number of slots, a power of two.
+ * @param slotSize  The size of a slot.
+ */
+void spscInit(struct SpscRing *ring, uint64_t capacity, size_t slotSize) {
+    pthread_condattr_t condAttr;
+
+    memset(ring, 0, sizeof(*ring));
+    ring->slotSize = (slotSize + SPSC_CACHE_LINE - 1) / SPSC_CACHE_LINE * SPSC_CACHE_LINE;
+    ring->mask = capacity - 1;
+    if (posix_memalign((void **) &ring->slots, SPSC_CACHE_LINE, capacity * ring->slotSize) != 0) {
+        perror("Error: Failed to allocate ring");
+        exit(EXIT_FAILURE);
+    }
+
+    // Deadlines are monotonic, so timed waits must be too
+    pthread_condattr_init(&condAttr);
+    pthread_condattr_setclock(&condAttr, CLOCK_MONOTONIC);
+    if (pthread_mutex_init(&ring->lock, NULL) != 0 || pthread_cond_init(&ring->wake, &condAttr) != 0) {
+        fprintf(stderr, "Error: Failed to initialize ring\n");
+        exit(EXIT_FAILURE);
+    }
+    pthread_condattr_destroy(&condAttr);
+}
+
+/**
+ * @brief spscDestroy is a function that frees a ring neither thread uses any more.
+ * 
+ * @param ring      The ring to free.
+ */
+void spscDestroy(struct SpscRing *ring) {
+    pthread_mutex_destroy(&ring->lock);
+    pthread_cond_destroy(&ring->wake);
+    free(ring->slots);
+    ring->slots = NULL;
+}
+
+/**
+ * @brief spscSlot is a function that returns the next free slot for the producer to fill.
+ * 
+ * @param ring      The ring.
+ * @return          The slot, or NULL if the ring is full.
+ */
+void *spscSlot(struct SpscRing *ring) {
+    uint64_t next = ring->tail + ring->filled;
+
+    if (next - ring->headSeen > ring->mask) {
+        ring->headSeen = __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE);
+        if (next - ring->headSeen > ring->mask) {
+            return NULL;
+        }
+    }
+    return ring->slots + (next & ring->mask) * ring->slotSize;
+}
+
+/**
+ * @brief spscPush is a function that counts the slot spscSlot returned as filled. The consumer sees it
+ *        once it is published.
+ * 
+ * @param ring      The ring.
+ */
+void spscPush(struct SpscRing *ring) {
+    ring->filled++;
+}
+
+/**
+ * @brief spscPublish is a function that hands every filled slot to the consumer and wakes it if it sleeps.
+ *        The tail store and the load of sleeping are sequentially consistent, as are the consumer's store
+ *        of sleeping and load of tail in spscWait, so at least one side sees the other and a wake-up is
+ *        never lost.
+ * 
+ * @param ring      The ring.
+ */
+void spscPublish(struct SpscRing *ring) {
+    if (ring->filled == 0) {
+        return;
+    }
+    __atomic_store_n(&ring->tail, ring->tail + ring->filled, __ATOMIC_SEQ_CST);
+    ring->filled = 0;
+    if (__atomic_load_n(&ring->sleeping, __ATOMIC_SEQ_CST)) {
+        pthread_mutex_lock(&ring->lock);
+        pthread_cond_signal(&ring->wake);
+        pthread_mutex_unlock(&ring->lock);
+    }
+}
+
+/**
+ * @brief spscFront is a function that returns the oldest published slot for the consumer to read.
+ * 
+ * @param ring      The ring.
+ * @return          The slot, or NULL if the ring is empty.
+ */
+void *spscFront(struct SpscRing *ring) {
+    if (ring->head == ring->tailSeen) {
+        ring->tailSeen = __atomic_load_n(&ring->tail, __ATOMIC_ACQUIRE);
+        if (ring->head == ring->tailSeen) {
+            return NULL;
+        }
+    }
+    return ring->slots + (ring->head & ring->mask) * ring->slotSize;
+}
+
+/**
+ * @brief spscPop is a function that gives the slot spscFront returned back to the producer.
+ * 
+ * @param ring      The ring.
+ */
+void spscPop(struct SpscRing *ring) {
+    __atomic_store_n(&ring->head, ring->head + 1, __ATOMIC_RELEASE);
+}
+
+/**
+ * @brief spscWait is a function that makes the consumer sleep until a slot is published or a deadline
+ *        passes.
+ * 
+ * @param ring      The ring.
+ * @param deadline  Monotonic time to give up at (ns), UINT64_MAX for none.
+ * @return          1 if a slot is ready, 0 if the deadline passed first.
+ */
+int spscWait(struct SpscRing *ring, uint64_t deadline) {
+    int ready;
+
+    if (spscFront(ring) != NULL) {
+        return 1;
+    }
+
+    pthread_mutex_lock(&ring->lock);
+    __atomic_store_n(&ring->sleeping, 1, __ATOMIC_SEQ_CST);
+    while (!(ready = __atomic_load_n(&ring->tail, __ATOMIC_SEQ_CST) != ring->head) && monotonicNs() < deadline) {
+        if (deadline == UINT64_MAX) {
+            pthread_cond_wait(&ring->wake, &ring->lock);
+        } else {
+            struct timespec wakeup = nsToTimespec(deadline);
+            pthread_cond_timedwait(&ring->wake, &ring->lock, &wakeup);
+        }
+    }
+    __atomic_store_n(&ring->sleeping, 0, __ATOMIC_RELAXED);
+    pthread_mutex_unlock(&ring->lock);
+    return ready;
+}
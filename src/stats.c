@@ -0,0 +1,587 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdarg.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <time.h>
+#include <unistd.h>
+#include <pthread.h>
+
+#include "./include/stats.h"
+
+#define TRACE_BUFFER_BYTES (64 * 1024)
+#define TRACE_EVENT_MAX_BYTES 512
+#define TRACE_FLUSH_NS (100 * NSEC_PER_MSEC)    // A quiet thread's events reach the file at least this often
+#define STATS_PATH_MAX 4096
+
+static const char *counterNames[STAT_COUNT] = {
+    "packets_sent", "bytes_sent", "packets_received", "bytes_received", "retransmits", "timeouts",
+    "loss_events", "duplicates", "corrupt", "probes", "fec_parity", "fec_repaired", "resumed_bytes",
+    "compressed_bytes", "delivered_bytes", "disk_writes", "disk_blocked_ns",
+};
+
+/**
+ * Every connection that is being or was recently recorded, and where dumps go.
+ */
+static struct {
+    pthread_mutex_t     lock;           // Guards everything below
+    const char          *program;
+    const char          *path;          // The dump file, NULL to dump to stderr on SIGUSR1 only
+    uint64_t            start;          // Monotonic time statsInit was called (ns)
+    struct ConnStats    *active;
+    struct ConnStats    *finished;      // Copies of the latest STATS_MAX_FINISHED, newest first
+    unsigned int        finishedCount;
+    uint64_t            dropped[STAT_COUNT];    // Totals of the finished connections no longer kept
+    uint64_t            droppedCount;
+} registry = { .lock = PTHREAD_MUTEX_INITIALIZER };
+
+/**
+ * Events of one thread, written to the trace file in whole records.
+ */
+struct TraceBuffer {
+    size_t      fill;
+    uint64_t    flushed;        // Monotonic time of the last write (ns)
+    char        data[TRACE_BUFFER_BYTES];
+};
+
+int traceFd = -1;
+static uint64_t traceStart;
+static __thread struct TraceBuffer *traceBuffer;
+
+/**
+ * @brief loadCounter is a function that reads a value another thread may be storing.
+ */
+static uint64_t loadCounter(const uint64_t *value) {
+    return __atomic_load_n(value, __ATOMIC_RELAXED);
+}
+
+/**
+ * @brief storeCounter is a function that stores a value a dump may be reading.
+ */
+static void storeCounter(uint64_t *value, uint64_t newValue) {
+    __atomic_store_n(value, newValue, __ATOMIC_RELAXED);
+}
+
+/**
+ * @brief histogramBucket is a function that returns the bucket of a value.
+ * 
+ * @param value     The value.
+ */
+static unsigned int histogramBucket(uint64_t value) {
+    unsigned int msb;
+    unsigned int bucket;
+
+    if (value < STATS_HISTOGRAM_SUB_BUCKETS) {
+        return (unsigned int) value;
+    }
+    msb = 63 - __builtin_clzll(value);
+    bucket = (msb - 3) * STATS_HISTOGRAM_SUB_BUCKETS + ((value >> (msb - 4)) & (STATS_HISTOGRAM_SUB_BUCKETS - 1));
+    return bucket < STATS_HISTOGRAM_BUCKETS ? bucket : STATS_HISTOGRAM_BUCKETS - 1;
+}
+
+/**
+ * @brief histogramUpper is a function that returns the highest value a bucket holds.
+ * 
+ * @param bucket    The bucket.
+ */
+static uint64_t histogramUpper(unsigned int bucket) {
+    unsigned int shift;
+
+    if (bucket < STATS_HISTOGRAM_SUB_BUCKETS) {
+        return bucket;
+    }
+    shift = bucket / STATS_HISTOGRAM_SUB_BUCKETS - 1;
+    return ((uint64_t) (STATS_HISTOGRAM_SUB_BUCKETS + bucket % STATS_HISTOGRAM_SUB_BUCKETS + 1) << shift) - 1;
+}
+
+/**
+ * @brief statsHistogramRecord is a function that adds a value to a histogram. Only one thread may record
+ *        into a histogram.
+ * 
+ * @param histogram     The histogram.
+ * @param value         The value.
+ */
+void statsHistogramRecord(struct StatsHistogram *histogram, uint64_t value) {
+    unsigned int bucket = histogramBucket(value);
+
+    storeCounter(&histogram->buckets[bucket], histogram->buckets[bucket] + 1);
+    storeCounter(&histogram->sum, histogram->sum + value);
+    if (value < histogram->min) {
+        storeCounter(&histogram->min, value);
+    }
+    if (value > histogram->max) {
+        storeCounter(&histogram->max, value);
+    }
+    storeCounter(&histogram->count, histogram->count + 1);
+}
+
+/**
+ * @brief histogramPercentile is a function that returns the upper bound of the bucket holding a
+ *        percentile, which is never above the largest value recorded.
+ * 
+ * @param histogram     The histogram.
+ * @param count         The number of values, as read by the caller.
+ * @param percentile    The percentile, from 0 to 100.
+ */
+static uint64_t histogramPercentile(const struct StatsHistogram *histogram, uint64_t count, double percentile) {
+    uint64_t rank = (uint64_t) (count * percentile / 100.0 + 0.999999);
+    uint64_t seen = 0;
+    uint64_t max = loadCounter(&histogram->max);
+
+    for (unsigned int i = 0; i < STATS_HISTOGRAM_BUCKETS; i++) {
+        seen += loadCounter(&histogram->buckets[i]);
+        if (seen >= rank && seen > 0) {
+            return histogramUpper(i) < max ? histogramUpper(i) : max;
+        }
+    }
+    return max;
+}
+
+/**
+ * @brief storeSample is a function that stores a timeline sample a dump may be reading.
+ */
+static void storeSample(struct StatsSample *to, const struct StatsSample *from) {
+    storeCounter(&to->time, from->time);
+    storeCounter(&to->cwnd, from->cwnd);
+    storeCounter(&to->pacingRate, from->pacingRate);
+    storeCounter(&to->bytesInFlight, from->bytesInFlight);
+    storeCounter(&to->srtt, from->srtt);
+    storeCounter(&to->delivered, from->delivered);
+}
+
+/**
+ * @brief statsTimelineRecord is a function that adds a sample to a timeline if one is due, thinning out
+ *        the timeline first when it is full. Only one thread may record into a timeline.
+ * 
+ * @param timeline  The timeline.
+ * @param now       The current monotonic time (ns).
+ * @param sample    The sample; its time is filled in.
+ */
+void statsTimelineRecord(struct StatsTimeline *timeline, uint64_t now, const struct StatsSample *sample) {
+    struct StatsSample point = *sample;
+
+    if (!statsTimelineDue(timeline, now)) {
+        return;
+    }
+    if (timeline->count == STATS_TIMELINE_CAPACITY) {
+        for (unsigned int i = 1; i < STATS_TIMELINE_CAPACITY / 2; i++) {
+            storeSample(&timeline->samples[i], &timeline->samples[2 * i]);
+        }
+        __atomic_store_n(&timeline->count, STATS_TIMELINE_CAPACITY / 2, __ATOMIC_RELEASE);
+        timeline->interval *= 2;
+    }
+
+    point.time = now - timeline->start;
+    storeSample(&timeline->samples[timeline->count], &point);
+    __atomic_store_n(&timeline->count, timeline->count + 1, __ATOMIC_RELEASE);
+    timeline->next = now + timeline->interval;
+}
+
+/**
+ * @brief statsConnInit is a function that prepares the statistics of a new connection.
+ * 
+ * @param stats         The statistics to initialize.
+ * @param peer          The address of the other end.
+ * @param connectionId  The connection ID of the transfer, 0 if there is none.
+ * @param offset        The file offset of the connection's range.
+ */
+void statsConnInit(struct ConnStats *stats, const struct sockaddr_in *peer, uint32_t connectionId, uint64_t offset) {
+    char host[INET_ADDRSTRLEN];
+
+    memset(stats, 0, sizeof(*stats));
+    inet_ntop(AF_INET, &peer->sin_addr, host, sizeof(host));
+    snprintf(stats->peer, sizeof(stats->peer), "%s:%u", host, ntohs(peer->sin_port));
+    stats->connectionId = connectionId;
+    stats->offset = offset;
+    stats->start = monotonicNs();
+    stats->rtt.min = UINT64_MAX;
+    stats->timeline.start = stats->start;
+    stats->timeline.interval = STATS_TIMELINE_INTERVAL_NS;
+}
+
+/**
+ * @brief statsRegister is a function that makes a connection's statistics part of every dump.
+ * 
+ * @param stats     The statistics.
+ */
+void statsRegister(struct ConnStats *stats) {
+    pthread_mutex_lock(&registry.lock);
+    stats->prev = NULL;
+    stats->next = registry.active;
+    if (registry.active != NULL) {
+        registry.active->prev = stats;
+    }
+    registry.active = stats;
+    pthread_mutex_unlock(&registry.lock);
+}
+
+/**
+ * @brief statsUnregister is a function that keeps a copy of a finished connection's statistics, so the
+ *        caller may free them. Every thread that counted for the connection must be done with it. Only
+ *        the latest STATS_MAX_FINISHED connections are kept whole; older ones only add to the totals.
+ * 
+ * @param stats     The statistics.
+ */
+void statsUnregister(struct ConnStats *stats) {
+    struct ConnStats *copy = malloc(sizeof(struct ConnStats));
+
+    pthread_mutex_lock(&registry.lock);
+    if (stats->prev != NULL) {
+        stats->prev->next = stats->next;
+    } else {
+        registry.active = stats->next;
+    }
+    if (stats->next != NULL) {
+        stats->next->prev = stats->prev;
+    }
+    stats->end = monotonicNs();
+
+    if (copy == NULL) {
+        // Without memory for a copy the connection still counts in the totals
+        for (int i = 0; i < STAT_COUNT; i++) {
+            registry.dropped[i] += statsTotal(stats, i);
+        }
+        registry.droppedCount++;
+        pthread_mutex_unlock(&registry.lock);
+        return;
+    }
+
+    memcpy(copy, stats, sizeof(*copy));
+    copy->prev = NULL;
+    copy->next = registry.finished;
+    registry.finished = copy;
+    if (++registry.finishedCount > STATS_MAX_FINISHED) {
+        struct ConnStats **link = &registry.finished;
+
+        while ((*link)->next != NULL) {
+            link = &(*link)->next;
+        }
+        for (int i = 0; i < STAT_COUNT; i++) {
+            registry.dropped[i] += statsTotal(*link, i);
+        }
+        registry.droppedCount++;
+        free(*link);
+        *link = NULL;
+        registry.finishedCount--;
+    }
+    pthread_mutex_unlock(&registry.lock);
+}
+
+/**
+ * @brief statsTotal is a function that sums a counter over every thread's block.
+ * 
+ * @param stats     The statistics of a connection.
+ * @param counter   The counter.
+ */
+uint64_t statsTotal(const struct ConnStats *stats, enum StatsCounter counter) {
+    uint64_t total = 0;
+
+    for (int slot = 0; slot < STATS_SLOTS; slot++) {
+        total += loadCounter(&stats->counters[slot].value[counter]);
+    }
+    return total;
+}
+
+/**
+ * @brief writeConnection is a function that writes one connection as a JSON object.
+ * 
+ * @param out       The stream.
+ * @param stats     The statistics of the connection.
+ * @param now       The current monotonic time (ns).
+ */
+static void writeConnection(FILE *out, const struct ConnStats *stats, uint64_t now) {
+    uint64_t end = stats->end != 0 ? stats->end : now;
+    double seconds = (double) (end - stats->start) / NSEC_PER_SEC;
+    uint64_t samples = loadCounter(&stats->rtt.count);
+    unsigned int points = __atomic_load_n(&stats->timeline.count, __ATOMIC_ACQUIRE);
+
+    fprintf(out, "    {\n      \"peer\": \"%s\",\n      \"connection_id\": \"%08x\",\n      \"offset\": %llu,\n",
+            stats->peer, stats->connectionId, (unsigned long long int) stats->offset);
+    if (loadCounter(&stats->datagramSize) != 0) {
+        fprintf(out, "      \"datagram_size\": %llu,\n", (unsigned long long int) loadCounter(&stats->datagramSize));
+    }
+    fprintf(out, "      \"active\": %s,\n      \"duration_s\": %.6f,\n", stats->end == 0 ? "true" : "false", seconds);
+    for (int i = 0; i < STAT_COUNT; i++) {
+        fprintf(out, "      \"%s\": %llu,\n", counterNames[i], (unsigned long long int) statsTotal(stats, i));
+    }
+    fprintf(out, "      \"goodput_bytes_per_sec\": %.0f,\n",
+            seconds > 0 ? statsTotal(stats, STAT_DELIVERED) / seconds : 0.0);
+
+    fprintf(out, "      \"rtt_us\": {\"samples\": %llu", (unsigned long long int) samples);
+    if (samples > 0) {
+        fprintf(out, ", \"min\": %llu, \"avg\": %llu, \"p50\": %llu, \"p99\": %llu, \"max\": %llu",
+                (unsigned long long int) loadCounter(&stats->rtt.min),
+                (unsigned long long int) (loadCounter(&stats->rtt.sum) / samples),
+                (unsigned long long int) histogramPercentile(&stats->rtt, samples, 50),
+                (unsigned long long int) histogramPercentile(&stats->rtt, samples, 99),
+                (unsigned long long int) loadCounter(&stats->rtt.max));
+        fprintf(out, ", \"histogram\": [");
+        for (unsigned int i = 0, first = 1; i < STATS_HISTOGRAM_BUCKETS; i++) {
+            uint64_t count = loadCounter(&stats->rtt.buckets[i]);
+
+            if (count > 0) {
+                fprintf(out, "%s[%llu, %llu]", first ? "" : ", ", (unsigned long long int) histogramUpper(i),
+                        (unsigned long long int) count);
+                first = 0;
+            }
+        }
+        fprintf(out, "]");
+    }
+    fprintf(out, "},\n");
+
+    fprintf(out, "      \"timeline\": [");
+    for (unsigned int i = 0; i < points; i++) {
+        const struct StatsSample *sample = &stats->timeline.samples[i];
+
+        fprintf(out, "%s\n        {\"t_ms\": %.3f, \"cwnd\": %llu, \"pacing_rate\": %llu, \"bytes_in_flight\": %llu, "
+                "\"srtt_us\": %llu, \"delivered_bytes\": %llu}", i == 0 ? "" : ",",
+                (double) loadCounter(&sample->time) / NSEC_PER_MSEC,
+                (unsigned long long int) loadCounter(&sample->cwnd),
+                (unsigned long long int) loadCounter(&sample->pacingRate),
+                (unsigned long long int) loadCounter(&sample->bytesInFlight),
+                (unsigned long long int) (loadCounter(&sample->srtt) / NSEC_PER_USEC),
+                (unsigned long long int) loadCounter(&sample->delivered));
+    }
+    fprintf(out, "%s]\n    }", points > 0 ? "\n      " : "");
+}
+
+/**
+ * @brief writeDump is a function that writes every recorded connection and the totals as one JSON
+ *        document. The caller holds the registry lock.
+ * 
+ * @param out   The stream.
+ */
+static void writeDump(FILE *out) {
+    uint64_t now = monotonicNs();
+    uint64_t totals[STAT_COUNT];
+    uint64_t connections = registry.droppedCount;
+    int first = 1;
+
+    memcpy(totals, registry.dropped, sizeof(totals));
+    fprintf(out, "{\n  \"program\": \"%s\",\n  \"time\": %lld,\n  \"uptime_s\": %.6f,\n  \"connections\": [\n",
+            registry.program, (long long int) time(NULL), (double) (now - registry.start) / NSEC_PER_SEC);
+    for (int list = 0; list < 2; list++) {
+        for (struct ConnStats *stats = list == 0 ? registry.active : registry.finished; stats != NULL; stats = stats->next) {
+            fprintf(out, "%s", first ? "" : ",\n");
+            writeConnection(out, stats, now);
+            for (int i = 0; i < STAT_COUNT; i++) {
+                totals[i] += statsTotal(stats, i);
+            }
+            connections++;
+            first = 0;
+        }
+    }
+
+    fprintf(out, "%s  ],\n  \"totals\": {\n    \"connections\": %llu", first ? "" : "\n",
+            (unsigned long long int) connections);
+    for (int i = 0; i < STAT_COUNT; i++) {
+        fprintf(out, ",\n    \"%s\": %llu", counterNames[i], (unsigned long long int) totals[i]);
+    }
+    fprintf(out, "\n  }\n}\n");
+}
+
+/**
+ * @brief statsDump is a function that writes the statistics as JSON: to the stats file, replaced
+ *        atomically so readers never see half a dump, or to stderr if there is none.
+ */
+void statsDump(void) {
+    char temporary[STATS_PATH_MAX];
+    FILE *out = stderr;
+
+    pthread_mutex_lock(&registry.lock);
+    if (registry.path != NULL) {
+        snprintf(temporary, sizeof(temporary), "%s.tmp", registry.path);
+        out = fopen(temporary, "w");
+        if (out == NULL) {
+            perror("Warning: Failed to write statistics");
+            pthread_mutex_unlock(&registry.lock);
+            return;
+        }
+    }
+
+    writeDump(out);
+    if (out == stderr) {
+        fflush(out);
+    } else if (fclose(out) != 0 || rename(temporary, registry.path) < 0) {
+        perror("Warning: Failed to write statistics");
+    }
+    pthread_mutex_unlock(&registry.lock);
+}
+
+/**
+ * @brief dumpOnSignal is a thread that dumps the statistics each time the process gets SIGUSR1.
+ * 
+ * @param arg   Unused.
+ */
+static void *dumpOnSignal(void *arg) {
+    sigset_t signals;
+    int signal;
+
+    (void) arg;
+    sigemptyset(&signals);
+    sigaddset(&signals, SIGUSR1);
+    while (sigwait(&signals, &signal) == 0) {
+        statsDump();
+    }
+    return NULL;
+}
+
+/**
+ * @brief traceOpen is a function that creates the trace file and writes its qlog header.
+ * 
+ * @param path      The trace file.
+ * @param program   The program, used as the trace title.
+ */
+static void traceOpen(const char *path, const char *program) {
+    struct timespec wall;
+    char header[TRACE_EVENT_MAX_BYTES];
+    int length;
+
+    traceFd = open(path, O_WRONLY | O_CREAT | O_TRUNC | O_APPEND | O_CLOEXEC, 0644);
+    if (traceFd < 0) {
+        perror("Error: Failed to open trace file");
+        exit(EXIT_FAILURE);
+    }
+
+    clock_gettime(CLOCK_REALTIME, &wall);
+    traceStart = monotonicNs();
+    length = snprintf(header, sizeof(header), "\x1e{\"qlog_version\": \"0.3\", \"qlog_format\": \"JSON-SEQ\", "
+                      "\"title\": \"%s\", \"trace\": {\"vantage_point\": {\"type\": \"%s\"}, \"common_fields\": "
+                      "{\"time_format\": \"relative\", \"reference_time\": %.3f}}}\n", program,
+                      strcmp(program, "rsend") == 0 ? "client" : "server",
+                      (double) wall.tv_sec * 1000 + (double) wall.tv_nsec / NSEC_PER_MSEC);
+    if (write(traceFd, header, length) != length) {
+        perror("Error: Failed to write trace file");
+        exit(EXIT_FAILURE);
+    }
+}
+
+/**
+ * @brief traceWrite is a function that appends the calling thread's buffered events to the trace file.
+ *        Each write holds whole records, so the events of different threads never interleave.
+ * 
+ * @param buffer    The calling thread's buffer.
+ * @param now       The current monotonic time (ns).
+ */
+static void traceWrite(struct TraceBuffer *buffer, uint64_t now) {
+    for (size_t done = 0; done < buffer->fill; ) {
+        ssize_t result = write(traceFd, buffer->data + done, buffer->fill - done);
+
+        if (result < 0 && errno == EINTR) {
+            continue;
+        }
+        if (result <= 0) {
+            perror("Warning: Failed to write trace file");
+            break;
+        }
+        done += result;
+    }
+    buffer->fill = 0;
+    buffer->flushed = now;
+}
+
+/**
+ * @brief traceEvent is a function that records a qlog event of a connection in the calling thread's
+ *        buffer. Callers check traceEnabled first.
+ * 
+ * @param stats     The connection, whose connection ID and offset name the event's group.
+ * @param now       The current monotonic time (ns).
+ * @param name      The qlog event name, such as "transport:packet_sent".
+ * @param format    printf format of the members of the event's data object.
+ */
+void traceEvent(const struct ConnStats *stats, uint64_t now, const char *name, const char *format, ...) {
+    struct TraceBuffer *buffer = traceBuffer;
+    va_list args;
+    int length;
+
+    if (buffer == NULL) {
+        buffer = calloc(1, sizeof(struct TraceBuffer));
+        if (buffer == NULL) {
+            return;
+        }
+        buffer->flushed = now;
+        traceBuffer = buffer;
+    }
+    if (TRACE_BUFFER_BYTES - buffer->fill < TRACE_EVENT_MAX_BYTES) {
+        traceWrite(buffer, now);
+    }
+
+    length = snprintf(buffer->data + buffer->fill, TRACE_EVENT_MAX_BYTES,
+                      "\x1e{\"time\": %.3f, \"name\": \"%s\", \"group_id\": \"%08x-%llu\", \"data\": {",
+                      (double) (now - traceStart) / NSEC_PER_MSEC, name, stats->connectionId,
+                      (unsigned long long int) stats->offset);
+    va_start(args, format);
+    length += vsnprintf(buffer->data + buffer->fill + length, TRACE_EVENT_MAX_BYTES - length - 3, format, args);
+    va_end(args);
+    if (length > TRACE_EVENT_MAX_BYTES - 3) {
+        return;     // Too long to be a well-formed record; the event is dropped
+    }
+    memcpy(buffer->data + buffer->fill + length, "}}\n", 3);
+    buffer->fill += length + 3;
+
+    if (now - buffer->flushed >= TRACE_FLUSH_NS) {
+        traceWrite(buffer, now);
+    }
+}
+
+/**
+ * @brief traceFlush is a function that writes the calling thread's remaining events. Every thread that
+ *        traces calls it before it exits.
+ */
+void traceFlush(void) {
+    if (traceBuffer != NULL) {
+        traceWrite(traceBuffer, monotonicNs());
+        free(traceBuffer);
+        traceBuffer = NULL;
+    }
+}
+
+/**
+ * @brief statsInit is a function that starts recording. SIGUSR1 is blocked and handled by a thread of its
+ *        own, so it must be called before any other thread is created, which then inherit the mask.
+ * 
+ * @param program   The program name shown in the dumps.
+ * @param path      The file statsFinish and SIGUSR1 dump to, or NULL to dump to stderr on SIGUSR1 only.
+ * @param tracePath The qlog trace file, or NULL for no trace.
+ */
+void statsInit(const char *program, const char *path, const char *tracePath) {
+    sigset_t signals;
+    pthread_t thread;
+
+    registry.program = program;
+    registry.path = path;
+    registry.start = monotonicNs();
+    if (path != NULL && strlen(path) + sizeof(".tmp") > STATS_PATH_MAX) {
+        fprintf(stderr, "Error: Statistics file name is too long\n");
+        exit(EXIT_FAILURE);
+    }
+    if (tracePath != NULL) {
+        traceOpen(tracePath, program);
+    }
+
+    sigemptyset(&signals);
+    sigaddset(&signals, SIGUSR1);
+    if (pthread_sigmask(SIG_BLOCK, &signals, NULL) != 0 ||
+        pthread_create(&thread, NULL, dumpOnSignal, NULL) != 0 || pthread_detach(thread) != 0) {
+        fprintf(stderr, "Error: Failed to start statistics\n");
+        exit(EXIT_FAILURE);
+    }
+}
+
+/**
+ * @brief statsFinish is a function that writes the final dump if there is a stats file, and the calling
+ *        thread's trace events.
+ */
+void statsFinish(void) {
+    if (registry.path != NULL) {
+        statsDump();
+    }
+    if (traceEnabled()) {
+        traceFlush();
+        close(traceFd);
+        traceFd = -1;
+    }
+}
@@ -0,0 +1,145 @@
+#include <stddef.h>
+
+#include "./include/timerwheel.h"
+
+/**
+ * @brief timerInit is a function that prepares a timer that is not armed.
+ * 
+ * @param timer     The timer.
+ * @param handler   Called with arg when the timer fires. It may arm the timer again.
+ * @param arg       Passed to the handler.
+ */
+void timerInit(struct Timer *timer, TimerHandler handler, void *arg) {
+    timer->prev = NULL;
+    timer->next = NULL;
+    timer->expires = 0;
+    timer->handler = handler;
+    timer->arg = arg;
+    timer->armed = 0;
+}
+
+/**
+ * @brief timerWheelInit is a function that creates an empty wheel.
+ * 
+ * @param wheel     The wheel.
+ * @param now       The current monotonic time (ns).
+ */
+void timerWheelInit(struct TimerWheel *wheel, uint64_t now) {
+    for (unsigned int i = 0; i < TIMER_WHEEL_SLOTS; i++) {
+        wheel->slots[i].prev = &wheel->slots[i];
+        wheel->slots[i].next = &wheel->slots[i];
+    }
+    wheel->tick = now / TIMER_WHEEL_TICK_NS;
+    wheel->count = 0;
+}
+
+/**
+ * @brief timerArm is a function that arms a timer, or moves it if it is already armed.
+ * 
+ * @param wheel     The wheel.
+ * @param timer     The timer.
+ * @param expires   The monotonic time to fire at (ns). A time already past fires on the next advance.
+ */
+void timerArm(struct TimerWheel *wheel, struct Timer *timer, uint64_t expires) {
+    uint64_t tick = expires / TIMER_WHEEL_TICK_NS;
+    struct Timer *head;
+
+    timerCancel(wheel, timer);
+    if (tick < wheel->tick) {
+        tick = wheel->tick;
+    }
+    head = &wheel->slots[tick & (TIMER_WHEEL_SLOTS - 1)];
+
+    timer->expires = expires;
+    timer->prev = head->prev;
+    timer->next = head;
+    head->prev->next = timer;
+    head->prev = timer;
+    timer->armed = 1;
+    wheel->count++;
+}
+
+/**
+ * @brief timerCancel is a function that disarms a timer. Cancelling one that is not armed does nothing.
+ * 
+ * @param wheel     The wheel.
+ * @param timer     The timer.
+ */
+void timerCancel(struct TimerWheel *wheel, struct Timer *timer) {
+    if (!timer->armed) {
+        return;
+    }
+    timer->prev->next = timer->next;
+    timer->next->prev = timer->prev;
+    timer->prev = NULL;
+    timer->next = NULL;
+    timer->armed = 0;
+    wheel->count--;
+}
+
+/**
+ * @brief timerWheelAdvance is a function that fires every timer whose tick has passed, in tick order.
+ *        Each slot is moved to a private list before its timers fire, so handlers may arm or cancel any
+ *        timer; one armed again for a time already past fires on a later tick of the same advance.
+ * 
+ * @param wheel     The wheel.
+ * @param now       The current monotonic time (ns).
+ */
+void timerWheelAdvance(struct TimerWheel *wheel, uint64_t now) {
+    uint64_t last = now / TIMER_WHEEL_TICK_NS;
+
+    while (wheel->tick <= last && wheel->count > 0) {
+        struct Timer *head = &wheel->slots[wheel->tick & (TIMER_WHEEL_SLOTS - 1)];
+        struct Timer due;
+        uint64_t tick = wheel->tick++;
+
+        if (head->next == head) {
+            continue;
+        }
+        due.next = head->next;
+        due.prev = head->prev;
+        due.next->prev = &due;
+        due.prev->next = &due;
+        head->next = head;
+        head->prev = head;
+
+        while (due.next != &due) {
+            struct Timer *timer = due.next;
+
+            timerCancel(wheel, timer);
+            if (timer->expires / TIMER_WHEEL_TICK_NS <= tick) {
+                timer->handler(timer, timer->arg, now);
+            } else {
+                // A later revolution goes back in the same slot
+                timerArm(wheel, timer, timer->expires);
+            }
+        }
+    }
+
+    // With nothing armed there is nothing to visit, however long the loop slept
+    if (wheel->tick <= last) {
+        wheel->tick = last + 1;
+    }
+}
+
+/**
+ * @brief timerWheelNextWakeup is a function that returns when the wheel next needs advancing: the tick of
+ *        the first occupied slot. Its timers may belong to a later revolution, in which case advancing
+ *        then fires nothing and the next wakeup is looked up again.
+ * 
+ * @param wheel     The wheel.
+ * @return          The monotonic time to advance at (ns), or UINT64_MAX if nothing is armed.
+ */
+uint64_t timerWheelNextWakeup(struct TimerWheel *wheel) {
+    if (wheel->count == 0) {
+        return UINT64_MAX;
+    }
+    for (uint64_t tick = wheel->tick; tick < wheel->tick + TIMER_WHEEL_SLOTS; tick++) {
+        struct Timer *head = &wheel->slots[tick & (TIMER_WHEEL_SLOTS - 1)];
+
+        if (head->next != head) {
+            return tick * TIMER_WHEEL_TICK_NS;
+        }
+    }
+    return UINT64_MAX;
+}
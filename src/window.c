@@ -0,0 +1,520 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <time.h>
+
+#include "./include/window.h"
+
+/**
+ * @brief windowInit is a function that allocates an empty send window.
+ * 
+ * @param window    The window to initialize.
+ * @param capacity  The maximum number of segments in flight.
+ * @param firstSeq  The sequence number of the first data segment.
+ * @param lastSeq   The sequence number of the final data segment.
+ */
+void windowInit(struct SendWindow *window, uint32_t capacity, uint32_t firstSeq, uint32_t lastSeq) {
+    window->segments = calloc(capacity, sizeof(struct Segment));
+    if (window->segments == NULL) {
+        perror("Error: Failed to allocate send window");
+        exit(EXIT_FAILURE);
+    }
+    window->capacity = capacity;
+    window->base = firstSeq;
+    window->nextSeq = firstSeq;
+    window->lastSeq = lastSeq;
+    window->bytesInFlight = 0;
+    window->rwnd = UINT64_MAX;
+    window->rightEdge = UINT32_MAX;
+    window->probes = 0;
+    window->rackXmitTime = 0;
+    window->rackRtt = 0;
+    window->highestAcked = 0;
+    window->reordering = 0;
+    window->reorderTime = 0;
+    window->rackDeadline = UINT64_MAX;
+    window->lossMarked = firstSeq - 1;
+    window->sentHead = NULL;
+    window->sentTail = NULL;
+    window->lostHead = NULL;
+    window->lostTail = NULL;
+}
+
+/**
+ * @brief windowDestroy is a function that frees a send window.
+ * 
+ * @param window    The window to free.
+ */
+void windowDestroy(struct SendWindow *window) {
+    free(window->segments);
+    window->segments = NULL;
+}
+
+/**
+ * @brief sentUnlink is a function that takes a segment off the list of transmissions in flight.
+ * 
+ * @param window    The send window.
+ * @param segment   The segment, which must be on the list.
+ */
+static void sentUnlink(struct SendWindow *window, struct Segment *segment) {
+    if (segment->sentPrev != NULL) {
+        segment->sentPrev->sentNext = segment->sentNext;
+    } else {
+        window->sentHead = segment->sentNext;
+    }
+    if (segment->sentNext != NULL) {
+        segment->sentNext->sentPrev = segment->sentPrev;
+    } else {
+        window->sentTail = segment->sentPrev;
+    }
+    segment->sentPrev = NULL;
+    segment->sentNext = NULL;
+    segment->outstanding = 0;
+}
+
+/**
+ * @brief lostLink is a function that queues a segment for retransmission.
+ * 
+ * @param window    The send window.
+ * @param segment   The segment.
+ * @param after     The queued segment it goes after, or NULL to put it first.
+ */
+static void lostLink(struct SendWindow *window, struct Segment *segment, struct Segment *after) {
+    segment->lostPrev = after;
+    segment->lostNext = after != NULL ? after->lostNext : window->lostHead;
+    if (segment->lostNext != NULL) {
+        segment->lostNext->lostPrev = segment;
+    } else {
+        window->lostTail = segment;
+    }
+    if (after != NULL) {
+        after->lostNext = segment;
+    } else {
+        window->lostHead = segment;
+    }
+}
+
+/**
+ * @brief lostUnlink is a function that takes a segment out of the retransmission queue.
+ * 
+ * @param window    The send window.
+ * @param segment   The segment, which must be queued.
+ */
+static void lostUnlink(struct SendWindow *window, struct Segment *segment) {
+    if (segment->lostPrev != NULL) {
+        segment->lostPrev->lostNext = segment->lostNext;
+    } else {
+        window->lostHead = segment->lostNext;
+    }
+    if (segment->lostNext != NULL) {
+        segment->lostNext->lostPrev = segment->lostPrev;
+    } else {
+        window->lostTail = segment->lostPrev;
+    }
+    segment->lostPrev = NULL;
+    segment->lostNext = NULL;
+}
+
+/**
+ * @brief markLost is a function that stops counting a segment as in flight and queues it for
+ *        retransmission.
+ * 
+ * @param window    The send window.
+ * @param segment   The lost segment.
+ * @param after     The queued segment it goes after, or NULL to put it first.
+ */
+static void markLost(struct SendWindow *window, struct Segment *segment, struct Segment *after) {
+    if (segment->lost || segment->acked) {
+        return;
+    }
+    if (segment->outstanding) {
+        sentUnlink(window, segment);
+    }
+    segment->lost = 1;
+    window->bytesInFlight -= segment->dataSize;
+    lostLink(window, segment, after);
+}
+
+/**
+ * @brief windowDone is a function that checks whether every segment of the transfer has been acknowledged.
+ * 
+ * @param window    The send window.
+ */
+int windowDone(struct SendWindow *window) {
+    return window->base > window->lastSeq;
+}
+
+/**
+ * @brief windowInFlight is a function that returns the number of sent but unacknowledged segments.
+ * 
+ * @param window    The send window.
+ */
+uint32_t windowInFlight(struct SendWindow *window) {
+    return window->nextSeq - window->base;
+}
+
+/**
+ * @brief windowHasRoom is a function that checks whether a new segment may be sent.
+ * 
+ * @param window    The send window.
+ */
+int windowHasRoom(struct SendWindow *window) {
+    return window->nextSeq <= window->lastSeq && windowInFlight(window) < window->capacity;
+}
+
+/**
+ * @brief windowReceiverHasRoom is a function that checks whether the receiver has advertised room for the
+ *        next new segment.
+ * 
+ * @param window    The send window.
+ */
+int windowReceiverHasRoom(struct SendWindow *window) {
+    return window->nextSeq <= window->rightEdge;
+}
+
+/**
+ * @brief windowSetReceiverWindow is a function that records the window advertised in an ACK. The window
+ *        starts after the acknowledged segment, so it covers ackNum + 1 .. ackNum + rwnd / mss.
+ * 
+ * @param window    The send window.
+ * @param ackNum    The cumulative ACK the window was advertised with.
+ * @param rwnd      The advertised window (bytes).
+ * @param mss       The payload size of a full segment.
+ */
+void windowSetReceiverWindow(struct SendWindow *window, uint32_t ackNum, uint64_t rwnd, uint32_t mss) {
+    uint64_t edge = ackNum + rwnd / mss;
+
+    window->rwnd = rwnd;
+    window->rightEdge = edge > UINT32_MAX ? UINT32_MAX : (uint32_t) edge;
+}
+
+/**
+ * @brief windowGet is a function that returns the in-flight segment with the given sequence number.
+ * 
+ * @param window    The send window.
+ * @param seqNum    The sequence number to look up.
+ * @return          The segment, or NULL if it is not in flight.
+ */
+struct Segment *windowGet(struct SendWindow *window, uint32_t seqNum) {
+    if (seqNum < window->base || seqNum >= window->nextSeq) {
+        return NULL;
+    }
+    return &window->segments[seqNum % window->capacity];
+}
+
+/**
+ * @brief windowAdd is a function that reserves the next sequence number for a new segment.
+ * 
+ * @param window    The send window, which must have room.
+ * @param dataSize  The payload size of the segment.
+ * @return          The new segment. The caller sets its send time and deadline.
+ */
+struct Segment *windowAdd(struct SendWindow *window, ssize_t dataSize) {
+    struct Segment *segment = &window->segments[window->nextSeq % window->capacity];
+
+    memset(segment, 0, sizeof(*segment));
+    segment->seqNum = window->nextSeq;
+    segment->dataSize = dataSize;
+    window->nextSeq++;
+    window->bytesInFlight += dataSize;
+    return segment;
+}
+
+/**
+ * @brief windowAcked is a function that records the delivery of a segment that was not acknowledged before.
+ *        Only first transmissions update the RACK state, since an ACK cannot tell which copy of a
+ *        retransmitted segment arrived. A first copy delivered after a later segment, including one
+ *        acknowledged too soon after its retransmission to be that copy, measures how much the path
+ *        reorders.
+ * 
+ * @param window    The send window.
+ * @param segment   The delivered segment.
+ * @param now       The current monotonic time (ns).
+ * @param newest    If not NULL, keeps a copy of the most recently sent segment delivered by this ACK.
+ */
+static void windowAcked(struct SendWindow *window, struct Segment *segment, uint64_t now, struct Segment *newest) {
+    int firstCopy = segment->retransmits == 0 || now - segment->sentTime < window->rackRtt / 2;
+
+    if (!segment->lost) {
+        window->bytesInFlight -= segment->dataSize;
+    } else {
+        lostUnlink(window, segment);
+    }
+    if (segment->outstanding) {
+        sentUnlink(window, segment);
+    }
+    segment->acked = 1;
+
+    if (firstCopy && segment->firstSentTime < window->rackXmitTime) {
+        if (window->highestAcked - segment->seqNum > window->reordering) {
+            window->reordering = window->highestAcked - segment->seqNum;
+        }
+        if (window->rackXmitTime - segment->firstSentTime > window->reorderTime) {
+            window->reorderTime = window->rackXmitTime - segment->firstSentTime;
+        }
+    }
+    if (segment->seqNum > window->highestAcked) {
+        window->highestAcked = segment->seqNum;
+    }
+    if (segment->retransmits == 0 && segment->sentTime > window->rackXmitTime) {
+        window->rackXmitTime = segment->sentTime;
+        window->rackRtt = now > segment->sentTime ? now - segment->sentTime : 0;
+    }
+    if (newest != NULL && segment->sentTime >= newest->sentTime) {
+        *newest = *segment;
+    }
+}
+
+/**
+ * @brief windowAckCumulative is a function that slides the window past every segment up to ackNum.
+ * 
+ * @param window    The send window.
+ * @param ackNum    The highest in-order sequence number the receiver holds.
+ * @param now       The current monotonic time (ns).
+ * @param newest    If not NULL, keeps a copy of the most recently sent segment newly acknowledged.
+ * @return          The number of payload bytes newly acknowledged, not counting ones selectively
+ *                  acknowledged before.
+ */
+uint64_t windowAckCumulative(struct SendWindow *window, uint32_t ackNum, uint64_t now, struct Segment *newest) {
+    uint64_t ackedBytes = 0;
+
+    while (window->base <= ackNum && window->base < window->nextSeq) {
+        struct Segment *segment = &window->segments[window->base % window->capacity];
+        if (!segment->acked) {
+            windowAcked(window, segment, now, newest);
+            ackedBytes += segment->dataSize;
+        }
+        window->base++;
+    }
+    return ackedBytes;
+}
+
+/**
+ * @brief windowAckSelective is a function that records a segment the receiver reports holding above the
+ *        cumulative ACK. It stays in the window but is never retransmitted.
+ * 
+ * @param window    The send window.
+ * @param seqNum    The selectively acknowledged sequence number.
+ * @param now       The current monotonic time (ns).
+ * @param newest    If not NULL, keeps a copy of the most recently sent segment newly acknowledged.
+ * @return          The number of payload bytes newly acknowledged.
+ */
+uint64_t windowAckSelective(struct SendWindow *window, uint32_t seqNum, uint64_t now, struct Segment *newest) {
+    struct Segment *segment = windowGet(window, seqNum);
+
+    if (segment == NULL || segment->acked) {
+        return 0;
+    }
+    windowAcked(window, segment, now, newest);
+    return segment->dataSize;
+}
+
+/**
+ * @brief windowDetectLosses is a function that marks segments lost from the SACK scoreboard. A segment is
+ *        lost once dupThresh segments above it have been acknowledged (RFC 6675), or once a segment sent
+ *        after it has been delivered and it has been outstanding for the RTT of that delivery plus the
+ *        reordering window (RACK). Both thresholds grow to the reordering seen on the path so far, the
+ *        reordering window up to one RTT. Retransmissions are only judged by time, since segments above
+ *        them were sent earlier, and so are segments whose FEC block was followed by parity. Segments the
+ *        duplicate threshold was applied below are never looked at again, and RACK stops at the first
+ *        transmission it is too early to give up on, so a call only costs what is new. It is meant to run
+ *        after ACKs and once rackDeadline passes, which it sets to when RACK may next find a loss.
+ * 
+ * @param window        The send window.
+ * @param now           The current monotonic time (ns).
+ * @param reorderWindow The least time to allow for reordering (ns).
+ * @param dupThresh     The least number of acknowledged segments above a hole that declares it lost.
+ * @return              The most recently sent segment newly marked lost, or NULL if none was.
+ */
+struct Segment *windowDetectLosses(struct SendWindow *window, uint64_t now, uint64_t reorderWindow, uint32_t dupThresh) {
+    struct Segment *newest = NULL;
+    struct Segment *anchor = window->lostTail;
+    struct Segment *segment;
+    uint32_t floor = window->lossMarked >= window->base ? window->lossMarked + 1 : window->base;
+    uint32_t top = window->highestAcked + 1 < window->nextSeq ? window->highestAcked + 1 : window->nextSeq;
+    uint32_t seq = top;
+    uint32_t ackedAbove = 0;
+    uint64_t reorderTime = window->reorderTime;
+
+    // As in RACK, reordering is never waited out for longer than a round trip
+    if (reorderTime > window->rackRtt) {
+        reorderTime = window->rackRtt;
+    }
+    if (window->reordering > dupThresh) {
+        dupThresh = window->reordering;
+    }
+    if (reorderTime > reorderWindow) {
+        reorderWindow = reorderTime;
+    }
+
+    // Every first transmission below the dupThresh-th acknowledged segment from the top is lost. Those are
+    // marked from the highest down, each queued after the last, so they are retransmitted oldest first.
+    while (seq > floor && ackedAbove < dupThresh) {
+        seq--;
+        if (window->segments[seq % window->capacity].acked) {
+            ackedAbove++;
+        }
+    }
+    if (ackedAbove >= dupThresh && dupThresh > 0) {
+        for (uint32_t below = seq; below > floor; below--) {
+            segment = &window->segments[(below - 1) % window->capacity];
+            if (!segment->acked && !segment->lost && segment->retransmits == 0 && segment->parityTime == 0) {
+                markLost(window, segment, anchor);
+                if (newest == NULL || segment->sentTime > newest->sentTime) {
+                    newest = segment;
+                }
+            }
+        }
+        window->lossMarked = seq - 1;
+    }
+
+    // RACK goes through the transmissions oldest first, and none sent later can be lost before the first
+    // one that is still too young
+    window->rackDeadline = UINT64_MAX;
+    segment = window->sentHead;
+    while (segment != NULL && segment->sentTime < window->rackXmitTime) {
+        struct Segment *next = segment->sentNext;
+        uint64_t due = segment->sentTime + window->rackRtt + reorderWindow;
+
+        if (now < due) {
+            window->rackDeadline = due < window->rackDeadline ? due : window->rackDeadline;
+            break;
+        }
+
+        // Parity sent after the segment may still rebuild it at the receiver, so RACK times it from there
+        if (segment->retransmits == 0 && segment->parityTime != 0) {
+            due = segment->parityTime + window->rackRtt + reorderWindow;
+            if (segment->parityTime >= window->rackXmitTime) {
+                segment = next;
+                continue;
+            }
+            if (now < due) {
+                window->rackDeadline = due < window->rackDeadline ? due : window->rackDeadline;
+                segment = next;
+                continue;
+            }
+        }
+        markLost(window, segment, window->lostTail);
+        if (newest == NULL || segment->sentTime > newest->sentTime) {
+            newest = segment;
+        }
+        segment = next;
+    }
+    return newest;
+}
+
+/**
+ * @brief windowProtect is a function that records that parity was sent for a block of segments.
+ * 
+ * @param window    The send window.
+ * @param firstSeq  The first segment of the block.
+ * @param lastSeq   The last segment of the block.
+ * @param now       The current monotonic time (ns).
+ */
+void windowProtect(struct SendWindow *window, uint32_t firstSeq, uint32_t lastSeq, uint64_t now) {
+    for (uint32_t seq = firstSeq > window->base ? firstSeq : window->base; seq <= lastSeq && seq < window->nextSeq; seq++) {
+        window->segments[seq % window->capacity].parityTime = now;
+    }
+}
+
+/**
+ * @brief windowMarkLost is a function that queues a segment for retransmission and stops counting it as
+ *        in flight.
+ * 
+ * @param window    The send window.
+ * @param segment   The lost segment.
+ */
+void windowMarkLost(struct SendWindow *window, struct Segment *segment) {
+    markLost(window, segment, window->lostTail);
+}
+
+/**
+ * @brief windowRetransmitted is a function that takes a segment off the retransmission queue and puts it
+ *        back in flight.
+ * 
+ * @param window    The send window.
+ * @param segment   The segment that is being sent again.
+ */
+void windowRetransmitted(struct SendWindow *window, struct Segment *segment) {
+    if (segment->lost) {
+        lostUnlink(window, segment);
+        segment->lost = 0;
+        window->bytesInFlight += segment->dataSize;
+    }
+    segment->retransmits++;
+}
+
+/**
+ * @brief windowSent is a function that stamps a segment as it is handed to the network and puts it last
+ *        on the list of transmissions in flight.
+ * 
+ * @param window    The send window.
+ * @param segment   The segment, new or retransmitted.
+ * @param now       The current monotonic time (ns).
+ * @param deadline  When it is retransmitted unless acknowledged (ns).
+ */
+void windowSent(struct SendWindow *window, struct Segment *segment, uint64_t now, uint64_t deadline) {
+    if (segment->outstanding) {
+        sentUnlink(window, segment);
+    }
+    if (segment->retransmits == 0) {
+        segment->firstSentTime = now;
+    }
+    segment->sentTime = now;
+    segment->deadline = deadline;
+    segment->sentPrev = window->sentTail;
+    segment->sentNext = NULL;
+    if (window->sentTail != NULL) {
+        window->sentTail->sentNext = segment;
+    } else {
+        window->sentHead = segment;
+    }
+    window->sentTail = segment;
+    segment->outstanding = 1;
+}
+
+/**
+ * @brief windowExpire is a function that marks the oldest transmissions in flight as lost for as long as
+ *        their retransmit deadline has passed, like a single retransmission timer on the oldest segment.
+ * 
+ * @param window    The send window.
+ * @param now       The current monotonic time (ns).
+ * @return          The most recently sent expired segment, or NULL if none expired.
+ */
+struct Segment *windowExpire(struct SendWindow *window, uint64_t now) {
+    struct Segment *newest = NULL;
+
+    while (window->sentHead != NULL && window->sentHead->deadline <= now) {
+        newest = window->sentHead;
+        markLost(window, newest, window->lostTail);
+    }
+    return newest;
+}
+
+/**
+ * @brief windowNextRetransmit is a function that finds the next segment to retransmit: the oldest in the
+ *        window if it is lost, so recovery never waits behind later holes, and otherwise the first queued.
+ * 
+ * @param window    The send window.
+ * @return          The segment to retransmit, or NULL if none is lost.
+ */
+struct Segment *windowNextRetransmit(struct SendWindow *window) {
+    struct Segment *oldest = &window->segments[window->base % window->capacity];
+
+    if (window->base < window->nextSeq && oldest->lost && !oldest->acked) {
+        return oldest;
+    }
+    return window->lostHead;
+}
+
+/**
+ * @brief windowEarliestDeadline is a function that returns the retransmit deadline of the oldest
+ *        transmission in flight.
+ * 
+ * @param window    The send window.
+ * @return          The deadline (ns), or UINT64_MAX if nothing is in flight.
+ */
+uint64_t windowEarliestDeadline(struct SendWindow *window) {
+    return window->sentHead != NULL ? window->sentHead->deadline : UINT64_MAX;
+}
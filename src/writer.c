@@ -0,0 +1,427 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "./include/writer.h"
+#include "./include/crc32c.h"
+#include "./include/compress.h"
+
+/**
+ * @brief writeStage is a function that writes the staging chunk at its file offset, after waiting for
+ *        the write rate to allow it. Chunks that are aligned in the file and in length go through O_DIRECT
+ *        if it is in use; the rest, such as the end of a range, are written buffered so no padding ever
+ *        lands on bytes another flow owns. Time spent in the write system calls is counted as blocked.
+ *        A resumable transfer's checkpoint learns of every chunk written.
+ * 
+ * @param writer    The disk writer.
+ * @return          0 on success, -1 on error.
+ */
+static int writeStage(struct DiskWriter *writer) {
+    size_t length = writer->stageFill;
+    int fd = writer->file->fd;
+
+    if (writer->file->directFd >= 0 && writer->stageOffset % WRITER_ALIGN == 0 && length % WRITER_ALIGN == 0) {
+        fd = writer->file->directFd;
+    }
+
+    pacerWait(&writer->pacer, length);
+    uint64_t start = monotonicNs();
+    for (size_t done = 0; done < length; ) {
+        ssize_t result = pwrite(fd, writer->stage + done, length - done, writer->stageOffset + done);
+        if (result < 0 && errno == EINTR) {
+            continue;
+        }
+        if (result <= 0) {
+            return -1;
+        }
+        done += result;
+    }
+    if (writer->stats != NULL) {
+        statsAdd(writer->stats, STAT_DISK_WRITES, 1);
+        statsAdd(writer->stats, STAT_DISK_BLOCKED_NS, monotonicNs() - start);
+        statsAdd(writer->stats, STAT_DELIVERED, length);
+    }
+
+    writer->stageOffset += writer->stageFill;
+    writer->stageFill = 0;
+    if (writer->checkpoint != NULL) {
+        checkpointAdvance(writer->checkpoint, writer->checkpointFlow, writer->stageOffset);
+    }
+    return 0;
+}
+
+/**
+ * @brief stageAppend is a function that copies a segment into the staging chunk and writes the chunk
+ *        whenever it fills up. Segments arrive in order, so they also extend the digest. Data that was
+ *        decompressed straight into the chunk is only counted.
+ * 
+ * @param writer    The disk writer.
+ * @param data      The payload.
+ * @param dataSize  The payload size.
+ * @return          1 if a chunk was written, 0 if not, -1 on error.
+ */
+static int stageAppend(struct DiskWriter *writer, const char *data, size_t dataSize) {
+    int wrote = 0;
+
+    if (writer->digesting) {
+        writer->digest = crc32c(writer->digest, data, dataSize);
+    }
+
+    while (dataSize > 0) {
+        size_t room = WRITER_CHUNK_BYTES - writer->stageFill;
+        size_t length = dataSize < room ? dataSize : room;
+
+        if (data != writer->stage + writer->stageFill) {
+            memcpy(writer->stage + writer->stageFill, data, length);
+        }
+        writer->stageFill += length;
+        data += length;
+        dataSize -= length;
+
+        if (writer->stageFill == WRITER_CHUNK_BYTES) {
+            if (writeStage(writer) < 0) {
+                return -1;
+            }
+            wrote = 1;
+        }
+    }
+    return wrote;
+}
+
+/**
+ * @brief stageDecompress is a function that decompresses a segment of a compressed flow into the staging
+ *        chunk, or through the writer's buffer when the chunk may not have room for it, and appends it.
+ * 
+ * @param writer    The disk writer.
+ * @param data      The payload.
+ * @param dataSize  The payload size.
+ * @return          1 if a chunk was written, 0 if not, -1 on error with errno set.
+ */
+static int stageDecompress(struct DiskWriter *writer, const char *data, size_t dataSize) {
+    char *raw = writer->raw;
+    ssize_t length;
+
+    if (writer->stageFill + COMPRESS_MAX_RAW <= WRITER_CHUNK_BYTES) {
+        raw = writer->stage + writer->stageFill;
+    }
+    length = decompressSegment(data, dataSize, raw, COMPRESS_MAX_RAW);
+    if (length < 0) {
+        errno = EBADMSG;
+        return -1;
+    }
+    return stageAppend(writer, raw, length);
+}
+
+/**
+ * @brief writerDrain is a function that takes every in-order run from the reassembly ring, copying outside
+ *        the lock since the network thread never touches slots below cumulative, and frees the slots as
+ *        soon as their bytes have reached a written chunk or the end of the run. Once the writer is closing
+ *        and the ring is empty it writes the last partial chunk.
+ * 
+ * @param writer    The disk writer.
+ */
+static void writerDrain(struct DiskWriter *writer) {
+    struct ReassemblyBuffer *buffer = writer->buffer;
+
+    pthread_mutex_lock(&writer->lock);
+    while (writer->result == 0 && buffer->written != reassemblyReady(buffer, writer->closing)) {
+        uint32_t first = buffer->written;
+        uint32_t last = reassemblyReady(buffer, writer->closing);
+        int failed = 0;
+        pthread_mutex_unlock(&writer->lock);
+
+        for (uint32_t seq = first; seq < last && !failed; seq++) {
+            ssize_t dataSize;
+            const char *data = reassemblySegment(buffer, seq, &dataSize);
+            int wrote = writer->raw != NULL ? stageDecompress(writer, data, dataSize) : stageAppend(writer, data, dataSize);
+
+            if (wrote < 0) {
+                perror("Error: Failed to write received data");
+                failed = 1;
+            }
+            else if (wrote && seq + 1 < last) {
+                pthread_mutex_lock(&writer->lock);
+                reassemblyRelease(buffer, seq + 1);
+                pthread_mutex_unlock(&writer->lock);
+            }
+        }
+
+        pthread_mutex_lock(&writer->lock);
+        if (failed) {
+            writer->result = -1;
+        } else {
+            reassemblyRelease(buffer, last);
+        }
+    }
+
+    if (writer->result == 0 && writer->closing) {
+        int result = 1;
+        pthread_mutex_unlock(&writer->lock);
+
+        if (writer->stageFill > 0 && writeStage(writer) < 0) {
+            perror("Error: Failed to write received data");
+            result = -1;
+        }
+
+        pthread_mutex_lock(&writer->lock);
+        writer->result = result;
+    }
+    pthread_mutex_unlock(&writer->lock);
+}
+
+/**
+ * @brief writerSchedule is a function that queues a writer on its pool, or has the thread draining it look
+ *        again once it is done. The caller holds the writer lock.
+ * 
+ * @param writer    The disk writer.
+ */
+static void writerSchedule(struct DiskWriter *writer) {
+    struct WriterPool *pool = writer->pool;
+
+    pthread_mutex_lock(&pool->lock);
+    if (writer->scheduled) {
+        writer->rescan = 1;
+    } else {
+        writer->scheduled = 1;
+        writer->queueNext = NULL;
+        if (pool->queueTail != NULL) {
+            pool->queueTail->queueNext = writer;
+        } else {
+            pool->queueHead = writer;
+        }
+        pool->queueTail = writer;
+        pthread_cond_signal(&pool->ready);
+    }
+    pthread_mutex_unlock(&pool->lock);
+}
+
+/**
+ * @brief writerPoolRun is a pool thread. It drains queued writers one at a time, puts a writer that was
+ *        notified meanwhile back at the end of the queue and reports progress to its owner.
+ * 
+ * @param arg   The writer pool.
+ */
+static void *writerPoolRun(void *arg) {
+    struct WriterPool *pool = arg;
+
+    pthread_mutex_lock(&pool->lock);
+    for (;;) {
+        while (pool->queueHead == NULL && !pool->stopping) {
+            pthread_cond_wait(&pool->ready, &pool->lock);
+        }
+        if (pool->queueHead == NULL) {
+            break;
+        }
+
+        struct DiskWriter *writer = pool->queueHead;
+        pool->queueHead = writer->queueNext;
+        if (pool->queueHead == NULL) {
+            pool->queueTail = NULL;
+        }
+        pthread_mutex_unlock(&pool->lock);
+
+        writerDrain(writer);
+
+        // Once scheduled is cleared the owner may free the writer, so it is not touched after unlocking
+        pthread_mutex_lock(&pool->lock);
+        if (writer->rescan) {
+            writer->rescan = 0;
+            writer->queueNext = NULL;
+            if (pool->queueTail != NULL) {
+                pool->queueTail->queueNext = writer;
+            } else {
+                pool->queueHead = writer;
+            }
+            pool->queueTail = writer;
+        } else {
+            writer->scheduled = 0;
+        }
+        writer->progress(writer->progressArg);
+    }
+    pthread_mutex_unlock(&pool->lock);
+    return NULL;
+}
+
+/**
+ * @brief outputOpen is a function that creates the output file, or opens it as it is so a transfer that
+ *        resumes keeps what an earlier attempt wrote. A transfer that starts over truncates it.
+ * 
+ * @param file          The output file to initialize.
+ * @param filename      The file to write.
+ * @param direct        Whether to bypass the page cache with O_DIRECT. File systems that do not support it
+ *                      fall back to buffered writes.
+ * @return              0 on success, -1 if the file cannot be created.
+ */
+int outputOpen(struct OutputFile *file, const char *filename, int direct) {
+    file->fd = open(filename, O_WRONLY | O_CREAT, 0644);
+    if (file->fd < 0) {
+        return -1;
+    }
+
+    file->directFd = -1;
+    if (direct) {
+        file->directFd = open(filename, O_WRONLY | O_DIRECT);
+        if (file->directFd < 0 && errno == EINVAL) {
+            fprintf(stderr, "Warning: O_DIRECT is not supported for %s, using buffered writes\n", filename);
+        }
+    }
+    return 0;
+}
+
+/**
+ * @brief outputClose is a function that closes the output file once every writer is closed.
+ * 
+ * @param file      The output file.
+ */
+void outputClose(struct OutputFile *file) {
+    if (file->directFd >= 0) {
+        close(file->directFd);
+    }
+    close(file->fd);
+}
+
+/**
+ * @brief writerPoolInit is a function that starts the pool threads.
+ * 
+ * @param pool          The writer pool to initialize.
+ * @param threadCount   The number of threads, at least 1.
+ */
+void writerPoolInit(struct WriterPool *pool, unsigned int threadCount) {
+    memset(pool, 0, sizeof(*pool));
+    pool->threads = calloc(threadCount, sizeof(pthread_t));
+    if (pool->threads == NULL) {
+        perror("Error: Failed to allocate disk writers");
+        exit(EXIT_FAILURE);
+    }
+    if (pthread_mutex_init(&pool->lock, NULL) != 0 || pthread_cond_init(&pool->ready, NULL) != 0) {
+        fprintf(stderr, "Error: Failed to start disk writers\n");
+        exit(EXIT_FAILURE);
+    }
+    for (pool->threadCount = 0; pool->threadCount < threadCount; pool->threadCount++) {
+        if (pthread_create(&pool->threads[pool->threadCount], NULL, writerPoolRun, pool) != 0) {
+            fprintf(stderr, "Error: Failed to start disk writers\n");
+            exit(EXIT_FAILURE);
+        }
+    }
+}
+
+/**
+ * @brief writerPoolDestroy is a function that stops the pool threads once the queue is empty.
+ * 
+ * @param pool      The writer pool.
+ */
+void writerPoolDestroy(struct WriterPool *pool) {
+    pthread_mutex_lock(&pool->lock);
+    pool->stopping = 1;
+    pthread_cond_broadcast(&pool->ready);
+    pthread_mutex_unlock(&pool->lock);
+
+    for (unsigned int i = 0; i < pool->threadCount; i++) {
+        pthread_join(pool->threads[i], NULL);
+    }
+    free(pool->threads);
+    pthread_mutex_destroy(&pool->lock);
+    pthread_cond_destroy(&pool->ready);
+}
+
+/**
+ * @brief writerOpen is a function that prepares a writer for one flow of a transfer.
+ * 
+ * @param writer        The disk writer to initialize.
+ * @param pool          The pool whose threads write the flow's data.
+ * @param file          The output file.
+ * @param offset        The file offset of the flow's first segment.
+ * @param buffer        The reassembly ring the segments arrive in.
+ * @param writeRate     The maximum write rate in bytes per second, 0 for no limit.
+ * @param progress      Called after each time the writer was drained.
+ * @param progressArg   Passed to progress.
+ */
+void writerOpen(struct DiskWriter *writer, struct WriterPool *pool, struct OutputFile *file, off_t offset,
+                struct ReassemblyBuffer *buffer, uint64_t writeRate, WriterProgress progress, void *progressArg) {
+    memset(writer, 0, sizeof(*writer));
+    writer->buffer = buffer;
+    writer->file = file;
+    writer->stageOffset = offset;
+    writer->pool = pool;
+    writer->progress = progress;
+    writer->progressArg = progressArg;
+
+    if (posix_memalign((void **) &writer->stage, WRITER_ALIGN, WRITER_CHUNK_BYTES) != 0) {
+        perror("Error: Failed to allocate write buffer");
+        exit(EXIT_FAILURE);
+    }
+    pacerInit(&writer->pacer, writeRate, WRITER_CHUNK_BYTES);
+
+    if (pthread_mutex_init(&writer->lock, NULL) != 0) {
+        fprintf(stderr, "Error: Failed to start disk writer\n");
+        exit(EXIT_FAILURE);
+    }
+}
+
+/**
+ * @brief writerDecompress is a function that makes a writer decompress every segment before writing it.
+ * 
+ * @param writer    The disk writer of a compressed flow.
+ */
+void writerDecompress(struct DiskWriter *writer) {
+    writer->raw = malloc(COMPRESS_MAX_RAW);
+    if (writer->raw == NULL) {
+        perror("Error: Failed to allocate decompression buffer");
+        exit(EXIT_FAILURE);
+    }
+}
+
+/**
+ * @brief writerNotify is a function that hands the writer to the pool after new segments were received in
+ *        order. The caller holds the writer lock.
+ * 
+ * @param writer    The disk writer.
+ */
+void writerNotify(struct DiskWriter *writer) {
+    writerSchedule(writer);
+}
+
+/**
+ * @brief writerClose is a function that asks the pool to drain the reassembly ring and write the last
+ *        partial chunk. writerClosed tells when that is done.
+ * 
+ * @param writer    The disk writer.
+ */
+void writerClose(struct DiskWriter *writer) {
+    pthread_mutex_lock(&writer->lock);
+    writer->closing = 1;
+    writerSchedule(writer);
+    pthread_mutex_unlock(&writer->lock);
+}
+
+/**
+ * @brief writerClosed is a function that checks whether the pool is done with a writer.
+ * 
+ * @param writer    The disk writer.
+ * @return          1 once everything was written, -1 once a write failed, 0 while the pool still has work.
+ */
+int writerClosed(struct DiskWriter *writer) {
+    int result;
+
+    pthread_mutex_lock(&writer->lock);
+    pthread_mutex_lock(&writer->pool->lock);
+    result = writer->scheduled ? 0 : writer->result;
+    pthread_mutex_unlock(&writer->pool->lock);
+    pthread_mutex_unlock(&writer->lock);
+    return result;
+}
+
+/**
+ * @brief writerDestroy is a function that frees a writer the pool is done with.
+ * 
+ * @param writer    The disk writer.
+ */
+void writerDestroy(struct DiskWriter *writer) {
+    free(writer->stage);
+    free(writer->raw);
+    pthread_mutex_destroy(&writer->lock);
+}